@@ -26,6 +26,8 @@
 #include "ns3/csma-module.h"
 #include "ns3/applications-module.h"
 #include "ns3/ptp-module.h"
+#include "ptp-animation-counter.h"
+#include <cmath>
 
 using namespace ns3;
 
@@ -38,9 +40,28 @@ int main(int argc, char **argv) {
   float delay = 10;
   float utilization = 0.01; 
   uint32_t packetSize = 1024; // Bytes
-  uint64_t interval = 50000000; // nanoseconds
+  int logSyncInterval = 0; // Sync interval is 2^logSyncInterval seconds
+  bool adaptiveSync = false; // Nodes adapt their sync interval to their offset
+  int maxLogSyncInterval = 6; // Longest adaptive sync interval
   uint32_t nUsers = 6; // Number of users
   std::string logdir ("");
+  bool dumpEndpointsOnly = false; // Clock dump of sender and receiver only
+  bool rawTrace = true; // Write every offset sample to ptp_offset.bin
+  std::string syncMode ("unicast"); // SYNC and FOLLOW: unicast, multicast or broadcast
+  bool oneStep = false; // One-step clocks, no FOLLOW messages
+  std::string servo ("step"); // Clock servo: step or pi
+  std::string delayMechanism ("e2e"); // Delay measurement: e2e or p2p
+  std::string oscillator ("constant"); // Node oscillators: constant or noisy
+  std::string timestamping ("application"); // Time stamp point: application, software or hardware
+  double timestampLatency = 0; // Mean latency of software and application time stamps (ns)
+  double maxPpm = 50; // Largest frequency offset of noisy oscillators
+  double randomWalk = 1; // Frequency random walk of noisy oscillators (ppb after 1 s)
+  double phaseNoise = 5; // White phase noise of noisy oscillators (ns)
+  double aging = 0; // Aging of noisy oscillators (ppb per day)
+  bool transparentClock = false; // Switches correct PTP messages for their residence time
+  bool animation = false; // Write a NetAnim trace with the offset error of each node
+  uint32_t animSamplePeriod = 1; // Syncs of a node per NetAnim counter update
+  bool animPerRound = false; // Write the NetAnim counters once per sync interval
 
   /* Setup Command Line Arguments */
   CommandLine cmd;
@@ -48,15 +69,36 @@ int main(int argc, char **argv) {
   cmd.AddValue("delay", "Transmission delay of each CSMA link", delay);
   cmd.AddValue("utilization", "Simulated utilization of CSMA links", utilization);
   cmd.AddValue("packetSize", "size of application packet sent", packetSize);
-  cmd.AddValue("interval", "interval (seconds) between packets", interval);
+  cmd.AddValue("logSyncInterval", "Sync interval is 2^logSyncInterval seconds", logSyncInterval);
+  cmd.AddValue("adaptiveSync", "Converged nodes back off to 2^maxLogSyncInterval seconds", adaptiveSync);
+  cmd.AddValue("maxLogSyncInterval", "Longest sync interval of adaptive sync", maxLogSyncInterval);
   cmd.AddValue("users", "Number of receivers", nUsers);
   cmd.AddValue("logdir", "Directory to write statistics to", logdir);
+  cmd.AddValue("dumpEndpointsOnly", "Debug clock dump lists only sender and receiver", dumpEndpointsOnly);
+  cmd.AddValue("rawTrace", "Write every offset sample (ptp_summary.csv is always written)", rawTrace);
+  cmd.AddValue("syncMode", "Send SYNC and FOLLOW by unicast, multicast or broadcast", syncMode);
+  cmd.AddValue("oneStep", "SYNC carries the transmit time stamp, no FOLLOW", oneStep);
+  cmd.AddValue("servo", "Clock servo: step (offset only) or pi (offset and frequency)", servo);
+  cmd.AddValue("delayMechanism", "Delay to the master: e2e (DREQ/DRPLY) or p2p (peer delay per link)", delayMechanism);
+  cmd.AddValue("timestamping", "Event messages are time stamped by the application, the device driver (software) or the PHY (hardware)", timestamping);
+  cmd.AddValue("timestampLatency", "Mean of the exponential latency of software and application time stamps in ns", timestampLatency);
+  cmd.AddValue("oscillator", "Node oscillators: constant (fixed rate) or noisy (offset, random walk, phase noise, aging)", oscillator);
+  cmd.AddValue("maxPpm", "Frequency offsets of noisy oscillators are uniform in +-maxPpm ppm", maxPpm);
+  cmd.AddValue("randomWalk", "Frequency random walk of noisy oscillators in ppb after one second", randomWalk);
+  cmd.AddValue("phaseNoise", "White phase noise of noisy oscillators in ns", phaseNoise);
+  cmd.AddValue("aging", "Aging of noisy oscillators in ppb per day", aging);
+  cmd.AddValue("transparentClock", "Switches are end-to-end transparent clocks", transparentClock);
+  cmd.AddValue("animation", "Write a NetAnim trace with packet metadata and offset error counters", animation);
+  cmd.AddValue("animSamplePeriod", "Update the offset error counter of a node in one of every n syncs", animSamplePeriod);
+  cmd.AddValue("animPerRound", "Write the offset error counters once per sync interval", animPerRound);
   cmd.Parse(argc, argv);
 
   // Convert to time object
-  Time interPacketInterval = NanoSeconds(interval);
+  Time interPacketInterval = Seconds(std::pow(2.0, logSyncInterval));
 
-  ns3::PacketMetadata::Enable ();
+  if(animation) {
+    ns3::PacketMetadata::Enable ();
+  }
 
   // Create nodes
   // Not only create `nUsers` nodes for PTP terminals,
@@ -120,6 +162,15 @@ int main(int argc, char **argv) {
     );
   }
 
+  // Transparent clocks on the switches
+  std::vector<PtpTransparentClock *> transparentClocks;
+  if(transparentClock) {
+    for(uint32_t i = 0; i < nUsers-1; i++) {
+      transparentClocks.push_back(new PtpTransparentClock());
+      transparentClocks[i]->install(csmaSwitches.Get(i));
+    }
+  }
+
   // Add Internet stack to terminals
   InternetStackHelper internet;
   internet.Install(nodes);
@@ -156,95 +207,47 @@ int main(int argc, char **argv) {
   // }
 
   // PTP Application
-  // Store static PTP nodes
-  std::vector<PtpNode *> staticNodes(nUsers);
-  // Socket to neighbor node
-  std::vector<std::vector<Ptr<Socket>>> neighbor(nUsers);
-  TypeId tid = TypeId::LookupByName("ns3::UdpSocketFactory");
-
-  uint16_t srcPort, dstPort;
-  int socket_count = 0;
-  
-  // List of socket links established in the network
-  std::vector<SocketLink *> socketLinks(2 * (nUsers - 1));
-
   PTPNetwork ptpTest(nUsers, packetSize, interPacketInterval, logdir);
-  staticNodes[0] = new PtpNode(0, 0, 0, deviceIpv4InterfaceContainer.GetAddress(0));
-  ptpTest.addNode(staticNodes[0]);
+  if(dumpEndpointsOnly) {
+    ptpTest.setClockDumpScope(DUMP_SENDER_RECEIVER);
+  }
+  ptpTest.setOffsetTraceEnabled(rawTrace);
+  ptpTest.setOneStepClock(oneStep);
+  if(delayMechanism == "p2p") {
+    ptpTest.setDelayMechanism(DELAY_P2P);
+  }
+  ptpTest.setChannelDataRate(DataRate(bandwidth));
 
-  // socketIndex[0] = -1;
-  for(uint32_t i = 1; i < nUsers; i++) {
-    staticNodes[i] = new PtpNode(i, 0, i, deviceIpv4InterfaceContainer.GetAddress(i));
-    // All nodes are neighbor of global master clock
-    // Create an UDP Socket on node i and add it to neighbor socket vectors.
-    neighbor[0].push_back(Socket::CreateSocket(nodes.Get(0), tid));
-    // The port is (i + 1) * 100 + j
-    srcPort = 100 + i;
-    // The destination port is (i + 1) * 100
-    dstPort = 100 * (i + 1);
-    // Bind to source IP and source port
-    neighbor[0][i-1]->Bind(InetSocketAddress(deviceIpv4InterfaceContainer.GetAddress(0), srcPort));
-    // Connect the socket to neighbor identified in neighborList[i][j]
-    neighbor[0][i-1]->Connect(InetSocketAddress(
-      deviceIpv4InterfaceContainer.GetAddress(i), dstPort
-    ));
-    // Set Receive Callback for each socket
-    neighbor[0][i-1]->SetRecvCallback(
-      MakeCallback(&PTPNetwork::receivePacket, &ptpTest)
-    );
-    // Create socket Link
-    socketLinks[socket_count] = new SocketLink(
-      0, i, 
-      deviceIpv4InterfaceContainer.GetAddress(0), srcPort,
-      deviceIpv4InterfaceContainer.GetAddress(i), dstPort,
-      neighbor[0][i-1]
-    );
-    // Add Neighbor
-    staticNodes[0]->addNeighbor(
-      i, socketLinks[socket_count]
-    );
-    // Add to PTP Network
-    ptpTest.addSocketLink(socketLinks[socket_count]);
-    socket_count ++;
-    // Create the return UDP socket on node i and add it to neighbor socket vectors.
-    neighbor[i].push_back(Socket::CreateSocket(nodes.Get(i), tid));
-    // The port is (i + 1) * 100 + j
-    srcPort = 100 + i;
-    // The destination port is (i + 1) * 100
-    dstPort = 100 * (i + 1);
-    // Bind to source IP and source port
-    neighbor[i][0]->Bind(InetSocketAddress(deviceIpv4InterfaceContainer.GetAddress(i), dstPort));
-    // Connect the socket to neighbor identified in neighborList[i][j]
-    neighbor[i][0]->Connect(InetSocketAddress(
-      deviceIpv4InterfaceContainer.GetAddress(0), srcPort
-    ));
-    // Set Receive Callback for each socket
-    neighbor[i][0]->SetRecvCallback(
-      MakeCallback(&PTPNetwork::receivePacket, &ptpTest)
-    );
-    // Create socket Link
-    socketLinks[socket_count] = new SocketLink(
-      i, 0, 
-      deviceIpv4InterfaceContainer.GetAddress(i), dstPort,
-      deviceIpv4InterfaceContainer.GetAddress(0), srcPort,
-      neighbor[i][0]
+  // All terminals are neighbors of the global master clock (node 0)
+  PtpHelper ptpHelper;
+  if(syncMode == "multicast") {
+    ptpHelper.SetSyncMode(PtpHelper::SYNC_MULTICAST);
+  } else if(syncMode == "broadcast") {
+    ptpHelper.SetSyncMode(PtpHelper::SYNC_BROADCAST);
+  }
+  if(servo == "pi") {
+    ptpHelper.SetServo(PtpHelper::SERVO_PI);
+  }
+  if(timestamping != "application" || timestampLatency > 0) {
+    Ptr<ExponentialRandomVariable> latency = CreateObject<ExponentialRandomVariable>();
+    latency->SetAttribute("Mean", DoubleValue(timestampLatency));
+    ptpHelper.SetTimestamping(
+      timestamping == "hardware" ? TIMESTAMP_HARDWARE :
+      timestamping == "software" ? TIMESTAMP_SOFTWARE : TIMESTAMP_APPLICATION,
+      latency
     );
-    // Add Neighbor
-    staticNodes[i]->addNeighbor(
-      0, socketLinks[socket_count]
+  }
+  if(oscillator == "noisy") {
+    ptpHelper.SetOscillatorNoise(maxPpm, randomWalk, phaseNoise, aging);
+  }
+  if(adaptiveSync) {
+    ptpHelper.SetAdaptiveSyncInterval(
+      interPacketInterval, Seconds(std::pow(2.0, maxLogSyncInterval))
     );
-    // Add to PTP Network
-    ptpTest.addSocketLink(socketLinks[socket_count]);
-    socket_count++;
-    // Print information to console
-    std::cout << "[PTP Socket]: Master Node " << 0 << " " << 
-      deviceIpv4InterfaceContainer.GetAddress(0) << ":" << srcPort 
-      << " <--> " << 
-      "Slave Node " << i << " " <<
-      deviceIpv4InterfaceContainer.GetAddress(i) << ":" << dstPort << 
-      std::endl;
-    ptpTest.addNode(staticNodes[i]);
   }
+  ptpHelper.Install(
+    ptpTest, nodes, deviceIpv4InterfaceContainer, PtpTopology::Star(nUsers)
+  );
 
   // On-off application
   DataRate linkBandwidth = DataRateValue(bandwidth).Get();
@@ -279,28 +282,38 @@ int main(int argc, char **argv) {
   // Pcap tracing
   csma.EnablePcapAll(logdir + "traffic-bridge", false);
 
-  AnimationInterface anim(logdir + "ptp-csma.xml");
-  for(uint32_t i = 0; i < nUsers; i++) {
-    if(i == 0) {
-      anim.SetConstantPosition(nodes.Get(i), 10.0, 10.0);
-    } else {
-      anim.SetConstantPosition(nodes.Get(i), 10.0 * (i + 1), 20.0);
-      anim.SetConstantPosition(csmaSwitches.Get(i - 1), 10.0 * (i + 1), 10.0);
+  // NetAnim trace, the offset errors published by the OffsetError trace
+  AnimationInterface *anim = NULL;
+  PtpAnimationCounter *animCounter = NULL;
+  PtpOffsetErrorSampler *animSampler = NULL;
+  if(animation) {
+    anim = new AnimationInterface(logdir + "ptp-csma.xml");
+    for(uint32_t i = 0; i < nUsers; i++) {
+      if(i == 0) {
+        anim->SetConstantPosition(nodes.Get(i), 10.0, 10.0);
+      } else {
+        anim->SetConstantPosition(nodes.Get(i), 10.0 * (i + 1), 20.0);
+        anim->SetConstantPosition(csmaSwitches.Get(i - 1), 10.0 * (i + 1), 10.0);
+      }
     }
-  }
-  anim.SetConstantPosition(nodes.Get(nUsers), 5.0 * (1 + nUsers), 5.0);
-  anim.EnablePacketMetadata(true);
+    anim->SetConstantPosition(nodes.Get(nUsers), 5.0 * (1 + nUsers), 5.0);
+    anim->EnablePacketMetadata(true);
 
-  int clkOffsetCounterId = anim.AddNodeCounter(
-    "offset_error", AnimationInterface::DOUBLE_COUNTER
-  );
-  ptpTest.setAnimationInterface(
-    &anim, clkOffsetCounterId
-  );
+    animCounter = new PtpAnimationCounter(
+      anim, anim->AddNodeCounter("offset_error", AnimationInterface::DOUBLE_COUNTER)
+    );
+    animSampler = new PtpOffsetErrorSampler();
+    animSampler->SetSink(animCounter->getCallback());
+    animSampler->SetSamplePeriod(animSamplePeriod);
+    if(animPerRound) {
+      animSampler->SetBatchInterval(interPacketInterval);
+    }
+    ptpTest.connectOffsetErrorTrace(animSampler->GetCallback());
+  }
   ptpTest.setSimulationIterations(1000);
   
   Simulator::ScheduleWithContext(
-    neighbor[0][0]->GetNode()->GetId(),
+    nodes.Get(0)->GetId(),
     Seconds(1.0),
     &PTPNetwork::startPTPProtocol,
     &ptpTest
@@ -309,7 +322,16 @@ int main(int argc, char **argv) {
   // Save traces
   NS_LOG_INFO ("Run Simulation.");
   Simulator::Run ();
-  Simulator::Destroy ();
   ptpTest.closeLogs();
+  Simulator::Destroy ();
+  delete animSampler;
+  delete animCounter;
+  delete anim;
+  for(uint32_t i = 0; i < transparentClocks.size(); i++) {
+    NS_LOG_INFO("Switch " << i << " corrected " <<
+      transparentClocks[i]->getCorrectedCount() << " messages, residence " <<
+      transparentClocks[i]->getTotalResidenceTime().GetNanoSeconds() << " ns.");
+    delete transparentClocks[i];
+  }
   NS_LOG_INFO ("Done.");
 }
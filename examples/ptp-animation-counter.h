@@ -0,0 +1,71 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors: Tinghui Wang <tinghui.wang@wsu.edu>
+ *
+ * NetAnim node counter sink for clock offset errors, shared by the examples
+ * that write a NetAnim trace (they link the netanim module).
+ *
+ */
+
+#ifndef PTP_ANIMATION_COUNTER_H
+#define PTP_ANIMATION_COUNTER_H
+
+#include "ns3/core-module.h"
+#include "ns3/netanim-module.h"
+
+using namespace ns3;
+
+/**
+ * @brief Updates a NetAnim node counter with the offset errors published
+ * by PTPNetwork or PtpApplication
+ *
+ * Every update writes one XML element; connect the counter through a
+ * PtpOffsetErrorSampler to sample or batch the updates on long runs.
+ */
+class PtpAnimationCounter {
+public:
+  /**
+   * @brief Construct a new PtpAnimationCounter object
+   *
+   * @param anim Animation interface, must outlive the simulation.
+   * @param counterId Double counter added with `AddNodeCounter`.
+   */
+  PtpAnimationCounter(AnimationInterface *anim, uint32_t counterId)
+    : m_anim(anim), m_counterId(counterId) {}
+
+  /**
+   * @brief Trace sink of the offset error of a node after sync
+   *
+   * @param nodeId PTP node ID, the ns-3 node ID the counter is shown on.
+   * @param offsetError Offset error in ns.
+   */
+  void offsetErrorChanged(uint16_t nodeId, double offsetError) {
+    m_anim->UpdateNodeCounter(m_counterId, nodeId, offsetError);
+  }
+
+  /**
+   * @brief Get the callback of `offsetErrorChanged`
+   */
+  Callback<void, uint16_t, double> getCallback() {
+    return MakeCallback(&PtpAnimationCounter::offsetErrorChanged, this);
+  }
+
+private:
+  AnimationInterface *m_anim; //< Animation interface the counter belongs to
+  uint32_t m_counterId; //< Node counter of the offset error
+};
+
+#endif /* PTP_ANIMATION_COUNTER_H */
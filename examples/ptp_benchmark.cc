@@ -0,0 +1,426 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors: Tinghui Wang <tinghui.wang@wsu.edu>
+ *
+ * Scalability benchmark of PTPNetwork on star, chain, tree and mesh
+ * topologies. Every PTP link is its own point-to-point style SimpleChannel
+ * and every node answers on one address, so the cost measured is the one of
+ * the PTP model and the IP stack, not of a shared medium.
+ *
+ * Each configuration runs in a child process, so its peak RSS is its own.
+ * Results are printed as a table and written as JSON (--json) to compare
+ * versions of the module.
+ */
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/simple-net-device-helper.h"
+#include "ns3/ptp-module.h"
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <new>
+#include <sstream>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("PTP_Benchmark");
+
+#ifdef PTP_INSTRUMENTATION
+static uint64_t g_allocations = 0; //< Heap allocations of the program
+
+// Count the allocations of the program for the PTP instrumentation probes
+void *operator new(std::size_t size) {
+  g_allocations++;
+  void *p = std::malloc(size == 0 ? 1 : size);
+  if(p == NULL) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void *operator new[](std::size_t size) {
+  return operator new(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  g_allocations++;
+  return std::malloc(size == 0 ? 1 : size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+  return operator new(size, std::nothrow);
+}
+
+void operator delete(void *p) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void *p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept {
+  std::free(p);
+}
+
+static uint64_t getAllocations() {
+  return g_allocations;
+}
+#endif
+
+/**
+ * @brief Measures PTPNetwork::receivePacket for every socket of the network
+ */
+class ReceiveTimer {
+public:
+  ReceiveTimer(PTPNetwork *network)
+    : m_network(network), m_calls(0), m_nanoSeconds(0) {}
+
+  void receive(Ptr<Socket> socket) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    m_network->receivePacket(socket);
+    m_nanoSeconds += std::chrono::duration<double, std::nano>(
+      std::chrono::steady_clock::now() - start
+    ).count();
+    m_calls++;
+  }
+
+  uint64_t getCalls() { return m_calls; }
+  double getNanoSeconds() { return m_nanoSeconds; }
+
+private:
+  PTPNetwork *m_network; //< Network handling the packets
+  uint64_t m_calls; //< Calls of receivePacket
+  double m_nanoSeconds; //< Wall clock spent in receivePacket
+};
+
+/**
+ * @brief Split a comma separated list
+ */
+static std::vector<std::string> splitList(std::string list) {
+  std::vector<std::string> items;
+  std::stringstream stream(list);
+  std::string item;
+  while(std::getline(stream, item, ',')) {
+    if(!item.empty()) {
+      items.push_back(item);
+    }
+  }
+  return items;
+}
+
+/**
+ * @brief Peak resident set size of the process in kB
+ */
+static long getPeakRss() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return usage.ru_maxrss / 1024;
+#else
+  return usage.ru_maxrss;
+#endif
+}
+
+/**
+ * @brief Build the network of one configuration, run it and describe the
+ * result as a JSON object
+ */
+static std::string runBenchmark(
+  std::string topologyName, uint32_t nNodes, uint32_t fanout,
+  double simTime, Time syncInterval
+) {
+  std::chrono::steady_clock::time_point setupStart = std::chrono::steady_clock::now();
+  PtpTopology topology;
+  if(topologyName == "star") {
+    topology = PtpTopology::Star(nNodes);
+  } else if(topologyName == "chain") {
+    topology = PtpTopology::Chain(nNodes);
+  } else if(topologyName == "tree") {
+    topology = PtpTopology::Tree(nNodes, fanout);
+  } else {
+    topology = PtpTopology::Mesh(nNodes);
+  }
+
+  NodeContainer nodes;
+  nodes.Create(nNodes);
+  InternetStackHelper internet;
+  internet.SetIpv6StackInstall(false);
+  internet.Install(nodes);
+
+  // Node i answers on 10.0.0.0 + i + 1 on all its links, each link has a
+  // host route to the node at the other end.
+  SimpleNetDeviceHelper simple;
+  simple.SetDeviceAttribute("DataRate", StringValue("1Gbps"));
+  simple.SetChannelAttribute("Delay", TimeValue(MicroSeconds(1)));
+  Ipv4StaticRoutingHelper routing;
+  std::vector<int32_t> firstInterface(nNodes, -1);
+  for(uint32_t i = 0; i < nNodes; i++) {
+    const std::vector<uint32_t> &neighbors = topology.GetNeighbors(i);
+    for(uint32_t j = 0; j < neighbors.size(); j++) {
+      if(neighbors[j] < i) {
+        continue;
+      }
+      uint32_t ends[2] = {i, neighbors[j]};
+      NetDeviceContainer devices = simple.Install(
+        NodeContainer(nodes.Get(ends[0]), nodes.Get(ends[1]))
+      );
+      for(uint32_t k = 0; k < 2; k++) {
+        Ptr<Ipv4> ipv4 = nodes.Get(ends[k])->GetObject<Ipv4>();
+        uint32_t interface = ipv4->AddInterface(devices.Get(k));
+        ipv4->AddAddress(interface, Ipv4InterfaceAddress(
+          Ipv4Address(0x0a000001 + ends[k]), Ipv4Mask::GetOnes()
+        ));
+        ipv4->SetUp(interface);
+        routing.GetStaticRouting(ipv4)->AddHostRouteTo(
+          Ipv4Address(0x0a000001 + ends[1 - k]), interface
+        );
+        if(firstInterface[ends[k]] < 0) {
+          firstInterface[ends[k]] = interface;
+        }
+      }
+    }
+  }
+  Ipv4InterfaceContainer interfaces;
+  for(uint32_t i = 0; i < nNodes; i++) {
+    interfaces.Add(nodes.Get(i)->GetObject<Ipv4>(), firstInterface[i]);
+  }
+
+  PTPNetwork network(nNodes - 1, 0, syncInterval, "");
+  network.setOffsetTraceEnabled(false);
+  network.setSimulationIterations(
+    (int) std::ceil(simTime / syncInterval.GetSeconds())
+  );
+  PtpHelper ptpHelper;
+  ptpHelper.Install(network, nodes, interfaces, topology);
+
+  ReceiveTimer timer(&network);
+  for(uint32_t i = 0; i < nNodes; i++) {
+    PtpNode *node = network.getNodeById(i);
+    for(int j = 0; j < node->getNumNeighbors(); j++) {
+      node->getTxSocket(j)->getSocket()->SetRecvCallback(
+        MakeCallback(&ReceiveTimer::receive, &timer)
+      );
+    }
+  }
+  Simulator::Schedule(Seconds(1.0), &PTPNetwork::startPTPProtocol, &network);
+  Simulator::Stop(Seconds(1.0 + simTime));
+  double setupSeconds = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - setupStart
+  ).count();
+
+  std::chrono::steady_clock::time_point runStart = std::chrono::steady_clock::now();
+  Simulator::Run();
+  double wallSeconds = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - runStart
+  ).count();
+  uint64_t events = Simulator::GetEventCount();
+
+  uint64_t packets = 0;
+  for(uint32_t i = 0; i < nNodes; i++) {
+    for(int type = 0; type < PTP_NUM_MESSAGE_TYPES; type++) {
+      packets += network.getNodeById(i)->getReceivedPacketCounter((PtpMessageType_t) type) +
+        network.getNodeById(i)->getOverheardPacketCounter((PtpMessageType_t) type);
+    }
+  }
+  PtpOffsetStatistics offsets = network.getOffsetStatistics();
+
+  std::stringstream json;
+  json << std::setprecision(6) <<
+    "{\"topology\": \"" << topologyName << "\", " <<
+    "\"nodes\": " << nNodes << ", " <<
+    "\"links\": " << topology.GetNLinks() << ", " <<
+    "\"sim_seconds\": " << simTime << ", " <<
+    "\"setup_seconds\": " << setupSeconds << ", " <<
+    "\"wall_seconds\": " << wallSeconds << ", " <<
+    "\"wall_seconds_per_sim_second\": " << wallSeconds / simTime << ", " <<
+    "\"events\": " << events << ", " <<
+    "\"events_per_second\": " << (wallSeconds > 0 ? events / wallSeconds : 0) << ", " <<
+    "\"peak_rss_kb\": " << getPeakRss() << ", " <<
+    "\"packets_received\": " << packets << ", " <<
+    "\"receive_calls\": " << timer.getCalls() << ", " <<
+    "\"receive_ns_per_packet\": " <<
+    (packets > 0 ? timer.getNanoSeconds() / packets : 0) << ", " <<
+    "\"offset_samples\": " << offsets.getCount() << ", " <<
+    "\"offset_mean_ns\": " << offsets.getMean() << ", " <<
+    "\"offset_p99_ns\": " << offsets.getQuantile(0.99);
+#ifdef PTP_INSTRUMENTATION
+  const PtpProbeCounters_t &receive =
+    network.getInstrumentation().getCounters(PTP_PROBE_RECEIVE);
+  json << ", \"receive_allocations_per_packet\": " <<
+    (receive.calls > 0 ? (double) receive.allocations / receive.calls : 0);
+#endif
+  json << "}";
+
+  Simulator::Destroy();
+  return json.str();
+}
+
+/**
+ * @brief Run one configuration in a child process
+ *
+ * @return std::string The JSON object of the result, or one with an error
+ */
+static std::string runInChild(
+  std::string topologyName, uint32_t nNodes, uint32_t fanout,
+  double simTime, Time syncInterval
+) {
+  std::stringstream failure;
+  failure << "{\"topology\": \"" << topologyName << "\", \"nodes\": " <<
+    nNodes << ", \"error\": ";
+  int fds[2];
+  if(pipe(fds) != 0) {
+    failure << "\"pipe failed\"}";
+    return failure.str();
+  }
+  pid_t pid = fork();
+  if(pid < 0) {
+    close(fds[0]);
+    close(fds[1]);
+    failure << "\"fork failed\"}";
+    return failure.str();
+  }
+  if(pid == 0) {
+    close(fds[0]);
+    std::string result = runBenchmark(
+      topologyName, nNodes, fanout, simTime, syncInterval
+    );
+    ssize_t written = write(fds[1], result.c_str(), result.size());
+    close(fds[1]);
+    _exit(written == (ssize_t) result.size() ? 0 : 1);
+  }
+  close(fds[1]);
+  std::string result;
+  char buffer[4096];
+  ssize_t n;
+  while((n = read(fds[0], buffer, sizeof(buffer))) > 0) {
+    result.append(buffer, n);
+  }
+  close(fds[0]);
+  int status = 0;
+  waitpid(pid, &status, 0);
+  if(!WIFEXITED(status) || WEXITSTATUS(status) != 0 || result.empty()) {
+    failure << "\"child process failed with status " << status << "\"}";
+    return failure.str();
+  }
+  return result;
+}
+
+/**
+ * @brief Read a number field of a result for the table
+ */
+static std::string getField(const std::string &json, std::string name) {
+  std::string key = "\"" + name + "\": ";
+  size_t start = json.find(key);
+  if(start == std::string::npos) {
+    return "-";
+  }
+  start += key.size();
+  return json.substr(start, json.find_first_of(",}", start) - start);
+}
+
+int main(int argc, char **argv) {
+  std::string topologies ("star,chain,tree,mesh"); // Topologies benchmarked
+  std::string sizes ("10,100,1000,10000"); // Numbers of nodes benchmarked
+  uint32_t fanout = 4; // Children of each node in a tree
+  double simTime = 10; // Simulated seconds of PTP per configuration
+  int logSyncInterval = 0; // Sync interval is 2^logSyncInterval seconds
+  std::string jsonFile ("ptp_benchmark.json");
+  std::string label (""); // Version or build the results belong to
+
+  CommandLine cmd;
+  cmd.AddValue("topologies", "Comma separated topologies: star, chain, tree, mesh", topologies);
+  cmd.AddValue("sizes", "Comma separated numbers of nodes, up to 65535", sizes);
+  cmd.AddValue("fanout", "Children of each node in a tree topology", fanout);
+  cmd.AddValue("simTime", "Simulated seconds of PTP per configuration", simTime);
+  cmd.AddValue("logSyncInterval", "Sync interval is 2^logSyncInterval seconds", logSyncInterval);
+  cmd.AddValue("json", "File to write the results to", jsonFile);
+  cmd.AddValue("label", "Version or build the results belong to", label);
+  cmd.Parse(argc, argv);
+#ifdef PTP_INSTRUMENTATION
+  PtpInstrumentation::setAllocationCounter(&getAllocations);
+#endif
+
+  Time syncInterval = Seconds(std::pow(2.0, logSyncInterval));
+  std::vector<std::string> topologyNames = splitList(topologies);
+  std::vector<std::string> sizeList = splitList(sizes);
+  for(uint32_t i = 0; i < topologyNames.size(); i++) {
+    if(topologyNames[i] != "star" && topologyNames[i] != "chain" &&
+        topologyNames[i] != "tree" && topologyNames[i] != "mesh") {
+      std::cerr << "[ptp-benchmark] Error: Unknown topology " <<
+        topologyNames[i] << "." << std::endl;
+      return 1;
+    }
+  }
+  if(simTime <= 0 || fanout == 0) {
+    std::cerr << "[ptp-benchmark] Error: simTime and fanout must be positive." <<
+      std::endl;
+    return 1;
+  }
+
+  std::cout << std::setw(8) << "Topology" << std::setw(8) << "Nodes" <<
+    std::setw(14) << "Wall/sim [s]" << std::setw(14) << "Events/s" <<
+    std::setw(14) << "Peak RSS [kB]" << std::setw(14) << "Recv [ns/pkt]" <<
+    std::endl;
+  std::vector<std::string> results;
+  for(uint32_t i = 0; i < topologyNames.size(); i++) {
+    for(uint32_t j = 0; j < sizeList.size(); j++) {
+      uint32_t nNodes = std::strtoul(sizeList[j].c_str(), NULL, 10);
+      if(nNodes < 2 || nNodes > 65535) {
+        std::cerr << "[ptp-benchmark] Error: " << sizeList[j] <<
+          " nodes is out of range, skipped." << std::endl;
+        continue;
+      }
+      std::string result = runInChild(
+        topologyNames[i], nNodes, fanout, simTime, syncInterval
+      );
+      results.push_back(result);
+      std::cout << std::setw(8) << topologyNames[i] << std::setw(8) << nNodes <<
+        std::setw(14) << getField(result, "wall_seconds_per_sim_second") <<
+        std::setw(14) << getField(result, "events_per_second") <<
+        std::setw(14) << getField(result, "peak_rss_kb") <<
+        std::setw(14) << getField(result, "receive_ns_per_packet") << std::endl;
+    }
+  }
+
+  std::ofstream json(jsonFile.c_str());
+  if(!json.is_open()) {
+    std::cerr << "[ptp-benchmark] Failed to create " << jsonFile << "." << std::endl;
+    return 1;
+  }
+  json << "{\n  \"benchmark\": \"ptp-benchmark\",\n" <<
+    "  \"label\": \"" << label << "\",\n" <<
+    "  \"sync_interval_seconds\": " << syncInterval.GetSeconds() << ",\n" <<
+    "  \"tree_fanout\": " << fanout << ",\n" <<
+    "  \"results\": [\n";
+  for(uint32_t i = 0; i < results.size(); i++) {
+    json << "    " << results[i] << (i + 1 < results.size() ? ",\n" : "\n");
+  }
+  json << "  ]\n}\n";
+  json.close();
+  return 0;
+}
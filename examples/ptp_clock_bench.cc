@@ -0,0 +1,113 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors: Tinghui Wang <tinghui.wang@wsu.edu>
+ *
+ * Benchmark the lazily evaluated local clocks of PTP nodes against the
+ * per-event update of every node (the former
+ * PTPNetwork::setLocalTimeAtNodes), for networks of 10 to 10,000 nodes.
+ */
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/ptp-module.h"
+#include <chrono>
+#include <iomanip>
+
+using namespace ns3;
+
+/**
+ * @brief Simulated PTP message events between random pairs of nodes.
+ */
+class ClockBench {
+public:
+  ClockBench(uint32_t nNodes, bool eager) : m_eager(eager), m_checksum(0) {
+    for(uint32_t i = 0; i < nNodes; i++) {
+      m_nodes.push_back(new PtpNode(i, 0, i == 0 ? 0 : 1, Ipv4Address::GetAny()));
+    }
+    m_nodes[0]->setGlobalMaster();
+  }
+
+  ~ClockBench() {
+    for(uint32_t i = 0; i < m_nodes.size(); i++) {
+      delete m_nodes[i];
+    }
+  }
+
+  /**
+   * @brief One message exchange: both ends read their clock.
+   */
+  void messageEvent(uint32_t txId, uint32_t rxId) {
+    if(m_eager) {
+      // What every send and receive used to do.
+      for(uint32_t i = 0; i < m_nodes.size(); i++) {
+        m_nodes[i]->setLocalTime(Simulator::Now());
+      }
+    }
+    m_checksum += m_nodes[txId]->getLocalTime().GetNanoSeconds();
+    m_checksum += m_nodes[rxId]->getLocalTime().GetNanoSeconds();
+  }
+
+private:
+  std::vector<PtpNode *> m_nodes;
+  bool m_eager;
+  int64_t m_checksum;
+};
+
+/**
+ * @brief Run `nEvents` message events and return the wall time in seconds.
+ */
+static double runBench(uint32_t nNodes, uint32_t nEvents, bool eager) {
+  ClockBench bench(nNodes, eager);
+  srand(1);
+  for(uint32_t i = 0; i < nEvents; i++) {
+    Simulator::Schedule(
+      MicroSeconds(100 * (i + 1)),
+      &ClockBench::messageEvent, &bench,
+      rand() % nNodes, rand() % nNodes
+    );
+  }
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  Simulator::Run();
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+  Simulator::Destroy();
+  return std::chrono::duration<double>(end - start).count();
+}
+
+int main(int argc, char **argv) {
+  uint32_t maxNodes = 10000; // Largest network benchmarked
+  uint32_t nEvents = 20000; // PTP message events per run
+
+  CommandLine cmd;
+  cmd.AddValue("maxNodes", "Largest number of PTP nodes to benchmark", maxNodes);
+  cmd.AddValue("events", "Number of PTP message events per run", nEvents);
+  cmd.Parse(argc, argv);
+
+  std::cout << std::setw(10) << "Nodes" <<
+    std::setw(16) << "Eager [s]" <<
+    std::setw(16) << "Lazy [s]" <<
+    std::setw(12) << "Speedup" << std::endl;
+
+  for(uint32_t nNodes = 10; nNodes <= maxNodes; nNodes *= 10) {
+    double eager = runBench(nNodes, nEvents, true);
+    double lazy = runBench(nNodes, nEvents, false);
+    std::cout << std::setw(10) << nNodes <<
+      std::setw(16) << std::fixed << std::setprecision(6) << eager <<
+      std::setw(16) << lazy <<
+      std::setw(12) << std::setprecision(1) << eager / lazy << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,124 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors: Tinghui Wang <tinghui.wang@wsu.edu>
+ *
+ * Benchmark the socket to socket link dispatch in PTPNetwork::receivePacket
+ * against the linear scan it replaced, for a growing number of links.
+ */
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/ptp-module.h"
+#include <chrono>
+#include <iomanip>
+
+using namespace ns3;
+
+/**
+ * @brief Socket link lookup as done by PTPNetwork::receivePacket before the
+ * hash index was added.
+ */
+static SocketLink *linearLookup(
+  std::vector<SocketLink *> &socketLinks, Ptr<Socket> socket
+) {
+  uint32_t i = 0;
+  while(!(socketLinks[i]->getSocket() == socket)) {
+    i++;
+  }
+  return socketLinks[i];
+}
+
+int main(int argc, char **argv) {
+  uint32_t maxLinks = 20000; // Largest number of links benchmarked
+  uint32_t lookups = 200000; // Number of lookups per measurement
+
+  CommandLine cmd;
+  cmd.AddValue("maxLinks", "Largest number of socket links to benchmark", maxLinks);
+  cmd.AddValue("lookups", "Number of lookups per measurement", lookups);
+  cmd.Parse(argc, argv);
+
+  // All sockets live on one node; only the lookup is measured.
+  NodeContainer nodes;
+  nodes.Create(1);
+  InternetStackHelper internet;
+  internet.Install(nodes);
+  TypeId tid = TypeId::LookupByName("ns3::UdpSocketFactory");
+
+  std::cout << std::setw(10) << "Links" <<
+    std::setw(18) << "Linear [ns/pkt]" <<
+    std::setw(18) << "Indexed [ns/pkt]" << std::endl;
+
+  // Doubling from 10 links, ending at maxLinks itself
+  std::vector<uint32_t> sizes;
+  for(uint32_t nLinks = 10; nLinks < maxLinks; nLinks *= 2) {
+    sizes.push_back(nLinks);
+  }
+  if(maxLinks > 0) {
+    sizes.push_back(maxLinks);
+  }
+
+  for(uint32_t size = 0; size < sizes.size(); size++) {
+    uint32_t nLinks = sizes[size];
+    PTPNetwork ptpNetwork(1, 0, Seconds(1.0), "");
+    std::vector<SocketLink *> socketLinks;
+    std::vector<Ptr<Socket>> sockets;
+    for(uint32_t i = 0; i < nLinks; i++) {
+      Ptr<Socket> sock = Socket::CreateSocket(nodes.Get(0), tid);
+      SocketLink *socketLink = new SocketLink(
+        0, 0, Ipv4Address::GetAny(), 0, Ipv4Address::GetAny(), 0, sock
+      );
+      sockets.push_back(sock);
+      socketLinks.push_back(socketLink);
+      ptpNetwork.addSocketLink(socketLink);
+    }
+
+    // Same pseudo-random socket sequence for both lookups
+    std::vector<uint32_t> order(lookups);
+    srand(1);
+    for(uint32_t i = 0; i < lookups; i++) {
+      order[i] = rand() % nLinks;
+    }
+
+    uintptr_t checksum = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(uint32_t i = 0; i < lookups; i++) {
+      checksum += (uintptr_t) linearLookup(socketLinks, sockets[order[i]]);
+    }
+    std::chrono::steady_clock::time_point mid = std::chrono::steady_clock::now();
+    for(uint32_t i = 0; i < lookups; i++) {
+      checksum -= (uintptr_t) ptpNetwork.getSocketLink(sockets[order[i]]);
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    double linearNs = std::chrono::duration<double, std::nano>(mid - start).count() / lookups;
+    double indexedNs = std::chrono::duration<double, std::nano>(end - mid).count() / lookups;
+    std::cout << std::setw(10) << nLinks <<
+      std::setw(18) << std::fixed << std::setprecision(1) << linearNs <<
+      std::setw(18) << indexedNs << std::endl;
+    if(checksum != 0) {
+      std::cerr << "Lookup mismatch at " << nLinks << " links." << std::endl;
+      return 1;
+    }
+
+    for(uint32_t i = 0; i < nLinks; i++) {
+      delete socketLinks[i];
+    }
+  }
+
+  Simulator::Destroy();
+  return 0;
+}
@@ -0,0 +1,248 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors: Tinghui Wang <tinghui.wang@wsu.edu>
+ *
+ * Run IEEE 1588 PTP with the distributed simulator. A chain or tree of
+ * boundary clocks over point-to-point links is split into contiguous
+ * blocks, one per MPI rank (PtpTopology::GetPartition), and every backbone
+ * node may serve a CSMA LAN of end nodes on its own rank. Each rank builds
+ * the whole network but only runs the PtpApplication of its own nodes, so
+ * no PTP state is shared across ranks.
+ *
+ *   ./waf --run ptp-mpi --command-template="mpirun -np 4 %s --nodes=64"
+ *
+ * Each rank writes the offset statistics of its nodes to
+ * ptp_summary_rank<N>.csv in the log directory.
+ */
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/point-to-point-module.h"
+#include "ns3/csma-module.h"
+#include "ns3/mpi-module.h"
+#include "ns3/ptp-module.h"
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("PTP_MPI_Example");
+
+/**
+ * @brief Write one row of the offset statistics, in the columns of
+ * ptp_summary.csv
+ */
+static void writeSummaryRow(
+  std::ofstream &summary, std::string name, const PtpOffsetStatistics &stats
+) {
+  summary << name << "," << stats.getCount() << "," <<
+    stats.getMean() << "," << stats.getStdDev() << "," <<
+    stats.getMin() << "," << stats.getMax() << "," <<
+    stats.getQuantile(0.5) << "," << stats.getQuantile(0.99) << "," <<
+    stats.getQuantile(0.999) << "," <<
+    (stats.isConverged() ? stats.getConvergenceTime().GetSeconds() : -1) << '\n';
+}
+
+int main(int argc, char **argv) {
+  uint32_t nBackbone = 16; // Nodes of the point-to-point chain
+  std::string topologyType ("chain"); // Backbone: chain or tree
+  uint32_t fanout = 2; // Children of each backbone node in a tree
+  uint32_t lanUsers = 0; // End nodes on the CSMA LAN of each backbone node
+  std::string bandwidth ("1Gb/s");
+  float delay = 10; // Delay of each link (us), the lookahead across ranks
+  int logSyncInterval = 0; // Sync interval is 2^logSyncInterval seconds
+  uint32_t iterations = 100; // Sync intervals the protocol runs for
+  bool oneStep = false; // One-step clocks, no FOLLOW messages
+  std::string servo ("step"); // Clock servo: step or pi
+  bool nullMessages = false; // Null message instead of barrier synchronization
+  std::string logdir ("");
+
+  CommandLine cmd;
+  cmd.AddValue("nodes", "Nodes of the point-to-point backbone", nBackbone);
+  cmd.AddValue("topology", "Point-to-point links of the backbone: chain or tree", topologyType);
+  cmd.AddValue("fanout", "Children of each backbone node in a tree", fanout);
+  cmd.AddValue("lanUsers", "End nodes on a CSMA LAN of each backbone node", lanUsers);
+  cmd.AddValue("bandwidth", "Bandwidth of all links", bandwidth);
+  cmd.AddValue("delay", "Delay of each link in us", delay);
+  cmd.AddValue("logSyncInterval", "Sync interval is 2^logSyncInterval seconds", logSyncInterval);
+  cmd.AddValue("iterations", "Sync intervals the protocol runs for", iterations);
+  cmd.AddValue("oneStep", "SYNC carries the transmit time stamp, no FOLLOW", oneStep);
+  cmd.AddValue("servo", "Clock servo: step (offset only) or pi (offset and frequency)", servo);
+  cmd.AddValue("nullMessages", "Synchronize ranks with null messages instead of barriers", nullMessages);
+  cmd.AddValue("logdir", "Directory to write statistics to", logdir);
+  cmd.Parse(argc, argv);
+
+  if(nullMessages) {
+    GlobalValue::Bind(
+      "SimulatorImplementationType", StringValue("ns3::NullMessageSimulatorImpl")
+    );
+  } else {
+    GlobalValue::Bind(
+      "SimulatorImplementationType", StringValue("ns3::DistributedSimulatorImpl")
+    );
+  }
+  MpiInterface::Enable(&argc, &argv);
+  uint32_t systemId = MpiInterface::GetSystemId();
+  uint32_t systemCount = MpiInterface::GetSize();
+
+  if(nBackbone < 2 || nBackbone < systemCount || fanout == 0) {
+    std::cerr << "[ptp-mpi] Error: The backbone needs at least two nodes " <<
+      "and one node per rank." << std::endl;
+    MpiInterface::Disable();
+    return 1;
+  }
+
+  PtpTopology backboneTopology = (topologyType == "tree") ?
+    PtpTopology::Tree(nBackbone, fanout) : PtpTopology::Chain(nBackbone);
+  // Ranks get contiguous blocks of the backbone tree, each LAN the rank of
+  // its backbone node: only point-to-point links cross ranks.
+  std::vector<uint32_t> rankOf;
+  backboneTopology.GetPartition(0, systemCount, rankOf);
+  NodeContainer backbone;
+  std::vector<NodeContainer> lans(nBackbone);
+  for(uint32_t i = 0; i < nBackbone; i++) {
+    backbone.Create(1, rankOf[i]);
+  }
+  NodeContainer users;
+  for(uint32_t i = 0; i < nBackbone; i++) {
+    lans[i].Add(backbone.Get(i));
+    NodeContainer lanUserNodes;
+    lanUserNodes.Create(lanUsers, rankOf[i]);
+    lans[i].Add(lanUserNodes);
+    users.Add(lanUserNodes);
+  }
+
+  InternetStackHelper stack;
+  stack.Install(backbone);
+  stack.Install(users);
+
+  PointToPointHelper p2p;
+  p2p.SetDeviceAttribute("DataRate", StringValue(bandwidth));
+  p2p.SetChannelAttribute("Delay", TimeValue(MicroSeconds(delay)));
+  CsmaHelper csma;
+  csma.SetChannelAttribute("DataRate", StringValue(bandwidth));
+  csma.SetChannelAttribute("Delay", TimeValue(MicroSeconds(delay)));
+
+  // PTP node i is backbone node i, then the LAN users in order, reached at
+  // the address of their first link through the global routes
+  PtpTopology topology(nBackbone * (1 + lanUsers));
+  std::vector<std::pair<Ptr<Ipv4>, uint32_t> > nodeInterface(topology.GetNNodes());
+  std::vector<bool> addressed(topology.GetNNodes(), false);
+  Ipv4AddressHelper linkAddress;
+  linkAddress.SetBase("10.0.0.0", "255.255.255.252");
+  for(uint32_t i = 0; i < nBackbone; i++) {
+    const std::vector<uint32_t> &neighbors = backboneTopology.GetNeighbors(i);
+    for(uint32_t j = 0; j < neighbors.size(); j++) {
+      uint32_t peer = neighbors[j];
+      if(peer < i) {
+        continue;
+      }
+      Ipv4InterfaceContainer link = linkAddress.Assign(
+        p2p.Install(backbone.Get(i), backbone.Get(peer))
+      );
+      linkAddress.NewNetwork();
+      topology.AddLink(i, peer);
+      if(!addressed[i]) {
+        nodeInterface[i] = link.Get(0);
+        addressed[i] = true;
+      }
+      if(!addressed[peer]) {
+        nodeInterface[peer] = link.Get(1);
+        addressed[peer] = true;
+      }
+    }
+  }
+  Ipv4AddressHelper lanAddress;
+  lanAddress.SetBase("172.16.0.0", "255.255.255.0");
+  for(uint32_t i = 0; i < nBackbone && lanUsers > 0; i++) {
+    Ipv4InterfaceContainer lan = lanAddress.Assign(csma.Install(lans[i]));
+    lanAddress.NewNetwork();
+    for(uint32_t j = 0; j < lanUsers; j++) {
+      // Interface 0 of the LAN is its backbone node
+      uint32_t user = nBackbone + i * lanUsers + j;
+      nodeInterface[user] = lan.Get(j + 1);
+      topology.AddLink(i, user);
+    }
+  }
+  Ipv4GlobalRoutingHelper::PopulateRoutingTables();
+
+  Ipv4InterfaceContainer ptpInterfaces;
+  for(uint32_t i = 0; i < topology.GetNNodes(); i++) {
+    ptpInterfaces.Add(nodeInterface[i]);
+  }
+  NodeContainer ptpNodes(backbone, users);
+
+  Time syncInterval = Seconds(std::pow(2.0, logSyncInterval));
+  Time stop = Seconds(1.0 + std::pow(2.0, logSyncInterval) * iterations);
+  PtpApplicationHelper ptp;
+  ptp.SetAttribute("SyncInterval", TimeValue(syncInterval));
+  ptp.SetAttribute("OneStep", BooleanValue(oneStep));
+  ptp.SetAttribute("PiServo", BooleanValue(servo == "pi"));
+  ptp.SetMaster(0);
+  ptp.SetSystemId(systemId);
+  ApplicationContainer apps = ptp.Install(ptpNodes, ptpInterfaces, topology);
+  apps.Start(Seconds(1.0));
+  apps.Stop(stop);
+
+  NS_LOG_INFO("Rank " << systemId << " of " << systemCount << " runs " <<
+    apps.GetN() << " of " << topology.GetNNodes() << " PTP nodes.");
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  Simulator::Stop(stop + Seconds(1.0));
+  Simulator::Run();
+  double wallClock = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - start
+  ).count();
+
+  // The applications free their clocks when the simulator is destroyed
+  std::stringstream filename;
+  filename << logdir << "ptp_summary_rank" << systemId << ".csv";
+  std::ofstream summary(filename.str().c_str());
+  if(!summary.is_open()) {
+    std::cerr << "[ptp-mpi] Failed to create " << filename.str() << "." <<
+      std::endl;
+  } else {
+    summary << "node,samples,mean,stddev,min,max,p50,p99,p999,converged_at" << '\n';
+    PtpOffsetStatistics rankStatistics;
+    bool first = true;
+    for(uint32_t i = 0; i < apps.GetN(); i++) {
+      PtpNode *node = DynamicCast<PtpApplication>(apps.Get(i))->getPtpNode();
+      if(!node || node->getNodeId() == 0) {
+        continue;
+      }
+      std::stringstream name;
+      name << node->getNodeId();
+      writeSummaryRow(summary, name.str(), node->getOffsetStatistics());
+      if(first) {
+        rankStatistics = node->getOffsetStatistics();
+        first = false;
+      } else {
+        rankStatistics.merge(node->getOffsetStatistics());
+      }
+    }
+    writeSummaryRow(summary, "all", rankStatistics);
+    summary.close();
+  }
+  std::cout << "Rank " << systemId << ": " << apps.GetN() << " PTP nodes, " <<
+    wallClock << " s wall clock" << std::endl;
+
+  Simulator::Destroy();
+  MpiInterface::Disable();
+  return 0;
+}
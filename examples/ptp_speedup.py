@@ -0,0 +1,125 @@
+#!/usr/bin/env python3
+# -*- Mode: python; py-indent-offset: 4; indent-tabs-mode: nil; coding: utf-8; -*-
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License version 2 as
+# published by the Free Software Foundation;
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+#
+# Authors: Tinghui Wang <tinghui.wang@wsu.edu>
+#
+"""Report the speedup of ptp-mpi against the number of ranks on one machine.
+
+The same scenario is run with mpirun -np N for every N of --ranks, the
+topology partitioned by system ID (PtpTopology::GetPartition). The wall
+clock of a run is the one of its slowest rank. The speedup is relative to
+the first entry of --ranks, normally 1.
+
+Example, from the top of an ns-3 tree configured with --enable-mpi:
+
+    python3 contrib/ptp/examples/ptp_speedup.py --ranks 1,2,4,8 \\
+        -- --nodes=256 --topology=tree --fanout=4 --lanUsers=8
+"""
+
+import argparse
+import csv
+import os
+import re
+import subprocess
+import sys
+import time
+
+from ptp_sweep import find_binary
+
+RANK_LINE = re.compile(r'^Rank (\d+): (\d+) PTP nodes, ([0-9.eE+-]+) s wall clock')
+
+
+def run_ranks(mpirun, ranks, binary, outdir, extra):
+    """Run ptp-mpi on some ranks and return (slowest rank s, process s)."""
+    run_dir = os.path.join(outdir, 'np%d' % ranks)
+    os.makedirs(run_dir, exist_ok=True)
+    args = mpirun.split() + ['-np', str(ranks), binary,
+                             '--logdir=' + run_dir + os.sep] + extra
+    start = time.time()
+    result = subprocess.run(args, stdout=subprocess.PIPE,
+                            stderr=subprocess.PIPE, universal_newlines=True)
+    elapsed = time.time() - start
+    with open(os.path.join(run_dir, 'stdout.txt'), 'w') as f:
+        f.write(result.stdout)
+    with open(os.path.join(run_dir, 'stderr.txt'), 'w') as f:
+        f.write(result.stderr)
+    if result.returncode != 0:
+        raise RuntimeError('%s exited with %d, see %s/stderr.txt' %
+                           (' '.join(args), result.returncode, run_dir))
+    walls = [float(m.group(3)) for m in
+             (RANK_LINE.match(line) for line in result.stdout.splitlines()) if m]
+    if len(walls) != ranks:
+        raise RuntimeError('%d of %d ranks reported, see %s/stdout.txt' %
+                           (len(walls), ranks, run_dir))
+    return max(walls), elapsed
+
+
+def main(argv):
+    extra = []
+    if '--' in argv:
+        extra = argv[argv.index('--') + 1:]
+        argv = argv[:argv.index('--')]
+    parser = argparse.ArgumentParser(
+        description='Speedup of ptp-mpi against the number of ranks.')
+    parser.add_argument('--ranks', default='1,2,4',
+                        help='Comma separated numbers of ranks to run')
+    parser.add_argument('--mpirun', default='mpirun',
+                        help='MPI launcher, with its own options')
+    parser.add_argument('--outdir', default='ptp-speedup',
+                        help='Directory of the runs and speedup.csv')
+    parser.add_argument('--ns3dir', default='.',
+                        help='Top of the built ns-3 tree')
+    parser.add_argument('--binary', default=None,
+                        help='ptp-mpi executable (default: looked up under ns3dir/build)')
+    args = parser.parse_args(argv)
+
+    try:
+        ranks = [int(r) for r in args.ranks.split(',') if r != '']
+    except ValueError:
+        parser.error('--ranks must be numbers separated by commas')
+    if not ranks or min(ranks) < 1:
+        parser.error('--ranks must be positive')
+    binary = args.binary or find_binary(args.ns3dir, 'ptp-mpi')
+    if binary is None:
+        sys.stderr.write('[ptp_speedup] Error: ptp-mpi is not built under '
+                         '%s/build, configure ns-3 with --enable-mpi or pass '
+                         '--binary.\n' % args.ns3dir)
+        return 1
+    binary = os.path.abspath(binary)
+    outdir = os.path.abspath(args.outdir)
+
+    rows = []
+    for n in ranks:
+        try:
+            wall, elapsed = run_ranks(args.mpirun, n, binary, outdir, extra)
+        except RuntimeError as e:
+            sys.stderr.write('[ptp_speedup] Error: %s\n' % e)
+            return 1
+        speedup = rows[0][1] / wall if rows else 1.0
+        rows.append((n, wall, elapsed, speedup, speedup * ranks[0] / n))
+        print('%4d ranks: %10.3f s simulation, %10.3f s process, speedup %6.2f, '
+              'efficiency %5.2f' % rows[-1])
+
+    with open(os.path.join(outdir, 'speedup.csv'), 'w', newline='') as f:
+        writer = csv.writer(f)
+        writer.writerow(['ranks', 'simulation_s', 'process_s', 'speedup',
+                         'efficiency'])
+        writer.writerows(rows)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
@@ -0,0 +1,215 @@
+#!/usr/bin/env python3
+# -*- Mode: python; py-indent-offset: 4; indent-tabs-mode: nil; coding: utf-8; -*-
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License version 2 as
+# published by the Free Software Foundation;
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+#
+# Authors: Tinghui Wang <tinghui.wang@wsu.edu>
+#
+"""Run ptp-csma or ptp-wifi-adhoc over a grid of parameters in parallel.
+
+Every combination of the grid is run --runs times, each as its own process
+with its own --RngRun and log directory, on --jobs cores at once. The
+ptp_summary.csv of every run is merged into sweep_summary.csv in the output
+directory, with the parameters and the RNG run in front of each row.
+
+Example, from the top of the ns-3 tree after ./waf build:
+
+    python3 contrib/ptp/examples/ptp_sweep.py --program ptp-csma \\
+        --grid bandwidth=10Mbps,100Mbps --grid utilization=0.2,0.5,0.8 \\
+        --grid users=2,8,32 --runs 5 --outdir sweep-csma
+
+Other program options are passed to every run after --, for instance
+`-- --servo=pi --rawTrace=false`.
+"""
+
+import argparse
+import csv
+import glob
+import itertools
+import os
+import subprocess
+import sys
+import time
+from concurrent.futures import ThreadPoolExecutor, as_completed
+
+PROGRAMS = ('ptp-csma', 'ptp-wifi-adhoc')
+
+
+def parse_grid(items):
+    """Turn ['name=v1,v2', ...] into an ordered list of (name, values)."""
+    grid = []
+    for item in items:
+        if '=' not in item:
+            raise ValueError('grid entry %r is not name=value[,value...]' % item)
+        name, values = item.split('=', 1)
+        values = [v for v in values.split(',') if v != '']
+        if not name or not values:
+            raise ValueError('grid entry %r has no name or no value' % item)
+        grid.append((name, values))
+    return grid
+
+
+def find_binary(ns3_dir, program):
+    """Find the executable waf built for a program of the module."""
+    patterns = [
+        os.path.join(ns3_dir, 'build', '**', 'ptp', 'examples', '*' + program + '*'),
+        os.path.join(ns3_dir, 'build', '**', '*' + program + '*'),
+    ]
+    for pattern in patterns:
+        for path in sorted(glob.glob(pattern, recursive=True)):
+            if os.path.isfile(path) and os.access(path, os.X_OK):
+                return path
+    return None
+
+
+def run_one(binary, ns3_dir, run_dir, params, rng_run, extra):
+    """Run one scenario and return (exit code, seconds, summary rows)."""
+    os.makedirs(run_dir, exist_ok=True)
+    # The programs append file names to logdir
+    args = [binary, '--logdir=' + run_dir + os.sep, '--RngRun=%d' % rng_run]
+    args += ['--%s=%s' % (name, value) for name, value in params]
+    args += extra
+    env = dict(os.environ)
+    # Binaries of a non-static build need the module libraries
+    lib_dirs = glob.glob(os.path.join(ns3_dir, 'build', 'lib'))
+    if lib_dirs:
+        env['LD_LIBRARY_PATH'] = os.pathsep.join(
+            lib_dirs + [env.get('LD_LIBRARY_PATH', '')])
+    start = time.time()
+    with open(os.path.join(run_dir, 'stdout.txt'), 'w') as out, \
+            open(os.path.join(run_dir, 'stderr.txt'), 'w') as err:
+        code = subprocess.call(args, stdout=out, stderr=err, env=env)
+    elapsed = time.time() - start
+    with open(os.path.join(run_dir, 'command.txt'), 'w') as cmd:
+        cmd.write(' '.join(args) + '\n')
+    rows = []
+    summary = os.path.join(run_dir, 'ptp_summary.csv')
+    if code == 0 and os.path.isfile(summary):
+        with open(summary) as f:
+            rows = list(csv.DictReader(f))
+    return code, elapsed, rows
+
+
+def main(argv):
+    extra = []
+    if '--' in argv:
+        extra = argv[argv.index('--') + 1:]
+        argv = argv[:argv.index('--')]
+    parser = argparse.ArgumentParser(
+        description='Run a PTP example over a grid of parameters on all cores.')
+    parser.add_argument('--program', choices=PROGRAMS, default='ptp-csma',
+                        help='Example program to run')
+    parser.add_argument('--grid', action='append', default=[],
+                        metavar='NAME=V1,V2,...',
+                        help='Values of one program option (repeat for more)')
+    parser.add_argument('--runs', type=int, default=1,
+                        help='RNG runs of every combination')
+    parser.add_argument('--firstRun', type=int, default=1,
+                        help='RngRun of the first run of each combination')
+    parser.add_argument('--jobs', type=int, default=os.cpu_count() or 1,
+                        help='Runs at once (default: number of cores)')
+    parser.add_argument('--outdir', default='ptp-sweep',
+                        help='Directory of the run directories and sweep_summary.csv')
+    parser.add_argument('--ns3dir', default='.',
+                        help='Top of the built ns-3 tree')
+    parser.add_argument('--binary', default=None,
+                        help='Program executable (default: looked up under ns3dir/build)')
+    parser.add_argument('--dryRun', action='store_true',
+                        help='Print the runs without starting them')
+    args = parser.parse_args(argv)
+
+    try:
+        grid = parse_grid(args.grid)
+    except ValueError as e:
+        parser.error(str(e))
+    if args.runs < 1 or args.jobs < 1:
+        parser.error('--runs and --jobs must be positive')
+
+    binary = args.binary or find_binary(args.ns3dir, args.program)
+    if binary is not None:
+        binary = os.path.abspath(binary)
+    if binary is None and not args.dryRun:
+        sys.stderr.write('[ptp_sweep] Error: %s is not built under %s/build, '
+                         'run ./waf build or pass --binary.\n' %
+                         (args.program, args.ns3dir))
+        return 1
+
+    names = [name for name, _ in grid]
+    combinations = list(itertools.product(*[values for _, values in grid]))
+    runs = []
+    for index, values in enumerate(combinations):
+        params = list(zip(names, values))
+        for rng_run in range(args.firstRun, args.firstRun + args.runs):
+            run_dir = os.path.join(os.path.abspath(args.outdir),
+                                   'run-%04d-rng%d' % (index, rng_run))
+            runs.append((index, params, rng_run, run_dir))
+    print('%d combinations x %d runs = %d runs of %s on %d cores' %
+          (len(combinations), args.runs, len(runs), args.program, args.jobs))
+    if args.dryRun:
+        for _, params, rng_run, run_dir in runs:
+            print('%s RngRun=%d %s' % (run_dir, rng_run, ' '.join(
+                '%s=%s' % p for p in params)))
+        return 0
+
+    os.makedirs(args.outdir, exist_ok=True)
+    # Each run is a separate process, the threads only wait for them
+    failed = 0
+    done = 0
+    merged = []
+    start = time.time()
+    with ThreadPoolExecutor(max_workers=args.jobs) as pool:
+        futures = {}
+        for index, params, rng_run, run_dir in runs:
+            future = pool.submit(run_one, binary, args.ns3dir, run_dir,
+                                 params, rng_run, extra)
+            futures[future] = (index, params, rng_run, run_dir)
+        for future in as_completed(futures):
+            index, params, rng_run, run_dir = futures[future]
+            code, elapsed, rows = future.result()
+            done += 1
+            if code != 0:
+                failed += 1
+                sys.stderr.write('[ptp_sweep] Error: %s exited with %d, see '
+                                 '%s/stderr.txt\n' % (run_dir, code, run_dir))
+            elif not rows:
+                sys.stderr.write('[ptp_sweep] Error: %s wrote no '
+                                 'ptp_summary.csv\n' % run_dir)
+            for row in rows:
+                merged.append((index, params, rng_run, run_dir, row))
+            print('[%d/%d] %s %.1f s' % (done, len(runs),
+                                         os.path.basename(run_dir), elapsed))
+
+    # Same order as the grid, whatever order the runs finished in: by
+    # combination, RNG run, then the rows of ptp_summary.csv with 'all' last
+    merged.sort(key=lambda r: (r[0], r[2], r[4].get('node') == 'all'))
+    columns = []
+    for _, _, _, _, row in merged:
+        for column in row:
+            if column not in columns:
+                columns.append(column)
+    summary = os.path.join(args.outdir, 'sweep_summary.csv')
+    with open(summary, 'w', newline='') as f:
+        writer = csv.writer(f)
+        writer.writerow(names + ['rng_run', 'run_dir'] + columns)
+        for _, params, rng_run, run_dir, row in merged:
+            writer.writerow([value for _, value in params] +
+                            [rng_run, os.path.basename(run_dir)] +
+                            [row.get(column, '') for column in columns])
+    print('%d runs in %.1f s, %d failed, summary in %s' %
+          (len(runs), time.time() - start, failed, summary))
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
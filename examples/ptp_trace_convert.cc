@@ -0,0 +1,43 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors: Tinghui Wang <tinghui.wang@wsu.edu>
+ *
+ * Convert the binary offset trace of a PTP run to the per-node node_<id>.dat
+ * text files used by the plotting scripts.
+ */
+
+#include "ns3/core-module.h"
+#include "ns3/ptp-module.h"
+
+using namespace ns3;
+
+int main(int argc, char **argv) {
+  std::string logdir ("");
+  std::string trace ("");
+
+  CommandLine cmd;
+  cmd.AddValue("logdir", "Directory of the PTP run; text files are written there", logdir);
+  cmd.AddValue("trace", "Binary trace file (default: <logdir>ptp_offset.bin)", trace);
+  cmd.Parse(argc, argv);
+
+  if(trace.empty()) {
+    trace = logdir + "ptp_offset.bin";
+  }
+  if(!PtpTraceWriter::convertToText(trace, logdir)) {
+    return 1;
+  }
+  return 0;
+}
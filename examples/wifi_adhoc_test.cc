@@ -24,6 +24,8 @@
 #include "ns3/internet-module.h"
 #include "ns3/netanim-module.h"
 #include "ns3/ptp-module.h"
+#include "ptp-animation-counter.h"
+#include <cmath>
 
 using namespace ns3;
 
@@ -32,24 +34,74 @@ int main(int argc, char **argv) {
   std::string phyMode ("DsssRate1Mbps");
   double rss = -93; // -dBm
   uint32_t packetSize = 1024; // Bytes
-  uint8_t interval = 5; // nanoseconds
+  int logSyncInterval = 0; // Sync interval is 2^logSyncInterval seconds
+  bool adaptiveSync = false; // Nodes adapt their sync interval to their offset
+  int maxLogSyncInterval = 6; // Longest adaptive sync interval
+  bool boundaryClock = false; // Every hop syncs its slaves on its own schedule
+  bool bmca = false; // Elect the grandmaster with ANNOUNCE messages
+  double failGrandmaster = -1; // Seconds into the protocol the grandmaster fails at
+  int iterations = 2; // Initial sync intervals the protocol runs for
   uint32_t nUsers = 6; // Number of users
   std::string logdir ("");
+  bool dumpEndpointsOnly = false; // Clock dump of sender and receiver only
+  bool rawTrace = true; // Write every offset sample to ptp_offset.bin
+  std::string syncMode ("unicast"); // SYNC and FOLLOW: unicast, multicast or broadcast
+  bool oneStep = false; // One-step clocks, no FOLLOW messages
+  std::string servo ("step"); // Clock servo: step or pi
+  std::string delayMechanism ("e2e"); // Delay measurement: e2e or p2p
+  std::string oscillator ("constant"); // Node oscillators: constant or noisy
+  std::string timestamping ("application"); // Time stamp point: only application on Wi-Fi
+  double timestampLatency = 0; // Mean latency of software and application time stamps (ns)
+  double maxPpm = 50; // Largest frequency offset of noisy oscillators
+  double randomWalk = 1; // Frequency random walk of noisy oscillators (ppb after 1 s)
+  double phaseNoise = 5; // White phase noise of noisy oscillators (ns)
+  double aging = 0; // Aging of noisy oscillators (ppb per day)
+  std::string topology ("chain"); // PTP links: chain, star or tree
+  uint32_t fanout = 2; // Children of each node in a tree
+  std::string topologyFile (""); // Adjacency lists, overrides `topology`
+  bool animation = false; // Write a NetAnim trace with the offset error of each node
+  uint32_t animSamplePeriod = 1; // Syncs of a node per NetAnim counter update
+  bool animPerRound = false; // Write the NetAnim counters once per sync interval
 
   /* Setup Command Line Arguments */
   CommandLine cmd;
   cmd.AddValue("phyMode", "Wifi Phy mode", phyMode);
   cmd.AddValue("rss", "received signal strength", rss);
   cmd.AddValue("packetSize", "size of application packet sent", packetSize);
-  cmd.AddValue("interval", "interval (seconds) between packets", interval);
+  cmd.AddValue("logSyncInterval", "Sync interval is 2^logSyncInterval seconds", logSyncInterval);
+  cmd.AddValue("adaptiveSync", "Converged nodes back off to 2^maxLogSyncInterval seconds", adaptiveSync);
+  cmd.AddValue("maxLogSyncInterval", "Longest sync interval of adaptive sync", maxLogSyncInterval);
+  cmd.AddValue("boundaryClock", "Nodes sync their slaves without waiting for their own sync", boundaryClock);
+  cmd.AddValue("bmca", "Elect the grandmaster with ANNOUNCE messages (best master clock algorithm)", bmca);
+  cmd.AddValue("failGrandmaster", "Seconds into the protocol the grandmaster fails at (negative: never)", failGrandmaster);
+  cmd.AddValue("iterations", "Initial sync intervals the protocol runs for", iterations);
   cmd.AddValue("users", "Number of receivers", nUsers);
   cmd.AddValue("logdir", "Directory to write statistics to", logdir);
+  cmd.AddValue("dumpEndpointsOnly", "Debug clock dump lists only sender and receiver", dumpEndpointsOnly);
+  cmd.AddValue("rawTrace", "Write every offset sample (ptp_summary.csv is always written)", rawTrace);
+  cmd.AddValue("syncMode", "Send SYNC and FOLLOW by unicast, multicast or broadcast", syncMode);
+  cmd.AddValue("oneStep", "SYNC carries the transmit time stamp, no FOLLOW", oneStep);
+  cmd.AddValue("servo", "Clock servo: step (offset only) or pi (offset and frequency)", servo);
+  cmd.AddValue("delayMechanism", "Delay to the master: e2e (DREQ/DRPLY) or p2p (peer delay per link)", delayMechanism);
+  cmd.AddValue("timestamping", "Event messages are time stamped by the application (the only point Wi-Fi devices support)", timestamping);
+  cmd.AddValue("timestampLatency", "Mean of the exponential latency of software and application time stamps in ns", timestampLatency);
+  cmd.AddValue("oscillator", "Node oscillators: constant (fixed rate) or noisy (offset, random walk, phase noise, aging)", oscillator);
+  cmd.AddValue("maxPpm", "Frequency offsets of noisy oscillators are uniform in +-maxPpm ppm", maxPpm);
+  cmd.AddValue("randomWalk", "Frequency random walk of noisy oscillators in ppb after one second", randomWalk);
+  cmd.AddValue("phaseNoise", "White phase noise of noisy oscillators in ns", phaseNoise);
+  cmd.AddValue("aging", "Aging of noisy oscillators in ppb per day", aging);
+  cmd.AddValue("topology", "PTP links between nodes: chain, star or tree", topology);
+  cmd.AddValue("fanout", "Children of each node in a tree topology", fanout);
+  cmd.AddValue("topologyFile", "File with the neighbors of node i on line i", topologyFile);
+  cmd.AddValue("animation", "Write a NetAnim trace with packet metadata and offset error counters", animation);
+  cmd.AddValue("animSamplePeriod", "Update the offset error counter of a node in one of every n syncs", animSamplePeriod);
+  cmd.AddValue("animPerRound", "Write the offset error counters once per sync interval", animPerRound);
   cmd.Parse(argc, argv);
 
   NS_LOG_COMPONENT_DEFINE("PTP_WifiAdhoc_Example");
 
   // Convert to time object
-  Time interPacketInterval = NanoSeconds(interval);
+  Time interPacketInterval = Seconds(std::pow(2.0, logSyncInterval));
   // disable fragmentation for frames below 2200 bytes
   Config::SetDefault("ns3::WifiRemoteStationManager::FragmentationThreshold",
     StringValue("2200"));
@@ -121,108 +173,75 @@ int main(int argc, char **argv) {
 
   Ipv4AddressHelper ipv4;
   ipv4.SetBase("10.1.1.0", "255.255.255.0");
-  ipv4.Assign(devices);
-  TypeId tid = TypeId::LookupByName("ns3::UdpSocketFactory");
+  Ipv4InterfaceContainer interfaces = ipv4.Assign(devices);
   TypeId tcpId = TypeId::LookupByName("ns3::TcpSocketFactory");
 
-  // List of Ipv4 Address
-  //int hopOfNode[ 3 ] ={ 0, 1, 1 };
-  char ipv4Add[7][12] = { "10.1.1.1", "10.1.1.2" , "10.1.1.3",
-                          "10.1.1.4", "10.1.1.5" , "10.1.1.6",
-                          "10.1.1.7" };
-
-  uint16_t connectToPortAtNode[6] = { 100, 200, 300, 400, 500, 600};
-  uint16_t hopOfNode[6] = {0, 1, 2, 3, 4, 5};
-  uint16_t masterOfNode[6] = {0, 0, 1, 2, 3, 4};
-  // int socketIndex[7]; // What is this?
-
-  int neighborList[6][4] = {
-    { 1, -1},    // Node 0
-    { 0, 2, -1}, // Node 1
-    { 1, 3, -1}, // Node 2
-    { 2, 4, -1}, // Node 3
-    { 3, 5, -1}, // Node 4
-    { 4, -1}     // Node 5
-  };
-
-  uint16_t neighborPort[6][3] = {
-    { 200 },
-    { 100, 300 },
-    { 201, 400 },
-    { 301, 500 },
-    { 401, 600 },
-    { 501 }
-  };
-
-  // Store static PTP nodes
-  std::vector<PtpNode *> staticNodes(nUsers);
-  // Store IPv4 address of each node
-  std::vector<Ipv4Address> ipv4Address(nUsers + 1);
-  // Socket to neighbor node
-  std::vector<std::vector<Ptr<Socket>>> neighbor(nUsers);
-  // List of socket links established in the network
-  std::vector<SocketLink *> socketLinks(10);
-
-  uint16_t i, j, socket_count=0, srcPort;
-
-  // create Ipv4 address 
-  
-  for( i=0; i < nUsers + 1;i++){
-    ipv4Address[i] = Ipv4Address(ipv4Add[i]);
+  // PTP links between the first `nUsers` nodes, node 0 is the master
+  PtpTopology ptpTopology;
+  if(!topologyFile.empty()) {
+    if(!PtpTopology::LoadAdjacencyList(topologyFile, ptpTopology)) {
+      return 1;
+    }
+  } else if(topology == "star") {
+    ptpTopology = PtpTopology::Star(nUsers);
+  } else if(topology == "tree") {
+    ptpTopology = PtpTopology::Tree(nUsers, fanout);
+  } else {
+    ptpTopology = PtpTopology::Chain(nUsers);
   }
 
   // Create neighbor nodes
   PTPNetwork ptpTest(nUsers, packetSize, interPacketInterval, logdir);
-  
-  // socketIndex[0] = -1;
-  for(i = 0; i < nUsers; i++) {
-    j = 0;
-    staticNodes[i] = new PtpNode(i, masterOfNode[i], hopOfNode[i], ipv4Address[i]);
-    while(neighborList[i][j] != -1 && j < 4) {
-      // Create an UDP Socket on node i and add it to neighbor socket vectors.
-      neighbor[i].push_back(Socket::CreateSocket(nodes.Get(i), tid));
-      // The port is (i + 1) * 100 + j
-      srcPort = connectToPortAtNode[i] + j;
-      // Bind to source IP and source port
-      neighbor[i][j]->Bind(InetSocketAddress(ipv4Address[i], srcPort));
-      // Connect the socket to neighbor identified in neighborList[i][j]
-      neighbor[i][j]->Connect(
-        InetSocketAddress(ipv4Address[neighborList[i][j]], neighborPort[i][j])
-      );
-      // Print information to console
-      std::cout << "[Socket] txNode: " << i << " " << 
-        ipv4Address[i] << ":" << srcPort << " --> " << 
-        "DstNode: " << neighborList[i][j] << " " <<
-        ipv4Address[neighborList[i][j]] << ":" << neighborPort[i][j] << 
-        std::endl;
-      // Set Receive Callback for each socket
-      neighbor[i][j]->SetRecvCallback(
-        MakeCallback(&PTPNetwork::receivePacket, &ptpTest)
-      );
-      // Create socket Link
-      socketLinks[socket_count] = new SocketLink(
-        i, neighborList[i][j], 
-        ipv4Address[i], srcPort, 
-        ipv4Address[neighborList[i][j]], neighborPort[i][j],
-        neighbor[i][j]
-      );
-      // Add Neighbor
-      staticNodes[i]->addNeighbor(
-        neighborList[i][j], socketLinks[socket_count]
-      );
-      // Add to PTP Network
-      ptpTest.addSocketLink(socketLinks[socket_count]);
-      
-      socket_count++;
-      j++;
-    }
-    ptpTest.addNode(staticNodes[i]);
+  if(dumpEndpointsOnly) {
+    ptpTest.setClockDumpScope(DUMP_SENDER_RECEIVER);
+  }
+  ptpTest.setOffsetTraceEnabled(rawTrace);
+  ptpTest.setOneStepClock(oneStep);
+  if(delayMechanism == "p2p") {
+    ptpTest.setDelayMechanism(DELAY_P2P);
+  }
+  // 802.11b DSSS and HR/DSSS rates do not depend on the channel width
+  ptpTest.setChannelDataRate(DataRate(WifiMode(phyMode).GetDataRate(22)));
+  ptpTest.setBoundaryClock(boundaryClock);
+  ptpTest.setBmcaEnabled(bmca);
+
+  PtpHelper ptpHelper;
+  if(syncMode == "multicast") {
+    ptpHelper.SetSyncMode(PtpHelper::SYNC_MULTICAST);
+  } else if(syncMode == "broadcast") {
+    ptpHelper.SetSyncMode(PtpHelper::SYNC_BROADCAST);
+  }
+  if(servo == "pi") {
+    ptpHelper.SetServo(PtpHelper::SERVO_PI);
+  }
+  // PtpTimestamper cannot correct frames at the Wi-Fi PHY or MAC
+  if(timestamping != "application") {
+    std::cerr << "[ptp-wifi-adhoc] Error: Wi-Fi devices only support " <<
+      "application time stamps." << std::endl;
+    return 1;
+  }
+  if(timestampLatency > 0) {
+    Ptr<ExponentialRandomVariable> latency = CreateObject<ExponentialRandomVariable>();
+    latency->SetAttribute("Mean", DoubleValue(timestampLatency));
+    ptpHelper.SetTimestamping(TIMESTAMP_APPLICATION, latency);
+  }
+  if(oscillator == "noisy") {
+    ptpHelper.SetOscillatorNoise(maxPpm, randomWalk, phaseNoise, aging);
+  }
+  if(adaptiveSync) {
+    ptpHelper.SetAdaptiveSyncInterval(
+      interPacketInterval, Seconds(std::pow(2.0, maxLogSyncInterval))
+    );
+  }
+  ptpHelper.Install(ptpTest, nodes, interfaces, ptpTopology);
+
+  for(uint32_t i = 0; i < nUsers; i++) {
     // Create Socket for simulating network traffic
     // srcPort = (i + 1) * 1000;
     // dstPort = nUsers * 1000 + (i + 1);
     // Ptr<Socket> rxTrafficSocket = Socket::CreateSocket(nodes.Get(i), tcpId);
-    // rxTrafficSocket->Bind(InetSocketAddress(ipv4Address[i], srcPort));
-    // rxTrafficSocket->Connect(InetSocketAddress(ipv4Address[nUsers], dstPort));
+    // rxTrafficSocket->Bind(InetSocketAddress(interfaces.GetAddress(i), srcPort));
+    // rxTrafficSocket->Connect(InetSocketAddress(interfaces.GetAddress(nUsers), dstPort));
     // rxTrafficSocket->SetAcceptCallback(
     //   MakeNullCallback<bool, Ptr<Socket>, const Address &> (),
     //   MakeNullCallback<void, Ptr<Socket>, const Address &> ()
@@ -232,18 +251,18 @@ int main(int argc, char **argv) {
     //   MakeCallback(&PTPNetwork::recvTcpTraffic, &ptpTest)
     // );
     // Ptr<Socket> txTrafficSocket = Socket::CreateSocket(nodes.Get(nUsers), tcpId);
-    // txTrafficSocket->Bind(InetSocketAddress(ipv4Address[nUsers], dstPort));
-    // txTrafficSocket->Connect(InetSocketAddress(ipv4Address[i], srcPort));
+    // txTrafficSocket->Bind(InetSocketAddress(interfaces.GetAddress(nUsers), dstPort));
+    // txTrafficSocket->Connect(InetSocketAddress(interfaces.GetAddress(i), srcPort));
     // txTrafficSocket->SetRecvCallback(
     //   MakeCallback(&PTPNetwork::recvTcpTraffic, &ptpTest)
     // );
     // ptpTest.addTrafficSocket(
     //   new SocketLink(
-    //     nUsers, i, ipv4Address[nUsers], dstPort, ipv4Address[i], srcPort,
+    //     nUsers, i, interfaces.GetAddress(nUsers), dstPort, interfaces.GetAddress(i), srcPort,
     //     txTrafficSocket
     //   ),
     //   new SocketLink(
-    //     i, nUsers, ipv4Address[i], srcPort, ipv4Address[nUsers], dstPort,
+    //     i, nUsers, interfaces.GetAddress(i), srcPort, interfaces.GetAddress(nUsers), dstPort,
     //     rxTrafficSocket
     //   )
     // );
@@ -253,22 +272,29 @@ int main(int argc, char **argv) {
   // Pcap tracing
   wifiPhy.EnablePcap ("ptp-wifi-broadcast", devices);
 
-  AnimationInterface anim(logdir + "ptp-test.xml");
-  anim.SetConstantPosition(nodes.Get(0), 0.0, 15.0);
-  anim.SetConstantPosition(nodes.Get(1), 4.0, 15.0);
-  anim.SetConstantPosition(nodes.Get(2), 8.0, 15.0);
-  anim.SetConstantPosition(nodes.Get(3), 12.0, 15.0);
-  anim.SetConstantPosition(nodes.Get(4), 16.0, 15.0);
-  anim.SetConstantPosition(nodes.Get(5), 20.0, 15.0);
-  anim.SetConstantPosition(nodes.Get(6), 10.0, 5.0);
-  anim.EnablePacketMetadata(true);
-  int clkOffsetCounterId = anim.AddNodeCounter(
-    "offset_error", AnimationInterface::DOUBLE_COUNTER
-  );
-  ptpTest.setAnimationInterface(
-    &anim, clkOffsetCounterId
-  );
-  ptpTest.setSimulationIterations(2);
+  // NetAnim trace, the offset errors published by the OffsetError trace
+  AnimationInterface *anim = NULL;
+  PtpAnimationCounter *animCounter = NULL;
+  PtpOffsetErrorSampler *animSampler = NULL;
+  if(animation) {
+    anim = new AnimationInterface(logdir + "ptp-test.xml");
+    for(uint32_t i = 0; i < nUsers; i++) {
+      anim->SetConstantPosition(nodes.Get(i), 4.0 * i, 15.0);
+    }
+    anim->SetConstantPosition(nodes.Get(nUsers), 2.0 * (nUsers - 1), 5.0);
+    anim->EnablePacketMetadata(true);
+    animCounter = new PtpAnimationCounter(
+      anim, anim->AddNodeCounter("offset_error", AnimationInterface::DOUBLE_COUNTER)
+    );
+    animSampler = new PtpOffsetErrorSampler();
+    animSampler->SetSink(animCounter->getCallback());
+    animSampler->SetSamplePeriod(animSamplePeriod);
+    if(animPerRound) {
+      animSampler->SetBatchInterval(interPacketInterval);
+    }
+    ptpTest.connectOffsetErrorTrace(animSampler->GetCallback());
+  }
+  ptpTest.setSimulationIterations(iterations);
   
   // Simulator::ScheduleWithContext(
   //   nUsers, Seconds(1.0), &PTPNetwork::startTcpTraffic, &ptpTest,
@@ -276,13 +302,22 @@ int main(int argc, char **argv) {
   // );
 
   Simulator::ScheduleWithContext(
-    neighbor[0][0]->GetNode()->GetId(),
+    nodes.Get(0)->GetId(),
     Seconds(1.0),
     &PTPNetwork::startPTPProtocol,
     &ptpTest
   );
+  if(failGrandmaster >= 0) {
+    Simulator::Schedule(
+      Seconds(1.0 + failGrandmaster), &PTPNetwork::failGrandmaster, &ptpTest
+    );
+  }
 
   Simulator::Run();
+  ptpTest.closeLogs();
   Simulator::Destroy();
+  delete animSampler;
+  delete animCounter;
+  delete anim;
   return 0;
 }
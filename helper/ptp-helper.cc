@@ -1,11 +1,589 @@
 /* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
 
 #include "ptp-helper.h"
+#include "ns3/log.h"
+#include "ns3/socket.h"
+#include "ns3/inet-socket-address.h"
+#include "ns3/ipv4.h"
+#include "ns3/ipv4-static-routing-helper.h"
+#include <cmath>
+#include <deque>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
 
 namespace ns3 {
 
-/* ... */
+NS_LOG_COMPONENT_DEFINE ("PtpHelper");
 
+PtpTopology::PtpTopology (uint32_t nNodes)
+  : m_adjacency (nNodes),
+    m_nLinks (0)
+{
+}
+
+PtpTopology
+PtpTopology::Star (uint32_t nNodes, uint32_t root)
+{
+  PtpTopology topology (nNodes);
+  if (nNodes == 0)
+    {
+      return topology;
+    }
+  NS_ABORT_MSG_IF (root >= nNodes, "Star root " << root << " out of range");
+  topology.m_adjacency[root].reserve (nNodes - 1);
+  for (uint32_t i = 0; i < nNodes; i++)
+    {
+      if (i != root)
+        {
+          topology.AddLink (root, i);
+        }
+    }
+  return topology;
+}
+
+PtpTopology
+PtpTopology::Chain (uint32_t nNodes)
+{
+  PtpTopology topology (nNodes);
+  for (uint32_t i = 0; i + 1 < nNodes; i++)
+    {
+      topology.AddLink (i, i + 1);
+    }
+  return topology;
+}
+
+PtpTopology
+PtpTopology::Tree (uint32_t nNodes, uint32_t fanout)
+{
+  NS_ABORT_MSG_IF (fanout == 0, "Tree fanout must be positive");
+  PtpTopology topology (nNodes);
+  for (uint32_t i = 1; i < nNodes; i++)
+    {
+      topology.AddLink ((i - 1) / fanout, i);
+    }
+  return topology;
+}
+
+PtpTopology
+PtpTopology::Mesh (uint32_t nNodes, uint32_t columns)
+{
+  if (columns == 0)
+    {
+      columns = (uint32_t) std::ceil (std::sqrt ((double) nNodes));
+    }
+  PtpTopology topology (nNodes);
+  for (uint32_t i = 0; i < nNodes; i++)
+    {
+      if ((i + 1) % columns != 0 && i + 1 < nNodes)
+        {
+          topology.AddLink (i, i + 1);
+        }
+      if (i + columns < nNodes)
+        {
+          topology.AddLink (i, i + columns);
+        }
+    }
+  return topology;
+}
+
+PtpTopology
+PtpTopology::FromAdjacencyList (const std::vector<std::vector<uint32_t> > &adjacency)
+{
+  PtpTopology topology (adjacency.size ());
+  uint32_t nEntries = 0;
+  for (uint32_t i = 0; i < adjacency.size (); i++)
+    {
+      for (uint32_t j = 0; j < adjacency[i].size (); j++)
+        {
+          NS_ABORT_MSG_IF (adjacency[i][j] >= adjacency.size (),
+                           "Node " << i << " lists unknown neighbor " << adjacency[i][j]);
+        }
+      topology.m_adjacency[i] = adjacency[i];
+      nEntries += adjacency[i].size ();
+    }
+  topology.m_nLinks = nEntries / 2;
+  return topology;
+}
+
+bool
+PtpTopology::LoadAdjacencyList (std::string filename, PtpTopology &topology)
+{
+  std::ifstream file (filename.c_str ());
+  if (!file.is_open ())
+    {
+      NS_LOG_ERROR ("Failed to open topology file " << filename);
+      return false;
+    }
+  std::vector<std::vector<uint32_t> > adjacency;
+  std::string line;
+  while (std::getline (file, line))
+    {
+      if (!line.empty () && line[0] == '#')
+        {
+          continue;
+        }
+      std::istringstream neighbors (line);
+      std::vector<uint32_t> list;
+      uint32_t neighbor;
+      while (neighbors >> neighbor)
+        {
+          list.push_back (neighbor);
+        }
+      adjacency.push_back (list);
+    }
+  topology = FromAdjacencyList (adjacency);
+  return true;
+}
+
+void
+PtpTopology::AddLink (uint32_t a, uint32_t b)
+{
+  NS_ABORT_MSG_IF (a >= m_adjacency.size () || b >= m_adjacency.size (),
+                   "Link " << a << " - " << b << " out of range");
+  m_adjacency[a].push_back (b);
+  m_adjacency[b].push_back (a);
+  m_nLinks++;
+}
+
+uint32_t
+PtpTopology::GetNNodes (void) const
+{
+  return m_adjacency.size ();
+}
+
+uint32_t
+PtpTopology::GetNLinks (void) const
+{
+  return m_nLinks;
+}
+
+const std::vector<uint32_t> &
+PtpTopology::GetNeighbors (uint32_t node) const
+{
+  return m_adjacency[node];
+}
+
+bool
+PtpTopology::GetSpanningTree (uint32_t root, std::vector<uint32_t> &parent,
+                              std::vector<uint16_t> &hop) const
+{
+  uint32_t nNodes = m_adjacency.size ();
+  parent.assign (nNodes, nNodes);
+  hop.assign (nNodes, 0);
+  parent[root] = root;
+  uint32_t reached = 1;
+  std::deque<uint32_t> queue;
+  queue.push_back (root);
+  while (!queue.empty ())
+    {
+      uint32_t node = queue.front ();
+      queue.pop_front ();
+      for (uint32_t j = 0; j < m_adjacency[node].size (); j++)
+        {
+          uint32_t neighbor = m_adjacency[node][j];
+          if (parent[neighbor] == nNodes)
+            {
+              parent[neighbor] = node;
+              hop[neighbor] = hop[node] + 1;
+              reached++;
+              queue.push_back (neighbor);
+            }
+        }
+    }
+  return reached == nNodes;
+}
+
+bool
+PtpTopology::GetPartition (uint32_t root, uint32_t nParts,
+                           std::vector<uint32_t> &part) const
+{
+  uint32_t nNodes = m_adjacency.size ();
+  std::vector<uint32_t> parent;
+  std::vector<uint16_t> hop;
+  if (nParts == 0 || !GetSpanningTree (root, parent, hop))
+    {
+      return false;
+    }
+  std::vector<std::vector<uint32_t> > children (nNodes);
+  for (uint32_t i = 0; i < nNodes; i++)
+    {
+      if (i != root)
+        {
+          children[parent[i]].push_back (i);
+        }
+    }
+  // Depth-first order of the tree, without recursion for deep chains
+  part.assign (nNodes, 0);
+  uint32_t visited = 0;
+  std::vector<uint32_t> stack (1, root);
+  while (!stack.empty ())
+    {
+      uint32_t node = stack.back ();
+      stack.pop_back ();
+      part[node] = (uint32_t) ((uint64_t) visited * nParts / nNodes);
+      visited++;
+      for (uint32_t j = children[node].size (); j > 0; j--)
+        {
+          stack.push_back (children[node][j - 1]);
+        }
+    }
+  return true;
+}
+
+PtpHelper::PtpHelper ()
+  : m_basePort (100),
+    m_master (0),
+    m_syncMode (SYNC_UNICAST),
+    m_groupPort (319),
+    m_servoType (SERVO_STEP),
+    m_adaptiveSyncInterval (false),
+    m_randomWalk (0),
+    m_phaseNoise (0),
+    m_aging (0),
+    m_timestamping (false),
+    m_timestampMode (TIMESTAMP_APPLICATION)
+{
+}
+
+void
+PtpHelper::SetSyncMode (SyncMode mode)
+{
+  m_syncMode = mode;
+}
+
+void
+PtpHelper::SetGroupPort (uint16_t port)
+{
+  m_groupPort = port;
+}
+
+void
+PtpHelper::SetServo (ServoType type)
+{
+  m_servoType = type;
+}
+
+void
+PtpHelper::SetAdaptiveSyncInterval (Time minInterval, Time maxInterval)
+{
+  NS_ABORT_MSG_IF (minInterval > maxInterval, "Sync interval range is empty");
+  m_adaptiveSyncInterval = true;
+  m_minSyncInterval = minInterval;
+  m_maxSyncInterval = maxInterval;
+}
+
+void
+PtpHelper::SetOscillatorNoise (double maxFrequencyOffset, double randomWalk,
+                               double phaseNoise, double aging)
+{
+  m_frequencyOffset = CreateObject<UniformRandomVariable> ();
+  m_frequencyOffset->SetAttribute ("Min", DoubleValue (-maxFrequencyOffset));
+  m_frequencyOffset->SetAttribute ("Max", DoubleValue (maxFrequencyOffset));
+  m_randomWalk = randomWalk;
+  m_phaseNoise = phaseNoise;
+  m_aging = aging;
+}
+
+void
+PtpHelper::SetTimestamping (PtpTimestampMode_t mode,
+                            Ptr<RandomVariableStream> latency)
+{
+  m_timestamping = true;
+  m_timestampMode = mode;
+  m_timestampLatency = latency;
+}
+
+void
+PtpHelper::SetBasePort (uint16_t port)
+{
+  m_basePort = port;
+}
+
+void
+PtpHelper::SetMaster (uint32_t index)
+{
+  m_master = index;
+}
+
+std::vector<PtpNode *>
+PtpHelper::Install (PTPNetwork &network,
+                    const NodeContainer &nodes,
+                    const Ipv4InterfaceContainer &interfaces,
+                    const PtpTopology &topology) const
+{
+  uint32_t nNodes = topology.GetNNodes ();
+  NS_ABORT_MSG_IF (nodes.GetN () < nNodes || interfaces.GetN () < nNodes,
+                   "Topology has more nodes than the node or interface container");
+  // Node IDs are 16-bit, the largest one stands for the group
+  NS_ABORT_MSG_IF (nNodes > PTP_GROUP_NODE_ID,
+                   "Topology has more than " << PTP_GROUP_NODE_ID << " nodes");
+  NS_ABORT_MSG_IF (m_master >= nNodes, "Master node " << m_master << " out of range");
+  // Node IDs are indices into the network's node list
+  NS_ABORT_MSG_IF (network.getNumNodes () != 0, "PTP network already has nodes");
+
+  std::vector<uint32_t> parent;
+  std::vector<uint16_t> hop;
+  NS_ABORT_MSG_UNLESS (topology.GetSpanningTree (m_master, parent, hop),
+                       "Some nodes cannot reach master node " << m_master);
+
+  // Port of the socket of node b towards node a is basePort + (index of a
+  // in the neighbors of b), keyed by (b << 32 | a).
+  std::unordered_map<uint64_t, uint16_t> peerPort;
+  peerPort.reserve (2 * topology.GetNLinks ());
+  for (uint32_t i = 0; i < nNodes; i++)
+    {
+      const std::vector<uint32_t> &neighbors = topology.GetNeighbors (i);
+      NS_ABORT_MSG_IF (neighbors.size () > 65535u - m_basePort,
+                       "Node " << i << " has too many neighbors for base port " << m_basePort);
+      for (uint32_t j = 0; j < neighbors.size (); j++)
+        {
+          peerPort[((uint64_t) i << 32) | neighbors[j]] = m_basePort + j;
+        }
+    }
+
+  std::vector<PtpNode *> ptpNodes;
+  ptpNodes.reserve (nNodes);
+  network.reserve (nNodes, 2 * topology.GetNLinks ()
+                   + (m_syncMode != SYNC_UNICAST ? nNodes : 0));
+  network.setMasterIndex (m_master);
+  TypeId tid = TypeId::LookupByName ("ns3::UdpSocketFactory");
+  for (uint32_t i = 0; i < nNodes; i++)
+    {
+      Ipv4Address hostIp = interfaces.GetAddress (i);
+      PtpNode *ptpNode = new PtpNode (i, parent[i], hop[i], hostIp);
+      const std::vector<uint32_t> &neighbors = topology.GetNeighbors (i);
+      ptpNode->reserveNeighbors (neighbors.size ());
+      if (m_servoType == SERVO_PI)
+        {
+          ptpNode->setServo (Create<PtpPiServo> ());
+        }
+      if (m_frequencyOffset)
+        {
+          ptpNode->setOscillator (
+            Create<PtpNoisyOscillator> (m_frequencyOffset->GetValue (),
+                                        m_randomWalk, m_phaseNoise, m_aging));
+        }
+      if (m_adaptiveSyncInterval)
+        {
+          ptpNode->setSyncIntervalPolicy (
+            Create<PtpAdaptiveSyncInterval> (m_minSyncInterval, m_maxSyncInterval));
+        }
+      for (uint32_t j = 0; j < neighbors.size (); j++)
+        {
+          uint32_t dst = neighbors[j];
+          uint16_t hostPort = m_basePort + j;
+          std::unordered_map<uint64_t, uint16_t>::const_iterator it =
+            peerPort.find (((uint64_t) dst << 32) | i);
+          NS_ABORT_MSG_IF (it == peerPort.end (),
+                           "Link " << i << " - " << dst << " is not listed by node " << dst);
+          uint16_t dstPort = it->second;
+          Ipv4Address dstIp = interfaces.GetAddress (dst);
+
+          Ptr<Socket> socket = Socket::CreateSocket (nodes.Get (i), tid);
+          socket->Bind (InetSocketAddress (hostIp, hostPort));
+          socket->Connect (InetSocketAddress (dstIp, dstPort));
+          socket->SetRecvCallback (MakeCallback (&PTPNetwork::receivePacket, &network));
+          SocketLink *socketLink = new SocketLink (i, dst, hostIp, hostPort,
+                                                   dstIp, dstPort, socket);
+          ptpNode->addNeighbor (dst, socketLink);
+          network.addSocketLink (socketLink);
+          NS_LOG_INFO ("[PTP Socket] Node " << i << " " << hostIp << ":" << hostPort
+                       << " --> Node " << dst << " " << dstIp << ":" << dstPort);
+        }
+      if (m_syncMode != SYNC_UNICAST)
+        {
+          InstallGroupSockets (network, nodes.Get (i), interfaces, i);
+        }
+      network.addNode (ptpNode);
+      if (m_timestamping)
+        {
+          Ptr<PtpTimestamper> timestamper = Create<PtpTimestamper> (ptpNode, m_timestampMode);
+          timestamper->setLatency (m_timestampLatency);
+          timestamper->install (nodes.Get (i));
+          network.setTimestamper (i, timestamper);
+        }
+      ptpNodes.push_back (ptpNode);
+    }
+  return ptpNodes;
+}
+
+void
+PtpHelper::InstallGroupSockets (PTPNetwork &network, Ptr<Node> node,
+                                const Ipv4InterfaceContainer &interfaces,
+                                uint32_t i) const
+{
+  TypeId tid = TypeId::LookupByName ("ns3::UdpSocketFactory");
+  Ipv4Address hostIp = interfaces.GetAddress (i);
+  Ipv4Address groupIp = Ipv4Address::GetBroadcast ();
+  if (m_syncMode == SYNC_MULTICAST)
+    {
+      groupIp = Ipv4Address ("224.0.1.129");
+      // Send multicast out of the PTP interface
+      std::pair<Ptr<Ipv4>, uint32_t> interface = interfaces.Get (i);
+      Ipv4StaticRoutingHelper multicast;
+      multicast.SetDefaultMulticastRoute (
+        node, interface.first->GetNetDevice (interface.second));
+    }
+
+  // The sending socket takes an ephemeral port so the group port stays
+  // free for the receiving socket
+  Ptr<Socket> txSocket = Socket::CreateSocket (node, tid);
+  txSocket->SetAllowBroadcast (true);
+  txSocket->Bind (InetSocketAddress (hostIp, 0));
+  txSocket->Connect (InetSocketAddress (groupIp, m_groupPort));
+  network.addGroupSocketLink (new SocketLink (i, PTP_GROUP_NODE_ID, hostIp, 0,
+                                              groupIp, m_groupPort, txSocket));
+
+  Ptr<Socket> rxSocket = Socket::CreateSocket (node, tid);
+  rxSocket->Bind (InetSocketAddress (Ipv4Address::GetAny (), m_groupPort));
+  rxSocket->SetRecvCallback (MakeCallback (&PTPNetwork::receivePacket, &network));
+  network.addSocketLink (new SocketLink (i, PTP_GROUP_NODE_ID, hostIp, m_groupPort,
+                                         groupIp, m_groupPort, rxSocket));
+}
+
+PtpApplicationHelper::PtpApplicationHelper ()
+  : m_master (0),
+    m_partitioned (false),
+    m_systemId (0)
+{
+  m_factory.SetTypeId ("ns3::PtpApplication");
+}
+
+void
+PtpApplicationHelper::SetAttribute (std::string name, const AttributeValue &value)
+{
+  m_factory.Set (name, value);
+}
+
+void
+PtpApplicationHelper::SetMaster (uint32_t index)
+{
+  m_master = index;
+}
+
+void
+PtpApplicationHelper::SetSystemId (uint32_t systemId)
+{
+  m_partitioned = true;
+  m_systemId = systemId;
+}
+
+ApplicationContainer
+PtpApplicationHelper::Install (const NodeContainer &nodes,
+                               const Ipv4InterfaceContainer &interfaces,
+                               const PtpTopology &topology) const
+{
+  uint32_t nNodes = topology.GetNNodes ();
+  NS_ABORT_MSG_IF (nodes.GetN () < nNodes || interfaces.GetN () < nNodes,
+                   "Topology has more nodes than the containers");
+  NS_ABORT_MSG_IF (nNodes > PTP_GROUP_NODE_ID,
+                   "Topology has more than " << PTP_GROUP_NODE_ID << " nodes");
+  std::vector<uint32_t> parent;
+  std::vector<uint16_t> hop;
+  NS_ABORT_MSG_UNLESS (topology.GetSpanningTree (m_master, parent, hop),
+                       "Some nodes cannot reach master node " << m_master);
+
+  ApplicationContainer apps;
+  for (uint32_t i = 0; i < nNodes; i++)
+    {
+      // The node runs on another rank, which installs its application
+      if (m_partitioned && nodes.Get (i)->GetSystemId () != m_systemId)
+        {
+          continue;
+        }
+      Ptr<PtpApplication> app = m_factory.Create<PtpApplication> ();
+      app->SetAttribute ("NodeId", UintegerValue (i));
+      app->SetAttribute ("MasterId", UintegerValue (parent[i]));
+      app->SetAttribute ("Role", EnumValue (i == m_master ? PTP_ROLE_GRANDMASTER
+                                                          : PTP_ROLE_SLAVE));
+      // Tree links only: the parent and the children of the node
+      const std::vector<uint32_t> &neighbors = topology.GetNeighbors (i);
+      for (uint32_t j = 0; j < neighbors.size (); j++)
+        {
+          uint32_t peer = neighbors[j];
+          if ((i != m_master && peer == parent[i]) || (peer != m_master && parent[peer] == i))
+            {
+              app->addPeer (peer, interfaces.GetAddress (peer));
+            }
+        }
+      nodes.Get (i)->AddApplication (app);
+      apps.Add (app);
+    }
+  return apps;
+}
+
+PtpOffsetErrorSampler::PtpOffsetErrorSampler ()
+  : m_samplePeriod (1),
+    m_batchInterval (Seconds (0)),
+    m_flushScheduled (false)
+{
+}
+
+void
+PtpOffsetErrorSampler::SetSink (Callback<void, uint16_t, double> sink)
+{
+  m_sink = sink;
+}
+
+void
+PtpOffsetErrorSampler::SetSamplePeriod (uint32_t period)
+{
+  m_samplePeriod = (period == 0) ? 1 : period;
+}
+
+void
+PtpOffsetErrorSampler::SetBatchInterval (Time interval)
+{
+  m_batchInterval = interval;
+}
+
+void
+PtpOffsetErrorSampler::OffsetErrorChanged (uint16_t nodeId, double offsetError)
+{
+  if (nodeId >= m_syncCount.size ())
+    {
+      m_syncCount.resize (nodeId + 1, 0);
+      m_pending.resize (nodeId + 1, 0);
+      m_isPending.resize (nodeId + 1, false);
+    }
+  if (m_syncCount[nodeId]++ % m_samplePeriod != 0 || m_sink.IsNull ())
+    {
+      return;
+    }
+  if (!m_batchInterval.IsStrictlyPositive ())
+    {
+      m_sink (nodeId, offsetError);
+      return;
+    }
+  m_pending[nodeId] = offsetError;
+  m_isPending[nodeId] = true;
+  if (!m_flushScheduled)
+    {
+      m_flushScheduled = true;
+      Simulator::Schedule (m_batchInterval, &PtpOffsetErrorSampler::Flush, this);
+    }
+}
+
+Callback<void, uint16_t, double>
+PtpOffsetErrorSampler::GetCallback (void)
+{
+  return MakeCallback (&PtpOffsetErrorSampler::OffsetErrorChanged, this);
+}
+
+void
+PtpOffsetErrorSampler::Flush (void)
+{
+  m_flushScheduled = false;
+  for (uint32_t i = 0; i < m_isPending.size (); i++)
+    {
+      if (m_isPending[i])
+        {
+          m_isPending[i] = false;
+          m_sink (i, m_pending[i]);
+        }
+    }
+}
 
 }
 
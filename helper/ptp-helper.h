@@ -2,9 +2,371 @@
 #ifndef PTP_HELPER_H
 #define PTP_HELPER_H
 
+#include "ns3/node-container.h"
+#include "ns3/ipv4-interface-container.h"
+#include "ns3/application-container.h"
+#include "ns3/object-factory.h"
+#include "ns3/ptp-network.h"
+#include "ns3/ptp-node.h"
+#include "ns3/ptp-application.h"
+#include <string>
+#include <vector>
+
 namespace ns3 {
 
-/* ... */
+/**
+ * \brief Undirected graph of the PTP links between nodes
+ *
+ * Node i of the topology is the i-th node of the NodeContainer passed to
+ * PtpHelper::Install.
+ */
+class PtpTopology
+{
+public:
+  /**
+   * \brief Create a topology of isolated nodes
+   *
+   * \param nNodes Number of nodes
+   */
+  PtpTopology (uint32_t nNodes = 0);
+
+  /**
+   * \brief Every node is linked to the root node
+   */
+  static PtpTopology Star (uint32_t nNodes, uint32_t root = 0);
+
+  /**
+   * \brief Node i is linked to node i + 1
+   */
+  static PtpTopology Chain (uint32_t nNodes);
+
+  /**
+   * \brief Complete tree rooted at node 0; node i is linked to its parent
+   * (i - 1) / fanout
+   */
+  static PtpTopology Tree (uint32_t nNodes, uint32_t fanout);
+
+  /**
+   * \brief Grid mesh: nodes fill rows of `columns` nodes (the smallest
+   * width of a square by default), each linked to its right and lower
+   * neighbor
+   */
+  static PtpTopology Mesh (uint32_t nNodes, uint32_t columns = 0);
+
+  /**
+   * \brief Topology from adjacency lists
+   *
+   * \param adjacency adjacency[i] lists the neighbors of node i. Each link
+   * has to be listed from both ends.
+   */
+  static PtpTopology FromAdjacencyList (const std::vector<std::vector<uint32_t> > &adjacency);
+
+  /**
+   * \brief Read adjacency lists from a text file
+   *
+   * Line i lists the neighbors of node i, separated by spaces. Lines
+   * starting with '#' are skipped.
+   *
+   * \param filename
+   * \param topology The topology read
+   * \return false if the file cannot be read.
+   */
+  static bool LoadAdjacencyList (std::string filename, PtpTopology &topology);
+
+  /**
+   * \brief Link node a and node b
+   */
+  void AddLink (uint32_t a, uint32_t b);
+
+  uint32_t GetNNodes (void) const;
+
+  /**
+   * \brief Number of undirected links
+   */
+  uint32_t GetNLinks (void) const;
+
+  const std::vector<uint32_t> &GetNeighbors (uint32_t node) const;
+
+  /**
+   * \brief Breadth-first spanning tree from the root
+   *
+   * \param root Node providing the master clock
+   * \param parent The master of each node (the root is its own master)
+   * \param hop Number of hops from each node to the root
+   * \return false if some node cannot reach the root.
+   */
+  bool GetSpanningTree (uint32_t root, std::vector<uint32_t> &parent,
+                        std::vector<uint16_t> &hop) const;
+
+  /**
+   * \brief Split the nodes into parts of equal size for the distributed
+   * simulator
+   *
+   * Parts are contiguous blocks of the depth-first order of the spanning
+   * tree, so each part holds whole subtrees and few tree links cross parts.
+   *
+   * \param root Node providing the master clock
+   * \param nParts Number of parts (MPI ranks)
+   * \param part The part (system ID) of each node
+   * \return false if some node cannot reach the root.
+   */
+  bool GetPartition (uint32_t root, uint32_t nParts,
+                     std::vector<uint32_t> &part) const;
+
+private:
+  std::vector<std::vector<uint32_t> > m_adjacency; //!< Neighbors of each node
+  uint32_t m_nLinks; //!< Number of undirected links
+};
+
+/**
+ * \brief Build the PTP overlay of a network
+ *
+ * For every link of a PtpTopology the helper opens one connected UDP
+ * socket at each end, wraps it into a SocketLink and registers it with the
+ * PTPNetwork and the PtpNode. The socket of node i towards its j-th
+ * neighbor is bound to port basePort + j, so one node may have up to
+ * 65535 - basePort neighbors. The master and hop of each node follow the
+ * breadth-first spanning tree rooted at the master node.
+ *
+ * In multicast and broadcast mode every node also gets a group socket
+ * sending SYNC and FOLLOW to 224.0.1.129 (or 255.255.255.255) on the
+ * group port, and a socket receiving on that port. DREQ and DRPLY stay
+ * unicast.
+ */
+class PtpHelper
+{
+public:
+  /**
+   * \brief How SYNC and FOLLOW messages are sent
+   */
+  enum SyncMode
+  {
+    SYNC_UNICAST, //!< One copy per neighbor
+    SYNC_MULTICAST, //!< One copy to the IEEE 1588 multicast group 224.0.1.129
+    SYNC_BROADCAST //!< One copy to the IPv4 limited broadcast address
+  };
+
+  /**
+   * \brief Clock servo of the slave nodes
+   */
+  enum ServoType
+  {
+    SERVO_STEP, //!< Step the clock by every offset (PtpStepServo)
+    SERVO_PI //!< Correct the frequency with a PI controller (PtpPiServo)
+  };
+
+  PtpHelper ();
+
+  /**
+   * \brief Select how SYNC and FOLLOW messages are sent
+   */
+  void SetSyncMode (SyncMode mode);
+
+  /**
+   * \brief Set the UDP port of multicast and broadcast SYNC and FOLLOW
+   * messages (the IEEE 1588 event port, 319, by default)
+   */
+  void SetGroupPort (uint16_t port);
+
+  /**
+   * \brief Select the clock servo created for every node
+   */
+  void SetServo (ServoType type);
+
+  /**
+   * \brief Let every node adapt its sync interval between minInterval and
+   * maxInterval (PtpAdaptiveSyncInterval)
+   */
+  void SetAdaptiveSyncInterval (Time minInterval, Time maxInterval);
+
+  /**
+   * \brief Drive every node by a PtpNoisyOscillator instead of the default
+   * constant rate oscillator
+   *
+   * \param maxFrequencyOffset Frequency offsets are drawn uniformly from
+   * [-maxFrequencyOffset, maxFrequencyOffset] ppm
+   * \param randomWalk Frequency random walk after one second in ppb
+   * \param phaseNoise White phase noise in ns
+   * \param aging Frequency drift in ppb per day
+   */
+  void SetOscillatorNoise (double maxFrequencyOffset, double randomWalk,
+                           double phaseNoise, double aging);
+
+  /**
+   * \brief Time stamp event messages at the network devices of every node
+   * (PtpTimestamper) instead of in the application
+   *
+   * \param mode Time stamp point
+   * \param latency Nanoseconds from the time stamp point to software and
+   * application time stamps, or null for none
+   */
+  void SetTimestamping (PtpTimestampMode_t mode,
+                        Ptr<RandomVariableStream> latency = Ptr<RandomVariableStream> ());
+
+  /**
+   * \brief Set the first UDP port used by PTP sockets on each node
+   */
+  void SetBasePort (uint16_t port);
+
+  /**
+   * \brief Set the index of the node providing the master clock
+   */
+  void SetMaster (uint32_t index);
+
+  /**
+   * \brief Create the PtpNodes, sockets and socket links of a topology
+   *
+   * The network must not have any node yet: the ID of each PtpNode is its
+   * index in the topology.
+   *
+   * \param network The PTP network receiving the nodes and socket links
+   * \param nodes Node i of the topology is nodes.Get (i)
+   * \param interfaces Node i of the topology uses interfaces.GetAddress (i)
+   * \param topology Links between PTP nodes
+   * \return The PtpNodes created, indexed by node ID
+   */
+  std::vector<PtpNode *> Install (PTPNetwork &network,
+                                  const NodeContainer &nodes,
+                                  const Ipv4InterfaceContainer &interfaces,
+                                  const PtpTopology &topology) const;
+
+private:
+  /**
+   * \brief Create the group sockets of node i
+   */
+  void InstallGroupSockets (PTPNetwork &network, Ptr<Node> node,
+                            const Ipv4InterfaceContainer &interfaces,
+                            uint32_t i) const;
+
+  uint16_t m_basePort; //!< Port of the socket towards the first neighbor
+  uint32_t m_master; //!< Index of the master node
+  SyncMode m_syncMode; //!< How SYNC and FOLLOW messages are sent
+  uint16_t m_groupPort; //!< Port of multicast and broadcast messages
+  ServoType m_servoType; //!< Clock servo of every node
+  bool m_adaptiveSyncInterval; //!< Whether nodes adapt their sync interval
+  Time m_minSyncInterval; //!< Sync interval of a disturbed node
+  Time m_maxSyncInterval; //!< Sync interval of a converged node
+  Ptr<UniformRandomVariable> m_frequencyOffset; //!< Frequency offsets of noisy oscillators, null for the default oscillator
+  double m_randomWalk; //!< Frequency random walk of noisy oscillators (ppb)
+  double m_phaseNoise; //!< White phase noise of noisy oscillators (ns)
+  double m_aging; //!< Aging of noisy oscillators (ppb per day)
+  bool m_timestamping; //!< Whether nodes get a PtpTimestamper
+  PtpTimestampMode_t m_timestampMode; //!< Time stamp point of every node
+  Ptr<RandomVariableStream> m_timestampLatency; //!< Latency of software and application time stamps
+};
+
+/**
+ * \brief Install a PtpApplication on every node of a topology
+ *
+ * The master of each node and its peers follow the breadth-first spanning
+ * tree rooted at the master node: a node exchanges messages with its
+ * parent and its children only. Unlike PtpHelper, no PTPNetwork is
+ * involved; the applications own their clocks and sockets.
+ */
+class PtpApplicationHelper
+{
+public:
+  PtpApplicationHelper ();
+
+  /**
+   * \brief Set an attribute of every PtpApplication created
+   */
+  void SetAttribute (std::string name, const AttributeValue &value);
+
+  /**
+   * \brief Set the index of the node providing the master clock
+   */
+  void SetMaster (uint32_t index);
+
+  /**
+   * \brief Only install applications on the nodes of one system ID
+   *
+   * With the distributed simulator every rank builds the whole network but
+   * runs the applications of its own nodes only, so pass
+   * MpiInterface::GetSystemId () here.
+   */
+  void SetSystemId (uint32_t systemId);
+
+  /**
+   * \brief Create one PtpApplication per node of a topology
+   *
+   * \param nodes Node i of the topology is nodes.Get (i)
+   * \param interfaces Node i of the topology uses interfaces.GetAddress (i)
+   * \param topology Links between PTP nodes
+   * \return The applications, indexed by node ID unless a system ID is set
+   */
+  ApplicationContainer Install (const NodeContainer &nodes,
+                                const Ipv4InterfaceContainer &interfaces,
+                                const PtpTopology &topology) const;
+
+private:
+  ObjectFactory m_factory; //!< Factory of the applications
+  uint32_t m_master; //!< Index of the master node
+  bool m_partitioned; //!< Whether only nodes of m_systemId get applications
+  uint32_t m_systemId; //!< System ID (MPI rank) of the nodes to install on
+};
+
+/**
+ * \brief Thins out the offset errors published by PTPNetwork or
+ * PtpApplication before they reach a sink
+ *
+ * Every sync of a node reaches the sink by default. The offset errors can
+ * be sampled (one in every samplePeriod syncs of each node) or batched (the
+ * last sampled offset error of each node passed on once per batch interval,
+ * usually the sync interval), e.g. for a NetAnim node counter that writes
+ * one XML element per update.
+ */
+class PtpOffsetErrorSampler
+{
+public:
+  PtpOffsetErrorSampler ();
+
+  /**
+   * \brief Set the sink of the sampled offset errors
+   *
+   * \param sink Called with the PTP node ID and the offset error (ns)
+   */
+  void SetSink (Callback<void, uint16_t, double> sink);
+
+  /**
+   * \brief Pass on one in every period syncs of each node
+   *
+   * \param period 1 (default) passes on every sync
+   */
+  void SetSamplePeriod (uint32_t period);
+
+  /**
+   * \brief Pass on the sampled offset errors once per interval
+   *
+   * \param interval Zero (default) passes them on at once
+   */
+  void SetBatchInterval (Time interval);
+
+  /**
+   * \brief Trace sink of the offset error of a node after sync
+   */
+  void OffsetErrorChanged (uint16_t nodeId, double offsetError);
+
+  /**
+   * \brief Get the callback of OffsetErrorChanged, to connect to
+   * PTPNetwork::connectOffsetErrorTrace or the OffsetError trace source
+   */
+  Callback<void, uint16_t, double> GetCallback (void);
+
+private:
+  /**
+   * \brief Pass on the offset errors batched since the last flush
+   */
+  void Flush (void);
+
+  Callback<void, uint16_t, double> m_sink; //!< Sink of the sampled offset errors
+  uint32_t m_samplePeriod; //!< Syncs of a node per offset error passed on
+  Time m_batchInterval; //!< Interval between batches, zero for none
+  std::vector<uint32_t> m_syncCount; //!< Syncs of each node so far
+  std::vector<double> m_pending; //!< Last sampled offset error of each node
+  std::vector<bool> m_isPending; //!< Whether m_pending holds a value to pass on
+  bool m_flushScheduled; //!< Whether a flush is scheduled
+};
 
 }
 
@@ -0,0 +1,332 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors: Tinghui Wang <tinghui.wang@wsu.edu>
+ *
+ * This file implements the PTP stack of a single node as an ns-3
+ * application.
+ */
+
+#include "ns3/core-module.h"
+#include "ns3/internet-module.h"
+#include "ptp-application.h"
+#include "ptp-transparent-clock.h"
+#include <iostream>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("PtpApplication");
+
+NS_OBJECT_ENSURE_REGISTERED(PtpApplication);
+
+/* UDP and IPv4 headers of every PTP message */
+static const uint32_t PTP_UDP_IP_OVERHEAD = 28;
+
+TypeId PtpApplication::GetTypeId(void) {
+  static TypeId tid = TypeId("ns3::PtpApplication")
+    .SetParent<Application>()
+    .SetGroupName("Ptp")
+    .AddConstructor<PtpApplication>()
+    .AddAttribute("NodeId", "PTP node ID, unique in the network",
+                  UintegerValue(0),
+                  MakeUintegerAccessor(&PtpApplication::m_nodeId),
+                  MakeUintegerChecker<uint16_t>())
+    .AddAttribute("Role", "Grandmaster or slave",
+                  EnumValue(PTP_ROLE_SLAVE),
+                  MakeEnumAccessor(&PtpApplication::m_role),
+                  MakeEnumChecker(PTP_ROLE_GRANDMASTER, "Grandmaster",
+                                  PTP_ROLE_SLAVE, "Slave"))
+    .AddAttribute("MasterId", "Node ID of the peer a slave synchronizes to",
+                  UintegerValue(0),
+                  MakeUintegerAccessor(&PtpApplication::m_masterId),
+                  MakeUintegerChecker<uint16_t>())
+    .AddAttribute("Port", "UDP port of PTP messages",
+                  UintegerValue(319),
+                  MakeUintegerAccessor(&PtpApplication::m_port),
+                  MakeUintegerChecker<uint16_t>())
+    .AddAttribute("SyncInterval", "Interval between SYNC messages",
+                  TimeValue(Seconds(1.0)),
+                  MakeTimeAccessor(&PtpApplication::m_syncInterval),
+                  MakeTimeChecker())
+    .AddAttribute("OneStep", "SYNC carries its transmit time stamp, no FOLLOW",
+                  BooleanValue(false),
+                  MakeBooleanAccessor(&PtpApplication::m_oneStep),
+                  MakeBooleanChecker())
+    .AddAttribute("PiServo", "Correct the frequency with a PI servo instead of "
+                  "stepping the clock by every offset",
+                  BooleanValue(false),
+                  MakeBooleanAccessor(&PtpApplication::m_piServo),
+                  MakeBooleanChecker())
+    .AddTraceSource("OffsetError", "Offset error (ns) of the clock after each sync",
+                    MakeTraceSourceAccessor(&PtpApplication::m_offsetErrorTrace),
+                    "PtpApplication::OffsetErrorCallback");
+  return tid;
+}
+
+PtpApplication::PtpApplication()
+  : m_ptpNode(NULL),
+    m_serving(false),
+    m_eventId(0),
+    m_invalidPacketCount(0)
+{}
+
+PtpApplication::~PtpApplication() {
+  delete m_ptpNode;
+}
+
+void PtpApplication::addPeer(uint16_t nodeId, Ipv4Address address) {
+  PtpPeer_t peer;
+  peer.nodeId = nodeId;
+  peer.address = address;
+  m_peers.push_back(peer);
+}
+
+PtpNode *PtpApplication::getPtpNode() {
+  return m_ptpNode;
+}
+
+uint64_t PtpApplication::getInvalidPacketCount() {
+  return m_invalidPacketCount;
+}
+
+void PtpApplication::DoDispose(void) {
+  m_socket = NULL;
+  delete m_ptpNode;
+  m_ptpNode = NULL;
+  Application::DoDispose();
+}
+
+const PtpPeer_t *PtpApplication::findPeer(uint16_t nodeId) {
+  for(uint32_t i = 0; i < m_peers.size(); i++) {
+    if(m_peers[i].nodeId == nodeId) {
+      return &m_peers[i];
+    }
+  }
+  return NULL;
+}
+
+void PtpApplication::createPtpNode() {
+  Ipv4Address address;
+  Ptr<Ipv4> ipv4 = GetNode()->GetObject<Ipv4>();
+  if(ipv4 && ipv4->GetNInterfaces() > 1) {
+    address = ipv4->GetAddress(1, 0).GetLocal();
+  }
+  bool grandmaster = m_role == PTP_ROLE_GRANDMASTER;
+  // A slave that cannot reach its master would never get synchronized
+  NS_ABORT_MSG_IF(!grandmaster && findPeer(m_masterId) == NULL,
+    "Master " << m_masterId << " of node " << m_nodeId << " is not a peer");
+  m_ptpNode = new PtpNode(m_nodeId, grandmaster ? m_nodeId : m_masterId,
+                          grandmaster ? 0 : 1, address);
+  m_ptpNode->reserveNeighbors(m_peers.size());
+  for(uint32_t i = 0; i < m_peers.size(); i++) {
+    m_ptpNode->addNeighbor(m_peers[i].nodeId, NULL);
+  }
+  if(m_piServo) {
+    m_ptpNode->setServo(Create<PtpPiServo>());
+  }
+  m_ptpNode->setSyncInterval(m_syncInterval);
+  if(grandmaster) {
+    m_ptpNode->setGlobalMaster();
+    m_ptpNode->setState(SYNCED);
+  }
+}
+
+void PtpApplication::StartApplication(void) {
+  if(m_ptpNode == NULL) {
+    createPtpNode();
+  }
+  if(!m_socket) {
+    m_socket = Socket::CreateSocket(
+      GetNode(), TypeId::LookupByName("ns3::UdpSocketFactory")
+    );
+    if(m_socket->Bind(InetSocketAddress(Ipv4Address::GetAny(), m_port)) == -1) {
+      std::cerr << "[PtpApplication::StartApplication] Error: Node " <<
+        m_nodeId << " cannot bind port " << m_port << "." << std::endl;
+    }
+  }
+  m_socket->SetRecvCallback(MakeCallback(&PtpApplication::receivePacket, this));
+  if(m_role == PTP_ROLE_GRANDMASTER || m_ptpNode->getState() == SYNCED) {
+    m_serving = true;
+    sendPeriodicSync();
+  }
+}
+
+void PtpApplication::StopApplication(void) {
+  Simulator::Cancel(m_syncEvent);
+  m_serving = false;
+  if(m_socket) {
+    m_socket->Close();
+    m_socket->SetRecvCallback(MakeNullCallback<void, Ptr<Socket> >());
+    m_socket = NULL;
+  }
+}
+
+void PtpApplication::sendPeriodicSync() {
+  for(uint32_t i = 0; i < m_peers.size(); i++) {
+    if(m_role == PTP_ROLE_SLAVE && m_peers[i].nodeId == m_masterId) {
+      continue;
+    }
+    sendSyncFollowPacket(m_peers[i]);
+  }
+  m_eventId++;
+  m_syncEvent = Simulator::Schedule(
+    m_syncInterval, &PtpApplication::sendPeriodicSync, this
+  );
+}
+
+void PtpApplication::sendPacket(
+  const PtpPeer_t &peer, const PtpHeader &header, bool event
+) {
+  Ptr<Packet> packet = Create<Packet>();
+  packet->AddHeader(header);
+  if(event) {
+    packet->AddPacketTag(PtpCorrectionTag());
+  }
+  m_socket->SendTo(packet, 0, InetSocketAddress(peer.address, m_port));
+  m_ptpNode->incrementSentPacketCounter(
+    header.getMessageType(), header.GetSerializedSize() + PTP_UDP_IP_OVERHEAD
+  );
+}
+
+void PtpApplication::sendSyncFollowPacket(const PtpPeer_t &peer) {
+  uint64_t syncId = m_ptpNode->getNewSyncId(peer.nodeId);
+  PtpHeader syncHeader;
+  syncHeader.setTxNodeId(m_nodeId);
+  syncHeader.setMessageType(SYNC);
+  syncHeader.setEventId(m_eventId);
+  syncHeader.setSyncId(syncId);
+  if(m_oneStep) {
+    m_ptpNode->setSyncSendTimeStamp(m_ptpNode->getLocalTime(), peer.nodeId);
+    syncHeader.setTwoStep(false);
+  }
+  syncHeader.setTimeStamp(m_ptpNode->getSyncSendTimeStamp(peer.nodeId));
+  sendPacket(peer, syncHeader, true);
+  if(m_oneStep) {
+    return;
+  }
+
+  m_ptpNode->setSyncSendTimeStamp(m_ptpNode->getLocalTime(), peer.nodeId);
+  PtpHeader followHeader;
+  followHeader.setTxNodeId(m_nodeId);
+  followHeader.setMessageType(FOLLOW);
+  followHeader.setEventId(m_eventId);
+  followHeader.setSyncId(syncId);
+  followHeader.setTimeStamp(m_ptpNode->getSyncSendTimeStamp(peer.nodeId));
+  sendPacket(peer, followHeader, false);
+}
+
+void PtpApplication::sendDreqPacket() {
+  const PtpPeer_t *master = findPeer(m_masterId);
+  if(master == NULL) {
+    return;
+  }
+  PtpHeader dreqHeader;
+  dreqHeader.setTxNodeId(m_nodeId);
+  dreqHeader.setMessageType(DREQ);
+  dreqHeader.setEventId(m_eventId);
+  dreqHeader.setSyncId(m_ptpNode->getPtpSyncId(FOLLOW));
+  sendPacket(*master, dreqHeader, true);
+  m_ptpNode->setState(WAITING);
+  m_ptpNode->setDreqSendTime(m_ptpNode->getLocalTime());
+}
+
+void PtpApplication::sendDrplyPacket(const PtpPeer_t &peer) {
+  PtpHeader drplyHeader;
+  drplyHeader.setTxNodeId(m_nodeId);
+  drplyHeader.setMessageType(DRPLY);
+  drplyHeader.setEventId(m_eventId);
+  drplyHeader.setTimeStamp(m_ptpNode->getDreqRecvTimeStamp(peer.nodeId));
+  drplyHeader.setCorrection(m_ptpNode->getDreqRecvCorrection(peer.nodeId));
+  sendPacket(peer, drplyHeader, false);
+}
+
+void PtpApplication::receivePacket(Ptr<Socket> socket) {
+  Ptr<Packet> packet;
+  Address from;
+  while((packet = socket->RecvFrom(from))) {
+    PtpHeader header;
+    // Truncated messages on the PTP port
+    if(!PtpHeader::isComplete(packet)) {
+      m_invalidPacketCount++;
+      NS_LOG_WARN("Node " << m_nodeId << ": PTP message of " <<
+        packet->GetSize() << " Bytes is too short, dropped.");
+      continue;
+    }
+    packet->RemoveHeader(header);
+    // Foreign or corrupted packets on the PTP port
+    if(header.getMessageType() == PTP_INVALID_MESSAGE) {
+      m_invalidPacketCount++;
+      NS_LOG_WARN("Node " << m_nodeId << ": invalid PTP message dropped.");
+      continue;
+    }
+    PtpCorrectionTag correctionTag;
+    if(packet->PeekPacketTag(correctionTag)) {
+      header.setCorrection(header.getCorrection() + correctionTag.getCorrection());
+    }
+    uint16_t senderId = header.getTxNodeId();
+    const PtpPeer_t *peer = findPeer(senderId);
+    PtpMessageType_t type = header.getMessageType();
+    // Only the master of a slave drives its clock
+    if(peer == NULL || ((type == SYNC || type == FOLLOW || type == DRPLY) &&
+        (m_role == PTP_ROLE_GRANDMASTER || senderId != m_masterId))) {
+      m_ptpNode->increaseOverheardPacketCounter(type);
+      continue;
+    }
+
+    if(type == SYNC) {
+      m_ptpNode->setSyncRecvTime(m_ptpNode->getLocalTime());
+      m_ptpNode->setSyncCorrection(header.getCorrection());
+      m_ptpNode->increaseReceivedPacketCounter(SYNC);
+      m_ptpNode->setState(ACTIVE);
+      m_ptpNode->setPtpSyncId(SYNC, header.getSyncId());
+      if(!header.getTwoStep()) {
+        m_ptpNode->setSyncTimeAtMaster(header.getTimeStamp());
+        m_ptpNode->setPtpSyncId(FOLLOW, header.getSyncId());
+        sendDreqPacket();
+      }
+    } else if(type == FOLLOW) {
+      m_ptpNode->setSyncTimeAtMaster(header.getTimeStamp());
+      m_ptpNode->increaseReceivedPacketCounter(FOLLOW);
+      m_ptpNode->setPtpSyncId(FOLLOW, header.getSyncId());
+      if(m_ptpNode->getPtpSyncId(SYNC) == m_ptpNode->getPtpSyncId(FOLLOW)) {
+        sendDreqPacket();
+      }
+    } else if(type == DREQ) {
+      m_ptpNode->setDreqRecvTimeStamp(m_ptpNode->getLocalTime(), senderId);
+      m_ptpNode->setDreqRecvCorrection(header.getCorrection(), senderId);
+      m_ptpNode->increaseReceivedPacketCounter(DREQ);
+      sendDrplyPacket(*peer);
+    } else if(type == DRPLY) {
+      m_ptpNode->setDreqTimeAtMaster(header.getTimeStamp());
+      m_ptpNode->setDreqCorrection(header.getCorrection());
+      m_ptpNode->increaseReceivedPacketCounter(DRPLY);
+      // The grandmaster follows the simulator time
+      m_ptpNode->calculateOffset(Simulator::Now());
+      m_ptpNode->setState(SYNCED);
+      NS_LOG_DEBUG("Node " << m_nodeId << " synchronized, offset error " <<
+        m_ptpNode->getCurrentOffsetError() << " ns");
+      if(!m_offsetErrorTrace.IsEmpty()) {
+        m_offsetErrorTrace(m_nodeId, m_ptpNode->getCurrentOffsetError());
+      }
+      if(!m_serving) {
+        m_serving = true;
+        sendPeriodicSync();
+      }
+    } else {
+      // Peer delay and ANNOUNCE messages are only handled by PTPNetwork
+      m_ptpNode->increaseOverheardPacketCounter(type);
+    }
+  }
+}
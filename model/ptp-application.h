@@ -0,0 +1,171 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors: Tinghui Wang <tinghui.wang@wsu.edu>
+ *
+ * This file declares the PTP stack of a single node as an ns-3
+ * application.
+ *
+ */
+
+#ifndef PTP_APPLICATION_H
+#define PTP_APPLICATION_H
+
+#include "ns3/core-module.h"
+#include "ns3/application.h"
+#include "ns3/socket.h"
+#include "ns3/ipv4-address.h"
+#include <vector>
+#include "ptp-header.h"
+#include "ptp-node.h"
+
+using namespace ns3;
+
+/**
+ * @brief Role of a PtpApplication
+ * PTP_ROLE_GRANDMASTER: Follows the simulator time and serves its peers
+ * PTP_ROLE_SLAVE: Synchronizes to its master peer, then serves its other
+ * peers (a boundary clock if it has any)
+ */
+typedef enum {
+  PTP_ROLE_GRANDMASTER = 0,
+  PTP_ROLE_SLAVE
+} PtpRole_t;
+
+/**
+ * @brief Peer of a PtpApplication
+ */
+typedef struct {
+  uint16_t nodeId; //< PTP node ID of the peer
+  Ipv4Address address; //< Address the peer's application listens on
+} PtpPeer_t;
+
+/**
+ * @brief PTP stack of one node
+ *
+ * Unlike PTPNetwork, which runs the protocol of all nodes, the application
+ * runs on its own node and owns its PtpNode clock and its UDP socket, so it
+ * can be installed, started and stopped with an ApplicationContainer and
+ * frees everything when disposed.
+ *
+ * Messages are exchanged with the peers added with `addPeer`, all on the
+ * same UDP port. The master sends SYNC (and FOLLOW with two-step clocks)
+ * to every peer but its own master every sync interval, and each slave
+ * measures the end-to-end delay with DREQ and DRPLY. A slave serves its
+ * peers once it has synchronized itself.
+ */
+class PtpApplication : public Application {
+public:
+  static TypeId GetTypeId(void);
+
+  /**
+   * @brief Signature of the OffsetError trace: PTP node ID and offset
+   * error (ns) after a sync
+   */
+  typedef void (*OffsetErrorCallback)(uint16_t nodeId, double offsetError);
+
+  PtpApplication();
+  virtual ~PtpApplication();
+
+  /**
+   * @brief Add a peer before the application starts
+   *
+   * @param nodeId PTP node ID of the peer
+   * @param address Address of the peer
+   */
+  void addPeer(uint16_t nodeId, Ipv4Address address);
+
+  /**
+   * @brief Get the clock of the node, created when the application starts
+   *
+   * @return PtpNode* NULL before the start and after the application is
+   * disposed.
+   */
+  PtpNode *getPtpNode();
+
+  /**
+   * @brief Get the number of received packets dropped because they are
+   * truncated or their message type is unknown
+   */
+  uint64_t getInvalidPacketCount();
+
+protected:
+  virtual void DoDispose(void);
+
+private:
+  virtual void StartApplication(void);
+  virtual void StopApplication(void);
+
+  /**
+   * @brief Create the clock of the node
+   */
+  void createPtpNode();
+
+  /**
+   * @brief Send SYNC to every peer but the master and schedule the next
+   */
+  void sendPeriodicSync();
+
+  /**
+   * @brief Send SYNC, and FOLLOW for a two-step clock, to one peer
+   */
+  void sendSyncFollowPacket(const PtpPeer_t &peer);
+
+  /**
+   * @brief Send DREQ to the master
+   */
+  void sendDreqPacket();
+
+  /**
+   * @brief Answer the DREQ of a peer
+   */
+  void sendDrplyPacket(const PtpPeer_t &peer);
+
+  /**
+   * @brief Send a PTP message to a peer and count it
+   */
+  void sendPacket(const PtpPeer_t &peer, const PtpHeader &header, bool event);
+
+  /**
+   * @brief Handle a PTP message from a peer
+   */
+  void receivePacket(Ptr<Socket> socket);
+
+  /**
+   * @brief Find a peer by node ID
+   *
+   * @return const PtpPeer_t* NULL if the node is not a peer.
+   */
+  const PtpPeer_t *findPeer(uint16_t nodeId);
+
+  uint16_t m_nodeId; //< PTP node ID
+  PtpRole_t m_role; //< Grandmaster or slave
+  uint16_t m_masterId; //< Peer the node synchronizes to
+  uint16_t m_port; //< UDP port of PTP messages
+  Time m_syncInterval; //< Interval between SYNC messages
+  bool m_oneStep; //< SYNC carries its transmit time stamp, no FOLLOW
+  bool m_piServo; //< PI servo instead of stepping the clock
+
+  std::vector<PtpPeer_t> m_peers; //< Peers of the node
+  PtpNode *m_ptpNode; //< Clock of the node, owned by the application
+  Ptr<Socket> m_socket; //< Socket of PTP messages
+  EventId m_syncEvent; //< Next SYNC
+  bool m_serving; //< Whether SYNC messages are sent
+  int m_eventId; //< Event ID of the next exchange
+  uint64_t m_invalidPacketCount; //< Received packets dropped as invalid
+  TracedCallback<uint16_t, double> m_offsetErrorTrace; //< Offset error after each sync
+};
+
+#endif /* PTP_APPLICATION_H */
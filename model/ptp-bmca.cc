@@ -0,0 +1,221 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors: Tinghui Wang <tinghui.wang@wsu.edu>
+ *
+ * This file implements the best master clock algorithm.
+ */
+
+#include "ns3/core-module.h"
+#include "ptp-bmca.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("PtpBmca");
+
+/* ANNOUNCE messages this many steps from their grandmaster are dropped */
+static const uint16_t PTP_MAX_STEPS_REMOVED = 255;
+
+PtpBmca::PtpBmca(uint16_t nodeId)
+  : m_nodeId(nodeId),
+    m_receiptTimeout(Seconds(3.0)),
+    m_state(BMCA_LISTENING),
+    m_listenUntil(NanoSeconds(0)),
+    m_parentId(nodeId),
+    m_sequenceId(0)
+{
+  m_defaultDataset.priority1 = 128;
+  m_defaultDataset.clockClass = 248;
+  m_defaultDataset.clockAccuracy = 0xFE;
+  m_defaultDataset.offsetScaledLogVariance = 0xFFFF;
+  m_defaultDataset.priority2 = 128;
+  m_defaultDataset.identity = nodeId;
+  m_parent.grandmaster = m_defaultDataset;
+  m_parent.stepsRemoved = 0;
+  m_parent.sequenceId = 0;
+}
+
+void PtpBmca::setDefaultDataset(const PtpClockDataset_t &dataset) {
+  m_defaultDataset = dataset;
+  m_defaultDataset.identity = m_nodeId;
+}
+
+const PtpClockDataset_t &PtpBmca::getDefaultDataset() const {
+  return m_defaultDataset;
+}
+
+void PtpBmca::setReceiptTimeout(Time timeout) {
+  m_receiptTimeout = timeout;
+}
+
+void PtpBmca::start(Time now) {
+  m_foreignMasters.clear();
+  m_progress.clear();
+  m_state = BMCA_LISTENING;
+  m_listenUntil = now + m_receiptTimeout;
+  m_parentId = m_nodeId;
+  m_parent.grandmaster = m_defaultDataset;
+  m_parent.stepsRemoved = 0;
+}
+
+void PtpBmca::addAnnounce(uint16_t senderId, const PtpAnnounce_t &announce, Time now) {
+  // Our own grandmaster data relayed back to us
+  if(announce.grandmaster.identity == m_nodeId) {
+    return;
+  }
+  std::unordered_map<uint16_t, PtpGrandmasterProgress_t>::iterator it =
+    m_progress.find(announce.grandmaster.identity);
+  if(it == m_progress.end()) {
+    PtpGrandmasterProgress_t progress;
+    progress.sequenceId = announce.sequenceId;
+    progress.advanced = now;
+    m_progress[announce.grandmaster.identity] = progress;
+  } else if((int16_t) (announce.sequenceId - it->second.sequenceId) > 0) {
+    it->second.sequenceId = announce.sequenceId;
+    it->second.advanced = now;
+  }
+  PtpForeignMaster_t &record = m_foreignMasters[senderId];
+  record.announce = announce;
+  record.received = now;
+}
+
+bool PtpBmca::isQualified(const PtpForeignMaster_t &record, Time now) const {
+  if(now - record.received > m_receiptTimeout) {
+    return false;
+  }
+  std::unordered_map<uint16_t, PtpGrandmasterProgress_t>::const_iterator it =
+    m_progress.find(record.announce.grandmaster.identity);
+  return it != m_progress.end() && now - it->second.advanced <= m_receiptTimeout;
+}
+
+bool PtpBmca::decide(Time now) {
+  bool found = false;
+  uint16_t bestId = m_nodeId;
+  PtpAnnounce_t best = m_parent;
+  std::unordered_map<uint16_t, PtpForeignMaster_t>::iterator it = m_foreignMasters.begin();
+  while(it != m_foreignMasters.end()) {
+    if(!isQualified(it->second, now)) {
+      it = m_foreignMasters.erase(it);
+      continue;
+    }
+    if(it->second.announce.stepsRemoved + 1 < PTP_MAX_STEPS_REMOVED &&
+       (!found || compare(it->second.announce, it->first, best, bestId) < 0)) {
+      best = it->second.announce;
+      bestId = it->first;
+      found = true;
+    }
+    ++it;
+  }
+
+  PtpBmcaState_t state;
+  uint16_t parentId;
+  PtpAnnounce_t parent;
+  if(found && compareDatasets(best.grandmaster, m_defaultDataset) < 0) {
+    state = BMCA_SLAVE;
+    parentId = bestId;
+    parent = best;
+    parent.stepsRemoved = best.stepsRemoved + 1;
+  } else if(m_state == BMCA_LISTENING && now < m_listenUntil) {
+    return false;
+  } else {
+    state = BMCA_GRANDMASTER;
+    parentId = m_nodeId;
+    parent.grandmaster = m_defaultDataset;
+    parent.stepsRemoved = 0;
+    parent.sequenceId = m_sequenceId;
+  }
+
+  bool changed = state != m_state || parentId != m_parentId ||
+    parent.grandmaster.identity != m_parent.grandmaster.identity ||
+    parent.stepsRemoved != m_parent.stepsRemoved;
+  if(changed) {
+    NS_LOG_INFO("Node " << m_nodeId << ": grandmaster " << parent.grandmaster.identity <<
+      " through node " << parentId << ", " << parent.stepsRemoved << " steps removed.");
+  }
+  m_state = state;
+  m_parentId = parentId;
+  m_parent = parent;
+  return changed;
+}
+
+PtpBmcaState_t PtpBmca::getState() const {
+  return m_state;
+}
+
+uint16_t PtpBmca::getParentId() const {
+  return m_parentId;
+}
+
+uint16_t PtpBmca::getGrandmasterId() const {
+  return m_parent.grandmaster.identity;
+}
+
+uint16_t PtpBmca::getStepsRemoved() const {
+  return m_parent.stepsRemoved;
+}
+
+PtpAnnounce_t PtpBmca::getAnnounce() {
+  PtpAnnounce_t announce = m_parent;
+  if(m_state == BMCA_SLAVE) {
+    std::unordered_map<uint16_t, PtpGrandmasterProgress_t>::const_iterator it =
+      m_progress.find(m_parent.grandmaster.identity);
+    if(it != m_progress.end()) {
+      announce.sequenceId = it->second.sequenceId;
+    }
+  } else {
+    announce.sequenceId = ++m_sequenceId;
+  }
+  return announce;
+}
+
+int PtpBmca::compareDatasets(const PtpClockDataset_t &a, const PtpClockDataset_t &b) {
+  if(a.priority1 != b.priority1) {
+    return a.priority1 < b.priority1 ? -1 : 1;
+  }
+  if(a.clockClass != b.clockClass) {
+    return a.clockClass < b.clockClass ? -1 : 1;
+  }
+  if(a.clockAccuracy != b.clockAccuracy) {
+    return a.clockAccuracy < b.clockAccuracy ? -1 : 1;
+  }
+  if(a.offsetScaledLogVariance != b.offsetScaledLogVariance) {
+    return a.offsetScaledLogVariance < b.offsetScaledLogVariance ? -1 : 1;
+  }
+  if(a.priority2 != b.priority2) {
+    return a.priority2 < b.priority2 ? -1 : 1;
+  }
+  if(a.identity != b.identity) {
+    return a.identity < b.identity ? -1 : 1;
+  }
+  return 0;
+}
+
+int PtpBmca::compare(
+  const PtpAnnounce_t &a, uint16_t aSender,
+  const PtpAnnounce_t &b, uint16_t bSender
+) {
+  int datasets = compareDatasets(a.grandmaster, b.grandmaster);
+  if(datasets != 0) {
+    return datasets;
+  }
+  // Same grandmaster: the shorter path, then the lower sender ID
+  if(a.stepsRemoved != b.stepsRemoved) {
+    return a.stepsRemoved < b.stepsRemoved ? -1 : 1;
+  }
+  if(aSender != bSender) {
+    return aSender < bSender ? -1 : 1;
+  }
+  return 0;
+}
@@ -0,0 +1,195 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors: Tinghui Wang <tinghui.wang@wsu.edu>
+ *
+ * This file declares the best master clock algorithm that elects the
+ * grandmaster and builds the synchronization tree from ANNOUNCE messages.
+ *
+ */
+
+#ifndef PTP_BMCA_H
+#define PTP_BMCA_H
+
+#include "ns3/core-module.h"
+#include <unordered_map>
+#include "ptp-message.h"
+
+using namespace ns3;
+
+/**
+ * @brief State of a node in the best master clock algorithm
+ * BMCA_LISTENING: Waiting for ANNOUNCE messages after start
+ * BMCA_GRANDMASTER: No better clock known, the node is the grandmaster
+ * BMCA_SLAVE: Synchronized to the neighbor with the best ANNOUNCE
+ */
+typedef enum {
+  BMCA_LISTENING = 0,
+  BMCA_GRANDMASTER,
+  BMCA_SLAVE
+} PtpBmcaState_t;
+
+/**
+ * @brief ANNOUNCE last received from a neighbor
+ */
+typedef struct {
+  PtpAnnounce_t announce; //< Body of the ANNOUNCE
+  Time received; //< Time it was received
+} PtpForeignMaster_t;
+
+/**
+ * @brief Last announce sequence number seen from a grandmaster
+ */
+typedef struct {
+  uint16_t sequenceId; //< Highest sequence number
+  Time advanced; //< Time the sequence number last went up
+} PtpGrandmasterProgress_t;
+
+/**
+ * @brief Best master clock algorithm of a node
+ *
+ * Keeps the last ANNOUNCE from each neighbor and picks the best one with
+ * the IEEE 1588 data set comparison: grandmaster priority1, clockClass,
+ * clockAccuracy, offsetScaledLogVariance, priority2 and identity, then the
+ * fewest steps removed, then the lowest sender ID. If the node's own clock
+ * is better, it becomes the grandmaster.
+ *
+ * An ANNOUNCE no longer qualifies after the announce receipt timeout, or
+ * once the announce sequence number of its grandmaster has not gone up for
+ * that long. Nodes relay the sequence number of their grandmaster, so stale
+ * relays of a dead grandmaster expire together instead of counting steps
+ * removed up to 255.
+ */
+class PtpBmca {
+public:
+  /**
+   * @brief Construct a new PtpBmca object with the default data set
+   * (priority 128, clockClass 248, unknown accuracy and variance)
+   *
+   * @param nodeId ID of the node, its clockIdentity
+   */
+  PtpBmca(uint16_t nodeId);
+
+  /**
+   * @brief Set the data set of the local clock; the identity stays the node
+   * ID
+   *
+   * @param dataset
+   */
+  void setDefaultDataset(const PtpClockDataset_t &dataset);
+
+  const PtpClockDataset_t &getDefaultDataset() const;
+
+  /**
+   * @brief Set how long an ANNOUNCE qualifies (announceReceiptTimeout times
+   * the announce interval)
+   *
+   * @param timeout
+   */
+  void setReceiptTimeout(Time timeout);
+
+  /**
+   * @brief Forget every ANNOUNCE and listen for one receipt timeout
+   *
+   * @param now
+   */
+  void start(Time now);
+
+  /**
+   * @brief Record an ANNOUNCE from a neighbor
+   *
+   * ANNOUNCE messages naming the node itself as grandmaster are dropped.
+   *
+   * @param senderId
+   * @param announce
+   * @param now
+   */
+  void addAnnounce(uint16_t senderId, const PtpAnnounce_t &announce, Time now);
+
+  /**
+   * @brief Run the state decision
+   *
+   * @param now
+   * @return true if the state, the parent or the grandmaster changed.
+   */
+  bool decide(Time now);
+
+  PtpBmcaState_t getState() const;
+
+  /**
+   * @brief Get the neighbor the node synchronizes to (the node itself if it
+   * is not a slave)
+   */
+  uint16_t getParentId() const;
+
+  /**
+   * @brief Get the ID of the grandmaster (the node itself if it is not a
+   * slave)
+   */
+  uint16_t getGrandmasterId() const;
+
+  /**
+   * @brief Get the hops from the grandmaster
+   */
+  uint16_t getStepsRemoved() const;
+
+  /**
+   * @brief Get the ANNOUNCE the node sends to its neighbors
+   *
+   * A grandmaster takes the next announce sequence number; a slave relays
+   * the last one of its grandmaster.
+   *
+   * @return PtpAnnounce_t
+   */
+  PtpAnnounce_t getAnnounce();
+
+  /**
+   * @brief Compare two ANNOUNCE messages
+   *
+   * @return int Negative if `a` from `aSender` is better than `b` from
+   * `bSender`, positive if it is worse, 0 if they are the same.
+   */
+  static int compare(
+    const PtpAnnounce_t &a, uint16_t aSender,
+    const PtpAnnounce_t &b, uint16_t bSender
+  );
+
+  /**
+   * @brief Compare two clock data sets
+   *
+   * @return int Negative if `a` is better, positive if `b` is better.
+   */
+  static int compareDatasets(const PtpClockDataset_t &a, const PtpClockDataset_t &b);
+
+private:
+  /**
+   * @brief Whether the ANNOUNCE of a neighbor is recent and its grandmaster
+   * alive
+   */
+  bool isQualified(const PtpForeignMaster_t &record, Time now) const;
+
+  const uint16_t m_nodeId; //< Node ID
+  PtpClockDataset_t m_defaultDataset; //< Data set of the local clock
+  Time m_receiptTimeout; //< Lifetime of an ANNOUNCE
+  PtpBmcaState_t m_state; //< Current state
+  Time m_listenUntil; //< End of the listening state
+  uint16_t m_parentId; //< Neighbor the node synchronizes to
+  PtpAnnounce_t m_parent; //< Grandmaster and steps removed of the node
+  uint16_t m_sequenceId; //< Announce sequence number as a grandmaster
+  std::unordered_map<uint16_t, PtpForeignMaster_t> m_foreignMasters; //< Last ANNOUNCE of each neighbor
+  std::unordered_map<uint16_t, PtpGrandmasterProgress_t> m_progress; //< Sequence number of each grandmaster
+};
+
+#endif /* PTP_BMCA_H */
@@ -0,0 +1,350 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors: Tinghui Wang <tinghui.wang@wsu.edu>
+ *
+ * This file implements the serialization of the PTP message header.
+ */
+
+#include "ns3/core-module.h"
+#include "ptp-header.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("PtpHeader");
+
+NS_OBJECT_ENSURE_REGISTERED(PtpHeader);
+
+/* Sizes of the IEEE 1588 common header and of the timestamp body */
+static const uint32_t PTP_COMMON_HEADER_SIZE = 34;
+static const uint32_t PTP_TIMESTAMP_SIZE = 10;
+/* requestingPortIdentity of peer delay messages (reserved in Pdelay_Req) */
+static const uint32_t PTP_PORT_IDENTITY_SIZE = 10;
+/* Announce body following the originTimestamp */
+static const uint32_t PTP_ANNOUNCE_BODY_SIZE = 20;
+/* timeSource of announced grandmasters: internal oscillator */
+static const uint8_t PTP_TIME_SOURCE_INTERNAL_OSCILLATOR = 0xA0;
+static const uint8_t PTP_VERSION = 2;
+static const int64_t NANOSECONDS_PER_SECOND = 1000000000;
+/* twoStepFlag: bit 1 of the first octet of flagField */
+static const uint16_t PTP_FLAG_TWO_STEP = 0x0200;
+
+/**
+ * @brief IEEE 1588 messageType code of a PTP message type
+ */
+static uint8_t getWireMessageType(PtpMessageType_t msgType) {
+  switch(msgType) {
+    case SYNC:
+      return 0x0;
+    case DREQ:
+      return 0x1;
+    case FOLLOW:
+      return 0x8;
+    case DRPLY:
+      return 0x9;
+    case PDELAY_REQ:
+      return 0x2;
+    case PDELAY_RESP:
+      return 0x3;
+    case PDELAY_FOLLOW:
+      return 0xA;
+    case ANNOUNCE:
+      return 0xB;
+    default:
+      return 0xF;
+  }
+}
+
+/**
+ * @brief IEEE 1588 controlField of a PTP message type
+ */
+static uint8_t getControlField(PtpMessageType_t msgType) {
+  switch(msgType) {
+    case SYNC:
+      return 0;
+    case DREQ:
+      return 1;
+    case FOLLOW:
+      return 2;
+    case DRPLY:
+      return 3;
+    default:
+      return 5;
+  }
+}
+
+/**
+ * @brief PTP message type of an IEEE 1588 messageType code
+ */
+static PtpMessageType_t getPtpMessageType(uint8_t wireType) {
+  switch(wireType) {
+    case 0x0:
+      return SYNC;
+    case 0x1:
+      return DREQ;
+    case 0x8:
+      return FOLLOW;
+    case 0x9:
+      return DRPLY;
+    case 0x2:
+      return PDELAY_REQ;
+    case 0x3:
+      return PDELAY_RESP;
+    case 0xA:
+      return PDELAY_FOLLOW;
+    case 0xB:
+      return ANNOUNCE;
+    default:
+      NS_LOG_WARN("Unsupported PTP message type " << (int) wireType);
+      return PTP_INVALID_MESSAGE;
+  }
+}
+
+PtpHeader::PtpHeader()
+  : m_messageType(SYNC),
+    m_txNodeId(0),
+    m_syncId(0),
+    m_eventId(0),
+    m_timeStamp(0),
+    m_correction(0),
+    m_twoStep(true)
+{
+  m_announce.grandmaster.priority1 = 0;
+  m_announce.grandmaster.clockClass = 0;
+  m_announce.grandmaster.clockAccuracy = 0;
+  m_announce.grandmaster.offsetScaledLogVariance = 0;
+  m_announce.grandmaster.priority2 = 0;
+  m_announce.grandmaster.identity = 0;
+  m_announce.stepsRemoved = 0;
+  m_announce.sequenceId = 0;
+}
+
+TypeId PtpHeader::GetTypeId(void) {
+  static TypeId tid = TypeId("ns3::PtpHeader")
+    .SetParent<Header>()
+    .SetGroupName("Ptp")
+    .AddConstructor<PtpHeader>();
+  return tid;
+}
+
+TypeId PtpHeader::GetInstanceTypeId(void) const {
+  return GetTypeId();
+}
+
+void PtpHeader::Print(std::ostream &os) const {
+  os << "type=" << m_messageType <<
+    " txNode=" << m_txNodeId <<
+    " syncId=" << m_syncId <<
+    " event=" << m_eventId <<
+    " timeStamp=" << m_timeStamp <<
+    " correction=" << m_correction <<
+    " twoStep=" << m_twoStep;
+}
+
+/**
+ * @brief Whether a PTP message type belongs to the peer delay mechanism
+ */
+static bool isPeerDelayMessage(PtpMessageType_t msgType) {
+  return msgType == PDELAY_REQ || msgType == PDELAY_RESP || msgType == PDELAY_FOLLOW;
+}
+
+uint32_t PtpHeader::GetSerializedSize(void) const {
+  if(isPeerDelayMessage(m_messageType)) {
+    return PTP_COMMON_HEADER_SIZE + PTP_TIMESTAMP_SIZE + PTP_PORT_IDENTITY_SIZE;
+  }
+  if(m_messageType == ANNOUNCE) {
+    return PTP_COMMON_HEADER_SIZE + PTP_TIMESTAMP_SIZE + PTP_ANNOUNCE_BODY_SIZE;
+  }
+  return PTP_COMMON_HEADER_SIZE + PTP_TIMESTAMP_SIZE;
+}
+
+void PtpHeader::Serialize(Buffer::Iterator start) const {
+  Buffer::Iterator i = start;
+  // transportSpecific | messageType
+  i.WriteU8(getWireMessageType(m_messageType));
+  i.WriteU8(PTP_VERSION);
+  i.WriteHtonU16(GetSerializedSize());
+  // domainNumber and reserved
+  i.WriteU8(0);
+  i.WriteU8(0);
+  // flagField
+  i.WriteHtonU16(m_twoStep ? PTP_FLAG_TWO_STEP : 0);
+  // correctionField (scaled nanoseconds)
+  i.WriteHtonU64((uint64_t) (m_correction * 65536));
+  // messageTypeSpecific
+  i.WriteHtonU32((uint32_t) m_eventId);
+  // sourcePortIdentity: clockIdentity and portNumber
+  i.WriteHtonU64(m_txNodeId);
+  i.WriteHtonU16(1);
+  i.WriteHtonU16(m_syncId);
+  i.WriteU8(getControlField(m_messageType));
+  // logMessageInterval
+  i.WriteU8(0x7F);
+
+  // Timestamp: 48-bit seconds and 32-bit nanoseconds
+  int64_t seconds = m_timeStamp / NANOSECONDS_PER_SECOND;
+  int64_t nanoSeconds = m_timeStamp % NANOSECONDS_PER_SECOND;
+  if(nanoSeconds < 0) {
+    seconds--;
+    nanoSeconds += NANOSECONDS_PER_SECOND;
+  }
+  i.WriteHtonU16((uint16_t) ((uint64_t) seconds >> 32));
+  i.WriteHtonU32((uint32_t) seconds);
+  i.WriteHtonU32((uint32_t) nanoSeconds);
+
+  if(isPeerDelayMessage(m_messageType)) {
+    // requestingPortIdentity, the socket link tells the requester apart
+    i.WriteHtonU64(0);
+    i.WriteHtonU16(0);
+  } else if(m_messageType == ANNOUNCE) {
+    // currentUtcOffset and reserved
+    i.WriteHtonU16(0);
+    i.WriteU8(0);
+    i.WriteU8(m_announce.grandmaster.priority1);
+    // grandmasterClockQuality
+    i.WriteU8(m_announce.grandmaster.clockClass);
+    i.WriteU8(m_announce.grandmaster.clockAccuracy);
+    i.WriteHtonU16(m_announce.grandmaster.offsetScaledLogVariance);
+    i.WriteU8(m_announce.grandmaster.priority2);
+    i.WriteHtonU64(m_announce.grandmaster.identity);
+    i.WriteHtonU16(m_announce.stepsRemoved);
+    i.WriteU8(PTP_TIME_SOURCE_INTERNAL_OSCILLATOR);
+  }
+}
+
+uint32_t PtpHeader::Deserialize(Buffer::Iterator start) {
+  Buffer::Iterator i = start;
+  m_messageType = getPtpMessageType(i.ReadU8() & 0x0F);
+  // versionPTP, messageLength, domainNumber, reserved
+  i.Next(5);
+  m_twoStep = (i.ReadNtohU16() & PTP_FLAG_TWO_STEP) != 0;
+  m_correction = ((int64_t) i.ReadNtohU64()) / 65536;
+  m_eventId = (int32_t) i.ReadNtohU32();
+  m_txNodeId = (uint16_t) i.ReadNtohU64();
+  // portNumber
+  i.Next(2);
+  m_syncId = i.ReadNtohU16();
+  // controlField and logMessageInterval
+  i.Next(2);
+
+  uint64_t seconds = ((uint64_t) i.ReadNtohU16()) << 32;
+  seconds |= i.ReadNtohU32();
+  // Sign extend the 48-bit seconds field
+  if(seconds & ((uint64_t) 1 << 47)) {
+    seconds |= ((uint64_t) 0xFFFF) << 48;
+  }
+  int64_t nanoSeconds = i.ReadNtohU32();
+  m_timeStamp = ((int64_t) seconds) * NANOSECONDS_PER_SECOND + nanoSeconds;
+
+  if(isPeerDelayMessage(m_messageType)) {
+    // requestingPortIdentity
+    i.Next(PTP_PORT_IDENTITY_SIZE);
+  } else if(m_messageType == ANNOUNCE) {
+    // currentUtcOffset and reserved
+    i.Next(3);
+    m_announce.grandmaster.priority1 = i.ReadU8();
+    m_announce.grandmaster.clockClass = i.ReadU8();
+    m_announce.grandmaster.clockAccuracy = i.ReadU8();
+    m_announce.grandmaster.offsetScaledLogVariance = i.ReadNtohU16();
+    m_announce.grandmaster.priority2 = i.ReadU8();
+    m_announce.grandmaster.identity = (uint16_t) i.ReadNtohU64();
+    m_announce.stepsRemoved = i.ReadNtohU16();
+    // timeSource
+    i.Next(1);
+  }
+
+  return GetSerializedSize();
+}
+
+bool PtpHeader::isComplete(Ptr<const Packet> packet) {
+  // transportSpecific | messageType, versionPTP, messageLength
+  uint8_t fields[4];
+  if(packet->GetSize() < sizeof(fields)) {
+    return false;
+  }
+  packet->CopyData(fields, sizeof(fields));
+  PtpHeader header;
+  header.setMessageType(getPtpMessageType(fields[0] & 0x0F));
+  uint16_t messageLength = (fields[2] << 8) | fields[3];
+  return packet->GetSize() >= header.GetSerializedSize() &&
+    packet->GetSize() >= messageLength;
+}
+
+PtpMessageType_t PtpHeader::getMessageType() const {
+  return m_messageType;
+}
+
+void PtpHeader::setMessageType(PtpMessageType_t msgType) {
+  m_messageType = msgType;
+}
+
+uint16_t PtpHeader::getTxNodeId() const {
+  return m_txNodeId;
+}
+
+void PtpHeader::setTxNodeId(uint16_t nodeId) {
+  m_txNodeId = nodeId;
+}
+
+uint16_t PtpHeader::getSyncId() const {
+  return m_syncId;
+}
+
+void PtpHeader::setSyncId(uint16_t syncId) {
+  m_syncId = syncId;
+}
+
+int PtpHeader::getEventId() const {
+  return m_eventId;
+}
+
+void PtpHeader::setEventId(int eventId) {
+  m_eventId = eventId;
+}
+
+Time PtpHeader::getTimeStamp() const {
+  return NanoSeconds(m_timeStamp);
+}
+
+void PtpHeader::setTimeStamp(Time timeStamp) {
+  m_timeStamp = timeStamp.GetNanoSeconds();
+}
+
+Time PtpHeader::getCorrection() const {
+  return NanoSeconds(m_correction);
+}
+
+void PtpHeader::setCorrection(Time correction) {
+  m_correction = correction.GetNanoSeconds();
+}
+
+bool PtpHeader::getTwoStep() const {
+  return m_twoStep;
+}
+
+void PtpHeader::setTwoStep(bool twoStep) {
+  m_twoStep = twoStep;
+}
+
+PtpAnnounce_t PtpHeader::getAnnounce() const {
+  PtpAnnounce_t announce = m_announce;
+  announce.sequenceId = m_syncId;
+  return announce;
+}
+
+void PtpHeader::setAnnounce(const PtpAnnounce_t &announce) {
+  m_announce = announce;
+  m_syncId = announce.sequenceId;
+}
@@ -0,0 +1,203 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors: Tinghui Wang <tinghui.wang@wsu.edu>
+ *
+ * This file declares the header carried by PTP messages.
+ *
+ */
+
+#ifndef PTP_HEADER_H
+#define PTP_HEADER_H
+
+#include "ns3/core-module.h"
+#include "ns3/header.h"
+#include "ns3/packet.h"
+#include "ptp-message.h"
+
+using namespace ns3;
+
+/**
+ * @brief PTP message header
+ *
+ * The wire format follows the 34-byte IEEE 1588-2008 common message header,
+ * followed by a 10-byte timestamp (48-bit seconds, 32-bit nanoseconds):
+ *
+ * - messageType: low nibble of the first byte, IEEE 1588 message type code
+ * - versionPTP, messageLength, domainNumber
+ * - flagField: twoStepFlag set unless the SYNC carries its own transmit
+ *   time stamp (one-step clock)
+ * - correctionField: nanoseconds scaled by 2^16
+ * - messageTypeSpecific (reserved in 1588-2008): simulation event ID
+ * - sourcePortIdentity: clockIdentity carries the sender node ID
+ * - sequenceId: sync ID of the message
+ * - controlField, logMessageInterval
+ *
+ * Peer delay messages end with the 10-byte requestingPortIdentity (left
+ * zero; reserved in Pdelay_Req). ANNOUNCE messages end with the 20-byte
+ * announce body: the grandmaster priorities, clock quality and identity,
+ * and stepsRemoved; their sequenceId is the announce sequence number of the
+ * grandmaster.
+ */
+class PtpHeader : public Header {
+public:
+  PtpHeader();
+
+  static TypeId GetTypeId(void);
+  virtual TypeId GetInstanceTypeId(void) const;
+  virtual void Print(std::ostream &os) const;
+  virtual uint32_t GetSerializedSize(void) const;
+  virtual void Serialize(Buffer::Iterator start) const;
+  virtual uint32_t Deserialize(Buffer::Iterator start);
+
+  /**
+   * @brief Check that a received packet holds a whole PTP message
+   *
+   * Peeks the messageType and messageLength fields, so that a truncated
+   * ANNOUNCE or peer delay message is dropped before Deserialize reads past
+   * its end.
+   *
+   * @param packet Packet that starts with a PTP header
+   * @return true if the packet is as long as its message type and its
+   * messageLength
+   */
+  static bool isComplete(Ptr<const Packet> packet);
+
+  /**
+   * @brief Get the PTP message type
+   *
+   * @return PtpMessageType_t
+   */
+  PtpMessageType_t getMessageType() const;
+
+  /**
+   * @brief Set the PTP message type
+   *
+   * @param msgType
+   */
+  void setMessageType(PtpMessageType_t msgType);
+
+  /**
+   * @brief Get the ID of the node that sends the message
+   *
+   * @return uint16_t
+   */
+  uint16_t getTxNodeId() const;
+
+  /**
+   * @brief Set the ID of the node that sends the message
+   *
+   * @param nodeId
+   */
+  void setTxNodeId(uint16_t nodeId);
+
+  /**
+   * @brief Get the sync ID (sequenceId) of the message
+   *
+   * @return uint16_t
+   */
+  uint16_t getSyncId() const;
+
+  /**
+   * @brief Set the sync ID (sequenceId) of the message
+   *
+   * @param syncId
+   */
+  void setSyncId(uint16_t syncId);
+
+  /**
+   * @brief Get the simulation event ID
+   *
+   * @return int
+   */
+  int getEventId() const;
+
+  /**
+   * @brief Set the simulation event ID
+   *
+   * @param eventId
+   */
+  void setEventId(int eventId);
+
+  /**
+   * @brief Get the timestamp carried by the message
+   *
+   * @return Time
+   */
+  Time getTimeStamp() const;
+
+  /**
+   * @brief Set the timestamp carried by the message
+   *
+   * @param timeStamp
+   */
+  void setTimeStamp(Time timeStamp);
+
+  /**
+   * @brief Get the correction field
+   *
+   * @return Time
+   */
+  Time getCorrection() const;
+
+  /**
+   * @brief Set the correction field
+   *
+   * @param correction
+   */
+  void setCorrection(Time correction);
+
+  /**
+   * @brief Is a FOLLOW message going to carry the SYNC time stamp
+   *
+   * @return true for two-step clocks
+   * @return false if the SYNC carries its transmit time stamp
+   */
+  bool getTwoStep() const;
+
+  /**
+   * @brief Set the twoStepFlag
+   *
+   * @param twoStep
+   */
+  void setTwoStep(bool twoStep);
+
+  /**
+   * @brief Get the body of an ANNOUNCE message
+   *
+   * @return PtpAnnounce_t
+   */
+  PtpAnnounce_t getAnnounce() const;
+
+  /**
+   * @brief Set the body of an ANNOUNCE message, and the sequence ID to its
+   * announce sequence number
+   *
+   * @param announce
+   */
+  void setAnnounce(const PtpAnnounce_t &announce);
+
+private:
+  PtpMessageType_t m_messageType; //< PTP message type
+  uint16_t m_txNodeId; //< Sender node ID (clockIdentity)
+  uint16_t m_syncId; //< Sequence ID
+  int32_t m_eventId; //< Simulation event ID
+  int64_t m_timeStamp; //< Timestamp in nanoseconds
+  int64_t m_correction; //< Correction in nanoseconds
+  bool m_twoStep; //< twoStepFlag
+  PtpAnnounce_t m_announce; //< Body of ANNOUNCE messages
+};
+
+#endif /* PTP_HEADER_H */
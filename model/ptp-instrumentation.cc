@@ -0,0 +1,113 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors: Tinghui Wang <tinghui.wang@wsu.edu>
+ *
+ * This file implements the opt-in instrumentation of the PTP message
+ * handlers.
+ */
+
+#include "ptp-instrumentation.h"
+
+#ifdef PTP_INSTRUMENTATION
+
+#include <cstddef>
+
+static PtpAllocationCounter_t g_ptpAllocationCounter = NULL; //< Installed by the program
+
+PtpInstrumentation::PtpInstrumentation() {
+  for(int i = 0; i < PTP_NUM_PROBES; i++) {
+    m_counters[i].calls = 0;
+    m_counters[i].nanoSeconds = 0;
+    m_counters[i].allocations = 0;
+  }
+}
+
+void PtpInstrumentation::record(
+  PtpProbe_t probe, uint64_t nanoSeconds, uint64_t allocations
+) {
+  m_counters[probe].calls++;
+  m_counters[probe].nanoSeconds += nanoSeconds;
+  m_counters[probe].allocations += allocations;
+}
+
+const PtpProbeCounters_t &PtpInstrumentation::getCounters(PtpProbe_t probe) const {
+  return m_counters[probe];
+}
+
+const char *PtpInstrumentation::getProbeName(PtpProbe_t probe) {
+  switch(probe) {
+    case PTP_PROBE_RECEIVE:
+      return "receivePacket";
+    case PTP_PROBE_RECEIVE_SYNC:
+      return "receivePacket:SYNC";
+    case PTP_PROBE_RECEIVE_FOLLOW:
+      return "receivePacket:FOLLOW";
+    case PTP_PROBE_RECEIVE_DREQ:
+      return "receivePacket:DREQ";
+    case PTP_PROBE_RECEIVE_DRPLY:
+      return "receivePacket:DRPLY";
+    case PTP_PROBE_SEND_SYNC_FOLLOW:
+      return "sendSyncFollowPacket";
+    case PTP_PROBE_SEND_DREQ:
+      return "sendDreqPacket";
+    case PTP_PROBE_SEND_DRPLY:
+      return "sendDrplyPacket";
+    case PTP_PROBE_PRINT_CLOCK_VALUES:
+      return "printClockValuesOfNodes";
+    default:
+      return "unknown";
+  }
+}
+
+void PtpInstrumentation::setAllocationCounter(PtpAllocationCounter_t counter) {
+  g_ptpAllocationCounter = counter;
+}
+
+uint64_t PtpInstrumentation::getAllocationCount() {
+  return g_ptpAllocationCounter != NULL ? g_ptpAllocationCounter() : 0;
+}
+
+void PtpInstrumentation::writeReport(std::ostream &os) const {
+  os << "probe,calls,total_ns,mean_ns,allocations,allocations_per_call" << '\n';
+  for(int i = 0; i < PTP_NUM_PROBES; i++) {
+    const PtpProbeCounters_t &counters = m_counters[i];
+    double calls = counters.calls > 0 ? counters.calls : 1;
+    os << getProbeName((PtpProbe_t) i) << "," << counters.calls << "," <<
+      counters.nanoSeconds << "," << counters.nanoSeconds / calls << "," <<
+      counters.allocations << "," << counters.allocations / calls << '\n';
+  }
+}
+
+PtpInstrumentScope::PtpInstrumentScope(
+  PtpInstrumentation &instrumentation, PtpProbe_t probe
+) : m_instrumentation(instrumentation),
+    m_probe(probe),
+    m_start(std::chrono::steady_clock::now()),
+    m_allocations(PtpInstrumentation::getAllocationCount())
+{}
+
+PtpInstrumentScope::~PtpInstrumentScope() {
+  uint64_t allocations = PtpInstrumentation::getAllocationCount() - m_allocations;
+  m_instrumentation.record(
+    m_probe,
+    std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - m_start
+    ).count(),
+    allocations
+  );
+}
+
+#endif /* PTP_INSTRUMENTATION */
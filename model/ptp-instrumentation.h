@@ -0,0 +1,139 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors: Tinghui Wang <tinghui.wang@wsu.edu>
+ *
+ * This file declares the opt-in instrumentation of the PTP message
+ * handlers. It is compiled in with PTP_INSTRUMENTATION defined
+ * (./waf configure --enable-ptp-instrumentation) and to nothing otherwise.
+ *
+ */
+
+#ifndef PTP_INSTRUMENTATION_H
+#define PTP_INSTRUMENTATION_H
+
+#include <stdint.h>
+
+/**
+ * @brief Instrumented code paths of PTPNetwork
+ */
+typedef enum {
+  PTP_PROBE_RECEIVE = 0, //< receivePacket, all message types
+  PTP_PROBE_RECEIVE_SYNC, //< receivePacket, SYNC branch
+  PTP_PROBE_RECEIVE_FOLLOW, //< receivePacket, FOLLOW branch
+  PTP_PROBE_RECEIVE_DREQ, //< receivePacket, DREQ branch
+  PTP_PROBE_RECEIVE_DRPLY, //< receivePacket, DRPLY branch
+  PTP_PROBE_SEND_SYNC_FOLLOW, //< sendSyncFollowPacket
+  PTP_PROBE_SEND_DREQ, //< sendDreqPacket
+  PTP_PROBE_SEND_DRPLY, //< sendDrplyPacket
+  PTP_PROBE_PRINT_CLOCK_VALUES, //< printClockValuesOfNodes
+  PTP_NUM_PROBES
+} PtpProbe_t;
+
+#ifdef PTP_INSTRUMENTATION
+
+#include <chrono>
+#include <ostream>
+
+/**
+ * @brief Counters of one probe
+ */
+typedef struct {
+  uint64_t calls; //< Times the code path ran
+  uint64_t nanoSeconds; //< Wall clock spent in it, nested probes included
+  uint64_t allocations; //< Heap allocations made in it, nested probes included
+} PtpProbeCounters_t;
+
+/**
+ * @brief Heap allocations made so far, as counted by the program
+ */
+typedef uint64_t (*PtpAllocationCounter_t)(void);
+
+/**
+ * @brief Call counts, wall clock and heap allocations of the probes of a
+ * PTPNetwork
+ *
+ * The module does not count allocations itself: a program that does (by
+ * replacing the global operator new, for instance) installs its counter with
+ * setAllocationCounter. Without one, no allocation is recorded.
+ */
+class PtpInstrumentation {
+public:
+  PtpInstrumentation();
+
+  /**
+   * @brief Add one run of a probe
+   */
+  void record(PtpProbe_t probe, uint64_t nanoSeconds, uint64_t allocations);
+
+  const PtpProbeCounters_t &getCounters(PtpProbe_t probe) const;
+
+  static const char *getProbeName(PtpProbe_t probe);
+
+  /**
+   * @brief Set the counter probes read heap allocations from
+   *
+   * @param counter NULL to stop counting allocations
+   */
+  static void setAllocationCounter(PtpAllocationCounter_t counter);
+
+  /**
+   * @brief Get the number of heap allocations made so far
+   *
+   * @return uint64_t 0 without an allocation counter
+   */
+  static uint64_t getAllocationCount();
+
+  /**
+   * @brief Write the counters as CSV: probe, calls, total and mean wall
+   * clock, total and mean allocations
+   */
+  void writeReport(std::ostream &os) const;
+
+private:
+  PtpProbeCounters_t m_counters[PTP_NUM_PROBES]; //< Counters of each probe
+};
+
+/**
+ * @brief Records a probe from its construction to the end of its scope
+ */
+class PtpInstrumentScope {
+public:
+  PtpInstrumentScope(PtpInstrumentation &instrumentation, PtpProbe_t probe);
+  ~PtpInstrumentScope();
+
+private:
+  PtpInstrumentation &m_instrumentation; //< Where the probe is recorded
+  PtpProbe_t m_probe; //< Probe recorded
+  std::chrono::steady_clock::time_point m_start; //< Wall clock at the start
+  uint64_t m_allocations; //< Allocations at the start
+};
+
+#define PTP_INSTRUMENT_CONCAT_(a, b) a##b
+#define PTP_INSTRUMENT_CONCAT(a, b) PTP_INSTRUMENT_CONCAT_(a, b)
+
+// One probe per line, so nested scopes do not shadow each other
+#define PTP_INSTRUMENT_SCOPE(instrumentation, probe) \
+  PtpInstrumentScope PTP_INSTRUMENT_CONCAT(ptpInstrumentScope, __LINE__)( \
+    instrumentation, probe \
+  )
+
+#else
+
+#define PTP_INSTRUMENT_SCOPE(instrumentation, probe)
+
+#endif /* PTP_INSTRUMENTATION */
+
+#endif /* PTP_INSTRUMENTATION_H */
@@ -33,25 +33,51 @@ using namespace ns3;
  * FOLLOW: Follow-up message with master timestamp
  * DREQ: Delay Request message
  * DRPLY: Delay Response message with master timestamp
+ * PDELAY_REQ: Peer Delay Request message
+ * PDELAY_RESP: Peer Delay Response message with the request receipt timestamp
+ * PDELAY_FOLLOW: Peer Delay Response Follow-up with the response timestamp
+ * ANNOUNCE: Announce message with the grandmaster of the sender
+ * PTP_INVALID_MESSAGE: Received message of an unknown or unsupported type,
+ * dropped without being counted by type
  */
 typedef enum {
   SYNC = 0,
   FOLLOW,
   DREQ,
-  DRPLY
+  DRPLY,
+  PDELAY_REQ,
+  PDELAY_RESP,
+  PDELAY_FOLLOW,
+  ANNOUNCE,
+  PTP_INVALID_MESSAGE
 } PtpMessageType_t;
 
+/* Number of PTP message types */
+static const int PTP_NUM_MESSAGE_TYPES = 8;
+
 /**
- * @brief Simulated information needed in PTP message.
+ * @brief Clock attributes compared by the best master clock algorithm, in
+ * order of precedence (lower values are better)
  */
-typedef struct PtpMessage {
-  uint16_t txNodeId;
-  uint16_t txNodeHop;
-  PtpMessageType_t messageType;
-  uint64_t syncId;
-  int eventId;
-  int64_t timeStamp;
-} PtpMessage_t;
+typedef struct {
+  uint8_t priority1; //< User priority of the clock
+  uint8_t clockClass; //< Traceability of the clock (248: default)
+  uint8_t clockAccuracy; //< Accuracy of the clock (0xFE: unknown)
+  uint16_t offsetScaledLogVariance; //< Stability of the clock
+  uint8_t priority2; //< User priority among equal clocks
+  uint16_t identity; //< clockIdentity: node ID
+} PtpClockDataset_t;
+
+/**
+ * @brief Body of an ANNOUNCE message
+ */
+typedef struct {
+  PtpClockDataset_t grandmaster; //< Grandmaster of the sender
+  uint16_t stepsRemoved; //< Hops from the grandmaster to the sender
+  uint16_t sequenceId; //< Announce sequence number of the grandmaster
+} PtpAnnounce_t;
+
+/* PTP messages are encoded with PtpHeader, see ptp-header.h */
 
 typedef struct TcpEchoMessageHeader {
   uint16_t txNodeId;
@@ -22,6 +22,8 @@
 #include "ptp-network.h"
 #include "ptp-socket-link.h"
 #include "ptp-message.h"
+#include "ptp-header.h"
+#include <algorithm>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
@@ -30,6 +32,9 @@ using namespace ns3;
 
 NS_LOG_COMPONENT_DEFINE("PtpNetwork");
 
+/* UDP and IPv4 headers added to each PTP message */
+static const uint32_t PTP_UDP_IP_OVERHEAD = 28;
+
 PTPNetwork::PTPNetwork(
   const uint32_t users,
   const uint32_t packetSize,
@@ -42,9 +47,19 @@ PTPNetwork::PTPNetwork(
     {
       m_iterations = 1;
       m_masterIndex = 0;
-      m_eventId = 0;
-      m_eventCounterId = 0;
       m_simulatingTraffic = false;
+      m_clockDumpScope = DUMP_ALL_NODES;
+      m_offsetTraceEnabled = true;
+      m_convergenceThreshold = 1000.0;
+      m_channelDataRate = 0;
+      m_oneStepClock = false;
+      m_boundaryClock = false;
+      m_delayMechanism = DELAY_E2E;
+      m_pdelayInterval = interPacketInterval;
+      m_bmcaEnabled = false;
+      m_announceInterval = interPacketInterval;
+      m_announceReceiptTimeout = 3;
+      m_invalidPacketCount = 0;
     }
 
 void PTPNetwork::setLogdir(std::string logdir) {
@@ -53,6 +68,31 @@ void PTPNetwork::setLogdir(std::string logdir) {
 
 void PTPNetwork::addSocketLink(SocketLink *socketLink) {
   m_socketLinks.push_back(socketLink);
+  m_socketLinkIndex[PeekPointer(socketLink->getSocket())] = socketLink;
+}
+
+void PTPNetwork::addGroupSocketLink(SocketLink *socketLink) {
+  uint16_t hostId = socketLink->getHostId();
+  if(hostId >= m_groupSocketLinks.size()) {
+    m_groupSocketLinks.resize(hostId + 1, NULL);
+  }
+  m_groupSocketLinks[hostId] = socketLink;
+}
+
+SocketLink *PTPNetwork::getGroupSocketLink(uint16_t nodeId) {
+  if(nodeId >= m_groupSocketLinks.size()) {
+    return NULL;
+  }
+  return m_groupSocketLinks[nodeId];
+}
+
+SocketLink *PTPNetwork::getSocketLink(Ptr<Socket> socket) {
+  std::unordered_map<Socket *, SocketLink *>::const_iterator it =
+    m_socketLinkIndex.find(PeekPointer(socket));
+  if(it == m_socketLinkIndex.end()) {
+    return NULL;
+  }
+  return it->second;
 }
 
 void PTPNetwork::addTrafficSocket(
@@ -63,11 +103,25 @@ void PTPNetwork::addTrafficSocket(
 }
 
 void PTPNetwork::addNode(PtpNode *node) {
-  std::stringstream nodeStatFilename;
-  nodeStatFilename << "node_" << node->getNodeId() << ".dat";
-  std::ofstream *nodeStatistics = new std::ofstream(m_logdir + nodeStatFilename.str());
+  node->setConvergenceThreshold(m_convergenceThreshold);
+  node->setSyncInterval(m_interPacketInterval);
   m_nodes.push_back(node);
-  m_fileStreams.push_back(nodeStatistics);
+  m_failedNodes.push_back(false);
+  m_timestampers.push_back(Ptr<PtpTimestamper>());
+}
+
+void PTPNetwork::reserve(uint32_t nodes, uint32_t socketLinks) {
+  m_nodes.reserve(nodes);
+  m_socketLinks.reserve(socketLinks);
+  m_socketLinkIndex.reserve(socketLinks);
+}
+
+uint32_t PTPNetwork::getNumNodes() {
+  return m_nodes.size();
+}
+
+void PTPNetwork::setMasterIndex(uint16_t masterIndex) {
+  m_masterIndex = masterIndex;
 }
 
 PtpNode *PTPNetwork::getNodeById(uint16_t nodeId) {
@@ -75,11 +129,7 @@ PtpNode *PTPNetwork::getNodeById(uint16_t nodeId) {
 }
 
 void PTPNetwork::receivePacket(Ptr<Socket> socket) {
-  // Record simulator time when packet is received at socket.
-  m_globalTime = NanoSeconds(Simulator::Now());
-  m_nodes[m_masterIndex]->setLocalTime(m_globalTime);
-
-  uint16_t i = 0;
+  PTP_INSTRUMENT_SCOPE(m_instrumentation, PTP_PROBE_RECEIVE);
   //int numNeighbor;
 
   uint16_t hostId, senderId;
@@ -90,136 +140,683 @@ void PTPNetwork::receivePacket(Ptr<Socket> socket) {
 
   // Acquire packets from socket
   Ptr<Packet> pktReceived = socket->Recv();
-  // uint32_t pktLength = pktReceived->GetSize();
-  PtpMessage_t *ptpMessage = (PtpMessage_t *) std::malloc(sizeof(PtpMessage_t));
-  pktReceived->CopyData((uint8_t *) ptpMessage, sizeof(PtpMessage_t));
+  PtpHeader ptpHeader;
+  // Truncated messages on a PTP port
+  if(!PtpHeader::isComplete(pktReceived)) {
+    m_invalidPacketCount++;
+    NS_LOG_WARN("PTP message of " << pktReceived->GetSize() <<
+      " Bytes is too short, dropped.");
+    return;
+  }
+  pktReceived->RemoveHeader(ptpHeader);
+  // Foreign or corrupted packets on a PTP port
+  if(ptpHeader.getMessageType() == PTP_INVALID_MESSAGE ||
+     ptpHeader.getTxNodeId() >= m_nodes.size()) {
+    m_invalidPacketCount++;
+    NS_LOG_WARN("Invalid PTP message dropped.");
+    return;
+  }
+  // Residence time added by transparent clocks on the way
+  PtpCorrectionTag correctionTag;
+  if(pktReceived->PeekPacketTag(correctionTag)) {
+    ptpHeader.setCorrection(ptpHeader.getCorrection() + correctionTag.getCorrection());
+  }
 
   // Now, we need to handle response to the packets
   // First, find from which neighbor this message comes from
-  i = 0;
-  while(!(m_socketLinks[i]->getSocket() == socket)) {
-    i++;
+  socketLink = this->getSocketLink(socket);
+  if(socketLink == NULL) {
+    std::cerr << "[PTPNetwork::receivePacket] Error: PTP message received " <<
+      "on a socket that is not registered with the network." << std::endl;
+    return;
   }
-  socketLink = m_socketLinks[i];
   // Host is the node that receives the packet
   hostId = socketLink->getHostId();
+  if(m_failedNodes[hostId]) {
+    return;
+  }
   hostNode = this->getNodeById(hostId);
   // Source of the PTP message should be acquired from the message
-  senderId = ptpMessage->txNodeId;
+  senderId = ptpHeader.getTxNodeId();
   senderNode = this->getNodeById(senderId);
 
-  setLocalTimeAtNodes();
+  // SYNC and FOLLOW sent to the group reach every node on the channel; a
+  // slave only follows its own master and replies on the unicast link.
+  if(socketLink->getDstId() == PTP_GROUP_NODE_ID) {
+    if(senderId == hostId || senderId != hostNode->getMasterId()) {
+      hostNode->increaseOverheardPacketCounter(ptpHeader.getMessageType());
+      return;
+    }
+    socketLink = hostNode->getTxSocketByNodeId(senderId);
+    if(socketLink == NULL) {
+      std::cerr << "[PTPNetwork::receivePacket] Error: Node " << hostId <<
+        " has no link to its master " << senderId << "." << std::endl;
+      return;
+    }
+  }
+  // A slave that changed master ignores what the previous one still sends
+  if((ptpHeader.getMessageType() == SYNC || ptpHeader.getMessageType() == FOLLOW ||
+      ptpHeader.getMessageType() == DRPLY) && senderId != hostNode->getMasterId()) {
+    hostNode->increaseOverheardPacketCounter(ptpHeader.getMessageType());
+    return;
+  }
 
   // Read Contents from the packet and prepare response
-  if(ptpMessage->messageType == SYNC) {
+  if(ptpHeader.getMessageType() == SYNC) {
+    PTP_INSTRUMENT_SCOPE(m_instrumentation, PTP_PROBE_RECEIVE_SYNC);
     // store SYNC receive time and wait for follow up
-    hostNode->setSyncRecvTime(hostNode->getLocalTime());
-    hostNode->increaseReceivedPacketCounter(ptpMessage->messageType);
+    hostNode->setSyncRecvTime(getReceiveTime(hostNode, pktReceived));
+    hostNode->setSyncCorrection(ptpHeader.getCorrection());
+    hostNode->increaseReceivedPacketCounter(ptpHeader.getMessageType());
     hostNode->setState(ACTIVE);
-    hostNode->setPtpSyncId(SYNC, ptpMessage->syncId);
+    hostNode->setPtpSyncId(SYNC, ptpHeader.getSyncId());
     printClockValuesOfNodes(
-      senderNode->getIpv4Address(), hostNode->getIpv4Address(),
-      senderNode->getNodeHop(), ptpMessage->messageType,
-      senderNode->getDreqSendTime(), senderNode->getSyncSendTimeStamp(hostId),
-      ptpMessage->eventId
+      senderNode, hostNode, ptpHeader.getMessageType(), ptpHeader.getEventId()
     );
-  } else if(ptpMessage->messageType == FOLLOW) {
+    if(!ptpHeader.getTwoStep()) {
+      // One-step clock: the SYNC carries its own transmit time stamp
+      hostNode->setSyncTimeAtMaster(ptpHeader.getTimeStamp());
+      hostNode->setPtpSyncId(FOLLOW, ptpHeader.getSyncId());
+      syncTimeStampReceived(socketLink, senderNode, hostNode, ptpHeader);
+    }
+  } else if(ptpHeader.getMessageType() == FOLLOW) {
+    PTP_INSTRUMENT_SCOPE(m_instrumentation, PTP_PROBE_RECEIVE_FOLLOW);
     // store SYNC send time and send DREQ
-    hostNode->setSyncTimeAtMaster(NanoSeconds(ptpMessage->timeStamp));
-    hostNode->increaseReceivedPacketCounter(ptpMessage->messageType);
-    hostNode->setPtpSyncId(FOLLOW, ptpMessage->syncId);
+    hostNode->setSyncTimeAtMaster(ptpHeader.getTimeStamp());
+    hostNode->increaseReceivedPacketCounter(ptpHeader.getMessageType());
+    hostNode->setPtpSyncId(FOLLOW, ptpHeader.getSyncId());
     // Delay update local time until the end of sequence
     printClockValuesOfNodes(
-      senderNode->getIpv4Address(), hostNode->getIpv4Address(),
-      senderNode->getNodeHop(), ptpMessage->messageType,
-      senderNode->getDreqSendTime(), senderNode->getSyncSendTimeStamp(hostId),
-      ptpMessage->eventId
+      senderNode, hostNode, ptpHeader.getMessageType(), ptpHeader.getEventId()
     );
     // Need to check if both FOLLOW and SYNC belong to same event
     if(hostNode->getPtpSyncId(SYNC) == hostNode->getPtpSyncId(FOLLOW)) {
-      // Schedule DREQ Packet Send
-      m_eventId++;
-      Simulator::Schedule(
-        NanoSeconds(0), 
-        &PTPNetwork::sendDreqPacket,
-        this, socketLink, m_eventId
-      );
+      syncTimeStampReceived(socketLink, senderNode, hostNode, ptpHeader);
     }
-  } else if(ptpMessage->messageType == DREQ) {
+  } else if(ptpHeader.getMessageType() == DREQ) {
+    PTP_INSTRUMENT_SCOPE(m_instrumentation, PTP_PROBE_RECEIVE_DREQ);
     // Time stamp, and then send DRPLY
-    hostNode->setDreqRecvTimeStamp(hostNode->getLocalTime(), ptpMessage->txNodeId);
+    hostNode->setDreqRecvTimeStamp(getReceiveTime(hostNode, pktReceived), ptpHeader.getTxNodeId());
+    hostNode->setDreqRecvCorrection(ptpHeader.getCorrection(), ptpHeader.getTxNodeId());
     hostNode->increaseReceivedPacketCounter(DREQ);
     printClockValuesOfNodes(
-      senderNode->getIpv4Address(), hostNode->getIpv4Address(),
-      senderNode->getNodeHop(), ptpMessage->messageType,
-      senderNode->getDreqSendTime(), senderNode->getSyncSendTimeStamp(hostId),
-      ptpMessage->eventId
+      senderNode, hostNode, ptpHeader.getMessageType(), ptpHeader.getEventId()
     );
     Simulator::Schedule(
       NanoSeconds(0),
       &PTPNetwork::sendDrplyPacket,
-      this, socketLink, ptpMessage->eventId
+      this, socketLink, ptpHeader.getEventId()
     );
-  } else if(ptpMessage->messageType == DRPLY) {
+  } else if(ptpHeader.getMessageType() == DRPLY) {
+    PTP_INSTRUMENT_SCOPE(m_instrumentation, PTP_PROBE_RECEIVE_DRPLY);
     // Update clock and mark SYNCED
-    hostNode->setDreqTimeAtMaster(NanoSeconds(ptpMessage->timeStamp));
+    hostNode->setDreqTimeAtMaster(ptpHeader.getTimeStamp());
+    hostNode->setDreqCorrection(ptpHeader.getCorrection());
     hostNode->increaseReceivedPacketCounter(DRPLY);
-    hostNode->setState(SYNCED);
-    // Update offset and error calculation
-    hostNode->calculateOffset(
-      this->getNodeById(m_masterIndex)->getLocalTime()
-    );
-    m_anim->UpdateNodeCounter(
-      m_ptpOffsetCounterId, 
-      hostNode->getNodeId(), 
-      hostNode->getCurrentOffsetError()
+    synchronizeNode(NULL, senderNode, hostNode, ptpHeader);
+  } else if(ptpHeader.getMessageType() == PDELAY_REQ) {
+    // Time stamp, and then send Pdelay_Resp and its follow-up
+    hostNode->increaseReceivedPacketCounter(PDELAY_REQ);
+    Simulator::Schedule(
+      NanoSeconds(0),
+      &PTPNetwork::sendPdelayRespPacket,
+      this, socketLink, ptpHeader, getReceiveTime(hostNode, pktReceived)
     );
-    *m_fileStreams[hostNode->getNodeId()] << 
-      hostNode->getCurrentOffsetError() << std::endl;
-    // m_fileStreams[hostNode->getNodeId()]->flush();
-    printClockValuesOfNodes(
-      senderNode->getIpv4Address(), hostNode->getIpv4Address(),
-      senderNode->getNodeHop(), ptpMessage->messageType,
-      senderNode->getDreqSendTime(), senderNode->getSyncSendTimeStamp(hostId),
-      ptpMessage->eventId
+  } else if(ptpHeader.getMessageType() == PDELAY_RESP) {
+    hostNode->increaseReceivedPacketCounter(PDELAY_RESP);
+    socketLink->setPdelayResponse(
+      ptpHeader.getSyncId(), ptpHeader.getTimeStamp(), getReceiveTime(hostNode, pktReceived),
+      ptpHeader.getCorrection()
     );
-    for(int i = 0; i < hostNode->getNumNeighbors(); i++) {
-      SocketLink *sockToNeighbor = hostNode->getTxSocket(i);
-      if(sockToNeighbor->getDstId() != senderId) {
-        Simulator::Schedule(
-          NanoSeconds(0),
-          &PTPNetwork::sendSyncFollowPacket, this, 
-          sockToNeighbor, m_eventId
-        );
-        m_eventId++;
+  } else if(ptpHeader.getMessageType() == PDELAY_FOLLOW) {
+    hostNode->increaseReceivedPacketCounter(PDELAY_FOLLOW);
+    if(socketLink->completePdelay(
+        ptpHeader.getSyncId(), ptpHeader.getTimeStamp(), ptpHeader.getCorrection())) {
+      NS_LOG_DEBUG("Node " << hostId << ": delay of the link to node " <<
+        senderId << " is " << socketLink->getLinkDelay().GetNanoSeconds() << " ns.");
+    }
+  } else if(ptpHeader.getMessageType() == ANNOUNCE) {
+    hostNode->increaseReceivedPacketCounter(ANNOUNCE);
+    if(m_bmcaEnabled) {
+      PtpBmca &bmca = hostNode->getBmca();
+      bmca.addAnnounce(senderId, ptpHeader.getAnnounce(), Simulator::Now());
+      if(bmca.decide(Simulator::Now())) {
+        applyBmcaDecision(hostNode);
       }
     }
+  }
+}
+
+void PTPNetwork::syncTimeStampReceived(
+  SocketLink *socketLink, PtpNode *senderNode, PtpNode *hostNode,
+  const PtpHeader &header
+) {
+  if(m_delayMechanism == DELAY_E2E) {
+    scheduleDreqPacket(socketLink);
+    return;
+  }
+  // Peer delay: the delay of the link to the master is measured apart
+  if(!socketLink->hasLinkDelay()) {
+    NS_LOG_DEBUG("Node " << hostNode->getNodeId() << ": SYNC skipped, " <<
+      "no peer delay measured yet.");
+    return;
+  }
+  synchronizeNode(socketLink, senderNode, hostNode, header);
+}
+
+void PTPNetwork::synchronizeNode(
+  SocketLink *peerLink, PtpNode *senderNode, PtpNode *hostNode,
+  const PtpHeader &header
+) {
+  uint16_t hostId = hostNode->getNodeId();
+  hostNode->setState(SYNCED);
+  // Update offset and error calculation
+  Time syncInterval = hostNode->getSyncInterval();
+  Time masterTime = this->getNodeById(hostNode->getGrandmasterId())->getLocalTime();
+  if(peerLink == NULL) {
+    hostNode->calculateOffset(masterTime);
   } else {
-    std::cerr << "[PTPNetwork::receivePacket] Error: PTP message with " << 
-      "invalid message type received." << std::endl;
+    hostNode->calculatePeerDelayOffset(peerLink->getLinkDelay(), masterTime);
+  }
+  if(hostNode->getSyncInterval() < syncInterval) {
+    rescheduleSync(hostId);
+  }
+  recordRoundSync(hostNode);
+  recordFailoverSync(hostNode);
+  if(!m_offsetErrorTrace.IsEmpty()) {
+    m_offsetErrorTrace(hostId, hostNode->getCurrentOffsetError());
+  }
+  if(m_offsetTraceEnabled) {
+    writeOffsetTrace(hostNode, header.getEventId());
+  }
+  printClockValuesOfNodes(
+    senderNode, hostNode, header.getMessageType(), header.getEventId()
+  );
+  // Once synchronized, the node serves its own slaves
+  if(!m_syncTimersStarted[hostId]) {
+    startSyncTimers(hostId, NanoSeconds(0));
   }
 }
 
 void PTPNetwork::startPTPProtocol() {
+  m_stopTime = Simulator::Now() + NanoSeconds(
+    m_interPacketInterval.GetNanoSeconds() * m_iterations
+  );
+  m_syncTimersStarted.assign(m_nodes.size(), false);
+  m_startTime = Simulator::Now();
+  PtpRound_t round;
+  round.synced = 0;
+  round.lastSync = NanoSeconds(0);
+  round.maxOffsetError = 0;
+  m_rounds.assign(m_iterations, round);
+  m_nodeRound.assign(m_nodes.size(), -1);
+  m_nodeLastSync.assign(m_nodes.size(), NanoSeconds(-1));
+
+  // Every slave measures the delay of the link to its master
+  if(m_delayMechanism == DELAY_P2P) {
+    for(uint32_t i = 0; i < m_nodes.size(); i++) {
+      // Any node may become a slave once masters are elected
+      if(m_bmcaEnabled || m_nodes[i]->getMasterId() != i) {
+        Simulator::Schedule(
+          NanoSeconds(0), &PTPNetwork::sendPeriodicPdelay, this, i
+        );
+      }
+    }
+  }
+
+  if(m_bmcaEnabled) {
+    // Every node listens for ANNOUNCE messages, SYNC starts with the first
+    // grandmaster elected
+    Time receiptTimeout = NanoSeconds(
+      m_announceInterval.GetNanoSeconds() * m_announceReceiptTimeout
+    );
+    for(uint32_t i = 0; i < m_nodes.size(); i++) {
+      m_nodes[i]->getBmca().setReceiptTimeout(receiptTimeout);
+      m_nodes[i]->getBmca().start(Simulator::Now());
+      m_nodes[i]->setMaster(i, 0);
+      m_nodes[i]->setGrandmasterId(i);
+      Simulator::Schedule(
+        NanoSeconds(5), &PTPNetwork::announceTick, this, i
+      );
+    }
+    return;
+  }
+
   // Get master node and set master node status to "SYNCED"
   PtpNode *master = this->getNodeById(m_masterIndex);
   master->setState(SYNCED);
+  for(uint32_t i = 0; i < m_nodes.size(); i++) {
+    m_nodes[i]->setGrandmasterId(m_masterIndex);
+  }
 
   // Schedule SEND and FOLLOW message
-  for(int i = 0; i < master->getNumNeighbors(); i++) {
-    SocketLink *sockToNeighbor = master->getTxSocket(i);
-    Simulator::Schedule(
-      NanoSeconds(5), 
-      &PTPNetwork::sendSyncFollowPacket, this, 
-      sockToNeighbor, m_eventId
+  if(m_boundaryClock) {
+    // Every node serves its slaves on its own schedule
+    for(uint32_t i = 0; i < m_nodes.size(); i++) {
+      startSyncTimers(i, NanoSeconds(5));
+    }
+  } else {
+    startSyncTimers(m_masterIndex, NanoSeconds(5));
+  }
+}
+
+void PTPNetwork::setDelayMechanism(PtpDelayMechanism_t mechanism) {
+  m_delayMechanism = mechanism;
+}
+
+void PTPNetwork::setPdelayInterval(Time interval) {
+  m_pdelayInterval = interval;
+}
+
+void PTPNetwork::sendPeriodicPdelay(uint16_t nodeId) {
+  if(Simulator::Now() >= m_stopTime || m_failedNodes[nodeId]) {
+    return;
+  }
+  PtpNode *node = this->getNodeById(nodeId);
+  SocketLink *masterLink = node->getTxSocketByNodeId(node->getMasterId());
+  if(node->getMasterId() != nodeId && masterLink != NULL) {
+    sendPdelayReqPacket(masterLink, node->getNewEventId());
+  }
+  Simulator::Schedule(
+    m_pdelayInterval, &PTPNetwork::sendPeriodicPdelay, this, nodeId
+  );
+}
+
+void PTPNetwork::sendPdelayReqPacket(SocketLink *socketLink, int eventId) {
+  PtpNode *txNode = this->getNodeById(socketLink->getHostId());
+  PtpHeader reqHeader;
+  reqHeader.setTxNodeId(txNode->getNodeId());
+  reqHeader.setMessageType(PDELAY_REQ);
+  reqHeader.setEventId(eventId);
+  reqHeader.setSyncId(socketLink->startPdelay(txNode->getLocalTime()));
+  Ptr<Packet> pktReq = Create<Packet>();
+  pktReq->AddHeader(reqHeader);
+  tagEventMessage(txNode, pktReq);
+  socketLink->getSocket()->Send(pktReq);
+
+  NS_LOG_DEBUG("sending PDELAY_REQ packet\n");
+  txNode->incrementSentPacketCounter(
+    PDELAY_REQ, reqHeader.GetSerializedSize() + PTP_UDP_IP_OVERHEAD
+  );
+}
+
+void PTPNetwork::sendPdelayRespPacket(
+  SocketLink *socketLink, PtpHeader reqHeader, Time reqRecvTime
+) {
+  PtpNode *txNode = this->getNodeById(socketLink->getHostId());
+  PtpHeader respHeader;
+  respHeader.setTxNodeId(txNode->getNodeId());
+  respHeader.setMessageType(PDELAY_RESP);
+  respHeader.setEventId(reqHeader.getEventId());
+  respHeader.setSyncId(reqHeader.getSyncId());
+  respHeader.setTimeStamp(reqRecvTime);
+  Ptr<Packet> pktResp = Create<Packet>();
+  pktResp->AddHeader(respHeader);
+  tagEventMessage(txNode, pktResp);
+  socketLink->getSocket()->Send(pktResp);
+  NS_LOG_DEBUG("sending PDELAY_RESP packet\n");
+  txNode->incrementSentPacketCounter(
+    PDELAY_RESP, respHeader.GetSerializedSize() + PTP_UDP_IP_OVERHEAD
+  );
+
+  // Two-step: the response time stamp follows, with the correction of the
+  // request
+  PtpHeader followHeader;
+  followHeader.setTxNodeId(txNode->getNodeId());
+  followHeader.setMessageType(PDELAY_FOLLOW);
+  followHeader.setEventId(reqHeader.getEventId());
+  followHeader.setSyncId(reqHeader.getSyncId());
+  followHeader.setTimeStamp(txNode->getLocalTime());
+  followHeader.setCorrection(reqHeader.getCorrection());
+  Ptr<Packet> pktFollow = Create<Packet>();
+  pktFollow->AddHeader(followHeader);
+  socketLink->getSocket()->Send(pktFollow);
+  NS_LOG_DEBUG("sending PDELAY_FOLLOW packet\n");
+  txNode->incrementSentPacketCounter(
+    PDELAY_FOLLOW, followHeader.GetSerializedSize() + PTP_UDP_IP_OVERHEAD
+  );
+}
+
+void PTPNetwork::setBoundaryClock(bool boundaryClock) {
+  m_boundaryClock = boundaryClock;
+}
+
+void PTPNetwork::setBmcaEnabled(bool enabled) {
+  m_bmcaEnabled = enabled;
+}
+
+void PTPNetwork::setAnnounceInterval(Time interval) {
+  m_announceInterval = interval;
+}
+
+void PTPNetwork::setAnnounceReceiptTimeout(uint32_t timeout) {
+  m_announceReceiptTimeout = timeout;
+}
+
+void PTPNetwork::announceTick(uint16_t nodeId) {
+  if(Simulator::Now() >= m_stopTime || m_failedNodes[nodeId]) {
+    return;
+  }
+  PtpNode *node = this->getNodeById(nodeId);
+  PtpBmca &bmca = node->getBmca();
+  if(bmca.decide(Simulator::Now())) {
+    applyBmcaDecision(node);
+  }
+  if(bmca.getState() != BMCA_LISTENING) {
+    // Every port but the one to the master announces the grandmaster
+    PtpAnnounce_t announce = bmca.getAnnounce();
+    int eventId = node->getNewEventId();
+    for(int i = 0; i < node->getNumNeighbors(); i++) {
+      SocketLink *sockToNeighbor = node->getTxSocket(i);
+      if(sockToNeighbor->getDstId() != node->getMasterId()) {
+        sendAnnouncePacket(sockToNeighbor, announce, eventId);
+      }
+    }
+  }
+  Simulator::Schedule(
+    m_announceInterval, &PTPNetwork::announceTick, this, nodeId
+  );
+}
+
+void PTPNetwork::sendAnnouncePacket(
+  SocketLink *socketLink, const PtpAnnounce_t &announce, int eventId
+) {
+  PtpNode *txNode = this->getNodeById(socketLink->getHostId());
+  PtpHeader announceHeader;
+  announceHeader.setTxNodeId(txNode->getNodeId());
+  announceHeader.setMessageType(ANNOUNCE);
+  announceHeader.setEventId(eventId);
+  announceHeader.setTimeStamp(txNode->getLocalTime());
+  announceHeader.setAnnounce(announce);
+  Ptr<Packet> pktAnnounce = Create<Packet>();
+  pktAnnounce->AddHeader(announceHeader);
+  socketLink->getSocket()->Send(pktAnnounce);
+
+  NS_LOG_DEBUG("sending ANNOUNCE packet\n");
+  txNode->incrementSentPacketCounter(
+    ANNOUNCE, announceHeader.GetSerializedSize() + PTP_UDP_IP_OVERHEAD
+  );
+}
+
+void PTPNetwork::applyBmcaDecision(PtpNode *node) {
+  PtpBmca &bmca = node->getBmca();
+  uint16_t nodeId = node->getNodeId();
+  node->setMaster(bmca.getParentId(), bmca.getStepsRemoved());
+  node->setGrandmasterId(bmca.getGrandmasterId());
+  if(bmca.getState() == BMCA_GRANDMASTER) {
+    node->setState(SYNCED);
+    if(!m_syncTimersStarted[nodeId]) {
+      startSyncTimers(nodeId, NanoSeconds(0));
+    }
+  } else if(bmca.getState() == BMCA_SLAVE) {
+    ensureSyncPort(bmca.getParentId(), nodeId);
+    if(m_boundaryClock && !m_syncTimersStarted[nodeId]) {
+      startSyncTimers(nodeId, NanoSeconds(0));
+    }
+  }
+  checkElection();
+}
+
+bool PTPNetwork::isSlaveOf(uint16_t slaveId, uint16_t masterId) {
+  return slaveId != masterId && !m_failedNodes[slaveId] &&
+    this->getNodeById(slaveId)->getMasterId() == masterId;
+}
+
+bool PTPNetwork::hasSlaves(SocketLink *socketLink) {
+  uint16_t hostId = socketLink->getHostId();
+  if(socketLink->getDstId() != PTP_GROUP_NODE_ID) {
+    return isSlaveOf(socketLink->getDstId(), hostId);
+  }
+  PtpNode *host = this->getNodeById(hostId);
+  for(int i = 0; i < host->getNumNeighbors(); i++) {
+    if(isSlaveOf(host->getTxSocket(i)->getDstId(), hostId)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void PTPNetwork::ensureSyncPort(uint16_t masterId, uint16_t slaveId) {
+  // A master that is not synchronized yet starts all its ports later
+  if(!m_syncTimersStarted[masterId]) {
+    return;
+  }
+  SocketLink *port = getGroupSocketLink(masterId);
+  if(port == NULL) {
+    port = this->getNodeById(masterId)->getTxSocketByNodeId(slaveId);
+  }
+  if(port == NULL) {
+    return;
+  }
+  PtpSyncTimer_t &timer = m_syncTimers[port];
+  if(timer.event.IsRunning()) {
+    return;
+  }
+  timer.lastSync = Simulator::Now();
+  timer.event = Simulator::Schedule(
+    NanoSeconds(0), &PTPNetwork::sendPeriodicSync, this, port
+  );
+}
+
+void PTPNetwork::failNode(uint16_t nodeId) {
+  if(m_failedNodes[nodeId]) {
+    return;
+  }
+  PtpNode *node = this->getNodeById(nodeId);
+  m_failedNodes[nodeId] = true;
+  node->setState(INACTIVE);
+  PtpFailover_t failover;
+  failover.nodeId = nodeId;
+  failover.failTime = Simulator::Now();
+  failover.grandmaster = node->getMasterId() == nodeId;
+  failover.newGrandmaster = nodeId;
+  failover.electedTime = NanoSeconds(-1);
+  failover.resyncTime = NanoSeconds(-1);
+  failover.slaves = 0;
+  failover.resynced = 0;
+  m_failovers.push_back(failover);
+  NS_LOG_INFO("Node " << nodeId << " failed" <<
+    (failover.grandmaster ? " (grandmaster)." : "."));
+  // The failure of a node nobody synchronizes to changes nothing
+  checkElection();
+}
+
+void PTPNetwork::failGrandmaster() {
+  for(uint32_t i = 0; i < m_nodes.size(); i++) {
+    if(!m_failedNodes[i]) {
+      failNode(m_nodes[i]->getGrandmasterId());
+      return;
+    }
+  }
+}
+
+const std::vector<PtpFailover_t> &PTPNetwork::getFailovers() {
+  return m_failovers;
+}
+
+void PTPNetwork::checkElection() {
+  bool pending = false;
+  for(uint32_t i = 0; i < m_failovers.size(); i++) {
+    pending = pending || m_failovers[i].electedTime.IsStrictlyNegative();
+  }
+  if(!pending) {
+    return;
+  }
+  // Every node still up has a master still up and the same grandmaster
+  int32_t grandmaster = -1;
+  uint32_t alive = 0;
+  for(uint32_t i = 0; i < m_nodes.size(); i++) {
+    if(m_failedNodes[i]) {
+      continue;
+    }
+    alive++;
+    if(m_bmcaEnabled && m_nodes[i]->getBmca().getState() == BMCA_LISTENING) {
+      return;
+    }
+    if(grandmaster < 0) {
+      grandmaster = m_nodes[i]->getGrandmasterId();
+    } else if(grandmaster != m_nodes[i]->getGrandmasterId()) {
+      return;
+    }
+    if(m_failedNodes[m_nodes[i]->getMasterId()]) {
+      return;
+    }
+  }
+  if(grandmaster < 0 || m_failedNodes[grandmaster]) {
+    return;
+  }
+  for(uint32_t i = 0; i < m_failovers.size(); i++) {
+    PtpFailover_t &failover = m_failovers[i];
+    if(!failover.electedTime.IsStrictlyNegative()) {
+      continue;
+    }
+    failover.newGrandmaster = grandmaster;
+    failover.electedTime = Simulator::Now();
+    failover.slaves = alive - 1;
+    if(failover.slaves == 0) {
+      failover.resyncTime = Simulator::Now();
+    }
+    NS_LOG_INFO("Node " << grandmaster << " is grandmaster " <<
+      (failover.electedTime - failover.failTime).GetNanoSeconds() <<
+      " ns after node " << failover.nodeId << " failed.");
+  }
+}
+
+void PTPNetwork::recordFailoverSync(PtpNode *node) {
+  if(m_nodeLastSync.empty()) {
+    return;
+  }
+  Time lastSync = m_nodeLastSync[node->getNodeId()];
+  m_nodeLastSync[node->getNodeId()] = Simulator::Now();
+  for(uint32_t i = 0; i < m_failovers.size(); i++) {
+    PtpFailover_t &failover = m_failovers[i];
+    // Each slave counts once, with its first sync since the election
+    if(failover.electedTime.IsStrictlyNegative() || !failover.resyncTime.IsStrictlyNegative() ||
+       lastSync >= failover.electedTime) {
+      continue;
+    }
+    failover.resynced++;
+    if(failover.resynced >= failover.slaves) {
+      failover.resyncTime = Simulator::Now();
+    }
+  }
+}
+
+void PTPNetwork::recordRoundSync(PtpNode *node) {
+  if(m_rounds.empty()) {
+    return;
+  }
+  int64_t round = (Simulator::Now() - m_startTime).GetNanoSeconds() /
+    m_interPacketInterval.GetNanoSeconds();
+  if(round >= (int64_t) m_rounds.size()) {
+    round = m_rounds.size() - 1;
+  }
+  PtpRound_t &record = m_rounds[round];
+  record.maxOffsetError = std::max(record.maxOffsetError, node->getCurrentOffsetError());
+  // Each slave counts once per round
+  if(m_nodeRound[node->getNodeId()] != round) {
+    m_nodeRound[node->getNodeId()] = round;
+    record.synced++;
+    record.lastSync = Simulator::Now();
+  }
+}
+
+#ifdef PTP_INSTRUMENTATION
+const PtpInstrumentation &PTPNetwork::getInstrumentation() {
+  return m_instrumentation;
+}
+#endif
+
+uint64_t PTPNetwork::getInvalidPacketCount() {
+  return m_invalidPacketCount;
+}
+
+const std::vector<PtpRound_t> &PTPNetwork::getRounds() {
+  return m_rounds;
+}
+
+void PTPNetwork::startSyncTimers(uint16_t nodeId, Time delay) {
+  PtpNode *node = this->getNodeById(nodeId);
+  m_syncTimersStarted[nodeId] = true;
+  std::vector<SocketLink *> ports;
+  for(int i = 0; i < node->getNumNeighbors(); i++) {
+    SocketLink *sockToNeighbor = node->getTxSocket(i);
+    // Only the slaves of the node get SYNC from it
+    if(isSlaveOf(sockToNeighbor->getDstId(), nodeId)) {
+      ports.push_back(sockToNeighbor);
+    }
+  }
+  SocketLink *groupLink = getGroupSocketLink(nodeId);
+  if(groupLink != NULL && !ports.empty()) {
+    // One SYNC and FOLLOW for all the slaves
+    ports.assign(1, groupLink);
+  }
+  for(uint32_t i = 0; i < ports.size(); i++) {
+    PtpSyncTimer_t &timer = m_syncTimers[ports[i]];
+    timer.lastSync = Simulator::Now();
+    timer.event = Simulator::Schedule(
+      delay, &PTPNetwork::sendPeriodicSync, this, ports[i]
     );
   }
-  m_eventId++;
-  m_iterations--;
-  if(m_iterations != 0) {
-    Simulator::Schedule(
-      Seconds(1.0),
-      &PTPNetwork::startPTPProtocol, this
+}
+
+void PTPNetwork::sendPeriodicSync(SocketLink *socketLink) {
+  if(Simulator::Now() >= m_stopTime || m_failedNodes[socketLink->getHostId()]) {
+    return;
+  }
+  // The port is started again if a slave comes back to it
+  if(!hasSlaves(socketLink)) {
+    return;
+  }
+  sendSyncFollowPacket(
+    socketLink, getNodeById(socketLink->getHostId())->getNewEventId()
+  );
+  PtpSyncTimer_t &timer = m_syncTimers[socketLink];
+  timer.lastSync = Simulator::Now();
+  timer.event = Simulator::Schedule(
+    getPortSyncInterval(socketLink),
+    &PTPNetwork::sendPeriodicSync, this, socketLink
+  );
+}
+
+Time PTPNetwork::getPortSyncInterval(SocketLink *socketLink) {
+  if(socketLink->getDstId() != PTP_GROUP_NODE_ID) {
+    return this->getNodeById(socketLink->getDstId())->getSyncInterval();
+  }
+  uint16_t hostId = socketLink->getHostId();
+  PtpNode *host = this->getNodeById(hostId);
+  Time interval = m_interPacketInterval;
+  bool found = false;
+  for(int i = 0; i < host->getNumNeighbors(); i++) {
+    PtpNode *neighbor = this->getNodeById(host->getTxSocket(i)->getDstId());
+    if(isSlaveOf(neighbor->getNodeId(), hostId) &&
+       (!found || neighbor->getSyncInterval() < interval)) {
+      interval = neighbor->getSyncInterval();
+      found = true;
+    }
+  }
+  return interval;
+}
+
+void PTPNetwork::rescheduleSync(uint16_t slaveId) {
+  uint16_t masterId = this->getNodeById(slaveId)->getMasterId();
+  SocketLink *port = getGroupSocketLink(masterId);
+  if(port == NULL) {
+    port = this->getNodeById(masterId)->getTxSocketByNodeId(slaveId);
+  }
+  std::unordered_map<SocketLink *, PtpSyncTimer_t>::iterator it =
+    m_syncTimers.find(port);
+  if(it == m_syncTimers.end() || !it->second.event.IsRunning()) {
+    return;
+  }
+  Time next = it->second.lastSync + getPortSyncInterval(port);
+  if(next < Simulator::Now()) {
+    next = Simulator::Now();
+  }
+  if(next < Simulator::Now() + Simulator::GetDelayLeft(it->second.event)) {
+    Simulator::Cancel(it->second.event);
+    it->second.event = Simulator::Schedule(
+      next - Simulator::Now(), &PTPNetwork::sendPeriodicSync, this, port
     );
   }
 }
@@ -227,108 +824,137 @@ void PTPNetwork::startPTPProtocol() {
 void PTPNetwork::sendSyncFollowPacket(
   SocketLink *socketLink, int eventId
 ) {
+  PTP_INSTRUMENT_SCOPE(m_instrumentation, PTP_PROBE_SEND_SYNC_FOLLOW);
   uint16_t txId = socketLink->getHostId();
   uint16_t rxId = socketLink->getDstId();
   PtpNode *txNode = m_nodes[txId];
   Ptr<Socket> sock = socketLink->getSocket();
   uint64_t syncId = txNode->getNewSyncId(rxId);
 
-  PtpMessage_t *msgSync = (PtpMessage_t *) std::malloc(sizeof(PtpMessage_t));
-  msgSync->txNodeId = txNode->getNodeId();
-  msgSync->txNodeHop = txNode->getNodeHop();
-  msgSync->messageType = SYNC;
-  msgSync->eventId = eventId;
-  msgSync->syncId = syncId;
-  msgSync->timeStamp = txNode->getSyncSendTimeStamp(rxId).GetNanoSeconds();
+  PtpHeader syncHeader;
+  syncHeader.setTxNodeId(txNode->getNodeId());
+  syncHeader.setMessageType(SYNC);
+  syncHeader.setEventId(eventId);
+  syncHeader.setSyncId(syncId);
+  if(m_oneStepClock) {
+    // The transmit time stamp is inserted into the SYNC on the fly
+    txNode->setSyncSendTimeStamp(txNode->getLocalTime(), rxId);
+    syncHeader.setTwoStep(false);
+  }
+  syncHeader.setTimeStamp(txNode->getSyncSendTimeStamp(rxId));
 
   // Send Sync Packet
-  Ptr<Packet> pktSync = Create<Packet>((uint8_t *) msgSync, sizeof(PtpMessage_t));
+  Ptr<Packet> pktSync = Create<Packet>();
+  pktSync->AddHeader(syncHeader);
+  tagEventMessage(txNode, pktSync);
   sock->Send(pktSync);
 
+  NS_LOG_DEBUG("sending SYNC packet\n");
+  txNode->incrementSentPacketCounter(
+    SYNC, syncHeader.GetSerializedSize() + PTP_UDP_IP_OVERHEAD
+  );
+  if(m_oneStepClock) {
+    return;
+  }
+
   // Timestamping
-  m_globalTime = NanoSeconds(Simulator::Now());
-  setLocalTimeAtNodes();
   txNode->setSyncSendTimeStamp(txNode->getLocalTime(), rxId);
-  NS_LOG_DEBUG("sending SYNC packet\n");
-  txNode->incrementSentPacketCounter(SYNC);
 
   // constructing FOLLOW-UP packet
-  PtpMessage_t *msgFollow = (PtpMessage_t *) std::malloc(sizeof(PtpMessage_t));
-  msgFollow->txNodeId = txNode->getNodeId();
-  msgFollow->txNodeHop = txNode->getNodeHop();
-  msgFollow->messageType = FOLLOW;
-  msgFollow->eventId = eventId;
-  msgFollow->syncId = syncId;
-  msgFollow->timeStamp = txNode->getSyncSendTimeStamp(rxId).GetNanoSeconds();
+  PtpHeader followHeader;
+  followHeader.setTxNodeId(txNode->getNodeId());
+  followHeader.setMessageType(FOLLOW);
+  followHeader.setEventId(eventId);
+  followHeader.setSyncId(syncId);
+  followHeader.setTimeStamp(txNode->getSyncSendTimeStamp(rxId));
 
   // Send FOLLOW UP Packet
-  Ptr<Packet> pktFollow = Create<Packet>((uint8_t *) msgFollow, sizeof(PtpMessage_t));
+  Ptr<Packet> pktFollow = Create<Packet>();
+  pktFollow->AddHeader(followHeader);
   sock->Send(pktFollow);
 
-  // TimeStamping?
-  m_globalTime = NanoSeconds(Simulator::Now());
-  setLocalTimeAtNodes();
   NS_LOG_DEBUG("sending FOLLOW packet\n");
-  txNode->incrementSentPacketCounter(FOLLOW);
+  txNode->incrementSentPacketCounter(
+    FOLLOW, followHeader.GetSerializedSize() + PTP_UDP_IP_OVERHEAD
+  );
+}
+
+void PTPNetwork::setTimestamper(uint16_t nodeId, Ptr<PtpTimestamper> timestamper) {
+  m_timestampers[nodeId] = timestamper;
+}
+
+void PTPNetwork::tagEventMessage(PtpNode *txNode, Ptr<Packet> packet) {
+  packet->AddPacketTag(PtpCorrectionTag());
+  Ptr<PtpTimestamper> timestamper = m_timestampers[txNode->getNodeId()];
+  if(timestamper) {
+    timestamper->transmit(packet);
+  }
+}
+
+Time PTPNetwork::getReceiveTime(PtpNode *hostNode, Ptr<const Packet> packet) {
+  Ptr<PtpTimestamper> timestamper = m_timestampers[hostNode->getNodeId()];
+  if(!timestamper) {
+    return hostNode->getLocalTime();
+  }
+  return timestamper->getReceiveTime(packet);
+}
+
+void PTPNetwork::scheduleDreqPacket(SocketLink *socketLink) {
+  Simulator::Schedule(
+    NanoSeconds(0), 
+    &PTPNetwork::sendDreqPacket,
+    this, socketLink, getNodeById(socketLink->getHostId())->getNewEventId()
+  );
+}
 
-  // Free both malloced buffer
-  std::free(msgSync);
-  std::free(msgFollow);
+void PTPNetwork::setOneStepClock(bool oneStep) {
+  m_oneStepClock = oneStep;
 }
 
 void PTPNetwork::sendDreqPacket(SocketLink *socketLink, int eventId) {
+  PTP_INSTRUMENT_SCOPE(m_instrumentation, PTP_PROBE_SEND_DREQ);
   PtpNode *txNode = this->getNodeById(socketLink->getHostId());
   // Prepare DREQ message
-  PtpMessage_t *msgDreq = (PtpMessage_t *) std::malloc(sizeof(PtpMessage_t));
-  msgDreq->txNodeId = txNode->getNodeId();
-  msgDreq->txNodeHop = txNode->getNodeHop();
-  msgDreq->messageType = DREQ;
-  msgDreq->eventId = eventId;
-  msgDreq->timeStamp = 0;
+  PtpHeader dreqHeader;
+  dreqHeader.setTxNodeId(txNode->getNodeId());
+  dreqHeader.setMessageType(DREQ);
+  dreqHeader.setEventId(eventId);
+  dreqHeader.setSyncId(txNode->getPtpSyncId(FOLLOW));
   // Send packet
-  Ptr<Packet> pktDreq = Create<Packet>((uint8_t *) msgDreq, sizeof(PtpMessage_t));
+  Ptr<Packet> pktDreq = Create<Packet>();
+  pktDreq->AddHeader(dreqHeader);
+  tagEventMessage(txNode, pktDreq);
   socketLink->getSocket()->Send(pktDreq);
 
   // Time Stamp
   txNode->setState(WAITING);
-  m_globalTime = NanoSeconds(Simulator::Now());
-  setLocalTimeAtNodes();
   txNode->setDreqSendTime(txNode->getLocalTime());
   NS_LOG_DEBUG("sending DREQ packet\n");
-  txNode->incrementSentPacketCounter(DREQ);
-
-  // Free malloced buffer
-  free(msgDreq);
+  txNode->incrementSentPacketCounter(
+    DREQ, dreqHeader.GetSerializedSize() + PTP_UDP_IP_OVERHEAD
+  );
 }
 
 void PTPNetwork::sendDrplyPacket(SocketLink *socketLink, int eventId) {
+  PTP_INSTRUMENT_SCOPE(m_instrumentation, PTP_PROBE_SEND_DRPLY);
   PtpNode *txNode = this->getNodeById(socketLink->getHostId());
   PtpNode *rxNode = this->getNodeById(socketLink->getDstId());
-  // Prepare DREQ message
-  PtpMessage_t *msgDrply = (PtpMessage_t *) std::malloc(sizeof(PtpMessage_t));
-  msgDrply->txNodeId = txNode->getNodeId();
-  msgDrply->txNodeHop = txNode->getNodeHop();
-  msgDrply->messageType = DRPLY;
-  msgDrply->eventId = eventId;
-  msgDrply->timeStamp = txNode->getDreqRecvTimeStamp(rxNode->getNodeId()).GetNanoSeconds();
+  // Prepare DRPLY message
+  PtpHeader drplyHeader;
+  drplyHeader.setTxNodeId(txNode->getNodeId());
+  drplyHeader.setMessageType(DRPLY);
+  drplyHeader.setEventId(eventId);
+  drplyHeader.setTimeStamp(txNode->getDreqRecvTimeStamp(rxNode->getNodeId()));
+  drplyHeader.setCorrection(txNode->getDreqRecvCorrection(rxNode->getNodeId()));
   // Send packet
-  Ptr<Packet> pktDrply = Create<Packet>((uint8_t *) msgDrply, sizeof(PtpMessage_t));
+  Ptr<Packet> pktDrply = Create<Packet>();
+  pktDrply->AddHeader(drplyHeader);
   socketLink->getSocket()->Send(pktDrply);
 
-  // Time Stamp
-  m_globalTime = NanoSeconds(Simulator::Now());
-  setLocalTimeAtNodes();
   NS_LOG_DEBUG("sending DRPLY packet\n");
-  txNode->incrementSentPacketCounter(DRPLY);
-
-  // Free malloced buffer
-  free(msgDrply);
-}
-
-void PTPNetwork::setLocalTimeAtNodes() {
-  for(uint32_t i = 0; i < m_nodes.size(); i++) {
-    m_nodes[i]->setLocalTime(m_globalTime);
-  }
+  txNode->incrementSentPacketCounter(
+    DRPLY, drplyHeader.GetSerializedSize() + PTP_UDP_IP_OVERHEAD
+  );
 }
 
 void PTPNetwork::startTcpTraffic(Time interval, uint32_t packetSize) {
@@ -404,10 +1030,14 @@ void PTPNetwork::echoTcpTraffic(
 }
 
 void PTPNetwork::printClockValuesOfNodes(
-  Ipv4Address txIp, Ipv4Address rxIp, 
-  uint16_t txHop, PtpMessageType_t msgType,
-  Time dreqAtMaster, Time syncSendTime, int id
+  PtpNode *txNode, PtpNode *rxNode, PtpMessageType_t msgType, int id
 ) {
+  PTP_INSTRUMENT_SCOPE(m_instrumentation, PTP_PROBE_PRINT_CLOCK_VALUES);
+  // Building the table is O(N), skip it unless it is going to be logged.
+  if(!isClockDumpEnabled()) {
+    return;
+  }
+
   std::string strMsgType;
   switch(msgType) {
     case SYNC:
@@ -422,6 +1052,18 @@ void PTPNetwork::printClockValuesOfNodes(
     case DRPLY:
       strMsgType = "DELAY REPLY";
       break;
+    case PDELAY_REQ:
+      strMsgType = "PEER DELAY REQUEST";
+      break;
+    case PDELAY_RESP:
+      strMsgType = "PEER DELAY RESPONSE";
+      break;
+    case PDELAY_FOLLOW:
+      strMsgType = "PEER DELAY RESPONSE FOLLOW UP";
+      break;
+    case ANNOUNCE:
+      strMsgType = "ANNOUNCE";
+      break;
     default:
       strMsgType = "UNKNOWN";
       break;
@@ -430,12 +1072,14 @@ void PTPNetwork::printClockValuesOfNodes(
   std::stringstream clockValuesLog;
 
   clockValuesLog << "----------------------------------------- " << std::endl;
-  clockValuesLog << " Sender: " << txIp << " [hop: " << txHop << "]" << std::endl;
-  clockValuesLog << " Receiver: " << rxIp << std::endl;
+  clockValuesLog << " Sender: " << txNode->getIpv4Address() << 
+    " [hop: " << txNode->getNodeHop() << "]" << std::endl;
+  clockValuesLog << " Receiver: " << rxNode->getIpv4Address() << std::endl;
   clockValuesLog << " Message Type: " << strMsgType << " , ID: " << id << std::endl;
   clockValuesLog << " TxNode Timestamps: " << 
-    std::setw(12) << dreqAtMaster.GetNanoSeconds() << " [DREQ], " <<
-    std::setw(12) << syncSendTime.GetNanoSeconds() << " [SYNC]" << std::endl;
+    std::setw(12) << txNode->getDreqSendTime().GetNanoSeconds() << " [DREQ], " <<
+    std::setw(12) << txNode->getSyncSendTimeStamp(rxNode->getNodeId()).GetNanoSeconds() << 
+    " [SYNC]" << std::endl;
   clockValuesLog << std::endl;
   clockValuesLog << std::setw(6) << "NodeId" << " => " <<
     std::setw(12) << "ClockDev." << " => " <<
@@ -450,52 +1094,14 @@ void PTPNetwork::printClockValuesOfNodes(
     std::setw(17) << "FOLLOW-UP" << " => " <<
     std::setw(17) << "DELAY-REQ" << " => " <<
     std::setw(17) << "DELAY-RPLY" << std::endl;
-  PtpNode *masterNode = this->getNodeById(m_masterIndex);
-  for(uint32_t j = 0; j < m_users; j++) {
-    PtpNode *node = this->getNodeById(j);
-    Time clockTime = node->getLocalTime();
-    NodeState_t nodeState = node->getState();
-    std::string strNodeState;
-    switch(nodeState) {
-      case INACTIVE:
-        strNodeState = "INACTIVE";
-        break;
-      case ACTIVE:
-        strNodeState = "ACTIVE";
-        break;
-      case WAITING:
-        strNodeState = "WAITING";
-        break;
-      case SYNCED:
-        strNodeState = "SYNCED";
-        break;
-      default:
-        strNodeState = "UNKNOWN";
-        break;
-    }
-    // The offset between the local time of a node w.r.t. to the master clock.
-    Time presentOffset = NanoSeconds(
-      node->getLocalTime().GetNanoSeconds() - 
-      masterNode->getLocalTime().GetNanoSeconds()
-    );
-    clockValuesLog << std::setw(6) << j << "    " <<
-      std::setw(12) << node->getClockError() << "    " <<
-      std::setw(12) << "EBS N/A" << "    " <<
-      std::setw(12) << "EAS N/A" << "    " <<
-      std::setw(12) << node->getLocalTime().GetNanoSeconds() << "    " <<
-      std::setw(12) << strNodeState << "    " <<
-      std::setw(12) << presentOffset.GetNanoSeconds() << "    " <<
-      std::setw(12) << "N/A" << "    " <<
-      std::setw(12) << "N/A" << "    " << 
-      std::setw(2) << node->getSentPacketCounter(SYNC) << " [tx] , " <<
-      std::setw(2) << node->getReceivedPacketCounter(SYNC) << " [rx]    " <<
-      std::setw(2) << node->getSentPacketCounter(FOLLOW) << " [tx] , " <<
-      std::setw(2) << node->getReceivedPacketCounter(FOLLOW) << " [rx]    " <<
-      std::setw(2) << node->getSentPacketCounter(DREQ) << " [tx] , " <<
-      std::setw(2) << node->getReceivedPacketCounter(DREQ) << " [rx]    " <<
-      std::setw(2) << node->getSentPacketCounter(DRPLY) << " [tx] , " <<
-      std::setw(2) << node->getReceivedPacketCounter(DRPLY) << " [rx]    " <<
-      std::endl;;
+  PtpNode *masterNode = this->getNodeById(rxNode->getGrandmasterId());
+  if(m_clockDumpScope == DUMP_SENDER_RECEIVER) {
+    printClockValuesOfNode(clockValuesLog, txNode, masterNode);
+    printClockValuesOfNode(clockValuesLog, rxNode, masterNode);
+  } else {
+    for(uint32_t j = 0; j < m_users; j++) {
+      printClockValuesOfNode(clockValuesLog, this->getNodeById(j), masterNode);
+    }
   }
   clockValuesLog << "----------------------------------------- " << std::endl;
   clockValuesLog << std::endl << std::endl;
@@ -503,19 +1109,301 @@ void PTPNetwork::printClockValuesOfNodes(
   NS_LOG_DEBUG(clockValuesLog.str());
 }
 
-void PTPNetwork::setAnimationInterface(
-  AnimationInterface *anim, int offsetCounterId
+void PTPNetwork::printClockValuesOfNode(
+  std::stringstream &clockValuesLog, PtpNode *node, PtpNode *masterNode
+) {
+  NodeState_t nodeState = node->getState();
+  std::string strNodeState;
+  switch(nodeState) {
+    case INACTIVE:
+      strNodeState = "INACTIVE";
+      break;
+    case ACTIVE:
+      strNodeState = "ACTIVE";
+      break;
+    case WAITING:
+      strNodeState = "WAITING";
+      break;
+    case SYNCED:
+      strNodeState = "SYNCED";
+      break;
+    default:
+      strNodeState = "UNKNOWN";
+      break;
+  }
+  // The offset between the local time of a node w.r.t. to the master clock.
+  Time presentOffset = NanoSeconds(
+    node->getLocalTime().GetNanoSeconds() - 
+    masterNode->getLocalTime().GetNanoSeconds()
+  );
+  clockValuesLog << std::setw(6) << node->getNodeId() << "    " <<
+    std::setw(12) << node->getClockError() << "    " <<
+    std::setw(12) << "EBS N/A" << "    " <<
+    std::setw(12) << "EAS N/A" << "    " <<
+    std::setw(12) << node->getLocalTime().GetNanoSeconds() << "    " <<
+    std::setw(12) << strNodeState << "    " <<
+    std::setw(12) << presentOffset.GetNanoSeconds() << "    " <<
+    std::setw(12) << "N/A" << "    " <<
+    std::setw(12) << "N/A" << "    " << 
+    std::setw(2) << node->getSentPacketCounter(SYNC) << " [tx] , " <<
+    std::setw(2) << node->getReceivedPacketCounter(SYNC) << " [rx]    " <<
+    std::setw(2) << node->getSentPacketCounter(FOLLOW) << " [tx] , " <<
+    std::setw(2) << node->getReceivedPacketCounter(FOLLOW) << " [rx]    " <<
+    std::setw(2) << node->getSentPacketCounter(DREQ) << " [tx] , " <<
+    std::setw(2) << node->getReceivedPacketCounter(DREQ) << " [rx]    " <<
+    std::setw(2) << node->getSentPacketCounter(DRPLY) << " [tx] , " <<
+    std::setw(2) << node->getReceivedPacketCounter(DRPLY) << " [rx]    " <<
+    std::endl;
+}
+
+bool PTPNetwork::isClockDumpEnabled() {
+#ifdef NS3_LOG_ENABLE
+  return g_log.IsEnabled(LOG_DEBUG);
+#else
+  return false;
+#endif
+}
+
+void PTPNetwork::setClockDumpScope(ClockDumpScope_t scope) {
+  m_clockDumpScope = scope;
+}
+
+void PTPNetwork::connectOffsetErrorTrace(
+  Callback<void, uint16_t, double> callback
 ) {
-  m_anim = anim;
-  m_ptpOffsetCounterId = offsetCounterId;
+  m_offsetErrorTrace.ConnectWithoutContext(callback);
+}
+
+void PTPNetwork::disconnectOffsetErrorTrace(
+  Callback<void, uint16_t, double> callback
+) {
+  m_offsetErrorTrace.DisconnectWithoutContext(callback);
 }
 
 void PTPNetwork::setSimulationIterations(int iterations) {
   m_iterations = iterations;
 }
 
+void PTPNetwork::writeOffsetTrace(PtpNode *node, int eventId) {
+  if(!m_traceWriter.isOpen() && !m_traceWriter.open(m_logdir + "ptp_offset.bin")) {
+    // Reported once, the summary statistics do not depend on the trace
+    std::cerr << "[PTPNetwork::writeOffsetTrace] Error: Offset trace " <<
+      "disabled." << std::endl;
+    m_offsetTraceEnabled = false;
+    return;
+  }
+  PtpTraceRecord_t record;
+  record.nodeId = node->getNodeId();
+  record.eventId = eventId;
+  record.simTime = Simulator::Now().GetNanoSeconds();
+  record.preOffsetError = node->getPreviousOffsetError();
+  record.postOffsetError = node->getCurrentOffsetError();
+  m_traceWriter.write(record);
+}
+
+void PTPNetwork::setOffsetTraceEnabled(bool enabled) {
+  m_offsetTraceEnabled = enabled;
+}
+
+void PTPNetwork::setConvergenceThreshold(double threshold) {
+  m_convergenceThreshold = threshold;
+  for(uint32_t i = 0; i < m_nodes.size(); i++) {
+    m_nodes[i]->setConvergenceThreshold(threshold);
+  }
+}
+
+PtpOffsetStatistics PTPNetwork::getOffsetStatistics() {
+  PtpOffsetStatistics networkStatistics;
+  for(uint32_t i = 0; i < m_nodes.size(); i++) {
+    if(!m_nodes[i]->isGlobalMaster()) {
+      networkStatistics.merge(m_nodes[i]->getOffsetStatistics());
+    }
+  }
+  return networkStatistics;
+}
+
+void PTPNetwork::writeSummaryRow(
+  std::ofstream &summary, std::string name, const PtpOffsetStatistics &stats
+) {
+  Time convergenceTime = stats.getConvergenceTime();
+  summary << name << "," << stats.getCount() << "," <<
+    stats.getMean() << "," << stats.getStdDev() << "," <<
+    stats.getMin() << "," << stats.getMax() << "," <<
+    stats.getQuantile(0.5) << "," << stats.getQuantile(0.99) << "," <<
+    stats.getQuantile(0.999) << "," <<
+    (stats.isConverged() ? convergenceTime.GetSeconds() : -1) << '\n';
+}
+
+void PTPNetwork::setChannelDataRate(DataRate dataRate) {
+  m_channelDataRate = dataRate.GetBitRate();
+}
+
+void PTPNetwork::writeMessageCounters() {
+  std::ofstream counters((m_logdir + "ptp_messages.csv").c_str());
+  if(!counters.is_open()) {
+    std::cerr << "[PTPNetwork::writeMessageCounters] Failed to create " <<
+      m_logdir << "ptp_messages.csv." << std::endl;
+    return;
+  }
+  const char *msgNames[PTP_NUM_MESSAGE_TYPES] = {
+    "sync", "follow", "dreq", "drply", "pdelay_req", "pdelay_resp", "pdelay_follow",
+    "announce"
+  };
+  counters << "node";
+  for(int type = SYNC; type < PTP_NUM_MESSAGE_TYPES; type++) {
+    counters << "," << msgNames[type] << "_tx," << msgNames[type] << "_bytes," <<
+      msgNames[type] << "_rx," << msgNames[type] << "_overheard";
+  }
+  counters << ",channel_utilization" << '\n';
+  // Share of the channel over the PTP run, in percent
+  double capacity = (m_stopTime - m_startTime).GetSeconds() * m_channelDataRate;
+  uint64_t totalPackets[PTP_NUM_MESSAGE_TYPES] = { 0 };
+  uint64_t totalBytes[PTP_NUM_MESSAGE_TYPES] = { 0 };
+  uint64_t totalReceived[PTP_NUM_MESSAGE_TYPES] = { 0 };
+  uint64_t totalOverheard[PTP_NUM_MESSAGE_TYPES] = { 0 };
+  uint64_t allBytes = 0;
+  for(uint32_t i = 0; i < m_nodes.size(); i++) {
+    uint64_t nodeBytes = 0;
+    counters << m_nodes[i]->getNodeId();
+    for(int type = SYNC; type < PTP_NUM_MESSAGE_TYPES; type++) {
+      PtpMessageType_t msgType = (PtpMessageType_t) type;
+      counters << "," << m_nodes[i]->getSentPacketCounter(msgType) <<
+        "," << m_nodes[i]->getSentByteCounter(msgType) <<
+        "," << m_nodes[i]->getReceivedPacketCounter(msgType) <<
+        "," << m_nodes[i]->getOverheardPacketCounter(msgType);
+      totalPackets[type] += m_nodes[i]->getSentPacketCounter(msgType);
+      totalBytes[type] += m_nodes[i]->getSentByteCounter(msgType);
+      totalReceived[type] += m_nodes[i]->getReceivedPacketCounter(msgType);
+      totalOverheard[type] += m_nodes[i]->getOverheardPacketCounter(msgType);
+      nodeBytes += m_nodes[i]->getSentByteCounter(msgType);
+    }
+    counters << ",";
+    if(capacity > 0) {
+      counters << 100.0 * nodeBytes * 8 / capacity;
+    }
+    counters << '\n';
+    allBytes += nodeBytes;
+  }
+  uint64_t allPackets = 0;
+  counters << "all";
+  for(int type = SYNC; type < PTP_NUM_MESSAGE_TYPES; type++) {
+    counters << "," << totalPackets[type] << "," << totalBytes[type] <<
+      "," << totalReceived[type] << "," << totalOverheard[type];
+    allPackets += totalPackets[type];
+  }
+  counters << ",";
+  if(capacity > 0) {
+    counters << 100.0 * allBytes * 8 / capacity;
+    NS_LOG_INFO("PTP sent " << allPackets << " packets, " << allBytes <<
+      " Bytes, " << 100.0 * allBytes * 8 / capacity << "% of the channel.");
+  } else {
+    NS_LOG_INFO("PTP sent " << allPackets << " packets, " << allBytes <<
+      " Bytes.");
+  }
+  counters << '\n';
+}
+
+void PTPNetwork::writeRounds() {
+  std::ofstream rounds((m_logdir + "ptp_rounds.csv").c_str());
+  if(!rounds.is_open()) {
+    std::cerr << "[PTPNetwork::writeRounds] Failed to create " <<
+      m_logdir << "ptp_rounds.csv." << std::endl;
+    return;
+  }
+  uint32_t slaves = 0;
+  for(uint32_t i = 0; i < m_nodes.size(); i++) {
+    if(!m_failedNodes[i] && m_nodes[i]->getMasterId() != m_nodes[i]->getNodeId()) {
+      slaves++;
+    }
+  }
+  // latency: from the start of the round until every slave got synchronized
+  rounds << "round,start,synced,latency,max_offset_error" << '\n';
+  uint32_t completeRounds = 0;
+  int64_t totalLatency = 0;
+  int64_t maxLatency = 0;
+  for(uint32_t i = 0; i < m_rounds.size(); i++) {
+    Time start = m_startTime + NanoSeconds(m_interPacketInterval.GetNanoSeconds() * i);
+    int64_t latency = -1;
+    if(m_rounds[i].synced >= slaves) {
+      latency = (m_rounds[i].lastSync - start).GetNanoSeconds();
+      completeRounds++;
+      totalLatency += latency;
+      maxLatency = std::max(maxLatency, latency);
+    }
+    rounds << i << "," << start.GetSeconds() << "," << m_rounds[i].synced <<
+      "," << latency << "," << m_rounds[i].maxOffsetError << '\n';
+  }
+  if(completeRounds > 0) {
+    NS_LOG_INFO("All slaves synchronized in " << completeRounds << " of " <<
+      m_rounds.size() << " rounds, latency mean " << totalLatency / completeRounds <<
+      " ns, max " << maxLatency << " ns.");
+  }
+}
+
+void PTPNetwork::writeFailovers() {
+  if(m_failovers.empty()) {
+    return;
+  }
+  std::ofstream failovers((m_logdir + "ptp_failover.csv").c_str());
+  if(!failovers.is_open()) {
+    std::cerr << "[PTPNetwork::writeFailovers] Failed to create " <<
+      m_logdir << "ptp_failover.csv." << std::endl;
+    return;
+  }
+  // latencies from the failure, -1 if never reached
+  failovers << "node,fail_time,was_grandmaster,grandmaster,election_latency,resync_latency" << '\n';
+  for(uint32_t i = 0; i < m_failovers.size(); i++) {
+    const PtpFailover_t &failover = m_failovers[i];
+    int64_t election = -1;
+    int64_t resync = -1;
+    if(!failover.electedTime.IsStrictlyNegative()) {
+      election = (failover.electedTime - failover.failTime).GetNanoSeconds();
+    }
+    if(!failover.resyncTime.IsStrictlyNegative()) {
+      resync = (failover.resyncTime - failover.failTime).GetNanoSeconds();
+    }
+    failovers << failover.nodeId << "," << failover.failTime.GetSeconds() << "," <<
+      failover.grandmaster << "," << failover.newGrandmaster << "," << election <<
+      "," << resync << '\n';
+    NS_LOG_INFO("Node " << failover.nodeId << " failed: election " << election <<
+      " ns, resync " << resync << " ns.");
+  }
+}
+
 void PTPNetwork::closeLogs() {
-  for(uint32_t i=0; i < m_fileStreams.size(); i++) {
-    m_fileStreams[i]->close();
+  writeMessageCounters();
+  writeRounds();
+  writeFailovers();
+  if(m_invalidPacketCount > 0) {
+    NS_LOG_INFO(m_invalidPacketCount << " invalid PTP messages dropped.");
+  }
+  std::ofstream summary((m_logdir + "ptp_summary.csv").c_str());
+  if(!summary.is_open()) {
+    std::cerr << "[PTPNetwork::closeLogs] Failed to create " << m_logdir <<
+      "ptp_summary.csv." << std::endl;
+  } else {
+    summary << "node,samples,mean,stddev,min,max,p50,p99,p999,converged_at" << '\n';
+    for(uint32_t i = 0; i < m_nodes.size(); i++) {
+      if(!m_nodes[i]->isGlobalMaster()) {
+        std::stringstream name;
+        name << m_nodes[i]->getNodeId();
+        writeSummaryRow(summary, name.str(), m_nodes[i]->getOffsetStatistics());
+      }
+    }
+    PtpOffsetStatistics networkStatistics = getOffsetStatistics();
+    writeSummaryRow(summary, "all", networkStatistics);
+    NS_LOG_INFO("Offset error over " << networkStatistics.getCount() <<
+      " syncs: mean " << networkStatistics.getMean() << " ns, p99 " <<
+      networkStatistics.getQuantile(0.99) << " ns.");
+  }
+#ifdef PTP_INSTRUMENTATION
+  std::ofstream report((m_logdir + "ptp_instrumentation.csv").c_str());
+  if(!report.is_open()) {
+    std::cerr << "[PTPNetwork::closeLogs] Failed to create " << m_logdir <<
+      "ptp_instrumentation.csv." << std::endl;
+  } else {
+    m_instrumentation.writeReport(report);
   }
+#endif
+  m_traceWriter.close();
 }
\ No newline at end of file
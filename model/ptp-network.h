@@ -24,15 +24,78 @@
 
 #include "ns3/core-module.h"
 #include "ns3/internet-module.h"
-#include "ns3/netanim-module.h"
+#include "ns3/data-rate.h"
 #include <vector>
 #include <cstdlib>
 #include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include "ptp-header.h"
+#include "ptp-instrumentation.h"
 #include "ptp-node.h"
 #include "ptp-socket-link.h"
+#include "ptp-statistics.h"
+#include "ptp-timestamper.h"
+#include "ptp-trace-writer.h"
+#include "ptp-transparent-clock.h"
 
 using namespace ns3;
 
+/**
+ * @brief Nodes listed in the clock value dump of each PTP message
+ * DUMP_ALL_NODES: Every node in the network
+ * DUMP_SENDER_RECEIVER: Only the sender and the receiver of the message
+ */
+typedef enum {
+  DUMP_ALL_NODES = 0,
+  DUMP_SENDER_RECEIVER
+} ClockDumpScope_t;
+
+/**
+ * @brief How slaves measure the delay to their master
+ * DELAY_E2E: DREQ and DRPLY with the master after every SYNC
+ * DELAY_P2P: Pdelay_Req, Pdelay_Resp and Pdelay_Resp_Follow_Up on the link
+ * to the master, at the peer delay interval; a SYNC alone then gives the
+ * offset
+ */
+typedef enum {
+  DELAY_E2E = 0,
+  DELAY_P2P
+} PtpDelayMechanism_t;
+
+/**
+ * @brief SYNC timer of a master port (a socket link towards a slave or the
+ * group)
+ */
+typedef struct {
+  EventId event; //< Next SYNC
+  Time lastSync; //< Time of the last SYNC
+} PtpSyncTimer_t;
+
+/**
+ * @brief Synchronization of the network in one round (one initial sync
+ * interval)
+ */
+typedef struct {
+  uint32_t synced; //< Slaves synchronized in the round
+  Time lastSync; //< Time the last of them got synchronized
+  double maxOffsetError; //< Largest offset error after a sync in the round
+} PtpRound_t;
+
+/**
+ * @brief Recovery of the network after a node failed
+ */
+typedef struct {
+  uint16_t nodeId; //< Failed node
+  Time failTime; //< Time the node failed
+  bool grandmaster; //< Whether the node was a grandmaster
+  uint16_t newGrandmaster; //< Grandmaster all the other nodes agreed on
+  Time electedTime; //< Time they agreed on it, negative if they never did
+  Time resyncTime; //< Time all of them synchronized since, negative if they never did
+  uint32_t slaves; //< Slaves of the new grandmaster
+  uint32_t resynced; //< Slaves synchronized since the election
+} PtpFailover_t;
+
 /**
  * \brief IEEE 1588 Test Network Structure
  * 
@@ -47,7 +110,8 @@ public:
    * @param users Number of users in the network.
    * @param neighborNode Neighbors of each user in the network,.
    * @param packetSize Default message packet size.
-   * @param interPacketInterval Transmission interval of packets
+   * @param interPacketInterval Interval between SYNC messages each node
+   * starts with (2^logSyncInterval seconds).
    */
   PTPNetwork (
     const uint32_t users,
@@ -63,6 +127,38 @@ public:
    */
   void addSocketLink(SocketLink *socketLink);
 
+  /**
+   * @brief Add the socket link used by a node to send SYNC and FOLLOW to all
+   * of its neighbors at once
+   * 
+   * The link goes to PTP_GROUP_NODE_ID (an IPv4 multicast or broadcast
+   * address). Nodes with a group link send one SYNC and FOLLOW per round
+   * instead of one per neighbor. The sockets receiving group messages are
+   * added with `addSocketLink`, with PTP_GROUP_NODE_ID as destination.
+   * 
+   * @param socketLink 
+   */
+  void addGroupSocketLink(SocketLink *socketLink);
+
+  /**
+   * @brief Get the group socket link of a node
+   * 
+   * @param nodeId 
+   * @return SocketLink* NULL if the node sends SYNC and FOLLOW by unicast.
+   */
+  SocketLink *getGroupSocketLink(uint16_t nodeId);
+
+  /**
+   * @brief Find the socket link that owns a socket
+   * 
+   * The lookup goes through a hash index built by `addSocketLink`, so the
+   * cost does not depend on the number of links in the network.
+   * 
+   * @param socket 
+   * @return SocketLink* NULL if the socket is not registered.
+   */
+  SocketLink *getSocketLink(Ptr<Socket> socket);
+
   void setLogdir(std::string logdir);
   
   /**
@@ -82,6 +178,28 @@ public:
    */
   void addNode(PtpNode *node);
 
+  /**
+   * @brief Pre-allocate storage for nodes and socket links
+   * 
+   * @param nodes Expected number of nodes
+   * @param socketLinks Expected number of socket links
+   */
+  void reserve(uint32_t nodes, uint32_t socketLinks);
+
+  /**
+   * @brief Get the number of PTP nodes in the network
+   * 
+   * @return uint32_t 
+   */
+  uint32_t getNumNodes();
+
+  /**
+   * @brief Set the ID of the node that provides the master clock
+   * 
+   * @param masterIndex 
+   */
+  void setMasterIndex(uint16_t masterIndex);
+
   /**
    * @brief Get the Node By Id object
    * 
@@ -90,11 +208,6 @@ public:
    */
   PtpNode *getNodeById(uint16_t index);
 
-  /**
-   * @brief Set the Local Time At Nodes object
-   */
-  void setLocalTimeAtNodes();
-
   /**
    * @brief Callback function when PTP message is received.
    * 
@@ -106,10 +219,101 @@ public:
    * @brief Start PTP protocol.
    * 
    * The protocol is started by the master sending SYNC and FOLLOW message to its
-   * neighbors.
+   * neighbors. Every port of a master (the link to a slave, or the group
+   * link) then sends SYNC at the sync interval of its slaves; a node starts
+   * its own ports once it is synchronized for the first time, or right away
+   * if it is a boundary clock. The protocol runs for the number of
+   * iterations times the initial sync interval.
    */
   void startPTPProtocol();
 
+  /**
+   * @brief Model boundary clocks
+   * 
+   * Every node starts its master ports with the global master instead of
+   * after its own first sync, so all the hops of a multi-hop network sync
+   * in parallel from the first round on.
+   * 
+   * @param boundaryClock 
+   */
+  void setBoundaryClock(bool boundaryClock);
+
+  /**
+   * @brief Select the delay mechanism (DELAY_E2E by default)
+   * 
+   * @param mechanism 
+   */
+  void setDelayMechanism(PtpDelayMechanism_t mechanism);
+
+  /**
+   * @brief Set the interval between peer delay measurements of a link (the
+   * initial sync interval by default)
+   * 
+   * @param interval 
+   */
+  void setPdelayInterval(Time interval);
+
+  /**
+   * @brief Time stamp the event messages of a node with a PtpTimestamper
+   * 
+   * Nodes without one are stamped by the application, when messages are
+   * sent and read.
+   * 
+   * @param nodeId 
+   * @param timestamper 
+   */
+  void setTimestamper(uint16_t nodeId, Ptr<PtpTimestamper> timestamper);
+
+  /**
+   * @brief Elect the grandmaster and build the synchronization tree with
+   * ANNOUNCE messages and the best master clock algorithm
+   * 
+   * The master and hops given to the nodes are then ignored: every node
+   * starts listening and sends ANNOUNCE to its neighbors once it is a
+   * grandmaster or a slave.
+   * 
+   * @param enabled 
+   */
+  void setBmcaEnabled(bool enabled);
+
+  /**
+   * @brief Set the interval between ANNOUNCE messages (the initial sync
+   * interval by default)
+   * 
+   * @param interval 
+   */
+  void setAnnounceInterval(Time interval);
+
+  /**
+   * @brief Set the number of announce intervals an ANNOUNCE stays valid (3
+   * by default)
+   * 
+   * @param timeout 
+   */
+  void setAnnounceReceiptTimeout(uint32_t timeout);
+
+  /**
+   * @brief Take a node down: it stops sending and drops every message
+   * 
+   * The time until the other nodes agree on a grandmaster again, and until
+   * they are all synchronized to it, is written to `ptp_failover.csv`.
+   * 
+   * @param nodeId 
+   */
+  void failNode(uint16_t nodeId);
+
+  /**
+   * @brief Take down the grandmaster of the first node still up
+   */
+  void failGrandmaster();
+
+  /**
+   * @brief Get the recovery of the network after each failure
+   * 
+   * @return const std::vector<PtpFailover_t>& 
+   */
+  const std::vector<PtpFailover_t> &getFailovers();
+
   /**
    * @brief Send SYNC and FOLLOW packet
    * 
@@ -121,6 +325,16 @@ public:
    */
   void sendSyncFollowPacket(SocketLink *socketLink, int eventId);
 
+  /**
+   * @brief Model one-step clocks
+   * 
+   * A one-step master writes the transmit time stamp into the SYNC itself
+   * and sends no FOLLOW; slaves answer such a SYNC with DREQ right away.
+   * 
+   * @param oneStep 
+   */
+  void setOneStepClock(bool oneStep);
+
   /**
    * @brief Send DREQ packet.
    * 
@@ -129,6 +343,36 @@ public:
    */
   void sendDreqPacket(SocketLink *socketLink, int eventId);
 
+  /**
+   * @brief Send Pdelay_Req packet on the link to the peer
+   * 
+   * @param socketLink 
+   * @param eventId 
+   */
+  void sendPdelayReqPacket(SocketLink *socketLink, int eventId);
+
+  /**
+   * @brief Send Pdelay_Resp and Pdelay_Resp_Follow_Up packets
+   * 
+   * @param socketLink The link to the requester
+   * @param reqHeader The Pdelay_Req answered
+   * @param reqRecvTime Local time the Pdelay_Req was received
+   */
+  void sendPdelayRespPacket(
+    SocketLink *socketLink, PtpHeader reqHeader, Time reqRecvTime
+  );
+
+  /**
+   * @brief Send ANNOUNCE packet.
+   * 
+   * @param socketLink 
+   * @param announce 
+   * @param eventId 
+   */
+  void sendAnnouncePacket(
+    SocketLink *socketLink, const PtpAnnounce_t &announce, int eventId
+  );
+
   /**
    * @brief Send DRPLY packet.
    * 
@@ -165,46 +409,287 @@ public:
   /**
    * @brief Print clock values of a PTP node in the system
    * 
-   * @param txIp 
-   * @param rxIp 
-   * @param txHop 
+   * The table is logged at DEBUG level of the `PtpNetwork` log component
+   * and is only built when that level is enabled.
+   * 
+   * @param txNode Sender of the PTP message
+   * @param rxNode Receiver of the PTP message
    * @param msgType 
-   * @param dreqAtMaster 
-   * @param syncSendTime 
    * @param id 
    */
   void printClockValuesOfNodes(
-    Ipv4Address txIp, Ipv4Address rxIp, 
-    uint16_t txHop, PtpMessageType_t msgType,
-    Time dreqAtMaster, Time syncSendTime, int id
+    PtpNode *txNode, PtpNode *rxNode, PtpMessageType_t msgType, int id
   );
 
   /**
-   * @brief Set the Animation Interface
+   * @brief Select which nodes are listed by `printClockValuesOfNodes`
    * 
-   * @param anim 
-   * @param offsetCounterId 
+   * @param scope DUMP_ALL_NODES (default) or DUMP_SENDER_RECEIVER
    */
-  void setAnimationInterface(
-    AnimationInterface *anim, int offsetCounterId
-  );
+  void setClockDumpScope(ClockDumpScope_t scope);
 
+  /**
+   * @brief Call a sink with the PTP node ID and the offset error (ns) of
+   * every node after it synchronizes
+   *
+   * Nothing is computed for the trace until a sink is connected, e.g.
+   * `PtpOffsetErrorSampler::GetCallback` to sample or batch the updates.
+   *
+   * @param callback
+   */
+  void connectOffsetErrorTrace(Callback<void, uint16_t, double> callback);
+
+  /**
+   * @brief Disconnect a sink of `connectOffsetErrorTrace`
+   *
+   * @param callback
+   */
+  void disconnectOffsetErrorTrace(Callback<void, uint16_t, double> callback);
+
+  /**
+   * @brief Set how long the protocol runs, in initial sync intervals
+   * 
+   * @param iterations 
+   */
   void setSimulationIterations(int iterations);
 
+  /**
+   * @brief Enable or disable the raw offset trace (`ptp_offset.bin`)
+   * 
+   * The online statistics are always kept, so the raw trace can be turned
+   * off for large parameter sweeps.
+   * 
+   * @param enabled 
+   */
+  void setOffsetTraceEnabled(bool enabled);
+
+  /**
+   * @brief Set the offset error (ns) under which a node is converged
+   * 
+   * Applies to the nodes already added and to nodes added afterwards.
+   * 
+   * @param threshold 
+   */
+  void setConvergenceThreshold(double threshold);
+
+  /**
+   * @brief Merge the offset statistics of all nodes
+   * 
+   * @return PtpOffsetStatistics 
+   */
+  PtpOffsetStatistics getOffsetStatistics();
+
+  /**
+   * @brief Set the data rate of the shared channel
+   * 
+   * The share of the channel taken by the PTP messages of each node and of
+   * the network, from the start of the protocol to the last SYNC interval,
+   * is written to the channel_utilization column of ptp_messages.csv.
+   * 
+   * @param dataRate 
+   */
+  void setChannelDataRate(DataRate dataRate);
+
+  /**
+   * @brief Get the synchronization of the network in each round
+   * 
+   * Round k starts k initial sync intervals after the protocol.
+   * 
+   * @return const std::vector<PtpRound_t>& 
+   */
+  const std::vector<PtpRound_t> &getRounds();
+
+  /**
+   * @brief Get the number of received packets dropped because they are
+   * truncated, their message type is unknown or their sender is not a node
+   * of the network
+   */
+  uint64_t getInvalidPacketCount();
+
+#ifdef PTP_INSTRUMENTATION
+  /**
+   * @brief Get the call counts, wall clock and allocations of the message
+   * handlers
+   */
+  const PtpInstrumentation &getInstrumentation();
+#endif
+
+  /**
+   * @brief Write the offset statistics summary (`ptp_summary.csv` in the log
+   * directory), the message counters of each node (`ptp_messages.csv`) and
+   * the network convergence of each round (`ptp_rounds.csv`) and the
+   * recovery after each failure (`ptp_failover.csv`), then flush and close
+   * the offset trace (`ptp_offset.bin`). With PTP_INSTRUMENTATION, the
+   * counters of the message handlers go to `ptp_instrumentation.csv`.
+   *
+   * Call it after `Simulator::Run` and before `Simulator::Destroy`.
+   */
   void closeLogs();
 
 private:
+  /**
+   * @brief Append the clock values of one node to the dump
+   */
+  void printClockValuesOfNode(
+    std::stringstream &clockValuesLog, PtpNode *node, PtpNode *masterNode
+  );
+
+  /**
+   * @brief Whether the clock value dump would be logged at all
+   */
+  bool isClockDumpEnabled();
+
+  /**
+   * @brief Append the offset errors of a synchronized node to the trace
+   */
+  void writeOffsetTrace(PtpNode *node, int eventId);
+
+  /**
+   * @brief Tag an event message for corrections and stamp it with the
+   * time stamper of the sending node
+   * 
+   * Must be called right before the message is sent.
+   */
+  void tagEventMessage(PtpNode *txNode, Ptr<Packet> packet);
+
+  /**
+   * @brief Get the local time an event message reached a node, from its
+   * time stamper if it has one
+   */
+  Time getReceiveTime(PtpNode *hostNode, Ptr<const Packet> packet);
+
+  /**
+   * @brief Schedule the DREQ of a slave once the SYNC time stamp of the
+   * master is known
+   */
+  void scheduleDreqPacket(SocketLink *socketLink);
+
+  /**
+   * @brief Measure the delay to the master, or synchronize right away with
+   * the peer delay mechanism, once the SYNC time stamp of the master is
+   * known
+   */
+  void syncTimeStampReceived(
+    SocketLink *socketLink, PtpNode *senderNode, PtpNode *hostNode,
+    const PtpHeader &header
+  );
+
+  /**
+   * @brief Correct the clock of a slave and let it serve its own slaves
+   * 
+   * @param peerLink The link to the master with its peer delay, or NULL
+   * for the end-to-end delay of the last DREQ
+   */
+  void synchronizeNode(
+    SocketLink *peerLink, PtpNode *senderNode, PtpNode *hostNode,
+    const PtpHeader &header
+  );
+
+  /**
+   * @brief Send Pdelay_Req on the link of a node to its master and schedule
+   * the next one
+   */
+  void sendPeriodicPdelay(uint16_t nodeId);
+
+  /**
+   * @brief Run the state decision of a node, send its ANNOUNCE and schedule
+   * the next one
+   */
+  void announceTick(uint16_t nodeId);
+
+  /**
+   * @brief Follow the master and grandmaster chosen by the best master clock
+   * algorithm of a node
+   */
+  void applyBmcaDecision(PtpNode *node);
+
+  /**
+   * @brief Whether a node is up and synchronizes to a master
+   */
+  bool isSlaveOf(uint16_t slaveId, uint16_t masterId);
+
+  /**
+   * @brief Whether a port of a node still leads to one of its slaves
+   */
+  bool hasSlaves(SocketLink *socketLink);
+
+  /**
+   * @brief Start sending SYNC to a new slave if its master serves slaves
+   * already
+   */
+  void ensureSyncPort(uint16_t masterId, uint16_t slaveId);
+
+  /**
+   * @brief Record the election after a failure once the nodes still up agree
+   * on a grandmaster
+   */
+  void checkElection();
+
+  /**
+   * @brief Count a sync of a node towards the recovery after failures
+   */
+  void recordFailoverSync(PtpNode *node);
+
+  /**
+   * @brief Write the recovery of the network after each failure
+   */
+  void writeFailovers();
+
+  /**
+   * @brief Start sending SYNC on every port of a node after `delay`
+   */
+  void startSyncTimers(uint16_t nodeId, Time delay);
+
+  /**
+   * @brief Send SYNC on a port and schedule the next one
+   */
+  void sendPeriodicSync(SocketLink *socketLink);
+
+  /**
+   * @brief Interval between SYNC messages on a port: the sync interval of
+   * the slave, or the shortest one of the slaves behind a group link
+   */
+  Time getPortSyncInterval(SocketLink *socketLink);
+
+  /**
+   * @brief Bring the next SYNC to a slave forward after its sync interval
+   * got shorter
+   */
+  void rescheduleSync(uint16_t slaveId);
+
+  /**
+   * @brief Count a sync of a slave in the current round
+   */
+  void recordRoundSync(PtpNode *node);
+
+  /**
+   * @brief Write the time each round took to synchronize every slave
+   */
+  void writeRounds();
+
+  /**
+   * @brief Write the packets and bytes sent, received and overheard by each
+   * node and by the network, and their share of the channel
+   */
+  void writeMessageCounters();
+
+  /**
+   * @brief Write one row of the statistics summary
+   */
+  void writeSummaryRow(
+    std::ofstream &summary, std::string name, const PtpOffsetStatistics &stats
+  );
+
   int m_iterations; //< Iterations to run
 
-  int m_eventId;  //< Global PTP event Id.
-  int m_eventCounterId; //< current event counter index.
   const uint32_t m_users;  //< Number of users in the network
   uint16_t m_masterIndex;  ///< Index of the master node
 
   std::vector<SocketLink *> m_socketLinks; //< Established sockets for PTP message transmission.
+  std::unordered_map<Socket *, SocketLink *> m_socketLinkIndex; //< Socket to socket link lookup for received packets.
+  std::vector<SocketLink *> m_groupSocketLinks; //< Multicast or broadcast link of each node, indexed by node ID.
   std::vector<PtpNode *> m_nodes; //< PTP clock nodes.
 
-  Time m_globalTime; //< Simulator global time
   const uint32_t m_packetSize; //< Packet Size
   const Time m_interPacketInterval; //< Synchronization Interval
 
@@ -214,11 +699,38 @@ private:
   uint32_t m_trafficPacketSize; //< Size of each TCP packet for network traffic simulation
   bool m_simulatingTraffic; //< Whether simulating the traffic at the moment
 
-  AnimationInterface *m_anim; //< Animation interface for logging
-  int m_ptpOffsetCounterId; //< Animation interface clock offset counter ID
+  TracedCallback<uint16_t, double> m_offsetErrorTrace; //< Offset error of each node after sync
+
+  ClockDumpScope_t m_clockDumpScope; //< Nodes listed in the clock value dump
 
   std::string m_logdir;
-  std::vector<std::ofstream *> m_fileStreams;
+  PtpTraceWriter m_traceWriter; //< Offset samples of all nodes
+  bool m_offsetTraceEnabled; //< Whether offset samples are written to m_traceWriter
+  double m_convergenceThreshold; //< Offset error (ns) of a converged node
+  uint64_t m_channelDataRate; //< Data rate of the shared channel in bit/s
+  bool m_oneStepClock; //< SYNC messages carry their own transmit time stamp
+
+  Time m_stopTime; //< No SYNC is sent from this time on
+  std::unordered_map<SocketLink *, PtpSyncTimer_t> m_syncTimers; //< SYNC timer of each master port
+  std::vector<bool> m_syncTimersStarted; //< Whether each node has started its master ports
+  bool m_boundaryClock; //< Nodes run their master ports from the start
+  PtpDelayMechanism_t m_delayMechanism; //< How slaves measure the delay to their master
+  Time m_pdelayInterval; //< Interval between peer delay measurements of a link
+  bool m_bmcaEnabled; //< Masters are elected with ANNOUNCE messages
+  Time m_announceInterval; //< Interval between ANNOUNCE messages
+  uint32_t m_announceReceiptTimeout; //< Announce intervals an ANNOUNCE stays valid
+  std::vector<bool> m_failedNodes; //< Whether each node is down
+  std::vector<Ptr<PtpTimestamper> > m_timestampers; //< Time stamper of each node, null for application time stamps
+  std::vector<Time> m_nodeLastSync; //< Time each node last got synchronized
+  std::vector<PtpFailover_t> m_failovers; //< Recovery after each failure
+
+  Time m_startTime; //< Start of the protocol
+  std::vector<PtpRound_t> m_rounds; //< Convergence of the network in each round
+  std::vector<int64_t> m_nodeRound; //< Last round each node got synchronized in
+  uint64_t m_invalidPacketCount; //< Received packets dropped as invalid
+#ifdef PTP_INSTRUMENTATION
+  PtpInstrumentation m_instrumentation; //< Counters of the message handlers
+#endif
 };
 
 #endif /* PTP_NETWORK_H */
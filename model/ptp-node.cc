@@ -34,6 +34,8 @@ PtpNode::PtpNode(
 ) : m_nodeId(id),
     m_masterId(masterId),
     m_hopNum(hop),
+    m_grandmasterId(masterId),
+    m_bmca(id),
     m_nodeIpv4Address(ipv4Address)
 {
   // Questions remain about what is hop here.
@@ -44,16 +46,33 @@ PtpNode::PtpNode(
   m_syncTimeAtMaster = NanoSeconds(0);
   m_dreqTimeAtMaster = NanoSeconds(0);
   m_syncRecvTime = NanoSeconds(0);
+  m_syncCorrection = NanoSeconds(0);
+  m_dreqCorrection = NanoSeconds(0);
   m_dreqSendTime = NanoSeconds(0);
   m_offset = NanoSeconds(0);
 
-  m_clockError = ( rand() % 12 ) * 0.012 / 12 + 0.994;
+  Ptr<UniformRandomVariable> clockError = CreateObject<UniformRandomVariable>();
+  m_oscillator = Create<PtpConstantOscillator>(clockError->GetInteger(0, 11) * 0.001 + 0.994);
+  m_anchorElapsed = 0;
+  m_frequencyAdjustment = 0;
+  m_servo = Create<PtpStepServo>();
+  m_syncInterval = Seconds(1.0);
+  m_syncIntervalPolicy = Create<PtpFixedSyncInterval>();
   m_prevOffsetError = 0;
   m_currOffsetError = 0;
 
+  m_group.nodeId = PTP_GROUP_NODE_ID;
+  m_group.txSocket = NULL;
+  m_group.syncSendTimeStamp = NanoSeconds(0);
+  m_group.dreqRecvTimeStamp = NanoSeconds(0);
+  m_group.dreqRecvCorrection = NanoSeconds(0);
+  m_group.syncId = 0;
+  m_eventId = 0;
+
   // Initialize the number of packets per message type to zero
-  for(int j=0; j < 4; j++) {
+  for(int j=0; j < PTP_NUM_MESSAGE_TYPES; j++) {
     m_sentPacket.push_back(0);
+    m_sentBytes.push_back(0);
     m_receivedPacket.push_back(0);
     m_overheardPacket.push_back(0);
     m_ptpMsgSyncId.push_back(0);
@@ -72,13 +91,35 @@ uint16_t PtpNode::getMasterId() {
   return m_masterId;
 }
 
+void PtpNode::setMaster(uint16_t masterId, uint16_t hop) {
+  if(masterId != m_masterId) {
+    m_servo->reset();
+  }
+  m_masterId = masterId;
+  m_hopNum = hop;
+}
+
+uint16_t PtpNode::getGrandmasterId() {
+  return m_grandmasterId;
+}
+
+void PtpNode::setGrandmasterId(uint16_t grandmasterId) {
+  m_grandmasterId = grandmasterId;
+}
+
+PtpBmca &PtpNode::getBmca() {
+  return m_bmca;
+}
+
 Ipv4Address PtpNode::getIpv4Address() {
   return m_nodeIpv4Address;
 }
 
 void PtpNode::setGlobalMaster() {
   m_isGlobalMaster = true;
-  m_clockError = 1.;
+  m_oscillator = Create<PtpConstantOscillator>(1.);
+  m_anchorElapsed = 0;
+  m_frequencyAdjustment = 0;
 }
 
 bool PtpNode::isGlobalMaster() {
@@ -93,25 +134,35 @@ void PtpNode::setState(NodeState_t s) {
   m_nodeState = s;
 }
 
+void PtpNode::setInitialTime(Time time) {
+  m_simulatorTime = Simulator::Now();
+  m_localTime = time;
+  m_anchorElapsed = m_oscillator->getElapsed(m_simulatorTime);
+}
+
 Time PtpNode::getLocalTime() {
-  return m_localTime;
+  return getLocalTime(Simulator::Now());
 }
 
-void PtpNode::setLocalTime(Time simulatorTime) {
+Time PtpNode::getLocalTime(Time simulatorTime) {
   if(!m_isGlobalMaster) {
     // Simulate node clock jitter
-    m_localTime = NanoSeconds(
-      (simulatorTime.GetNanoSeconds() - m_simulatorTime.GetNanoSeconds()) * m_clockError
-      + m_localTime.GetNanoSeconds()
+    return NanoSeconds(
+      (m_oscillator->getElapsed(simulatorTime) - m_anchorElapsed) *
+      (1 + m_frequencyAdjustment * 1e-9) + m_localTime.GetNanoSeconds()
     );
-    m_simulatorTime = simulatorTime;
   } else {
     // global master is synchronized to simulator global time
-    m_simulatorTime = simulatorTime;
-    m_localTime = simulatorTime;
+    return simulatorTime;
   }
 }
 
+void PtpNode::setLocalTime(Time simulatorTime) {
+  m_localTime = getLocalTime(simulatorTime);
+  m_simulatorTime = simulatorTime;
+  m_anchorElapsed = m_oscillator->getElapsed(simulatorTime);
+}
+
 Time PtpNode::getSyncTimeAtMaster() {
   return m_syncTimeAtMaster;
 }
@@ -144,53 +195,76 @@ void PtpNode::setDreqSendTime(Time time) {
   m_dreqSendTime = time;
 }
 
-Time PtpNode::getSyncSendTimeStamp(uint16_t nodeId) {
-  unsigned int i = 0;
-  while(i < m_neighbors.size() && m_neighbors[i] != nodeId) {
-    i++;
+void PtpNode::setSyncCorrection(Time correction) {
+  m_syncCorrection = correction;
+}
+
+void PtpNode::setDreqCorrection(Time correction) {
+  m_dreqCorrection = correction;
+}
+
+PtpNeighbor_t *PtpNode::findNeighbor(uint16_t nodeId) {
+  if(nodeId == PTP_GROUP_NODE_ID) {
+    return &m_group;
   }
-  if(i == m_neighbors.size()) {
+  std::unordered_map<uint16_t, uint32_t>::const_iterator it =
+    m_neighborIndex.find(nodeId);
+  if(it == m_neighborIndex.end()) {
+    return NULL;
+  }
+  return &m_neighbors[it->second];
+}
+
+Time PtpNode::getSyncSendTimeStamp(uint16_t nodeId) {
+  PtpNeighbor_t *neighbor = findNeighbor(nodeId);
+  if(neighbor == NULL) {
     std::cerr << "[PtpNode::getSyncSendTimeStamp] Failed to find node " << 
       nodeId << " in the neighbor list " << " of node " << m_nodeId << 
       "." << std::endl;
     return NanoSeconds(0);
   } else {
-    return m_syncSendTimeStamps[i];
+    return neighbor->syncSendTimeStamp;
   }
 }
 
 void PtpNode::setSyncSendTimeStamp(Time time, uint16_t nodeId) {
-  unsigned int i = 0;
-  while(i < m_neighbors.size() && m_neighbors[i] != nodeId) {
-    i++;
-  }
-  if(i < m_neighbors.size()) {
-    m_syncSendTimeStamps[i] = time;
+  PtpNeighbor_t *neighbor = findNeighbor(nodeId);
+  if(neighbor != NULL) {
+    neighbor->syncSendTimeStamp = time;
   }
 }
 
 Time PtpNode::getDreqRecvTimeStamp(uint16_t nodeId) {
-  unsigned int i = 0;
-  while(i < m_neighbors.size() && m_neighbors[i] != nodeId) {
-    i++;
-  }
-  if(i == m_neighbors.size()) {
+  PtpNeighbor_t *neighbor = findNeighbor(nodeId);
+  if(neighbor == NULL) {
     std::cerr << "[PtpNode::getDreqRecvTimeStamp] Failed to find node " << 
       nodeId << " in the neighbor list " << " of node " << m_nodeId << 
       "." << std::endl;
     return NanoSeconds(0);
   } else {
-    return m_dreqRecvTimeStamps[i];
+    return neighbor->dreqRecvTimeStamp;
   }
 }
 
 void PtpNode::setDreqRecvTimeStamp(Time time, uint16_t nodeId) {
-  unsigned int i = 0;
-  while(i < m_neighbors.size() && m_neighbors[i] != nodeId) {
-    i++;
+  PtpNeighbor_t *neighbor = findNeighbor(nodeId);
+  if(neighbor != NULL) {
+    neighbor->dreqRecvTimeStamp = time;
   }
-  if(i < m_neighbors.size()) {
-    m_dreqRecvTimeStamps[i] = time;
+}
+
+Time PtpNode::getDreqRecvCorrection(uint16_t nodeId) {
+  PtpNeighbor_t *neighbor = findNeighbor(nodeId);
+  if(neighbor == NULL) {
+    return NanoSeconds(0);
+  }
+  return neighbor->dreqRecvCorrection;
+}
+
+void PtpNode::setDreqRecvCorrection(Time correction, uint16_t nodeId) {
+  PtpNeighbor_t *neighbor = findNeighbor(nodeId);
+  if(neighbor != NULL) {
+    neighbor->dreqRecvCorrection = correction;
   }
 }
 
@@ -202,42 +276,50 @@ void PtpNode::addNeighbor(
   uint16_t nodeId, 
   SocketLink *txSocket
 ) {
-  m_dreqRecvTimeStamps.push_back(NanoSeconds(0));
-  m_syncSendTimeStamps.push_back(NanoSeconds(0));
-  m_masterSyncId.push_back(0);
-  m_neighbors.push_back(nodeId);
-  m_sockets.push_back(txSocket);
+  PtpNeighbor_t neighbor;
+  neighbor.nodeId = nodeId;
+  neighbor.txSocket = txSocket;
+  neighbor.syncSendTimeStamp = NanoSeconds(0);
+  neighbor.dreqRecvTimeStamp = NanoSeconds(0);
+  neighbor.dreqRecvCorrection = NanoSeconds(0);
+  neighbor.syncId = 0;
+  m_neighborIndex[nodeId] = m_neighbors.size();
+  m_neighbors.push_back(neighbor);
+}
+
+void PtpNode::reserveNeighbors(uint32_t neighbors) {
+  m_neighbors.reserve(neighbors);
+  m_neighborIndex.reserve(neighbors);
 }
 
 SocketLink *PtpNode::getTxSocket(int index) {
-  return m_sockets[index];
+  return m_neighbors[index].txSocket;
 }
 
 SocketLink *PtpNode::getTxSocketByNodeId(uint16_t nodeId) {
-  unsigned int i = 0;
-  while(i < m_neighbors.size() && m_neighbors[i] != nodeId) {
-    i++;
-  }
-  if(i < m_neighbors.size()) {
-    return m_sockets[i];
+  PtpNeighbor_t *neighbor = findNeighbor(nodeId);
+  if(neighbor != NULL) {
+    return neighbor->txSocket;
   } else {
     return NULL;
   }
 }
 
 uint64_t PtpNode::getNewSyncId(uint16_t nodeId) {
-  unsigned int i = 0;
-  while(i < m_neighbors.size() && m_neighbors[i] != nodeId) {
-    i++;
-  }
-  if(i < m_neighbors.size()) {
-    m_masterSyncId[i]++;
-    return m_masterSyncId[i];
+  PtpNeighbor_t *neighbor = findNeighbor(nodeId);
+  if(neighbor != NULL) {
+    neighbor->syncId++;
+    return neighbor->syncId;
   } else {
     return 0;
   }
 }
 
+int PtpNode::getNewEventId() {
+  m_eventId++;
+  return m_eventId;
+}
+
 void PtpNode::setPtpSyncId(PtpMessageType_t msgType, uint64_t syncId) {
   m_ptpMsgSyncId[msgType] = syncId;
 }
@@ -246,40 +328,106 @@ uint64_t PtpNode::getPtpSyncId(PtpMessageType_t msgType) {
   return m_ptpMsgSyncId[msgType];
 }
 
-void PtpNode::incrementSentPacketCounter(PtpMessageType_t msgType) {
+void PtpNode::incrementSentPacketCounter(PtpMessageType_t msgType, uint32_t bytes) {
   m_sentPacket[msgType]++;
+  m_sentBytes[msgType] += bytes;
 }
 
 void PtpNode::increaseReceivedPacketCounter(PtpMessageType_t msgType) {
   m_receivedPacket[msgType]++;
 }
 
+void PtpNode::increaseOverheardPacketCounter(PtpMessageType_t msgType) {
+  m_overheardPacket[msgType]++;
+}
+
 void PtpNode::calculateOffset(Time masterTime) {
-  int64_t clockOffset;
   if(!m_isGlobalMaster) {
-    clockOffset = (
-      (m_syncRecvTime.GetNanoSeconds() - m_syncTimeAtMaster.GetNanoSeconds()) +
-      (m_dreqSendTime.GetNanoSeconds() - m_dreqTimeAtMaster.GetNanoSeconds())
+    int64_t clockOffset = (
+      (m_syncRecvTime.GetNanoSeconds() - m_syncTimeAtMaster.GetNanoSeconds() -
+        m_syncCorrection.GetNanoSeconds()) +
+      (m_dreqSendTime.GetNanoSeconds() - m_dreqTimeAtMaster.GetNanoSeconds() +
+        m_dreqCorrection.GetNanoSeconds())
     ) / 2;
-    m_offset = NanoSeconds(clockOffset);
-    m_prevOffsetError = std::abs((
-      m_localTime.GetNanoSeconds() - masterTime.GetNanoSeconds()
-    ));
+    correctClock(clockOffset, masterTime);
+  }
+}
+
+void PtpNode::calculatePeerDelayOffset(Time linkDelay, Time masterTime) {
+  if(!m_isGlobalMaster) {
+    int64_t clockOffset = m_syncRecvTime.GetNanoSeconds() -
+      m_syncTimeAtMaster.GetNanoSeconds() - m_syncCorrection.GetNanoSeconds() -
+      linkDelay.GetNanoSeconds();
+    correctClock(clockOffset, masterTime);
+  }
+}
+
+void PtpNode::correctClock(int64_t clockOffset, Time masterTime) {
+  m_offset = NanoSeconds(clockOffset);
+  // Re-anchor at the current simulator time before correcting the clock
+  setLocalTime(Simulator::Now());
+  m_prevOffsetError = std::abs((
+    m_localTime.GetNanoSeconds() - masterTime.GetNanoSeconds()
+  ));
+  PtpServoState_t servoState;
+  double frequencyError = m_servo->sample(clockOffset, m_localTime, servoState);
+  if(servoState == SERVO_JUMP) {
+    // Step the clock
     m_localTime -= m_offset;
-    m_currOffsetError = std::abs((
-      m_localTime.GetNanoSeconds() - masterTime.GetNanoSeconds()
-    ));
-    std::stringstream calculateOffsetLog;
-    calculateOffsetLog << "Node " << m_nodeId << ": Clock synchronized." << 
-      std::endl <<
-      "Offset Before Sync: " << m_prevOffsetError << std::endl <<
-      "Offset After Sync: " << m_currOffsetError << std::endl;
-    NS_LOG_DEBUG(calculateOffsetLog.str());
   }
+  if(servoState != SERVO_UNLOCKED) {
+    setFrequencyAdjustment(-frequencyError);
+  }
+  m_syncInterval = m_syncIntervalPolicy->update(
+    m_syncInterval, std::abs((double) clockOffset)
+  );
+  m_currOffsetError = std::abs((
+    m_localTime.GetNanoSeconds() - masterTime.GetNanoSeconds()
+  ));
+  m_offsetStatistics.update(m_currOffsetError, Simulator::Now());
+  NS_LOG_DEBUG("Node " << m_nodeId << ": Clock synchronized." << 
+    std::endl <<
+    "Offset Before Sync: " << m_prevOffsetError << std::endl <<
+    "Offset After Sync: " << m_currOffsetError << std::endl);
 }
 
 double PtpNode::getClockError() {
-  return m_clockError;
+  return m_oscillator->getRate();
+}
+
+void PtpNode::setOscillator(Ptr<PtpOscillator> oscillator) {
+  setLocalTime(Simulator::Now());
+  m_oscillator = oscillator;
+  m_anchorElapsed = m_oscillator->getElapsed(m_simulatorTime);
+}
+
+Ptr<PtpOscillator> PtpNode::getOscillator() {
+  return m_oscillator;
+}
+
+void PtpNode::setServo(Ptr<PtpServo> servo) {
+  m_servo = servo;
+}
+
+void PtpNode::setFrequencyAdjustment(double ppb) {
+  setLocalTime(Simulator::Now());
+  m_frequencyAdjustment = ppb;
+}
+
+double PtpNode::getFrequencyAdjustment() {
+  return m_frequencyAdjustment;
+}
+
+void PtpNode::setSyncIntervalPolicy(Ptr<PtpSyncIntervalPolicy> policy) {
+  m_syncIntervalPolicy = policy;
+}
+
+void PtpNode::setSyncInterval(Time interval) {
+  m_syncInterval = interval;
+}
+
+Time PtpNode::getSyncInterval() {
+  return m_syncInterval;
 }
 
 int PtpNode::getSentPacketCounter(PtpMessageType_t msgType) {
@@ -290,6 +438,26 @@ int PtpNode::getReceivedPacketCounter(PtpMessageType_t msgType) {
   return m_receivedPacket[msgType];
 }
 
+uint64_t PtpNode::getSentByteCounter(PtpMessageType_t msgType) {
+  return m_sentBytes[msgType];
+}
+
+int PtpNode::getOverheardPacketCounter(PtpMessageType_t msgType) {
+  return m_overheardPacket[msgType];
+}
+
+double PtpNode::getPreviousOffsetError() {
+  return m_prevOffsetError;
+}
+
 double PtpNode::getCurrentOffsetError() {
   return m_currOffsetError;
 }
+
+const PtpOffsetStatistics &PtpNode::getOffsetStatistics() {
+  return m_offsetStatistics;
+}
+
+void PtpNode::setConvergenceThreshold(double threshold) {
+  m_offsetStatistics.setConvergenceThreshold(threshold);
+}
@@ -25,8 +25,14 @@
 
 #include "ns3/core-module.h"
 #include "ns3/ipv4-address.h"
+#include <unordered_map>
 #include "ptp-message.h"
+#include "ptp-bmca.h"
+#include "ptp-oscillator.h"
 #include "ptp-socket-link.h"
+#include "ptp-statistics.h"
+#include "ptp-servo.h"
+#include "ptp-sync-interval.h"
 
 using namespace ns3;
 
@@ -37,6 +43,18 @@ typedef enum {
   SYNCED
 } NodeState_t;
 
+/**
+ * @brief State kept by a node for each of its neighbors
+ */
+typedef struct PtpNeighbor {
+  uint16_t nodeId; //< Neighbor node ID
+  SocketLink *txSocket; //< Socket link to the neighbor
+  Time syncSendTimeStamp; //< The time stamp when SYNC is sent to the neighbor
+  Time dreqRecvTimeStamp; //< The time stamp when DREQ is received from the neighbor
+  Time dreqRecvCorrection; //< Correction field of the DREQ received from the neighbor
+  uint64_t syncId; //< Last sync ID used towards the neighbor
+} PtpNeighbor_t;
+
 class PtpNode {
 public:
 
@@ -62,6 +80,36 @@ public:
    */
   uint16_t getMasterId();
 
+  /**
+   * @brief Change the master of the node
+   * 
+   * The servo starts over if the master changes, as the offset to the new
+   * master has nothing to do with the samples so far.
+   * 
+   * @param masterId The node itself if it is a grandmaster
+   * @param hop Number of hops from the grandmaster
+   */
+  void setMaster(uint16_t masterId, uint16_t hop);
+
+  /**
+   * @brief Get the ID of the grandmaster the node is synchronized to
+   */
+  uint16_t getGrandmasterId();
+
+  /**
+   * @brief Set the ID of the grandmaster the node is synchronized to
+   * 
+   * @param grandmasterId 
+   */
+  void setGrandmasterId(uint16_t grandmasterId);
+
+  /**
+   * @brief Get the best master clock algorithm of the node
+   * 
+   * @return PtpBmca& 
+   */
+  PtpBmca &getBmca();
+
   /**
    * @brief Get the Ipv4 Address of the node
    * 
@@ -99,13 +147,19 @@ public:
   /**
    * @brief Set the Initial Time object
    * 
+   * The local clock reads `time` at the current simulator time and drifts
+   * from there.
+   * 
    * @param time 
    */
   void setInitialTime(Time time);
 
   /**
    * @brief Set Node Local Time
-   * This function is called after happening of any event in the network
+   * 
+   * Move the clock anchor forward to `simulatorTime`. The local time is
+   * evaluated lazily by `getLocalTime`, so this no longer has to be called
+   * after every event in the network.
    * 
    * @param time 
    */
@@ -114,10 +168,22 @@ public:
   /**
    * @brief Get local time of the node
    * 
+   * The local time is computed on demand from the clock anchor (simulator
+   * time, local time): the time counted by the oscillator since the anchor,
+   * corrected by the frequency adjustment of the servo.
+   * 
    * @return Time 
    */
   Time getLocalTime();
 
+  /**
+   * @brief Get local time of the node at a given simulator time
+   * 
+   * @param simulatorTime Simulator time not earlier than the clock anchor.
+   * @return Time 
+   */
+  Time getLocalTime(Time simulatorTime);
+
   /**
    * @brief Get SYNC message timestamp at master
    * 
@@ -174,6 +240,21 @@ public:
    */
   void setDreqSendTime(Time time);
 
+  /**
+   * @brief Set the residence time of the last SYNC in transparent clocks
+   * 
+   * @param correction 
+   */
+  void setSyncCorrection(Time correction);
+
+  /**
+   * @brief Set the residence time of the last DREQ in transparent clocks,
+   * as returned by the master in DRPLY
+   * 
+   * @param correction 
+   */
+  void setDreqCorrection(Time correction);
+
   /**
    * @brief Get SYNC message send time
    * 
@@ -200,6 +281,22 @@ public:
    */
   void setDreqRecvTimeStamp(Time time, uint16_t nodeId);
 
+  /**
+   * @brief Get the correction field of the DREQ received from a neighbor
+   * 
+   * @param nodeId 
+   * @return Time 
+   */
+  Time getDreqRecvCorrection(uint16_t nodeId);
+
+  /**
+   * @brief Set the correction field of the DREQ received from a neighbor
+   * 
+   * @param correction 
+   * @param nodeId 
+   */
+  void setDreqRecvCorrection(Time correction, uint16_t nodeId);
+
   /**
    * @brief Get number of neighbors of the current node
    * 
@@ -217,6 +314,13 @@ public:
     SocketLink *txSocket
   );
 
+  /**
+   * @brief Pre-allocate storage for neighbor records
+   * 
+   * @param neighbors Expected number of neighbors
+   */
+  void reserveNeighbors(uint32_t neighbors);
+
   /**
    * @brief Get the Tx Socket Link
    * 
@@ -234,11 +338,12 @@ public:
   SocketLink *getTxSocketByNodeId(uint16_t nodeId);
 
   /**
-   * @brief Increase sent packet counter (by message type)
+   * @brief Increase sent packet and byte counters (by message type)
    * 
    * @param msgType 
+   * @param bytes Size of the packet at the IP layer
    */
-  void incrementSentPacketCounter(PtpMessageType_t msgType);
+  void incrementSentPacketCounter(PtpMessageType_t msgType, uint32_t bytes);
 
   /**
    * @brief Increase received packet counter (by message type)
@@ -247,12 +352,32 @@ public:
    */
   void increaseReceivedPacketCounter(PtpMessageType_t msgType);
 
+  /**
+   * @brief Increase the counter of packets overheard and ignored (by message
+   * type)
+   * 
+   * @param msgType 
+   */
+  void increaseOverheardPacketCounter(PtpMessageType_t msgType);
+
   /**
    * @brief Calculate time offset
    * 
+   * The residence times of SYNC and DREQ in transparent clocks are taken
+   * out of the measured path delays.
+   * 
    * @param masterTime reference master clock
    */
   void calculateOffset(Time masterTime);
+
+  /**
+   * @brief Calculate time offset from the last SYNC and the delay of the
+   * link to the master measured by the peer delay mechanism
+   * 
+   * @param linkDelay One-way delay of the link to the master
+   * @param masterTime reference master clock
+   */
+  void calculatePeerDelayOffset(Time linkDelay, Time masterTime);
   
   /**
    * @brief Get number of packets sent of message type `msgType`.
@@ -270,26 +395,134 @@ public:
    */
   int getReceivedPacketCounter(PtpMessageType_t msgType);
 
+  /**
+   * @brief Get number of bytes sent in messages of type `msgType`.
+   * 
+   * @param msgType 
+   * @return uint64_t 
+   */
+  uint64_t getSentByteCounter(PtpMessageType_t msgType);
+
+  /**
+   * @brief Get number of packets of type `msgType` overheard and ignored.
+   * 
+   * @param msgType 
+   * @return int 
+   */
+  int getOverheardPacketCounter(PtpMessageType_t msgType);
+
   /**
    * @brief Get the Clock Error
    * 
-   * @return double 
+   * @return double Rate of the oscillator at its last read
    */
   double getClockError();
 
+  /**
+   * @brief Set the oscillator driving the local clock
+   * 
+   * The default is a PtpConstantOscillator with a rate drawn uniformly from
+   * 0.994, 0.995, ..., 1.005. The clock is re-anchored at the current
+   * simulator time, so the local time does not jump.
+   * 
+   * @param oscillator 
+   */
+  void setOscillator(Ptr<PtpOscillator> oscillator);
+
+  /**
+   * @brief Get the oscillator driving the local clock
+   * 
+   * @return Ptr<PtpOscillator> 
+   */
+  Ptr<PtpOscillator> getOscillator();
+
+  /**
+   * @brief Set the servo that turns offset measurements into clock
+   * corrections (a PtpStepServo by default)
+   * 
+   * @param servo 
+   */
+  void setServo(Ptr<PtpServo> servo);
+
+  /**
+   * @brief Set the frequency correction of the local clock
+   * 
+   * The clock is re-anchored at the current simulator time first, so the
+   * new rate only applies from now on.
+   * 
+   * @param ppb Correction in parts per billion (positive speeds the clock up)
+   */
+  void setFrequencyAdjustment(double ppb);
+
+  /**
+   * @brief Get the frequency correction of the local clock in ppb
+   * 
+   * @return double 
+   */
+  double getFrequencyAdjustment();
+
+  /**
+   * @brief Set the policy choosing the sync interval after each offset
+   * measurement (a PtpFixedSyncInterval by default)
+   * 
+   * @param policy 
+   */
+  void setSyncIntervalPolicy(Ptr<PtpSyncIntervalPolicy> policy);
+
+  /**
+   * @brief Set the interval between SYNC messages the node asks its master
+   * for
+   * 
+   * @param interval 
+   */
+  void setSyncInterval(Time interval);
+
+  /**
+   * @brief Get the interval between SYNC messages the node asks its master
+   * for
+   * 
+   * @return Time 
+   */
+  Time getSyncInterval();
+
   double getPreviousOffsetError();
 
   double getCurrentOffsetError();
 
+  /**
+   * @brief Get the online statistics of the offset error after each sync
+   * 
+   * @return const PtpOffsetStatistics& 
+   */
+  const PtpOffsetStatistics &getOffsetStatistics();
+
+  /**
+   * @brief Set the offset error (ns) under which the node is converged
+   * 
+   * @param threshold 
+   */
+  void setConvergenceThreshold(double threshold);
+
   uint64_t getNewSyncId(uint16_t nodeId);
 
+  /**
+   * @brief Get the ID of a new exchange started by the node
+   *
+   * Event IDs are counted per node, so an exchange is identified by the
+   * event ID together with the node that started it.
+   *
+   * @return int 
+   */
+  int getNewEventId();
+
   void setPtpSyncId(PtpMessageType_t msgType, uint64_t syncId);
 
   uint64_t getPtpSyncId(PtpMessageType_t msgType);
 
 private:
-  Time m_localTime; // Local time
-  Time m_simulatorTime; // Global Simulation Time
+  /* Clock anchor: local time reads m_localTime at simulator time m_simulatorTime */
+  Time m_localTime; // Local time at the anchor
+  Time m_simulatorTime; // Global Simulation Time at the anchor
 
   NodeState_t m_nodeState; //< PTP Node State: Inactive, Active, Waiting, Synced
 
@@ -299,36 +532,67 @@ private:
   Time m_dreqTimeAtMaster; //< The time stamp when DREQ message is sent
   /* Local time stamp */
   Time m_syncRecvTime; //< The time stamp when SYNC message is received
+  Time m_syncCorrection; //< Residence time of SYNC in transparent clocks
+  Time m_dreqCorrection; //< Residence time of DREQ in transparent clocks
   Time m_dreqSendTime; //< The time stamp when the slave node sends DREQ message
   std::vector<uint64_t> m_ptpMsgSyncId;
-
-  /* Time stamps used with current node as clock master for other slave neighbors */
-  std::vector<Time> m_syncSendTimeStamps; //< The time stamp when SYNC is sent to each neighbor.
-  std::vector<Time> m_dreqRecvTimeStamps; //< The time stamp when DREQ is received from each neighbor.
-  std::vector<uint64_t> m_masterSyncId;
+  int m_eventId; //< ID of the last exchange the node started
 
   Time m_offset; //< Local offset to the global time of the simulator
 
   /* Set during initialization */
   bool m_isGlobalMaster; //< Is global master clock node
   const uint16_t m_nodeId; //< Node ID
-  const uint16_t m_masterId; //< The ID of the node that provides the master clock for the current node
-  const uint16_t m_hopNum; //< Number of hops away from master.
+  uint16_t m_masterId; //< The ID of the node that provides the master clock for the current node
+  uint16_t m_hopNum; //< Number of hops away from master.
+  uint16_t m_grandmasterId; //< The ID of the root of the synchronization tree
+  PtpBmca m_bmca; //< Elects the master when ANNOUNCE messages are used
 
   /* Node configuration */
   const Ipv4Address m_nodeIpv4Address; //< Node IPv4 Address
 
   /* Neighbor Information */
-  std::vector<SocketLink *> m_sockets;
+  /**
+   * @brief Find the record of a neighbor
+   * 
+   * @param nodeId Neighbor node ID, or PTP_GROUP_NODE_ID for the record of
+   * multicast and broadcast SYNC messages.
+   * @return PtpNeighbor_t* NULL if the node is not a neighbor.
+   */
+  PtpNeighbor_t *findNeighbor(uint16_t nodeId);
+
+  /**
+   * @brief Hand a measured offset to the servo and correct the clock
+   * 
+   * @param clockOffset Offset from the master in nanoseconds
+   * @param masterTime reference master clock
+   */
+  void correctClock(int64_t clockOffset, Time masterTime);
+
+  /* Time stamps used with current node as clock master for other slave neighbors
+   * are kept in the neighbor records, in the order neighbors were added. */
+  std::vector<PtpNeighbor_t> m_neighbors; ///< Neighbors of current node
+  std::unordered_map<uint16_t, uint32_t> m_neighborIndex; ///< Neighbor node ID to index in m_neighbors
+  PtpNeighbor_t m_group; ///< Time stamps and sync ID of SYNC messages sent to PTP_GROUP_NODE_ID
+
+  /* Clock rate */
+  Ptr<PtpOscillator> m_oscillator; //< Free-running oscillator
+  double m_anchorElapsed; //< Time counted by the oscillator at the clock anchor (ns)
+  double m_frequencyAdjustment; //< Frequency correction (ppb) set by the servo
+  Ptr<PtpServo> m_servo; //< Clock servo
+
+  /* Sync interval */
+  Time m_syncInterval; //< Interval between SYNC messages from the master
+  Ptr<PtpSyncIntervalPolicy> m_syncIntervalPolicy; //< Chooses m_syncInterval
 
   /* Statistics */
-  double m_clockError;
   double m_prevOffsetError;
   double m_currOffsetError;
+  PtpOffsetStatistics m_offsetStatistics; //< Offset error after each sync
 
   /* Statistics */
-  std::vector<uint16_t> m_neighbors; ///< Neighbors of current node identified by nodeID
   std::vector<int> m_sentPacket; ///< Number of each type PTP messages sent (indexed by message type: SYNC, FOLLOW, DREQ and DRPLY).
+  std::vector<uint64_t> m_sentBytes; ///< Number of bytes sent at the IP layer (indexed by message type).
   std::vector<int> m_receivedPacket;// vector indexed by packet type(Sync, Follow, Dreq, Drply) and stores num of packets received
   std::vector<int> m_overheardPacket;// vector indexed by packet type(Sync, Follow, Dreq, Drply) and stores num of packets overheard and ignored
 };
@@ -0,0 +1,126 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors: Tinghui Wang <tinghui.wang@wsu.edu>
+ *
+ * This file implements the oscillator models.
+ */
+
+#include "ns3/core-module.h"
+#include "ptp-oscillator.h"
+#include <cmath>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("PtpOscillator");
+
+static const double SECONDS_PER_DAY = 86400;
+
+PtpOscillator::~PtpOscillator() {
+}
+
+int64_t PtpOscillator::assignStreams(int64_t stream) {
+  return 0;
+}
+
+PtpConstantOscillator::PtpConstantOscillator(double rate)
+  : m_rate(rate)
+{}
+
+double PtpConstantOscillator::getElapsed(Time simulatorTime) {
+  return simulatorTime.GetNanoSeconds() * m_rate;
+}
+
+double PtpConstantOscillator::getRate() {
+  return m_rate;
+}
+
+PtpNoisyOscillator::PtpNoisyOscillator(
+  double frequencyOffset,
+  double randomWalk,
+  double phaseNoise,
+  double aging
+) : m_frequencyOffset(frequencyOffset * 1e-6),
+    m_randomWalk(randomWalk * 1e-9),
+    m_phaseNoise(phaseNoise),
+    m_aging(aging * 1e-9 / SECONDS_PER_DAY),
+    m_temperatureAmplitude(0),
+    m_temperaturePeriod(SECONDS_PER_DAY),
+    m_time(0),
+    m_walk(0),
+    m_elapsed(0),
+    m_noiseTime(-1),
+    m_noise(0)
+{
+  m_normal = CreateObject<NormalRandomVariable>();
+  m_normal->SetAttribute("Mean", DoubleValue(0));
+  m_normal->SetAttribute("Variance", DoubleValue(1));
+}
+
+void PtpNoisyOscillator::setTemperatureCycle(double amplitude, Time period) {
+  m_temperatureAmplitude = amplitude * 1e-9;
+  m_temperaturePeriod = period.GetSeconds();
+}
+
+int64_t PtpNoisyOscillator::assignStreams(int64_t stream) {
+  m_normal->SetStream(stream);
+  return 1;
+}
+
+void PtpNoisyOscillator::advance(double seconds) {
+  double delta = seconds - m_time;
+  // Integrals of the frequency offset over (m_time, seconds)
+  double offset = m_frequencyOffset * delta +
+    m_aging * (seconds * seconds - m_time * m_time) / 2;
+  if(m_temperatureAmplitude != 0) {
+    double omega = 2 * M_PI / m_temperaturePeriod;
+    offset += m_temperatureAmplitude / omega *
+      (std::cos(omega * m_time) - std::cos(omega * seconds));
+  }
+  if(m_randomWalk > 0) {
+    // Brownian motion and its integral, drawn jointly
+    double z1 = m_normal->GetValue();
+    double z2 = m_normal->GetValue();
+    offset += m_walk * delta + m_randomWalk * std::pow(delta, 1.5) *
+      (z1 / 2 + z2 / (2 * std::sqrt(3.0)));
+    m_walk += m_randomWalk * std::sqrt(delta) * z1;
+  }
+  m_elapsed += (delta + offset) * 1e9;
+  m_time = seconds;
+}
+
+double PtpNoisyOscillator::getElapsed(Time simulatorTime) {
+  double seconds = simulatorTime.GetSeconds();
+  if(seconds < m_time) {
+    // Earlier than the last read: extrapolate back at the current rate
+    return m_elapsed - (m_time - seconds) * 1e9 * getRate();
+  }
+  if(seconds > m_time) {
+    advance(seconds);
+  }
+  if(m_phaseNoise > 0 && simulatorTime.GetNanoSeconds() != m_noiseTime) {
+    m_noiseTime = simulatorTime.GetNanoSeconds();
+    m_noise = m_phaseNoise * m_normal->GetValue();
+  }
+  return m_elapsed + m_noise;
+}
+
+double PtpNoisyOscillator::getRate() {
+  double rate = 1 + m_frequencyOffset + m_aging * m_time + m_walk;
+  if(m_temperatureAmplitude != 0) {
+    rate += m_temperatureAmplitude * std::sin(2 * M_PI * m_time / m_temperaturePeriod);
+  }
+  return rate;
+}
@@ -0,0 +1,146 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors: Tinghui Wang <tinghui.wang@wsu.edu>
+ *
+ * This file declares the oscillator models driving the local clocks.
+ *
+ */
+
+#ifndef PTP_OSCILLATOR_H
+#define PTP_OSCILLATOR_H
+
+#include "ns3/core-module.h"
+#include "ns3/simple-ref-count.h"
+
+using namespace ns3;
+
+/**
+ * @brief Free-running oscillator of a node
+ *
+ * An oscillator counts time at a rate slightly off the simulator time. It
+ * is only evaluated when the clock of its node is read, so oscillators with
+ * noise keep their state at the time of the last read and advance it from
+ * there.
+ */
+class PtpOscillator : public SimpleRefCount<PtpOscillator> {
+public:
+  virtual ~PtpOscillator();
+
+  /**
+   * @brief Get the time counted by the oscillator since simulator time 0
+   *
+   * Reads should not go back in time: an oscillator with noise only keeps
+   * its state at the last read, and extrapolates earlier reads from it.
+   *
+   * @param simulatorTime
+   * @return double Nanoseconds counted
+   */
+  virtual double getElapsed(Time simulatorTime) = 0;
+
+  /**
+   * @brief Get the rate of the oscillator at the last read (1 for an ideal
+   * oscillator)
+   *
+   * @return double
+   */
+  virtual double getRate() = 0;
+
+  /**
+   * @brief Use fixed random variable streams
+   *
+   * @param stream First stream index to use
+   * @return int64_t Number of streams used
+   */
+  virtual int64_t assignStreams(int64_t stream);
+};
+
+/**
+ * @brief Oscillator with a constant rate
+ */
+class PtpConstantOscillator : public PtpOscillator {
+public:
+  PtpConstantOscillator(double rate = 1.0);
+
+  virtual double getElapsed(Time simulatorTime);
+  virtual double getRate();
+
+private:
+  double m_rate; //< Rate of the oscillator
+};
+
+/**
+ * @brief Oscillator with a frequency offset, aging, a temperature cycle,
+ * random walk frequency noise and white phase noise
+ *
+ * The frequency offset of the oscillator at time t is
+ * frequencyOffset + aging * t + temperature cycle + random walk. Between
+ * two reads the random walk and its integral are drawn together from their
+ * joint Gaussian distribution, so the cost of a read does not depend on the
+ * time since the last one. White phase noise is added to each read, the
+ * same sample for all reads at the same simulator time.
+ */
+class PtpNoisyOscillator : public PtpOscillator {
+public:
+  /**
+   * @brief Construct a new PtpNoisyOscillator object
+   *
+   * @param frequencyOffset Constant frequency offset in ppm
+   * @param randomWalk Standard deviation of the frequency random walk after
+   * one second, in ppb
+   * @param phaseNoise Standard deviation of the white phase noise in ns
+   * @param aging Frequency drift in ppb per day
+   */
+  PtpNoisyOscillator(
+    double frequencyOffset = 0,
+    double randomWalk = 0,
+    double phaseNoise = 0,
+    double aging = 0
+  );
+
+  /**
+   * @brief Add a sinusoidal frequency offset following the temperature
+   *
+   * @param amplitude Largest frequency offset of the cycle in ppb
+   * @param period Period of the temperature cycle
+   */
+  void setTemperatureCycle(double amplitude, Time period);
+
+  virtual double getElapsed(Time simulatorTime);
+  virtual double getRate();
+  virtual int64_t assignStreams(int64_t stream);
+
+private:
+  /**
+   * @brief Advance the random walk and the time counted to `seconds`
+   */
+  void advance(double seconds);
+
+  double m_frequencyOffset; //< Constant frequency offset
+  double m_randomWalk; //< Random walk standard deviation after 1 s
+  double m_phaseNoise; //< White phase noise standard deviation (ns)
+  double m_aging; //< Frequency drift per second
+  double m_temperatureAmplitude; //< Amplitude of the temperature cycle
+  double m_temperaturePeriod; //< Period of the temperature cycle (s)
+
+  double m_time; //< Simulator time of the state (s)
+  double m_walk; //< Random walk frequency offset at m_time
+  double m_elapsed; //< Nanoseconds counted at m_time, without phase noise
+  int64_t m_noiseTime; //< Simulator time of the phase noise sample (ns)
+  double m_noise; //< Phase noise sample (ns)
+  Ptr<NormalRandomVariable> m_normal; //< Standard normal samples
+};
+
+#endif /* PTP_OSCILLATOR_H */
@@ -0,0 +1,150 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors: Tinghui Wang <tinghui.wang@wsu.edu>
+ *
+ * This file implements the clock servos.
+ */
+
+#include "ns3/core-module.h"
+#include "ptp-servo.h"
+#include <cmath>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("PtpServo");
+
+/* linuxptp PI constants for hardware time stamping */
+static const double PI_KP_SCALE = 0.7;
+static const double PI_KP_EXPONENT = -0.3;
+static const double PI_KP_NORM_MAX = 0.7;
+static const double PI_KI_SCALE = 0.3;
+static const double PI_KI_EXPONENT = 0.4;
+static const double PI_KI_NORM_MAX = 0.3;
+
+PtpServo::~PtpServo() {
+}
+
+double PtpStepServo::sample(int64_t offset, Time localTime, PtpServoState_t &state) {
+  state = SERVO_JUMP;
+  return 0;
+}
+
+void PtpStepServo::reset() {
+}
+
+PtpPiServo::PtpPiServo(
+  double firstStepThreshold,
+  double stepThreshold,
+  double maxFrequency
+) : m_firstStepThreshold(firstStepThreshold),
+    m_stepThreshold(stepThreshold),
+    m_maxFrequency(maxFrequency),
+    m_drift(0),
+    m_count(0),
+    m_firstUpdate(true)
+{
+  setSyncInterval(1.0);
+}
+
+void PtpPiServo::setSyncInterval(double interval) {
+  m_interval = interval;
+  m_kp = std::min(
+    PI_KP_SCALE * std::pow(interval, PI_KP_EXPONENT), PI_KP_NORM_MAX / interval
+  );
+  m_ki = std::min(
+    PI_KI_SCALE * std::pow(interval, PI_KI_EXPONENT), PI_KI_NORM_MAX / interval
+  );
+}
+
+double PtpPiServo::getKp() const {
+  return m_kp;
+}
+
+double PtpPiServo::getKi() const {
+  return m_ki;
+}
+
+void PtpPiServo::reset() {
+  m_count = 0;
+  m_firstUpdate = true;
+}
+
+double PtpPiServo::sample(int64_t offset, Time localTime, PtpServoState_t &state) {
+  double ppb = m_drift;
+  state = SERVO_UNLOCKED;
+
+  if(m_count > 0) {
+    // Follow the measured sync interval, which may be adapted over time
+    double interval = (localTime - m_local[1 < m_count ? 1 : 0]).GetSeconds();
+    if(interval > 0 && std::abs(interval - m_interval) > 0.01 * m_interval) {
+      setSyncInterval(interval);
+    }
+  }
+
+  switch(m_count) {
+    case 0:
+      m_offset[0] = offset;
+      m_local[0] = localTime;
+      m_count = 1;
+      break;
+    case 1:
+      m_offset[1] = offset;
+      m_local[1] = localTime;
+      if(m_local[0] >= m_local[1]) {
+        m_count = 0;
+        break;
+      }
+      // Frequency error from the change of offset between the two samples
+      m_drift += (m_offset[1] - m_offset[0]) * 1e9 /
+        (m_local[1] - m_local[0]).GetNanoSeconds();
+      m_drift = std::max(-m_maxFrequency, std::min(m_maxFrequency, m_drift));
+      if((m_firstUpdate && m_firstStepThreshold > 0 &&
+          m_firstStepThreshold < std::abs(offset)) ||
+         (m_stepThreshold > 0 && m_stepThreshold < std::abs(offset))) {
+        state = SERVO_JUMP;
+      } else {
+        state = SERVO_LOCKED;
+      }
+      ppb = m_drift;
+      m_count = 2;
+      break;
+    default: {
+      m_local[1] = localTime;
+      if(m_stepThreshold > 0 && m_stepThreshold < std::abs(offset)) {
+        m_count = 0;
+        break;
+      }
+      double kiTerm = m_ki * offset;
+      ppb = m_kp * offset + m_drift + kiTerm;
+      if(ppb < -m_maxFrequency) {
+        ppb = -m_maxFrequency;
+      } else if(ppb > m_maxFrequency) {
+        ppb = m_maxFrequency;
+      } else {
+        m_drift += kiTerm;
+      }
+      state = SERVO_LOCKED;
+      break;
+    }
+  }
+
+  if(state != SERVO_UNLOCKED) {
+    m_firstUpdate = false;
+  }
+  NS_LOG_DEBUG("PI servo: offset " << offset << " ns, " << ppb << " ppb, state " <<
+    state);
+  return ppb;
+}
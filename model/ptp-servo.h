@@ -0,0 +1,138 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors: Tinghui Wang <tinghui.wang@wsu.edu>
+ *
+ * This file declares the clock servos that turn offset measurements into
+ * clock corrections.
+ *
+ */
+
+#ifndef PTP_SERVO_H
+#define PTP_SERVO_H
+
+#include "ns3/core-module.h"
+#include "ns3/simple-ref-count.h"
+
+using namespace ns3;
+
+/**
+ * @brief State of a clock servo after a sample
+ * SERVO_UNLOCKED: Not enough samples, leave the clock alone
+ * SERVO_JUMP: Step the clock by the offset and set the frequency
+ * SERVO_LOCKED: Only set the frequency
+ */
+typedef enum {
+  SERVO_UNLOCKED = 0,
+  SERVO_JUMP,
+  SERVO_LOCKED
+} PtpServoState_t;
+
+/**
+ * @brief Clock servo of a slave node
+ *
+ * A servo is fed with the offset of the slave clock from its master after
+ * each delay request-response exchange and tells the node whether to step
+ * its clock and which frequency correction to apply.
+ */
+class PtpServo : public SimpleRefCount<PtpServo> {
+public:
+  virtual ~PtpServo();
+
+  /**
+   * @brief Process one offset measurement
+   *
+   * @param offset Offset of the slave clock from the master in nanoseconds
+   * (positive if the slave is ahead).
+   * @param localTime Local time of the measurement
+   * @param state What the node should do with the clock
+   * @return double Estimated frequency error of the slave clock in ppb
+   * (positive if the slave is fast); the node corrects it by the opposite
+   * amount.
+   */
+  virtual double sample(int64_t offset, Time localTime, PtpServoState_t &state) = 0;
+
+  /**
+   * @brief Forget the samples seen so far
+   */
+  virtual void reset() = 0;
+};
+
+/**
+ * @brief Servo that steps the clock by every offset and never corrects the
+ * frequency
+ */
+class PtpStepServo : public PtpServo {
+public:
+  virtual double sample(int64_t offset, Time localTime, PtpServoState_t &state);
+  virtual void reset();
+};
+
+/**
+ * @brief Proportional-integral servo
+ *
+ * Follows the PI servo of linuxptp: the first two samples estimate the
+ * frequency error, and the clock is stepped once if the offset is above
+ * the first step threshold. From then on the frequency is corrected by
+ * kp * offset + ki * (sum of offsets). The constants are derived from the
+ * interval between samples with the linuxptp hardware time stamping
+ * defaults, so they follow changes of the sync interval.
+ */
+class PtpPiServo : public PtpServo {
+public:
+  /**
+   * @brief Construct a new PtpPiServo object
+   *
+   * @param firstStepThreshold Offset (ns) above which the clock is stepped
+   * on the first update (0 to never step).
+   * @param stepThreshold Offset (ns) above which the servo is unlocked and
+   * starts over (0 to never unlock).
+   * @param maxFrequency Largest frequency correction in ppb.
+   */
+  PtpPiServo(
+    double firstStepThreshold = 20000,
+    double stepThreshold = 0,
+    double maxFrequency = 900000000
+  );
+
+  virtual double sample(int64_t offset, Time localTime, PtpServoState_t &state);
+  virtual void reset();
+
+  /**
+   * @brief Set the interval between samples and the PI constants from it
+   *
+   * @param interval Seconds between samples
+   */
+  void setSyncInterval(double interval);
+
+  double getKp() const;
+
+  double getKi() const;
+
+private:
+  double m_firstStepThreshold; //< Offset (ns) stepped on the first update
+  double m_stepThreshold; //< Offset (ns) that unlocks the servo
+  double m_maxFrequency; //< Largest frequency correction (ppb)
+  double m_interval; //< Seconds between samples the constants are set for
+  double m_kp; //< Proportional constant
+  double m_ki; //< Integral constant
+  double m_drift; //< Integral term: frequency error estimate (ppb)
+  int64_t m_offset[2]; //< First two offsets
+  Time m_local[2]; //< Local times of the first two offsets and of the last one
+  int m_count; //< Number of samples (0, 1 or 2 and more)
+  bool m_firstUpdate; //< Next update is the first since start
+};
+
+#endif /* PTP_SERVO_H */
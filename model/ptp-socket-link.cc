@@ -48,7 +48,10 @@ SocketLink::SocketLink(
     m_hostPort(hostPort),
     m_dstIp(dstIp),
     m_dstPort(dstPort),
-    m_sock(sock)
+    m_sock(sock),
+    m_pdelaySequenceId(0),
+    m_pdelayResponded(false),
+    m_hasLinkDelay(false)
     {}
 
 uint16_t SocketLink::getHostId() {
@@ -78,3 +81,47 @@ uint16_t SocketLink::getDstPort() {
 Ptr<Socket> SocketLink::getSocket() {
   return m_sock;
 }
+
+uint16_t SocketLink::startPdelay(Time sendTime) {
+  m_pdelaySequenceId++;
+  m_pdelayReqSendTime = sendTime;
+  m_pdelayResponded = false;
+  return m_pdelaySequenceId;
+}
+
+void SocketLink::setPdelayResponse(
+  uint16_t sequenceId, Time requestReceiptTime, Time responseReceiptTime,
+  Time correction
+) {
+  if(sequenceId != m_pdelaySequenceId) {
+    return;
+  }
+  m_pdelayReqRecvTime = requestReceiptTime;
+  m_pdelayRespRecvTime = responseReceiptTime;
+  m_pdelayRespCorrection = correction;
+  m_pdelayResponded = true;
+}
+
+bool SocketLink::completePdelay(
+  uint16_t sequenceId, Time responseOriginTime, Time correction
+) {
+  if(sequenceId != m_pdelaySequenceId || !m_pdelayResponded) {
+    return false;
+  }
+  m_pdelayResponded = false;
+  m_linkDelay = NanoSeconds((
+    (m_pdelayRespRecvTime.GetNanoSeconds() - m_pdelayReqSendTime.GetNanoSeconds()) -
+    (responseOriginTime.GetNanoSeconds() - m_pdelayReqRecvTime.GetNanoSeconds()) -
+    m_pdelayRespCorrection.GetNanoSeconds() - correction.GetNanoSeconds()
+  ) / 2);
+  m_hasLinkDelay = true;
+  return true;
+}
+
+bool SocketLink::hasLinkDelay() {
+  return m_hasLinkDelay;
+}
+
+Time SocketLink::getLinkDelay() {
+  return m_linkDelay;
+}
@@ -26,6 +26,12 @@
 
 using namespace ns3;
 
+/**
+ * @brief Destination ID of a socket link that reaches every PTP node on the
+ * channel (multicast or broadcast SYNC and FOLLOW messages)
+ */
+static const uint16_t PTP_GROUP_NODE_ID = 0xFFFF;
+
 class SocketLink {
 public:
   SocketLink(
@@ -45,6 +51,51 @@ public:
   Ipv4Address getDstIp();
   Ptr<Socket> getSocket();
 
+  /* Peer delay measurement of the link, run by the host */
+
+  /**
+   * @brief Start a peer delay exchange
+   * 
+   * @param sendTime Local time the Pdelay_Req is sent (t1)
+   * @return uint16_t Sequence ID of the Pdelay_Req
+   */
+  uint16_t startPdelay(Time sendTime);
+
+  /**
+   * @brief Record the Pdelay_Resp of the current exchange
+   * 
+   * @param sequenceId Sequence ID of the response
+   * @param requestReceiptTime Peer time the request was received (t2)
+   * @param responseReceiptTime Local time the response was received (t4)
+   * @param correction Correction field of the response
+   */
+  void setPdelayResponse(
+    uint16_t sequenceId, Time requestReceiptTime, Time responseReceiptTime,
+    Time correction
+  );
+
+  /**
+   * @brief Complete the current exchange with its Pdelay_Resp_Follow_Up
+   * 
+   * The link delay is ((t4 - t1) - (t3 - t2) - corrections) / 2.
+   * 
+   * @param sequenceId Sequence ID of the follow-up
+   * @param responseOriginTime Peer time the response was sent (t3)
+   * @param correction Correction field of the follow-up
+   * @return true if the link delay was updated.
+   */
+  bool completePdelay(uint16_t sequenceId, Time responseOriginTime, Time correction);
+
+  /**
+   * @brief Whether a peer delay exchange has completed on the link
+   */
+  bool hasLinkDelay();
+
+  /**
+   * @brief Get the last measured one-way delay of the link
+   */
+  Time getLinkDelay();
+
 private:
   const uint16_t m_hostId;    //< Host node ID
   const uint16_t m_dstId;     //< Destination node ID
@@ -53,6 +104,15 @@ private:
   const Ipv4Address m_dstIp;  //< Destination IPv4 Address
   const uint16_t m_dstPort;   //< Destination UDP Port
   const Ptr<Socket> m_sock;   //< Corresponding Socket Pointer
+
+  uint16_t m_pdelaySequenceId;   //< Sequence ID of the current peer delay exchange
+  Time m_pdelayReqSendTime;      //< t1: Pdelay_Req sent
+  Time m_pdelayReqRecvTime;      //< t2: Pdelay_Req received by the peer
+  Time m_pdelayRespRecvTime;     //< t4: Pdelay_Resp received
+  Time m_pdelayRespCorrection;   //< Correction field of the Pdelay_Resp
+  bool m_pdelayResponded;        //< Pdelay_Resp of the current exchange received
+  bool m_hasLinkDelay;           //< A peer delay exchange has completed
+  Time m_linkDelay;              //< Last measured one-way link delay
 };
 
 #endif /* PTP_SOCKET_LINK_H */
@@ -0,0 +1,170 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors: Tinghui Wang <tinghui.wang@wsu.edu>
+ *
+ * This file implements the online statistics of clock offset errors.
+ */
+
+#include "ns3/core-module.h"
+#include "ptp-statistics.h"
+#include <cmath>
+#include <limits>
+
+using namespace ns3;
+
+/* Samples below this value (ns) are counted in the zero bucket */
+static const double PTP_SKETCH_MIN_VALUE = 1e-3;
+
+PtpOffsetStatistics::PtpOffsetStatistics(
+  double relativeAccuracy,
+  double convergenceThreshold
+) : m_count(0),
+    m_mean(0),
+    m_m2(0),
+    m_min(std::numeric_limits<double>::infinity()),
+    m_max(-std::numeric_limits<double>::infinity()),
+    m_relativeAccuracy(relativeAccuracy),
+    m_zeroCount(0),
+    m_convergenceThreshold(convergenceThreshold),
+    m_converged(false),
+    m_convergenceTime(NanoSeconds(-1))
+{
+  m_gamma = (1 + relativeAccuracy) / (1 - relativeAccuracy);
+  m_logGamma = std::log(m_gamma);
+}
+
+int32_t PtpOffsetStatistics::getBucketIndex(double value) const {
+  return (int32_t) std::ceil(std::log(value) / m_logGamma);
+}
+
+void PtpOffsetStatistics::update(double offsetError, Time simTime) {
+  // Welford's online mean and variance
+  m_count++;
+  double delta = offsetError - m_mean;
+  m_mean += delta / m_count;
+  m_m2 += delta * (offsetError - m_mean);
+  m_min = std::min(m_min, offsetError);
+  m_max = std::max(m_max, offsetError);
+
+  double magnitude = std::abs(offsetError);
+  if(magnitude < PTP_SKETCH_MIN_VALUE) {
+    m_zeroCount++;
+  } else {
+    m_buckets[getBucketIndex(magnitude)]++;
+  }
+
+  if(magnitude <= m_convergenceThreshold) {
+    if(!m_converged) {
+      m_converged = true;
+      m_convergenceTime = simTime;
+    }
+  } else {
+    m_converged = false;
+    m_convergenceTime = NanoSeconds(-1);
+  }
+}
+
+void PtpOffsetStatistics::merge(const PtpOffsetStatistics &other) {
+  if(other.m_count == 0) {
+    return;
+  }
+  if(m_count == 0) {
+    m_converged = other.m_converged;
+    m_convergenceTime = other.m_convergenceTime;
+  } else {
+    m_converged = m_converged && other.m_converged;
+    if(m_converged) {
+      m_convergenceTime = std::max(m_convergenceTime, other.m_convergenceTime);
+    } else {
+      m_convergenceTime = NanoSeconds(-1);
+    }
+  }
+
+  // Chan et al. parallel combination of mean and variance
+  uint64_t count = m_count + other.m_count;
+  double delta = other.m_mean - m_mean;
+  m_mean += delta * other.m_count / count;
+  m_m2 += other.m_m2 + delta * delta * ((double) m_count * other.m_count / count);
+  m_count = count;
+  m_min = std::min(m_min, other.m_min);
+  m_max = std::max(m_max, other.m_max);
+
+  NS_ASSERT(m_relativeAccuracy == other.m_relativeAccuracy);
+  m_zeroCount += other.m_zeroCount;
+  std::map<int32_t, uint64_t>::const_iterator it;
+  for(it = other.m_buckets.begin(); it != other.m_buckets.end(); it++) {
+    m_buckets[it->first] += it->second;
+  }
+}
+
+void PtpOffsetStatistics::setConvergenceThreshold(double threshold) {
+  m_convergenceThreshold = threshold;
+}
+
+uint64_t PtpOffsetStatistics::getCount() const {
+  return m_count;
+}
+
+double PtpOffsetStatistics::getMean() const {
+  return m_mean;
+}
+
+double PtpOffsetStatistics::getVariance() const {
+  if(m_count < 2) {
+    return 0;
+  }
+  return m_m2 / (m_count - 1);
+}
+
+double PtpOffsetStatistics::getStdDev() const {
+  return std::sqrt(getVariance());
+}
+
+double PtpOffsetStatistics::getMin() const {
+  return m_count > 0 ? m_min : 0;
+}
+
+double PtpOffsetStatistics::getMax() const {
+  return m_count > 0 ? m_max : 0;
+}
+
+double PtpOffsetStatistics::getQuantile(double q) const {
+  if(m_count == 0) {
+    return 0;
+  }
+  double rank = q * (m_count - 1);
+  uint64_t seen = m_zeroCount;
+  if(rank < seen) {
+    return 0;
+  }
+  std::map<int32_t, uint64_t>::const_iterator it;
+  for(it = m_buckets.begin(); it != m_buckets.end(); it++) {
+    seen += it->second;
+    if(rank < seen) {
+      // Midpoint (in relative error) of the bucket bounds
+      return 2 * std::pow(m_gamma, it->first) / (m_gamma + 1);
+    }
+  }
+  return m_max;
+}
+
+bool PtpOffsetStatistics::isConverged() const {
+  return m_converged;
+}
+
+Time PtpOffsetStatistics::getConvergenceTime() const {
+  return m_convergenceTime;
+}
@@ -0,0 +1,136 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors: Tinghui Wang <tinghui.wang@wsu.edu>
+ *
+ * This file declares the online statistics of clock offset errors.
+ *
+ */
+
+#ifndef PTP_STATISTICS_H
+#define PTP_STATISTICS_H
+
+#include "ns3/core-module.h"
+#include <map>
+
+using namespace ns3;
+
+/**
+ * @brief Online statistics of clock offset errors
+ *
+ * Keeps count, mean, variance (Welford), min and max of the samples, a
+ * log-bucketed quantile sketch with bounded relative error, and the time
+ * at which the offset error last entered the convergence threshold.
+ * Statistics of several nodes are combined with `merge`.
+ */
+class PtpOffsetStatistics {
+public:
+  /**
+   * @brief Construct a new PtpOffsetStatistics object
+   *
+   * @param relativeAccuracy Relative error bound of the quantiles.
+   * @param convergenceThreshold Offset error (ns) under which a node is
+   * considered converged.
+   */
+  PtpOffsetStatistics(
+    double relativeAccuracy = 0.01,
+    double convergenceThreshold = 1000.0
+  );
+
+  /**
+   * @brief Add an offset error sample
+   *
+   * @param offsetError Offset error in nanoseconds
+   * @param simTime Simulator time of the sample
+   */
+  void update(double offsetError, Time simTime);
+
+  /**
+   * @brief Combine the samples of another statistics object into this one
+   *
+   * Both objects must use the same relative accuracy. The merged node is
+   * converged only if both are, at the later of the two times.
+   *
+   * @param other
+   */
+  void merge(const PtpOffsetStatistics &other);
+
+  /**
+   * @brief Set the offset error (ns) under which a node is converged
+   *
+   * @param threshold
+   */
+  void setConvergenceThreshold(double threshold);
+
+  uint64_t getCount() const;
+
+  double getMean() const;
+
+  double getVariance() const;
+
+  double getStdDev() const;
+
+  double getMin() const;
+
+  double getMax() const;
+
+  /**
+   * @brief Get an estimate of the q-quantile of the samples
+   *
+   * @param q Quantile in [0, 1]
+   * @return double
+   */
+  double getQuantile(double q) const;
+
+  /**
+   * @brief Is the offset error currently within the convergence threshold
+   */
+  bool isConverged() const;
+
+  /**
+   * @brief Simulator time since which all samples stayed within the
+   * convergence threshold
+   *
+   * @return Time Negative if not converged.
+   */
+  Time getConvergenceTime() const;
+
+private:
+  /**
+   * @brief Index of the sketch bucket holding a positive value
+   */
+  int32_t getBucketIndex(double value) const;
+
+  /* Moments */
+  uint64_t m_count; //< Number of samples
+  double m_mean; //< Running mean
+  double m_m2; //< Sum of squared differences from the mean
+  double m_min; //< Smallest sample
+  double m_max; //< Largest sample
+
+  /* Quantile sketch */
+  double m_relativeAccuracy; //< Relative error bound of the quantiles
+  double m_gamma; //< Ratio between bucket bounds
+  double m_logGamma; //< log(m_gamma)
+  std::map<int32_t, uint64_t> m_buckets; //< Counts of (gamma^(i-1), gamma^i]
+  uint64_t m_zeroCount; //< Samples too small for the buckets
+
+  /* Convergence */
+  double m_convergenceThreshold; //< Offset error (ns) of a converged node
+  bool m_converged; //< Last sample within the threshold
+  Time m_convergenceTime; //< Time of the first sample of the current converged run
+};
+
+#endif /* PTP_STATISTICS_H */
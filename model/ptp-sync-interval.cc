@@ -0,0 +1,101 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors: Tinghui Wang <tinghui.wang@wsu.edu>
+ *
+ * This file implements the sync interval policies.
+ */
+
+#include "ns3/core-module.h"
+#include "ptp-sync-interval.h"
+#include <cmath>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("PtpSyncInterval");
+
+PtpSyncIntervalPolicy::~PtpSyncIntervalPolicy() {
+}
+
+Time PtpFixedSyncInterval::update(Time interval, double offset) {
+  return interval;
+}
+
+PtpAdaptiveSyncInterval::PtpAdaptiveSyncInterval(
+  Time minInterval,
+  Time maxInterval,
+  double lowThreshold,
+  double highThreshold,
+  uint32_t holdSamples,
+  double alpha
+) : m_minInterval(minInterval),
+    m_maxInterval(maxInterval),
+    m_lowThreshold(lowThreshold),
+    m_highThreshold(highThreshold),
+    m_holdSamples(holdSamples),
+    m_alpha(alpha),
+    m_mean(0),
+    m_variance(0),
+    m_count(0),
+    m_quietSamples(0)
+{
+}
+
+Time PtpAdaptiveSyncInterval::update(Time interval, double offset) {
+  if(m_count == 0) {
+    m_mean = offset;
+    m_variance = 0;
+  } else {
+    // Exponentially weighted moving mean and variance
+    double diff = offset - m_mean;
+    double increment = m_alpha * diff;
+    m_mean += increment;
+    m_variance = (1 - m_alpha) * (m_variance + diff * increment);
+  }
+  m_count++;
+
+  Time next = interval;
+  if(offset > m_highThreshold) {
+    m_quietSamples = 0;
+    next = m_minInterval;
+  } else if(m_mean + 2 * std::sqrt(m_variance) < m_lowThreshold) {
+    m_quietSamples++;
+    if(m_quietSamples >= m_holdSamples) {
+      m_quietSamples = 0;
+      next = NanoSeconds(2 * interval.GetNanoSeconds());
+    }
+  } else {
+    m_quietSamples = 0;
+  }
+  if(next > m_maxInterval) {
+    next = m_maxInterval;
+  } else if(next < m_minInterval) {
+    next = m_minInterval;
+  }
+  if(next != interval) {
+    NS_LOG_DEBUG("Sync interval " << interval.GetSeconds() << " s -> " <<
+      next.GetSeconds() << " s, offset mean " << m_mean << " ns, variance " <<
+      m_variance);
+  }
+  return next;
+}
+
+double PtpAdaptiveSyncInterval::getMean() const {
+  return m_mean;
+}
+
+double PtpAdaptiveSyncInterval::getVariance() const {
+  return m_variance;
+}
@@ -0,0 +1,115 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors: Tinghui Wang <tinghui.wang@wsu.edu>
+ *
+ * This file declares the policies choosing the sync interval of a slave.
+ *
+ */
+
+#ifndef PTP_SYNC_INTERVAL_H
+#define PTP_SYNC_INTERVAL_H
+
+#include "ns3/core-module.h"
+#include "ns3/simple-ref-count.h"
+
+using namespace ns3;
+
+/**
+ * @brief Policy choosing how often a slave is sent SYNC messages
+ *
+ * After each delay request-response exchange the slave hands the measured
+ * offset to its policy, which returns the interval until the next SYNC.
+ * The master of the slave follows it, as with the message rates a slave
+ * requests by unicast negotiation in IEEE 1588.
+ */
+class PtpSyncIntervalPolicy : public SimpleRefCount<PtpSyncIntervalPolicy> {
+public:
+  virtual ~PtpSyncIntervalPolicy();
+
+  /**
+   * @brief Process one offset measurement
+   *
+   * @param interval Current sync interval
+   * @param offset Absolute offset measured by the slave in nanoseconds
+   * @return Time Next sync interval
+   */
+  virtual Time update(Time interval, double offset) = 0;
+};
+
+/**
+ * @brief Keep the sync interval the network started with
+ */
+class PtpFixedSyncInterval : public PtpSyncIntervalPolicy {
+public:
+  virtual Time update(Time interval, double offset);
+};
+
+/**
+ * @brief Back off while the offset stays small, sync fast once disturbed
+ *
+ * The policy keeps an exponentially weighted moving mean and variance of
+ * the measured offset. When mean + 2 standard deviations has stayed under
+ * the low threshold for `holdSamples` updates, the interval is doubled up
+ * to the largest interval. An offset above the high threshold brings the
+ * interval back to the smallest one at once.
+ */
+class PtpAdaptiveSyncInterval : public PtpSyncIntervalPolicy {
+public:
+  /**
+   * @brief Construct a new PtpAdaptiveSyncInterval object
+   *
+   * @param minInterval Interval of a disturbed slave
+   * @param maxInterval Interval of a slave that stays converged
+   * @param lowThreshold Offset (ns) under which the slave may back off
+   * @param highThreshold Offset (ns) above which the slave is disturbed
+   * @param holdSamples Updates under the low threshold before backing off
+   * @param alpha Weight of the newest offset in the moving statistics
+   */
+  PtpAdaptiveSyncInterval(
+    Time minInterval,
+    Time maxInterval,
+    double lowThreshold = 250,
+    double highThreshold = 1000,
+    uint32_t holdSamples = 4,
+    double alpha = 0.25
+  );
+
+  virtual Time update(Time interval, double offset);
+
+  /**
+   * @brief Moving mean of the offset (ns)
+   */
+  double getMean() const;
+
+  /**
+   * @brief Moving variance of the offset (ns^2)
+   */
+  double getVariance() const;
+
+private:
+  Time m_minInterval; //< Interval of a disturbed slave
+  Time m_maxInterval; //< Interval of a converged slave
+  double m_lowThreshold; //< Offset (ns) under which the slave may back off
+  double m_highThreshold; //< Offset (ns) above which the slave is disturbed
+  uint32_t m_holdSamples; //< Updates under the low threshold before backing off
+  double m_alpha; //< Weight of the newest offset
+  double m_mean; //< Moving mean of the offset
+  double m_variance; //< Moving variance of the offset
+  uint32_t m_count; //< Offsets seen so far
+  uint32_t m_quietSamples; //< Updates under the low threshold since the last change
+};
+
+#endif /* PTP_SYNC_INTERVAL_H */
@@ -0,0 +1,189 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors: Tinghui Wang <tinghui.wang@wsu.edu>
+ *
+ * This file implements the time stamping points of PTP event messages.
+ */
+
+#include "ns3/core-module.h"
+#include "ptp-timestamper.h"
+#include "ptp-transparent-clock.h"
+#include <iostream>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("PtpTimestamper");
+
+PtpTimestamper::PtpTimestamper(
+  PtpNode *node,
+  PtpTimestampMode_t mode,
+  Time maxAge
+) : m_node(node),
+    m_mode(mode),
+    m_maxAge(maxAge),
+    m_missed(0)
+{}
+
+uint32_t PtpTimestamper::install(Ptr<Node> node) {
+  uint32_t devices = 0;
+  for(uint32_t i = 0; i < node->GetNDevices(); i++) {
+    if(install(node->GetDevice(i))) {
+      devices++;
+    }
+  }
+  if(devices == 0) {
+    std::cerr << "[PtpTimestamper::install] Error: Node " <<
+      node->GetId() << " has no device to time stamp on." << std::endl;
+  }
+  return devices;
+}
+
+bool PtpTimestamper::install(Ptr<NetDevice> device) {
+  if(m_mode == TIMESTAMP_APPLICATION) {
+    return true;
+  }
+  // Wi-Fi PHYs trace a copy of the frame on the air, so a correction set
+  // there is lost, and the MAC traces frames before channel access.
+  TypeId wifiDevice;
+  if(TypeId::LookupByNameFailSafe("ns3::WifiNetDevice", &wifiDevice) &&
+     device->GetInstanceTypeId().IsChildOf(wifiDevice)) {
+    std::cerr << "[PtpTimestamper::install] Error: Node " <<
+      device->GetNode()->GetId() << ": Wi-Fi devices only support " <<
+      "application time stamps." << std::endl;
+    return false;
+  }
+  std::string txSource = (m_mode == TIMESTAMP_HARDWARE) ? "PhyTxBegin" : "MacTx";
+  std::string rxSource = (m_mode == TIMESTAMP_HARDWARE) ? "PhyRxEnd" : "MacRx";
+  // Connecting a callback of another signature would abort the simulation
+  if(getTraceSignature(device, txSource) != "ns3::Packet::TracedCallback" ||
+     getTraceSignature(device, rxSource) != "ns3::Packet::TracedCallback") {
+    return false;
+  }
+  device->TraceConnectWithoutContext(
+    txSource, MakeCallback(&PtpTimestamper::deviceTransmit, this));
+  return device->TraceConnectWithoutContext(
+    rxSource, MakeCallback(&PtpTimestamper::deviceReceive, this));
+}
+
+std::string PtpTimestamper::getTraceSignature(
+  Ptr<Object> object, std::string source
+) {
+  TypeId::TraceSourceInformation info;
+  if(!object->GetInstanceTypeId().LookupTraceSourceByName(source, &info)) {
+    return "";
+  }
+  return info.callback;
+}
+
+void PtpTimestamper::setLatency(Ptr<RandomVariableStream> latency) {
+  m_latency = latency;
+}
+
+PtpTimestampMode_t PtpTimestamper::getMode() {
+  return m_mode;
+}
+
+Time PtpTimestamper::getLatency() {
+  if(m_mode == TIMESTAMP_HARDWARE || !m_latency) {
+    return NanoSeconds(0);
+  }
+  return NanoSeconds(m_latency->GetValue());
+}
+
+void PtpTimestamper::expire(Time now) {
+  while(!m_txOrder.empty() && m_txOrder.front().first + m_maxAge < now) {
+    m_txTimestamps.erase(m_txOrder.front().second);
+    m_txOrder.pop_front();
+  }
+  while(!m_rxOrder.empty() && m_rxOrder.front().first + m_maxAge < now) {
+    m_rxTimestamps.erase(m_rxOrder.front().second);
+    m_rxOrder.pop_front();
+  }
+}
+
+void PtpTimestamper::transmit(Ptr<Packet> packet) {
+  PtpCorrectionTag tag;
+  if(!packet->PeekPacketTag(tag)) {
+    return;
+  }
+  if(m_mode == TIMESTAMP_APPLICATION) {
+    tag.setCorrection(tag.getCorrection() + getLatency());
+    packet->ReplacePacketTag(tag);
+    return;
+  }
+  Time now = Simulator::Now();
+  expire(now);
+  PtpTxTimestamp_t record;
+  record.timestamp = m_node->getLocalTime(now);
+  record.correction = tag.getCorrection();
+  m_txTimestamps[packet->GetUid()] = record;
+  m_txOrder.push_back(std::make_pair(now, packet->GetUid()));
+}
+
+void PtpTimestamper::deviceTransmit(Ptr<const Packet> packet) {
+  std::unordered_map<uint64_t, PtpTxTimestamp_t>::const_iterator it =
+    m_txTimestamps.find(packet->GetUid());
+  if(it == m_txTimestamps.end()) {
+    // Not an event message of this node
+    return;
+  }
+  PtpCorrectionTag tag;
+  if(!packet->PeekPacketTag(tag)) {
+    return;
+  }
+  // Retransmissions are stamped again, so the correction is recomputed from
+  // the one the message was handed over with.
+  Time delay = m_node->getLocalTime() + getLatency() - it->second.timestamp;
+  tag.setCorrection(it->second.correction + delay);
+  // The trace source hands out the frame being sent, update it in place
+  ConstCast<Packet>(packet)->ReplacePacketTag(tag);
+  NS_LOG_DEBUG("Node " << m_node->getNodeId() << ": transmit time stamp " <<
+    delay.GetNanoSeconds() << " ns after the application one");
+}
+
+void PtpTimestamper::deviceReceive(Ptr<const Packet> packet) {
+  PtpCorrectionTag tag;
+  if(!packet->PeekPacketTag(tag)) {
+    return;
+  }
+  Time now = Simulator::Now();
+  expire(now);
+  // A duplicate of a message already received does not reach the socket
+  if(m_rxTimestamps.count(packet->GetUid()) > 0) {
+    return;
+  }
+  m_rxTimestamps[packet->GetUid()] = m_node->getLocalTime(now) + getLatency();
+  m_rxOrder.push_back(std::make_pair(now, packet->GetUid()));
+}
+
+Time PtpTimestamper::getReceiveTime(Ptr<const Packet> packet) {
+  if(m_mode == TIMESTAMP_APPLICATION) {
+    return m_node->getLocalTime() + getLatency();
+  }
+  std::unordered_map<uint64_t, Time>::iterator it =
+    m_rxTimestamps.find(packet->GetUid());
+  if(it == m_rxTimestamps.end()) {
+    m_missed++;
+    return m_node->getLocalTime();
+  }
+  Time timestamp = it->second;
+  m_rxTimestamps.erase(it);
+  return timestamp;
+}
+
+uint64_t PtpTimestamper::getMissedCount() {
+  return m_missed;
+}
@@ -0,0 +1,192 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors: Tinghui Wang <tinghui.wang@wsu.edu>
+ *
+ * This file declares the time stamping points of PTP event messages on an
+ * end node.
+ *
+ */
+
+#ifndef PTP_TIMESTAMPER_H
+#define PTP_TIMESTAMPER_H
+
+#include "ns3/core-module.h"
+#include "ns3/node.h"
+#include "ns3/net-device.h"
+#include "ns3/packet.h"
+#include <deque>
+#include <unordered_map>
+#include "ptp-node.h"
+
+using namespace ns3;
+
+/**
+ * @brief Where event messages are time stamped
+ * TIMESTAMP_APPLICATION: When the application sends or reads the message
+ * TIMESTAMP_SOFTWARE: When the network device driver gets the message
+ * (MacTx and MacRx trace sources)
+ * TIMESTAMP_HARDWARE: When the message starts to leave or ends to arrive
+ * on the medium (PhyTxBegin and PhyRxEnd trace sources)
+ */
+typedef enum {
+  TIMESTAMP_APPLICATION = 0,
+  TIMESTAMP_SOFTWARE,
+  TIMESTAMP_HARDWARE
+} PtpTimestampMode_t;
+
+/**
+ * @brief Application time stamp of an event message not sent yet
+ */
+typedef struct {
+  Time timestamp; //< Local time the application stamped
+  Time correction; //< Correction of the message when it was handed over
+} PtpTxTimestamp_t;
+
+/**
+ * @brief Time stamps of PTP event messages at a chosen point of the stack
+ *
+ * PTPNetwork stamps SYNC, DREQ, PDELAY_REQ and PDELAY_RESP messages with
+ * the local time when it sends and reads them. With a PtpTimestamper on a
+ * node those times are taken at the network device instead:
+ *
+ * - Outgoing messages: the time from the application time stamp to the
+ *   time stamp point (queuing and channel access, for instance) is added to
+ *   their PtpCorrectionTag, the way a one-step clock corrects a message on
+ *   the fly. The receiver takes it out like a transparent clock residence
+ *   time, so two-step FOLLOW messages keep the application time stamp.
+ * - Incoming messages: the local time at the time stamp point is kept by
+ *   packet UID until PTPNetwork reads the message.
+ *
+ * Software and application time stamps can be taken a random latency after
+ * the time stamp point (interrupt and scheduling latency), which the
+ * simulated stack does not have otherwise. Install one time stamper per end
+ * node.
+ */
+class PtpTimestamper : public SimpleRefCount<PtpTimestamper> {
+public:
+  /**
+   * @brief Construct a new PtpTimestamper object
+   *
+   * @param node Node whose local clock stamps the messages
+   * @param mode Time stamp point
+   * @param maxAge Time stamps not claimed after this time are forgotten.
+   */
+  PtpTimestamper(
+    PtpNode *node,
+    PtpTimestampMode_t mode,
+    Time maxAge = Seconds(1.0)
+  );
+
+  /**
+   * @brief Watch every network device of a node
+   *
+   * Devices without the trace sources of the time stamp point are skipped.
+   *
+   * @param node
+   * @return uint32_t Number of devices watched
+   */
+  uint32_t install(Ptr<Node> node);
+
+  /**
+   * @brief Watch one network device
+   *
+   * The device itself must have the trace sources, passing the frame only
+   * (CSMA and point-to-point devices). Wi-Fi devices are refused in the
+   * hardware and software modes: their PHY traces a copy of the frame, so
+   * the correction never reaches the air, and their MAC traces the frame
+   * when it is queued, before channel access.
+   *
+   * @param device
+   * @return true if the device has the trace sources needed.
+   */
+  bool install(Ptr<NetDevice> device);
+
+  /**
+   * @brief Set the latency of software and application time stamps
+   *
+   * @param latency Nanoseconds from the time stamp point to the time stamp,
+   * drawn for every message (none by default)
+   */
+  void setLatency(Ptr<RandomVariableStream> latency);
+
+  PtpTimestampMode_t getMode();
+
+  /**
+   * @brief Record an event message the application stamps and sends now
+   *
+   * Call it before handing the message to the socket: a device may start
+   * the transmission before Send returns.
+   *
+   * @param packet Message carrying a PtpCorrectionTag
+   */
+  void transmit(Ptr<Packet> packet);
+
+  /**
+   * @brief Get the local time an event message was received at
+   *
+   * @param packet Message read from the socket
+   * @return Time Local time at the time stamp point, or now if the device
+   * did not see the message.
+   */
+  Time getReceiveTime(Ptr<const Packet> packet);
+
+  /**
+   * @brief Get the number of received messages the device did not stamp
+   *
+   * @return uint64_t
+   */
+  uint64_t getMissedCount();
+
+private:
+  /**
+   * @brief Correct a tagged message at the transmit time stamp point
+   */
+  void deviceTransmit(Ptr<const Packet> packet);
+
+  /**
+   * @brief Stamp a tagged message at the receive time stamp point
+   */
+  void deviceReceive(Ptr<const Packet> packet);
+
+  /**
+   * @brief Get the callback signature of a trace source
+   *
+   * @return std::string Empty if the object has no such trace source
+   */
+  static std::string getTraceSignature(Ptr<Object> object, std::string source);
+
+  /**
+   * @brief Draw the latency of a software or application time stamp
+   */
+  Time getLatency();
+
+  /**
+   * @brief Forget time stamps older than the maximum age
+   */
+  void expire(Time now);
+
+  PtpNode *m_node; //< Node whose clock stamps the messages
+  PtpTimestampMode_t m_mode; //< Time stamp point
+  Time m_maxAge; //< Time stamps not claimed for longer are forgotten
+  Ptr<RandomVariableStream> m_latency; //< Latency of software and application time stamps
+  std::unordered_map<uint64_t, PtpTxTimestamp_t> m_txTimestamps; //< Messages sent, by packet UID
+  std::unordered_map<uint64_t, Time> m_rxTimestamps; //< Local receive times, by packet UID
+  std::deque<std::pair<Time, uint64_t> > m_txOrder; //< Messages sent in order, to forget old ones
+  std::deque<std::pair<Time, uint64_t> > m_rxOrder; //< Messages received in order, to forget old ones
+  uint64_t m_missed; //< Received messages the device did not stamp
+};
+
+#endif /* PTP_TIMESTAMPER_H */
@@ -0,0 +1,253 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors: Tinghui Wang <tinghui.wang@wsu.edu>
+ *
+ * This file implements the binary trace sink for clock offset samples.
+ */
+
+#include "ns3/core-module.h"
+#include "ptp-trace-writer.h"
+#include <cstring>
+#include <map>
+#include <set>
+#include <sstream>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("PtpTraceWriter");
+
+/* File header: magic, format version, record size */
+static const uint8_t PTP_TRACE_MAGIC[4] = { 'P', 'T', 'P', 'O' };
+static const uint32_t PTP_TRACE_VERSION = 1;
+static const uint32_t PTP_TRACE_HEADER_SIZE = 12;
+static const uint32_t PTP_TRACE_RECORD_SIZE = 32;
+
+static void encodeU16(uint8_t *buf, uint16_t value) {
+  buf[0] = value & 0xFF;
+  buf[1] = (value >> 8) & 0xFF;
+}
+
+static void encodeU32(uint8_t *buf, uint32_t value) {
+  for(int i = 0; i < 4; i++) {
+    buf[i] = (value >> (8 * i)) & 0xFF;
+  }
+}
+
+static void encodeU64(uint8_t *buf, uint64_t value) {
+  for(int i = 0; i < 8; i++) {
+    buf[i] = (value >> (8 * i)) & 0xFF;
+  }
+}
+
+static void encodeDouble(uint8_t *buf, double value) {
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  encodeU64(buf, bits);
+}
+
+static uint16_t decodeU16(const uint8_t *buf) {
+  return buf[0] | (buf[1] << 8);
+}
+
+static uint32_t decodeU32(const uint8_t *buf) {
+  uint32_t value = 0;
+  for(int i = 0; i < 4; i++) {
+    value |= ((uint32_t) buf[i]) << (8 * i);
+  }
+  return value;
+}
+
+static uint64_t decodeU64(const uint8_t *buf) {
+  uint64_t value = 0;
+  for(int i = 0; i < 8; i++) {
+    value |= ((uint64_t) buf[i]) << (8 * i);
+  }
+  return value;
+}
+
+static double decodeDouble(const uint8_t *buf) {
+  uint64_t bits = decodeU64(buf);
+  double value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+PtpTraceWriter::PtpTraceWriter(uint32_t bufferSize)
+  : m_bufferSize(bufferSize)
+{
+  m_buffer.reserve(m_bufferSize + PTP_TRACE_RECORD_SIZE);
+}
+
+PtpTraceWriter::~PtpTraceWriter() {
+  close();
+}
+
+bool PtpTraceWriter::open(std::string filename) {
+  close();
+  m_file.open(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if(!m_file.is_open()) {
+    std::cerr << "[PtpTraceWriter::open] Failed to create trace file " <<
+      filename << "." << std::endl;
+    return false;
+  }
+  uint8_t header[PTP_TRACE_HEADER_SIZE];
+  std::memcpy(header, PTP_TRACE_MAGIC, 4);
+  encodeU32(header + 4, PTP_TRACE_VERSION);
+  encodeU32(header + 8, PTP_TRACE_RECORD_SIZE);
+  m_file.write((const char *) header, PTP_TRACE_HEADER_SIZE);
+  return true;
+}
+
+bool PtpTraceWriter::isOpen() {
+  return m_file.is_open();
+}
+
+void PtpTraceWriter::write(const PtpTraceRecord_t &record) {
+  size_t offset = m_buffer.size();
+  m_buffer.resize(offset + PTP_TRACE_RECORD_SIZE);
+  uint8_t *buf = &m_buffer[offset];
+  encodeU16(buf, record.nodeId);
+  encodeU16(buf + 2, 0);
+  encodeU32(buf + 4, (uint32_t) record.eventId);
+  encodeU64(buf + 8, (uint64_t) record.simTime);
+  encodeDouble(buf + 16, record.preOffsetError);
+  encodeDouble(buf + 24, record.postOffsetError);
+  if(m_buffer.size() >= m_bufferSize) {
+    flush();
+  }
+}
+
+void PtpTraceWriter::flush() {
+  if(m_file.is_open() && !m_buffer.empty()) {
+    m_file.write((const char *) &m_buffer[0], m_buffer.size());
+  }
+  m_buffer.clear();
+}
+
+void PtpTraceWriter::close() {
+  if(m_file.is_open()) {
+    flush();
+    m_file.close();
+  }
+}
+
+bool PtpTraceWriter::readTrace(
+  std::string filename, std::vector<PtpTraceRecord_t> &records
+) {
+  PtpTraceReader reader;
+  if(!reader.open(filename)) {
+    return false;
+  }
+  PtpTraceRecord_t record;
+  while(reader.read(record)) {
+    records.push_back(record);
+  }
+  return true;
+}
+
+/**
+ * @brief Append the text of each node to its node_<id>.dat file
+ *
+ * @param pending Text of each node, cleared once written.
+ * @param created Nodes whose file has been created, it is truncated the
+ * first time.
+ */
+static bool appendText(
+  std::string outputPrefix, std::map<uint16_t, std::string> &pending,
+  std::set<uint16_t> &created
+) {
+  std::map<uint16_t, std::string>::const_iterator it;
+  for(it = pending.begin(); it != pending.end(); it++) {
+    std::stringstream nodeStatFilename;
+    nodeStatFilename << "node_" << it->first << ".dat";
+    std::ios::openmode mode = std::ios::out |
+      (created.count(it->first) > 0 ? std::ios::app : std::ios::trunc);
+    std::ofstream nodeStatistics((outputPrefix + nodeStatFilename.str()).c_str(), mode);
+    if(!nodeStatistics.is_open()) {
+      std::cerr << "[PtpTraceWriter::convertToText] Failed to create " <<
+        outputPrefix << nodeStatFilename.str() << "." << std::endl;
+      return false;
+    }
+    nodeStatistics << it->second;
+    created.insert(it->first);
+  }
+  pending.clear();
+  return true;
+}
+
+bool PtpTraceWriter::convertToText(
+  std::string filename, std::string outputPrefix, uint32_t bufferSize
+) {
+  PtpTraceReader reader;
+  if(!reader.open(filename)) {
+    return false;
+  }
+  // Group samples by node so only one text file is open at a time
+  std::map<uint16_t, std::string> pending;
+  std::set<uint16_t> created;
+  uint64_t pendingBytes = 0;
+  PtpTraceRecord_t record;
+  while(reader.read(record)) {
+    std::stringstream sample;
+    sample << record.postOffsetError << '\n';
+    pending[record.nodeId] += sample.str();
+    pendingBytes += sample.str().size();
+    if(pendingBytes >= bufferSize) {
+      if(!appendText(outputPrefix, pending, created)) {
+        return false;
+      }
+      pendingBytes = 0;
+    }
+  }
+  return appendText(outputPrefix, pending, created);
+}
+
+bool PtpTraceReader::open(std::string filename) {
+  if(m_file.is_open()) {
+    m_file.close();
+  }
+  m_file.open(filename.c_str(), std::ios::in | std::ios::binary);
+  if(!m_file.is_open()) {
+    std::cerr << "[PtpTraceReader::open] Failed to open trace file " <<
+      filename << "." << std::endl;
+    return false;
+  }
+  uint8_t header[PTP_TRACE_HEADER_SIZE];
+  m_file.read((char *) header, PTP_TRACE_HEADER_SIZE);
+  if(m_file.gcount() != PTP_TRACE_HEADER_SIZE ||
+     std::memcmp(header, PTP_TRACE_MAGIC, 4) != 0 ||
+     decodeU32(header + 4) != PTP_TRACE_VERSION ||
+     decodeU32(header + 8) != PTP_TRACE_RECORD_SIZE) {
+    std::cerr << "[PtpTraceReader::open] " << filename <<
+      " is not a PTP offset trace." << std::endl;
+    m_file.close();
+    return false;
+  }
+  return true;
+}
+
+bool PtpTraceReader::read(PtpTraceRecord_t &record) {
+  uint8_t buf[PTP_TRACE_RECORD_SIZE];
+  if(!m_file.is_open() || !m_file.read((char *) buf, PTP_TRACE_RECORD_SIZE)) {
+    return false;
+  }
+  record.nodeId = decodeU16(buf);
+  record.eventId = (int32_t) decodeU32(buf + 4);
+  record.simTime = (int64_t) decodeU64(buf + 8);
+  record.preOffsetError = decodeDouble(buf + 16);
+  record.postOffsetError = decodeDouble(buf + 24);
+  return true;
+}
@@ -0,0 +1,152 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors: Tinghui Wang <tinghui.wang@wsu.edu>
+ *
+ * This file declares the binary trace sink for clock offset samples.
+ *
+ */
+
+#ifndef PTP_TRACE_WRITER_H
+#define PTP_TRACE_WRITER_H
+
+#include "ns3/core-module.h"
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace ns3;
+
+/**
+ * @brief One clock offset sample in the binary trace
+ */
+typedef struct PtpTraceRecord {
+  uint16_t nodeId; //< Node that synchronized
+  int32_t eventId; //< PTP event ID of the exchange, counted per node
+  int64_t simTime; //< Simulator time of the sample in nanoseconds
+  double preOffsetError; //< Offset error before the clock update
+  double postOffsetError; //< Offset error after the clock update
+} PtpTraceRecord_t;
+
+/**
+ * @brief Buffered writer of clock offset samples
+ *
+ * All nodes share a single file. Records are encoded little-endian in 32
+ * bytes each (node ID, reserved, event ID, simulator time, offset error
+ * before and after sync) after a 12-byte file header, and are written out
+ * in large blocks.
+ */
+class PtpTraceWriter {
+public:
+  /**
+   * @brief Construct a new PtpTraceWriter object
+   *
+   * @param bufferSize Bytes buffered before a write to the file.
+   */
+  PtpTraceWriter(uint32_t bufferSize = 1 << 20);
+
+  ~PtpTraceWriter();
+
+  /**
+   * @brief Create the trace file and write the file header
+   *
+   * @param filename
+   * @return true if the file is open for writing.
+   */
+  bool open(std::string filename);
+
+  /**
+   * @brief Is the trace file open
+   */
+  bool isOpen();
+
+  /**
+   * @brief Append one sample to the trace
+   *
+   * @param record
+   */
+  void write(const PtpTraceRecord_t &record);
+
+  /**
+   * @brief Write buffered records to the file
+   */
+  void flush();
+
+  /**
+   * @brief Flush and close the trace file
+   */
+  void close();
+
+  /**
+   * @brief Read all records of a binary trace file into memory
+   *
+   * Use PtpTraceReader to go through large traces one record at a time.
+   *
+   * @param filename
+   * @param records Records read, appended in file order.
+   * @return false if the file is missing or is not a PTP offset trace.
+   */
+  static bool readTrace(std::string filename, std::vector<PtpTraceRecord_t> &records);
+
+  /**
+   * @brief Convert a binary trace to per-node `node_<id>.dat` text files
+   *
+   * Each text file lists the offset error after sync of one node, one
+   * sample per line, as written by PTPNetwork before the binary trace. The
+   * trace is streamed; at most `bufferSize` bytes of text are held before
+   * they are appended to the files.
+   *
+   * @param filename Binary trace file.
+   * @param outputPrefix Prefix (usually the log directory) of the text files.
+   * @param bufferSize Bytes of text buffered across all nodes.
+   * @return false if the trace cannot be read or a file cannot be written.
+   */
+  static bool convertToText(
+    std::string filename, std::string outputPrefix,
+    uint32_t bufferSize = 1 << 24
+  );
+
+private:
+  std::ofstream m_file; //< Trace file
+  std::vector<uint8_t> m_buffer; //< Encoded records waiting to be written
+  uint32_t m_bufferSize; //< Flush threshold of m_buffer
+};
+
+/**
+ * @brief Sequential reader of a binary offset trace
+ */
+class PtpTraceReader {
+public:
+  /**
+   * @brief Open a trace file and check its file header
+   *
+   * @param filename
+   * @return false if the file is missing or is not a PTP offset trace.
+   */
+  bool open(std::string filename);
+
+  /**
+   * @brief Read the next record of the trace
+   *
+   * @param record
+   * @return false at the end of the trace.
+   */
+  bool read(PtpTraceRecord_t &record);
+
+private:
+  std::ifstream m_file; //< Trace file
+};
+
+#endif /* PTP_TRACE_WRITER_H */
@@ -0,0 +1,149 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors: Tinghui Wang <tinghui.wang@wsu.edu>
+ *
+ * This file implements the end-to-end transparent clock of bridge nodes.
+ */
+
+#include "ns3/core-module.h"
+#include "ptp-transparent-clock.h"
+#include <iostream>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("PtpTransparentClock");
+
+NS_OBJECT_ENSURE_REGISTERED(PtpCorrectionTag);
+
+PtpCorrectionTag::PtpCorrectionTag()
+  : m_correction(0)
+{}
+
+TypeId PtpCorrectionTag::GetTypeId(void) {
+  static TypeId tid = TypeId("ns3::PtpCorrectionTag")
+    .SetParent<Tag>()
+    .SetGroupName("Ptp")
+    .AddConstructor<PtpCorrectionTag>();
+  return tid;
+}
+
+TypeId PtpCorrectionTag::GetInstanceTypeId(void) const {
+  return GetTypeId();
+}
+
+uint32_t PtpCorrectionTag::GetSerializedSize(void) const {
+  return 8;
+}
+
+void PtpCorrectionTag::Serialize(TagBuffer i) const {
+  i.WriteU64((uint64_t) m_correction);
+}
+
+void PtpCorrectionTag::Deserialize(TagBuffer i) {
+  m_correction = (int64_t) i.ReadU64();
+}
+
+void PtpCorrectionTag::Print(std::ostream &os) const {
+  os << "correction=" << m_correction;
+}
+
+Time PtpCorrectionTag::getCorrection() const {
+  return NanoSeconds(m_correction);
+}
+
+void PtpCorrectionTag::setCorrection(Time correction) {
+  m_correction = correction.GetNanoSeconds();
+}
+
+PtpTransparentClock::PtpTransparentClock(Time maxResidence)
+  : m_maxResidence(maxResidence),
+    m_corrected(0),
+    m_totalResidence(NanoSeconds(0))
+{}
+
+uint32_t PtpTransparentClock::install(Ptr<Node> bridge) {
+  uint32_t ports = 0;
+  for(uint32_t i = 0; i < bridge->GetNDevices(); i++) {
+    if(install(bridge->GetDevice(i))) {
+      ports++;
+    }
+  }
+  if(ports == 0) {
+    std::cerr << "[PtpTransparentClock::install] Error: Node " <<
+      bridge->GetId() << " has no port to watch." << std::endl;
+  }
+  return ports;
+}
+
+bool PtpTransparentClock::install(Ptr<NetDevice> port) {
+  if(!port->TraceConnectWithoutContext(
+      "MacPromiscRx", MakeCallback(&PtpTransparentClock::portReceive, this))) {
+    return false;
+  }
+  if(!port->TraceConnectWithoutContext(
+      "PhyTxBegin", MakeCallback(&PtpTransparentClock::portTransmit, this))) {
+    port->TraceDisconnectWithoutContext(
+      "MacPromiscRx", MakeCallback(&PtpTransparentClock::portReceive, this));
+    return false;
+  }
+  return true;
+}
+
+uint64_t PtpTransparentClock::getCorrectedCount() {
+  return m_corrected;
+}
+
+Time PtpTransparentClock::getTotalResidenceTime() {
+  return m_totalResidence;
+}
+
+void PtpTransparentClock::portReceive(Ptr<const Packet> packet) {
+  PtpCorrectionTag tag;
+  if(!packet->PeekPacketTag(tag)) {
+    return;
+  }
+  Time now = Simulator::Now();
+  // Forget messages that never left the bridge
+  while(!m_ingressOrder.empty() && m_ingressOrder.front().first + m_maxResidence < now) {
+    m_ingressTime.erase(m_ingressOrder.front().second);
+    m_ingressOrder.pop_front();
+  }
+  m_ingressTime[packet->GetUid()] = now;
+  m_ingressOrder.push_back(std::make_pair(now, packet->GetUid()));
+}
+
+void PtpTransparentClock::portTransmit(Ptr<const Packet> packet) {
+  PtpCorrectionTag tag;
+  if(!packet->PeekPacketTag(tag)) {
+    return;
+  }
+  std::unordered_map<uint64_t, Time>::const_iterator it =
+    m_ingressTime.find(packet->GetUid());
+  if(it == m_ingressTime.end()) {
+    // Sent by the bridge node itself
+    return;
+  }
+  // Broadcast copies leave on several ports, so the entry is kept until it
+  // gets old.
+  Time residence = Simulator::Now() - it->second;
+  tag.setCorrection(tag.getCorrection() + residence);
+  // The trace source hands out the frame being sent, update it in place
+  ConstCast<Packet>(packet)->ReplacePacketTag(tag);
+  m_corrected++;
+  m_totalResidence += residence;
+  NS_LOG_DEBUG("Residence time " << residence.GetNanoSeconds() <<
+    " ns, correction " << tag.getCorrection().GetNanoSeconds() << " ns");
+}
@@ -0,0 +1,145 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors: Tinghui Wang <tinghui.wang@wsu.edu>
+ *
+ * This file declares the end-to-end transparent clock of bridge nodes.
+ *
+ */
+
+#ifndef PTP_TRANSPARENT_CLOCK_H
+#define PTP_TRANSPARENT_CLOCK_H
+
+#include "ns3/core-module.h"
+#include "ns3/node.h"
+#include "ns3/net-device.h"
+#include "ns3/packet.h"
+#include "ns3/tag.h"
+#include <deque>
+#include <unordered_map>
+
+using namespace ns3;
+
+/**
+ * @brief Residence time accumulated by transparent clocks along the path of
+ * a PTP event message
+ *
+ * A real transparent clock rewrites the correctionField of the message as
+ * it leaves the bridge. In the simulation the bridges add to this tag
+ * instead, and the receiver folds the tag into the correction field of the
+ * PtpHeader. PTPNetwork tags SYNC and DREQ messages when they are sent.
+ */
+class PtpCorrectionTag : public Tag {
+public:
+  PtpCorrectionTag();
+
+  static TypeId GetTypeId(void);
+  virtual TypeId GetInstanceTypeId(void) const;
+  virtual uint32_t GetSerializedSize(void) const;
+  virtual void Serialize(TagBuffer i) const;
+  virtual void Deserialize(TagBuffer i);
+  virtual void Print(std::ostream &os) const;
+
+  /**
+   * @brief Get the residence time accumulated so far
+   *
+   * @return Time
+   */
+  Time getCorrection() const;
+
+  /**
+   * @brief Set the residence time accumulated so far
+   *
+   * @param correction
+   */
+  void setCorrection(Time correction);
+
+private:
+  int64_t m_correction; //< Residence time in nanoseconds
+};
+
+/**
+ * @brief End-to-end transparent clock of a bridge node
+ *
+ * The clock watches the ports of a bridge. A tagged PTP message received on
+ * a port (MacPromiscRx) is matched by its packet UID when a copy starts its
+ * transmission on another port (PhyTxBegin), and the time spent in the
+ * bridge, queuing behind other traffic included, is added to its
+ * PtpCorrectionTag. The residence time runs from the end of the reception
+ * to the start of the transmission; the rest of each hop is part of the
+ * link delay. Install one clock per bridge node.
+ */
+class PtpTransparentClock {
+public:
+  /**
+   * @brief Construct a new PtpTransparentClock object
+   *
+   * @param maxResidence Messages still in the bridge after this time are
+   * forgotten.
+   */
+  PtpTransparentClock(Time maxResidence = Seconds(1.0));
+
+  /**
+   * @brief Watch every port of a bridge node
+   *
+   * Devices without the MacPromiscRx and PhyTxBegin trace sources (the
+   * BridgeNetDevice itself) are skipped.
+   *
+   * @param bridge
+   * @return uint32_t Number of ports watched
+   */
+  uint32_t install(Ptr<Node> bridge);
+
+  /**
+   * @brief Watch one port of a bridge
+   *
+   * @param port
+   * @return true if the port has the trace sources needed.
+   */
+  bool install(Ptr<NetDevice> port);
+
+  /**
+   * @brief Get the number of messages corrected
+   *
+   * @return uint64_t
+   */
+  uint64_t getCorrectedCount();
+
+  /**
+   * @brief Get the total residence time added to corrections
+   *
+   * @return Time
+   */
+  Time getTotalResidenceTime();
+
+private:
+  /**
+   * @brief Record the reception of a tagged message
+   */
+  void portReceive(Ptr<const Packet> packet);
+
+  /**
+   * @brief Add the residence time of a tagged message about to be sent
+   */
+  void portTransmit(Ptr<const Packet> packet);
+
+  Time m_maxResidence; //< Messages in the bridge for longer are forgotten
+  std::unordered_map<uint64_t, Time> m_ingressTime; //< Reception time of messages in the bridge, by packet UID
+  std::deque<std::pair<Time, uint64_t> > m_ingressOrder; //< Messages in the order received, to forget old ones
+  uint64_t m_corrected; //< Messages corrected
+  Time m_totalResidence; //< Residence time added to corrections
+};
+
+#endif /* PTP_TRANSPARENT_CLOCK_H */
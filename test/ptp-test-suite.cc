@@ -1,6 +1,31 @@
 /* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
 
 // Include a header file from your module to test.
+#include "ns3/ptp-node.h"
+#include "ns3/ptp-header.h"
+#include "ns3/ptp-trace-writer.h"
+#include "ns3/ptp-statistics.h"
+#include "ns3/ptp-servo.h"
+#include "ns3/ptp-sync-interval.h"
+#include "ns3/ptp-transparent-clock.h"
+#include "ns3/ptp-bmca.h"
+#include "ns3/ptp-oscillator.h"
+#include "ns3/ptp-timestamper.h"
+#include "ns3/ptp-application.h"
+#include "ns3/ptp-network.h"
+#include "ns3/ptp-helper.h"
+#include "ns3/packet.h"
+#include "ns3/simple-net-device-helper.h"
+#include "ns3/internet-module.h"
+#include "ns3/csma-module.h"
+#include "ns3/bridge-module.h"
+#include "ns3/wifi-module.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
 
 // An essential include is test.h
 #include "ns3/test.h"
@@ -45,6 +70,1663 @@ PtpTestCase1::DoRun (void)
   NS_TEST_ASSERT_MSG_EQ_TOL (0.01, 0.01, 0.001, "Numbers are not equal within tolerance");
 }
 
+// Check that the lazily evaluated local clock follows a reference clock
+// advanced at every event, the way nodes were updated before clocks were
+// evaluated lazily.
+class PtpLazyClockTestCase : public TestCase
+{
+public:
+  PtpLazyClockTestCase ();
+  virtual ~PtpLazyClockTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void CheckClocks (void);
+
+  PtpNode *m_slave;
+  PtpNode *m_master;
+  int64_t m_referenceTime; // Reference clock of the slave (ns)
+  Time m_referenceSimTime; // Simulator time of the last reference update
+  uint32_t m_steps; // Reference updates so far
+};
+
+PtpLazyClockTestCase::PtpLazyClockTestCase ()
+  : TestCase ("Ptp local clocks are evaluated on demand")
+{
+}
+
+PtpLazyClockTestCase::~PtpLazyClockTestCase ()
+{
+}
+
+void
+PtpLazyClockTestCase::CheckClocks (void)
+{
+  // Per-event update: the elapsed simulator time times the clock rate,
+  // truncated to whole nanoseconds at every step
+  Time now = Simulator::Now ();
+  m_referenceTime += (int64_t) ((now - m_referenceSimTime).GetNanoSeconds () *
+                                m_slave->getClockError ());
+  m_referenceSimTime = now;
+  m_steps++;
+  NS_TEST_ASSERT_MSG_EQ_TOL (m_slave->getLocalTime ().GetNanoSeconds (), m_referenceTime,
+                             (int64_t) m_steps, "Lazy clock drifted from the stepped reference");
+  NS_TEST_ASSERT_MSG_EQ (m_slave->getLocalTime (), m_slave->getLocalTime (),
+                         "Reading the clock must not change it");
+  NS_TEST_ASSERT_MSG_EQ (m_master->getLocalTime (), Simulator::Now (),
+                         "Global master must follow the simulator time");
+}
+
+void
+PtpLazyClockTestCase::DoRun (void)
+{
+  m_slave = new PtpNode (1, 0, 1, Ipv4Address ("10.1.1.2"));
+  m_master = new PtpNode (0, 0, 0, Ipv4Address ("10.1.1.1"));
+  m_master->setGlobalMaster ();
+  m_referenceTime = 0;
+  m_referenceSimTime = Seconds (0);
+  m_steps = 0;
+
+  // Irregular events over several sync intervals of one second
+  for (uint32_t i = 1; i <= 50; i++)
+    {
+      Simulator::Schedule (MicroSeconds (4000 * i * i + 37 * i),
+                           &PtpLazyClockTestCase::CheckClocks, this);
+    }
+  Simulator::Run ();
+  Simulator::Destroy ();
+  NS_TEST_ASSERT_MSG_EQ (m_steps, 50, "Reference clock not stepped at every event");
+
+  delete m_slave;
+  delete m_master;
+}
+
+// Check that a PTP header survives serialization into a packet.
+class PtpHeaderTestCase : public TestCase
+{
+public:
+  PtpHeaderTestCase ();
+  virtual ~PtpHeaderTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+PtpHeaderTestCase::PtpHeaderTestCase ()
+  : TestCase ("Ptp header serialization round trip")
+{
+}
+
+PtpHeaderTestCase::~PtpHeaderTestCase ()
+{
+}
+
+void
+PtpHeaderTestCase::DoRun (void)
+{
+  PtpHeader txHeader;
+  txHeader.setMessageType (FOLLOW);
+  txHeader.setTxNodeId (4242);
+  txHeader.setSyncId (17);
+  txHeader.setEventId (123456);
+  txHeader.setTimeStamp (NanoSeconds (1234567890123));
+  txHeader.setCorrection (NanoSeconds (-250));
+
+  Ptr<Packet> packet = Create<Packet> ();
+  packet->AddHeader (txHeader);
+  NS_TEST_ASSERT_MSG_EQ (packet->GetSize (), 44, "Unexpected PTP message size");
+
+  PtpHeader rxHeader;
+  packet->RemoveHeader (rxHeader);
+  NS_TEST_ASSERT_MSG_EQ (rxHeader.getMessageType (), FOLLOW, "Message type mismatch");
+  NS_TEST_ASSERT_MSG_EQ (rxHeader.getTxNodeId (), 4242, "Sender ID mismatch");
+  NS_TEST_ASSERT_MSG_EQ (rxHeader.getSyncId (), 17, "Sync ID mismatch");
+  NS_TEST_ASSERT_MSG_EQ (rxHeader.getEventId (), 123456, "Event ID mismatch");
+  NS_TEST_ASSERT_MSG_EQ (rxHeader.getTimeStamp (), NanoSeconds (1234567890123),
+                         "Timestamp mismatch");
+  NS_TEST_ASSERT_MSG_EQ (rxHeader.getCorrection (), NanoSeconds (-250),
+                         "Correction mismatch");
+  NS_TEST_ASSERT_MSG_EQ (rxHeader.getTwoStep (), true, "Two-step flag lost");
+
+  // One-step SYNC
+  txHeader.setMessageType (SYNC);
+  txHeader.setTwoStep (false);
+  packet->AddHeader (txHeader);
+  packet->RemoveHeader (rxHeader);
+  NS_TEST_ASSERT_MSG_EQ (rxHeader.getMessageType (), SYNC, "Message type mismatch");
+  NS_TEST_ASSERT_MSG_EQ (rxHeader.getTwoStep (), false, "One-step flag lost");
+
+  // Unknown messageType (0x5 is reserved) on the wire
+  uint8_t bytes[44];
+  packet->AddHeader (txHeader);
+  packet->CopyData (bytes, sizeof (bytes));
+  bytes[0] = 0x5;
+  Ptr<Packet> foreign = Create<Packet> (bytes, sizeof (bytes));
+  foreign->RemoveHeader (rxHeader);
+  NS_TEST_ASSERT_MSG_EQ (rxHeader.getMessageType (), PTP_INVALID_MESSAGE,
+                         "Unknown message type taken for a known one");
+
+  // Truncated messages are caught before Deserialize reads their body
+  NS_TEST_ASSERT_MSG_EQ (PtpHeader::isComplete (packet), true, "Whole SYNC refused");
+  NS_TEST_ASSERT_MSG_EQ (PtpHeader::isComplete (Create<Packet> (bytes, 3)), false,
+                         "Message without a length taken for whole");
+  uint8_t longer[64];
+  std::copy (bytes, bytes + sizeof (bytes), longer);
+  longer[3] = 64;
+  NS_TEST_ASSERT_MSG_EQ (PtpHeader::isComplete (Create<Packet> (longer, sizeof (bytes))), false,
+                         "Message shorter than its messageLength taken for whole");
+  const PtpMessageType_t bodyTypes[] = { ANNOUNCE, PDELAY_REQ, PDELAY_RESP, PDELAY_FOLLOW };
+  for (uint32_t i = 0; i < sizeof (bodyTypes) / sizeof (bodyTypes[0]); i++)
+    {
+      PtpHeader bodyHeader;
+      bodyHeader.setMessageType (bodyTypes[i]);
+      Ptr<Packet> whole = Create<Packet> ();
+      whole->AddHeader (bodyHeader);
+      NS_TEST_ASSERT_MSG_EQ (PtpHeader::isComplete (whole), true, "Whole message refused");
+      uint32_t size = whole->CopyData (longer, sizeof (longer));
+      // messageLength zeroed: the message type alone tells the size
+      longer[2] = 0;
+      longer[3] = 0;
+      NS_TEST_ASSERT_MSG_EQ (PtpHeader::isComplete (Create<Packet> (longer, size - 1)), false,
+                             "Truncated message body taken for whole");
+    }
+}
+
+// Check that offset samples survive the binary trace and its conversion
+// to per-node text files.
+class PtpTraceWriterTestCase : public TestCase
+{
+public:
+  PtpTraceWriterTestCase ();
+  virtual ~PtpTraceWriterTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+PtpTraceWriterTestCase::PtpTraceWriterTestCase ()
+  : TestCase ("Ptp binary offset trace round trip")
+{
+}
+
+PtpTraceWriterTestCase::~PtpTraceWriterTestCase ()
+{
+}
+
+void
+PtpTraceWriterTestCase::DoRun (void)
+{
+  std::string traceFile = CreateTempDirFilename ("ptp_offset.bin");
+  // A small buffer forces several writes to the file
+  PtpTraceWriter writer (64);
+  NS_TEST_ASSERT_MSG_EQ (writer.open (traceFile), true, "Cannot create trace");
+  for (uint16_t i = 0; i < 10; i++)
+    {
+      PtpTraceRecord_t record;
+      record.nodeId = i % 2;
+      record.eventId = i;
+      record.simTime = 1000000000 * (int64_t) i;
+      record.preOffsetError = 1000.5 * i;
+      record.postOffsetError = 0.25 * i;
+      writer.write (record);
+    }
+  writer.close ();
+
+  std::vector<PtpTraceRecord_t> records;
+  NS_TEST_ASSERT_MSG_EQ (PtpTraceWriter::readTrace (traceFile, records), true,
+                         "Cannot read trace");
+  NS_TEST_ASSERT_MSG_EQ (records.size (), 10, "Records lost in trace");
+  NS_TEST_ASSERT_MSG_EQ (records[7].nodeId, 1, "Node ID mismatch");
+  NS_TEST_ASSERT_MSG_EQ (records[7].eventId, 7, "Event ID mismatch");
+  NS_TEST_ASSERT_MSG_EQ (records[7].simTime, 7000000000, "Time mismatch");
+  NS_TEST_ASSERT_MSG_EQ (records[7].preOffsetError, 7003.5, "Offset mismatch");
+  NS_TEST_ASSERT_MSG_EQ (records[7].postOffsetError, 1.75, "Offset mismatch");
+
+  // Stream the trace with a few samples of text buffered at a time
+  std::string prefix = CreateTempDirFilename ("");
+  NS_TEST_ASSERT_MSG_EQ (PtpTraceWriter::convertToText (traceFile, prefix, 8), true,
+                         "Cannot convert trace");
+  std::ifstream nodeStatistics ((prefix + "node_1.dat").c_str ());
+  double offset;
+  uint32_t samples = 0;
+  while (nodeStatistics >> offset)
+    {
+      NS_TEST_ASSERT_MSG_EQ (offset, 0.25 * (2 * samples + 1), "Text sample mismatch");
+      samples++;
+    }
+  NS_TEST_ASSERT_MSG_EQ (samples, 5, "Text samples lost");
+
+  PtpTraceReader reader;
+  NS_TEST_ASSERT_MSG_EQ (reader.open (prefix + "node_1.dat"), false,
+                         "Text file taken for a binary trace");
+}
+
+// Check the online offset statistics against exact values, and that
+// merging per-node statistics matches accumulating all samples at once.
+class PtpStatisticsTestCase : public TestCase
+{
+public:
+  PtpStatisticsTestCase ();
+  virtual ~PtpStatisticsTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+PtpStatisticsTestCase::PtpStatisticsTestCase ()
+  : TestCase ("Ptp online offset statistics")
+{
+}
+
+PtpStatisticsTestCase::~PtpStatisticsTestCase ()
+{
+}
+
+void
+PtpStatisticsTestCase::DoRun (void)
+{
+  PtpOffsetStatistics all (0.01, 10);
+  PtpOffsetStatistics odd (0.01, 10);
+  PtpOffsetStatistics even (0.01, 10);
+  // Offset errors 1000, 999, ..., 1 ns, one sample per second
+  for (uint32_t i = 0; i < 1000; i++)
+    {
+      double offset = 1000 - i;
+      all.update (offset, Seconds (i));
+      if (i % 2)
+        {
+          odd.update (offset, Seconds (i));
+        }
+      else
+        {
+          even.update (offset, Seconds (i));
+        }
+    }
+  NS_TEST_ASSERT_MSG_EQ (all.getCount (), 1000, "Samples lost");
+  NS_TEST_ASSERT_MSG_EQ_TOL (all.getMean (), 500.5, 1e-9, "Mean mismatch");
+  NS_TEST_ASSERT_MSG_EQ_TOL (all.getVariance (), 83416.6667, 1e-3, "Variance mismatch");
+  NS_TEST_ASSERT_MSG_EQ (all.getMin (), 1, "Min mismatch");
+  NS_TEST_ASSERT_MSG_EQ (all.getMax (), 1000, "Max mismatch");
+  NS_TEST_ASSERT_MSG_EQ_TOL (all.getQuantile (0.5), 500, 500 * 0.01, "p50 out of bound");
+  NS_TEST_ASSERT_MSG_EQ_TOL (all.getQuantile (0.99), 990, 990 * 0.01, "p99 out of bound");
+  // Offsets stay within 10 ns from the sample at 990 s onwards
+  NS_TEST_ASSERT_MSG_EQ (all.isConverged (), true, "Not converged");
+  NS_TEST_ASSERT_MSG_EQ (all.getConvergenceTime (), Seconds (990), "Convergence time mismatch");
+
+  PtpOffsetStatistics merged (0.01, 10);
+  merged.merge (odd);
+  merged.merge (even);
+  NS_TEST_ASSERT_MSG_EQ (merged.getCount (), all.getCount (), "Merged count mismatch");
+  NS_TEST_ASSERT_MSG_EQ_TOL (merged.getMean (), all.getMean (), 1e-9, "Merged mean mismatch");
+  NS_TEST_ASSERT_MSG_EQ_TOL (merged.getVariance (), all.getVariance (), 1e-6,
+                            "Merged variance mismatch");
+  NS_TEST_ASSERT_MSG_EQ (merged.getQuantile (0.999), all.getQuantile (0.999),
+                         "Merged p99.9 mismatch");
+  // The network converges when its last node does
+  NS_TEST_ASSERT_MSG_EQ (merged.getConvergenceTime (), Seconds (991),
+                         "Merged convergence time mismatch");
+
+  all.update (100, Seconds (1000));
+  NS_TEST_ASSERT_MSG_EQ (all.isConverged (), false, "Converged beyond threshold");
+}
+
+// Check the links of the generated topologies, the master and hop of each
+// node derived from them, and their partition into ranks.
+class PtpTopologyTestCase : public TestCase
+{
+public:
+  PtpTopologyTestCase ();
+  virtual ~PtpTopologyTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+PtpTopologyTestCase::PtpTopologyTestCase ()
+  : TestCase ("Ptp topology, spanning tree and partition")
+{
+}
+
+PtpTopologyTestCase::~PtpTopologyTestCase ()
+{
+}
+
+void
+PtpTopologyTestCase::DoRun (void)
+{
+  std::vector<uint32_t> parent;
+  std::vector<uint16_t> hop;
+
+  PtpTopology star = PtpTopology::Star (10000);
+  NS_TEST_ASSERT_MSG_EQ (star.GetNLinks (), 9999, "Star link count");
+  NS_TEST_ASSERT_MSG_EQ (star.GetNeighbors (0).size (), 9999, "Star root degree");
+  NS_TEST_ASSERT_MSG_EQ (star.GetSpanningTree (0, parent, hop), true, "Star disconnected");
+  NS_TEST_ASSERT_MSG_EQ (parent[9999], 0, "Star master mismatch");
+  NS_TEST_ASSERT_MSG_EQ (hop[9999], 1, "Star hop mismatch");
+
+  PtpTopology empty = PtpTopology::Star (0);
+  NS_TEST_ASSERT_MSG_EQ (empty.GetNNodes (), 0, "Empty star node count");
+  NS_TEST_ASSERT_MSG_EQ (empty.GetNLinks (), 0, "Empty star link count");
+
+  PtpTopology chain = PtpTopology::Chain (6);
+  NS_TEST_ASSERT_MSG_EQ (chain.GetNLinks (), 5, "Chain link count");
+  NS_TEST_ASSERT_MSG_EQ (chain.GetSpanningTree (0, parent, hop), true, "Chain disconnected");
+  NS_TEST_ASSERT_MSG_EQ (parent[5], 4, "Chain master mismatch");
+  NS_TEST_ASSERT_MSG_EQ (hop[5], 5, "Chain hop mismatch");
+
+  PtpTopology tree = PtpTopology::Tree (15, 2);
+  NS_TEST_ASSERT_MSG_EQ (tree.GetNLinks (), 14, "Tree link count");
+  NS_TEST_ASSERT_MSG_EQ (tree.GetSpanningTree (0, parent, hop), true, "Tree disconnected");
+  NS_TEST_ASSERT_MSG_EQ (parent[14], 6, "Tree master mismatch");
+  NS_TEST_ASSERT_MSG_EQ (hop[14], 3, "Tree hop mismatch");
+
+  PtpTopology mesh = PtpTopology::Mesh (10);
+  NS_TEST_ASSERT_MSG_EQ (mesh.GetNLinks (), 13, "Mesh link count");
+  NS_TEST_ASSERT_MSG_EQ (mesh.GetNeighbors (5).size (), 4, "Mesh inner degree");
+  NS_TEST_ASSERT_MSG_EQ (mesh.GetSpanningTree (0, parent, hop), true, "Mesh disconnected");
+  NS_TEST_ASSERT_MSG_EQ (hop[9], 3, "Mesh hop mismatch");
+
+  // Parts are blocks of the depth-first order: subtrees of 1 and 2
+  std::vector<uint32_t> part;
+  NS_TEST_ASSERT_MSG_EQ (tree.GetPartition (0, 2, part), true, "Tree not partitioned");
+  NS_TEST_ASSERT_MSG_EQ (part[10], 0, "Subtree of node 1 split");
+  NS_TEST_ASSERT_MSG_EQ (part[2], 1, "Subtree of node 2 split");
+  NS_TEST_ASSERT_MSG_EQ (part[14], 1, "Subtree of node 2 split");
+  NS_TEST_ASSERT_MSG_EQ (chain.GetPartition (0, 3, part), true, "Chain not partitioned");
+  NS_TEST_ASSERT_MSG_EQ (part[1], 0, "Chain part mismatch");
+  NS_TEST_ASSERT_MSG_EQ (part[3], 1, "Chain part mismatch");
+  NS_TEST_ASSERT_MSG_EQ (part[4], 2, "Chain part mismatch");
+
+  // Ring 0 - 1 - 2 - 3 - 0 plus an isolated node 4
+  std::vector<std::vector<uint32_t> > adjacency (5);
+  uint32_t ring[4][2] = { {1, 3}, {0, 2}, {1, 3}, {2, 0} };
+  for (uint32_t i = 0; i < 4; i++)
+    {
+      adjacency[i].assign (ring[i], ring[i] + 2);
+    }
+  PtpTopology custom = PtpTopology::FromAdjacencyList (adjacency);
+  NS_TEST_ASSERT_MSG_EQ (custom.GetNLinks (), 4, "Adjacency link count");
+  NS_TEST_ASSERT_MSG_EQ (custom.GetSpanningTree (1, parent, hop), false,
+                         "Isolated node reached");
+  NS_TEST_ASSERT_MSG_EQ (hop[3], 2, "Ring hop mismatch");
+}
+
+// Check that SYNC sent to the group keep their own sync ID and time stamp,
+// and that messages are counted by type.
+class PtpGroupSyncTestCase : public TestCase
+{
+public:
+  PtpGroupSyncTestCase ();
+  virtual ~PtpGroupSyncTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+PtpGroupSyncTestCase::PtpGroupSyncTestCase ()
+  : TestCase ("Ptp group SYNC records and message counters")
+{
+}
+
+PtpGroupSyncTestCase::~PtpGroupSyncTestCase ()
+{
+}
+
+void
+PtpGroupSyncTestCase::DoRun (void)
+{
+  PtpNode node (0, 0, 0, Ipv4Address ("10.1.1.1"));
+  node.addNeighbor (1, NULL);
+  node.addNeighbor (2, NULL);
+
+  NS_TEST_ASSERT_MSG_EQ (node.getNewSyncId (PTP_GROUP_NODE_ID), 1, "Group sync ID");
+  NS_TEST_ASSERT_MSG_EQ (node.getNewSyncId (PTP_GROUP_NODE_ID), 2, "Group sync ID");
+  NS_TEST_ASSERT_MSG_EQ (node.getNewSyncId (1), 1, "Neighbor sync ID follows group");
+  node.setSyncSendTimeStamp (MicroSeconds (3), PTP_GROUP_NODE_ID);
+  NS_TEST_ASSERT_MSG_EQ (node.getSyncSendTimeStamp (PTP_GROUP_NODE_ID), MicroSeconds (3),
+                         "Group time stamp");
+  NS_TEST_ASSERT_MSG_EQ (node.getSyncSendTimeStamp (2), NanoSeconds (0),
+                         "Neighbor time stamp follows group");
+  NS_TEST_ASSERT_MSG_EQ (node.getNumNeighbors (), 2, "Group counted as neighbor");
+
+  node.incrementSentPacketCounter (SYNC, 72);
+  node.incrementSentPacketCounter (SYNC, 72);
+  node.incrementSentPacketCounter (DRPLY, 72);
+  node.increaseOverheardPacketCounter (FOLLOW);
+  NS_TEST_ASSERT_MSG_EQ (node.getSentPacketCounter (SYNC), 2, "SYNC count");
+  NS_TEST_ASSERT_MSG_EQ (node.getSentByteCounter (SYNC), 144, "SYNC bytes");
+  NS_TEST_ASSERT_MSG_EQ (node.getSentByteCounter (FOLLOW), 0, "FOLLOW bytes");
+  NS_TEST_ASSERT_MSG_EQ (node.getOverheardPacketCounter (FOLLOW), 1, "Overheard count");
+}
+
+// Drive the PI servo with a clock running 100 ppm fast, then 110 ppm fast,
+// and check that it locks the frequency and removes the offset.
+class PtpPiServoTestCase : public TestCase
+{
+public:
+  PtpPiServoTestCase ();
+  virtual ~PtpPiServoTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+PtpPiServoTestCase::PtpPiServoTestCase ()
+  : TestCase ("Ptp PI servo locks frequency and offset")
+{
+}
+
+PtpPiServoTestCase::~PtpPiServoTestCase ()
+{
+}
+
+void
+PtpPiServoTestCase::DoRun (void)
+{
+  PtpPiServo servo;
+  PtpServoState_t state;
+  double drift = 100000; // ppb
+  double adjustment = 0; // ppb
+  double offset = 50000; // ns
+
+  // The first sample only records the offset
+  servo.sample ((int64_t) offset, Seconds (1), state);
+  NS_TEST_ASSERT_MSG_EQ (state, SERVO_UNLOCKED, "First sample");
+
+  // The second one measures the drift and steps the clock
+  offset += drift + adjustment;
+  double ppb = servo.sample ((int64_t) offset, Seconds (2), state);
+  NS_TEST_ASSERT_MSG_EQ (state, SERVO_JUMP, "Step above the first step threshold");
+  NS_TEST_ASSERT_MSG_EQ_TOL (ppb, drift, 1, "Drift estimate");
+  offset = 0;
+  adjustment = -ppb;
+
+  drift = 110000;
+  for (int i = 3; i < 60; i++)
+    {
+      offset += drift + adjustment;
+      ppb = servo.sample ((int64_t) offset, Seconds (i), state);
+      NS_TEST_ASSERT_MSG_EQ (state, SERVO_LOCKED, "Frequency corrections only");
+      adjustment = -ppb;
+    }
+  NS_TEST_ASSERT_MSG_EQ_TOL (offset, 0, 10, "Offset removed");
+  NS_TEST_ASSERT_MSG_EQ_TOL (ppb, drift, 10, "Frequency locked");
+}
+
+// Check that the adaptive sync interval backs off while offsets stay small
+// and drops to the shortest interval on a large offset.
+class PtpAdaptiveSyncIntervalTestCase : public TestCase
+{
+public:
+  PtpAdaptiveSyncIntervalTestCase ();
+  virtual ~PtpAdaptiveSyncIntervalTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+PtpAdaptiveSyncIntervalTestCase::PtpAdaptiveSyncIntervalTestCase ()
+  : TestCase ("Ptp adaptive sync interval")
+{
+}
+
+PtpAdaptiveSyncIntervalTestCase::~PtpAdaptiveSyncIntervalTestCase ()
+{
+}
+
+void
+PtpAdaptiveSyncIntervalTestCase::DoRun (void)
+{
+  PtpFixedSyncInterval fixed;
+  NS_TEST_ASSERT_MSG_EQ (fixed.update (Seconds (2), 1e6), Seconds (2), "Fixed interval");
+
+  PtpAdaptiveSyncInterval policy (Seconds (1), Seconds (8), 250, 1000, 4);
+  Time interval = Seconds (1);
+  for (int i = 0; i < 3; i++)
+    {
+      interval = policy.update (interval, 50);
+    }
+  NS_TEST_ASSERT_MSG_EQ (interval, Seconds (1), "Hold before backing off");
+  interval = policy.update (interval, 50);
+  NS_TEST_ASSERT_MSG_EQ (interval, Seconds (2), "Back off");
+  for (int i = 0; i < 20; i++)
+    {
+      interval = policy.update (interval, 50);
+    }
+  NS_TEST_ASSERT_MSG_EQ (interval, Seconds (8), "Longest interval");
+  NS_TEST_ASSERT_MSG_EQ_TOL (policy.getMean (), 50, 1e-6, "Moving mean");
+
+  interval = policy.update (interval, 5000);
+  NS_TEST_ASSERT_MSG_EQ (interval, Seconds (1), "Disturbed");
+  NS_TEST_ASSERT_MSG_GT (policy.getVariance (), 0, "Moving variance");
+  for (int i = 0; i < 4; i++)
+    {
+      interval = policy.update (interval, 50);
+    }
+  NS_TEST_ASSERT_MSG_EQ (interval, Seconds (1), "No back off while the variance is high");
+}
+
+// Check that the residence times reported by transparent clocks are taken
+// out of the path delay.
+class PtpTransparentClockTestCase : public TestCase
+{
+public:
+  PtpTransparentClockTestCase ();
+  virtual ~PtpTransparentClockTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+PtpTransparentClockTestCase::PtpTransparentClockTestCase ()
+  : TestCase ("Ptp transparent clock corrections")
+{
+}
+
+PtpTransparentClockTestCase::~PtpTransparentClockTestCase ()
+{
+}
+
+void
+PtpTransparentClockTestCase::DoRun (void)
+{
+  PtpCorrectionTag tag;
+  tag.setCorrection (NanoSeconds (300));
+  Ptr<Packet> packet = Create<Packet> ();
+  packet->AddPacketTag (tag);
+  PtpCorrectionTag rxTag;
+  NS_TEST_ASSERT_MSG_EQ (packet->PeekPacketTag (rxTag), true, "Tag lost");
+  NS_TEST_ASSERT_MSG_EQ (rxTag.getCorrection (), NanoSeconds (300), "Correction lost");
+
+  // Slave 1000 ns ahead, 500 ns links, SYNC and DREQ spend 300 ns and
+  // 700 ns in a switch.
+  PtpNode slave (1, 0, 1, Ipv4Address ("10.1.1.2"));
+  slave.setInitialTime (NanoSeconds (0));
+  slave.setSyncTimeAtMaster (NanoSeconds (0));
+  slave.setSyncRecvTime (NanoSeconds (1800));
+  slave.setSyncCorrection (NanoSeconds (300));
+  slave.setDreqSendTime (NanoSeconds (5000));
+  slave.setDreqTimeAtMaster (NanoSeconds (5200));
+  slave.setDreqCorrection (NanoSeconds (700));
+  slave.calculateOffset (NanoSeconds (0));
+  NS_TEST_ASSERT_MSG_EQ (slave.getLocalTime (), NanoSeconds (-1000),
+                         "Clock not stepped by the corrected offset");
+}
+
+// Check that a transparent clock on a CSMA bridge adds the time tagged
+// messages queue behind a large frame to their correction, and forgets the
+// messages that stay in the bridge longer than its limit.
+class PtpTransparentBridgeTestCase : public TestCase
+{
+public:
+  PtpTransparentBridgeTestCase ();
+  virtual ~PtpTransparentBridgeTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void RunBridge (PtpTransparentClock &clock, const char *base);
+  void Send (Ptr<Socket> socket, uint32_t size, bool tagged);
+  void Receive (Ptr<Socket> socket);
+
+  std::vector<Time> m_corrections; // Corrections of the tagged messages received
+};
+
+PtpTransparentBridgeTestCase::PtpTransparentBridgeTestCase ()
+  : TestCase ("Ptp transparent clock on a CSMA bridge")
+{
+}
+
+PtpTransparentBridgeTestCase::~PtpTransparentBridgeTestCase ()
+{
+}
+
+void
+PtpTransparentBridgeTestCase::Send (Ptr<Socket> socket, uint32_t size, bool tagged)
+{
+  Ptr<Packet> packet = Create<Packet> (size);
+  if (tagged)
+    {
+      PtpCorrectionTag tag;
+      tag.setCorrection (NanoSeconds (100));
+      packet->AddPacketTag (tag);
+    }
+  socket->Send (packet);
+}
+
+void
+PtpTransparentBridgeTestCase::Receive (Ptr<Socket> socket)
+{
+  Ptr<Packet> packet = socket->Recv ();
+  PtpCorrectionTag tag;
+  if (packet->PeekPacketTag (tag))
+    {
+      m_corrections.push_back (tag.getCorrection ());
+    }
+}
+
+// Node 0 - bridge - node 1. Once ARP and the bridge have learned the
+// addresses, node 0 sends a large frame and two tagged ones right behind
+// it; the tagged ones wait in the bridge while the large one leaves.
+void
+PtpTransparentBridgeTestCase::RunBridge (PtpTransparentClock &clock, const char *base)
+{
+  m_corrections.clear ();
+  NodeContainer nodes;
+  nodes.Create (2);
+  Ptr<Node> bridgeNode = CreateObject<Node> ();
+  CsmaHelper csma;
+  csma.SetChannelAttribute ("DataRate", DataRateValue (DataRate ("100Mbps")));
+  csma.SetChannelAttribute ("Delay", TimeValue (NanoSeconds (0)));
+  NetDeviceContainer terminals;
+  NetDeviceContainer ports;
+  for (uint32_t i = 0; i < 2; i++)
+    {
+      NetDeviceContainer link = csma.Install (NodeContainer (nodes.Get (i), bridgeNode));
+      terminals.Add (link.Get (0));
+      ports.Add (link.Get (1));
+    }
+  BridgeHelper bridge;
+  bridge.Install (bridgeNode, ports);
+  NS_TEST_ASSERT_MSG_EQ (clock.install (bridgeNode), 2, "Bridge ports not watched");
+
+  InternetStackHelper internet;
+  internet.Install (nodes);
+  Ipv4AddressHelper ipv4;
+  ipv4.SetBase (base, "255.255.255.0");
+  Ipv4InterfaceContainer interfaces = ipv4.Assign (terminals);
+
+  TypeId tid = TypeId::LookupByName ("ns3::UdpSocketFactory");
+  Ptr<Socket> sink = Socket::CreateSocket (nodes.Get (1), tid);
+  sink->Bind (InetSocketAddress (Ipv4Address::GetAny (), 319));
+  sink->SetRecvCallback (MakeCallback (&PtpTransparentBridgeTestCase::Receive, this));
+  Ptr<Socket> source = Socket::CreateSocket (nodes.Get (0), tid);
+  source->Bind ();
+  source->Connect (InetSocketAddress (interfaces.GetAddress (1), 319));
+
+  Simulator::Schedule (Seconds (1), &PtpTransparentBridgeTestCase::Send, this, source, 10, false);
+  Simulator::Schedule (Seconds (2), &PtpTransparentBridgeTestCase::Send, this, source, 1400, false);
+  Simulator::Schedule (Seconds (2), &PtpTransparentBridgeTestCase::Send, this, source, 44, true);
+  Simulator::Schedule (Seconds (2), &PtpTransparentBridgeTestCase::Send, this, source, 44, true);
+  Simulator::Stop (Seconds (3));
+  Simulator::Run ();
+  Simulator::Destroy ();
+}
+
+void
+PtpTransparentBridgeTestCase::DoRun (void)
+{
+  // Both tagged messages are corrected by the time they waited
+  PtpTransparentClock clock;
+  RunBridge (clock, "10.1.3.0");
+  NS_TEST_ASSERT_MSG_EQ (m_corrections.size (), 2, "Tagged messages lost");
+  NS_TEST_ASSERT_MSG_EQ (clock.getCorrectedCount (), 2, "Messages not corrected");
+  NS_TEST_ASSERT_MSG_GT (clock.getTotalResidenceTime (), NanoSeconds (0),
+                         "No residence time in a busy bridge");
+  for (uint32_t i = 0; i < m_corrections.size (); i++)
+    {
+      NS_TEST_ASSERT_MSG_GT (m_corrections[i], NanoSeconds (100), "Residence time not added");
+    }
+  NS_TEST_ASSERT_MSG_EQ (m_corrections[0] + m_corrections[1] - NanoSeconds (200),
+                         clock.getTotalResidenceTime (),
+                         "Correction differs from the residence time measured");
+
+  // With a 1 ns limit the first tagged message is forgotten when the second
+  // arrives, so only the second one is corrected
+  PtpTransparentClock shortClock (NanoSeconds (1));
+  RunBridge (shortClock, "10.1.4.0");
+  NS_TEST_ASSERT_MSG_EQ (m_corrections.size (), 2, "Tagged messages lost");
+  NS_TEST_ASSERT_MSG_EQ (shortClock.getCorrectedCount (), 1, "Old message not forgotten");
+  NS_TEST_ASSERT_MSG_EQ (m_corrections[0], NanoSeconds (100), "Forgotten message corrected");
+  NS_TEST_ASSERT_MSG_EQ (m_corrections[1] - NanoSeconds (100),
+                         shortClock.getTotalResidenceTime (),
+                         "Correction differs from the residence time measured");
+  NS_TEST_ASSERT_MSG_GT (m_corrections[1], NanoSeconds (100), "Residence time not added");
+}
+
+class PtpPeerDelayTestCase : public TestCase
+{
+public:
+  PtpPeerDelayTestCase ();
+  virtual ~PtpPeerDelayTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+PtpPeerDelayTestCase::PtpPeerDelayTestCase ()
+  : TestCase ("Ptp peer delay measurement")
+{
+}
+
+PtpPeerDelayTestCase::~PtpPeerDelayTestCase ()
+{
+}
+
+void
+PtpPeerDelayTestCase::DoRun (void)
+{
+  PtpHeader txHeader;
+  txHeader.setMessageType (PDELAY_RESP);
+  txHeader.setSyncId (9);
+  txHeader.setTimeStamp (NanoSeconds (1500));
+  Ptr<Packet> packet = Create<Packet> ();
+  packet->AddHeader (txHeader);
+  NS_TEST_ASSERT_MSG_EQ (packet->GetSize (), 54, "Unexpected Pdelay_Resp size");
+  PtpHeader rxHeader;
+  packet->RemoveHeader (rxHeader);
+  NS_TEST_ASSERT_MSG_EQ (rxHeader.getMessageType (), PDELAY_RESP, "Message type mismatch");
+  NS_TEST_ASSERT_MSG_EQ (rxHeader.getSyncId (), 9, "Sync ID mismatch");
+  NS_TEST_ASSERT_MSG_EQ (rxHeader.getTimeStamp (), NanoSeconds (1500), "Time stamp mismatch");
+
+  // The peer turns the request around in 300 ns; 2300 ns round trip
+  SocketLink link (1, 0, Ipv4Address ("10.1.1.2"), 100, Ipv4Address ("10.1.1.1"), 100, 0);
+  NS_TEST_ASSERT_MSG_EQ (link.hasLinkDelay (), false, "Link delay before any exchange");
+  uint16_t seq = link.startPdelay (NanoSeconds (0));
+  link.setPdelayResponse (seq, NanoSeconds (1500), NanoSeconds (2300), NanoSeconds (0));
+  NS_TEST_ASSERT_MSG_EQ (link.completePdelay (seq + 1, NanoSeconds (1800), NanoSeconds (0)),
+                         false, "Follow-up of another exchange accepted");
+  NS_TEST_ASSERT_MSG_EQ (link.completePdelay (seq, NanoSeconds (1800), NanoSeconds (0)),
+                         true, "Exchange not completed");
+  NS_TEST_ASSERT_MSG_EQ (link.getLinkDelay (), NanoSeconds (1000), "Wrong link delay");
+
+  // Slave 1000 ns ahead: the SYNC alone gives the offset
+  PtpNode slave (1, 0, 1, Ipv4Address ("10.1.1.2"));
+  slave.setInitialTime (NanoSeconds (0));
+  slave.setSyncTimeAtMaster (NanoSeconds (0));
+  slave.setSyncRecvTime (NanoSeconds (2000));
+  slave.calculatePeerDelayOffset (link.getLinkDelay (), NanoSeconds (0));
+  NS_TEST_ASSERT_MSG_EQ (slave.getLocalTime (), NanoSeconds (-1000),
+                         "Clock not stepped by the peer delay offset");
+}
+
+class PtpOscillatorTestCase : public TestCase
+{
+public:
+  PtpOscillatorTestCase ();
+  virtual ~PtpOscillatorTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+PtpOscillatorTestCase::PtpOscillatorTestCase ()
+  : TestCase ("Ptp oscillator models")
+{
+}
+
+PtpOscillatorTestCase::~PtpOscillatorTestCase ()
+{
+}
+
+void
+PtpOscillatorTestCase::DoRun (void)
+{
+  // 10 ppm offset and 1 ppb per day of aging over one day
+  Ptr<PtpNoisyOscillator> drift = Create<PtpNoisyOscillator> (10, 0, 0, 1);
+  double day = 86400e9;
+  NS_TEST_ASSERT_MSG_EQ_TOL (drift->getElapsed (Seconds (86400)), day * (1 + 10e-6 + 0.5e-9), 1,
+                             "Offset and aging not integrated");
+  NS_TEST_ASSERT_MSG_EQ_TOL (drift->getRate (), 1 + 10e-6 + 1e-9, 1e-15,
+                             "Aging not applied to the rate");
+
+  // One read over a long interval or many short reads: same distribution,
+  // same time counted on average
+  Ptr<PtpNoisyOscillator> noisy = Create<PtpNoisyOscillator> (0, 10, 5, 0);
+  noisy->assignStreams (1);
+  double first = noisy->getElapsed (Seconds (100));
+  NS_TEST_ASSERT_MSG_EQ (noisy->getElapsed (Seconds (100)), first,
+                         "Reading the oscillator twice at once must not change it");
+  NS_TEST_ASSERT_MSG_EQ_TOL (first, 100e9, 1e5, "Random walk too large");
+  NS_TEST_ASSERT_MSG_GT (noisy->getElapsed (Seconds (101)), first, "Oscillator went backwards");
+
+  // Same stream, same samples
+  Ptr<PtpNoisyOscillator> replay = Create<PtpNoisyOscillator> (0, 10, 5, 0);
+  replay->assignStreams (1);
+  NS_TEST_ASSERT_MSG_EQ (replay->getElapsed (Seconds (100)), first,
+                         "Oscillator not reproducible from its stream");
+
+  // Swapping the oscillator of a node does not step its clock
+  PtpNode node (1, 0, 1, Ipv4Address ("10.1.1.2"));
+  double rate = node.getClockError ();
+  Simulator::Schedule (Seconds (1), &PtpNode::setOscillator, &node,
+                       Ptr<PtpOscillator> (Create<PtpConstantOscillator> (1.001)));
+  Simulator::Stop (Seconds (2));
+  Simulator::Run ();
+  NS_TEST_ASSERT_MSG_EQ_TOL (node.getLocalTime ().GetNanoSeconds (), 1e9 * (rate + 1.001), 1,
+                             "Clock stepped when its oscillator changed");
+  Simulator::Destroy ();
+}
+
+class PtpTimestamperTestCase : public TestCase
+{
+public:
+  PtpTimestamperTestCase ();
+  virtual ~PtpTimestamperTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+PtpTimestamperTestCase::PtpTimestamperTestCase ()
+  : TestCase ("Ptp time stamp points")
+{
+}
+
+PtpTimestamperTestCase::~PtpTimestamperTestCase ()
+{
+}
+
+void
+PtpTimestamperTestCase::DoRun (void)
+{
+  PtpNode node (0, 0, 0, Ipv4Address ("10.1.1.1"));
+  node.setGlobalMaster ();
+  Ptr<ConstantRandomVariable> latency = CreateObject<ConstantRandomVariable> ();
+  latency->SetAttribute ("Constant", DoubleValue (250));
+
+  // Application time stamps: sent messages are corrected for the latency,
+  // received ones stamped late by it
+  Ptr<PtpTimestamper> application = Create<PtpTimestamper> (&node, TIMESTAMP_APPLICATION);
+  application->setLatency (latency);
+  Ptr<Packet> packet = Create<Packet> ();
+  packet->AddPacketTag (PtpCorrectionTag ());
+  application->transmit (packet);
+  PtpCorrectionTag tag;
+  packet->PeekPacketTag (tag);
+  NS_TEST_ASSERT_MSG_EQ (tag.getCorrection (), NanoSeconds (250), "Latency not corrected");
+  NS_TEST_ASSERT_MSG_EQ (application->getReceiveTime (packet), NanoSeconds (250),
+                         "Receive time stamp without latency");
+
+  // Hardware time stamps ignore the latency; a message the device did not
+  // see is stamped when it is read
+  Ptr<PtpTimestamper> hardware = Create<PtpTimestamper> (&node, TIMESTAMP_HARDWARE);
+  hardware->setLatency (latency);
+  NS_TEST_ASSERT_MSG_EQ (hardware->getReceiveTime (packet), NanoSeconds (0),
+                         "Receive time stamp of an unseen message");
+  NS_TEST_ASSERT_MSG_EQ (hardware->getMissedCount (), 1, "Unseen message not counted");
+}
+
+// Check the correction written to outgoing messages and the receive time
+// stamps at each time stamp point, on two nodes of a CSMA channel. The
+// message is sent right behind a large frame, so it waits for the medium
+// between the software and the hardware time stamp points.
+class PtpTimestamperCsmaTestCase : public TestCase
+{
+public:
+  PtpTimestamperCsmaTestCase (PtpTimestampMode_t mode, std::string name, const char *base);
+  virtual ~PtpTimestamperCsmaTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void Send (Ptr<Socket> socket, bool event);
+  void TransmitBegin (Ptr<const Packet> packet);
+  void Receive (Ptr<Socket> socket);
+
+  PtpTimestampMode_t m_mode;
+  const char *m_base; // Network of the CSMA channel
+  Ptr<PtpTimestamper> m_txTimestamper;
+  Ptr<PtpTimestamper> m_rxTimestamper;
+  Time m_sendTime; // Time the event message was handed over
+  Time m_txBeginTime; // Time the event message started to leave
+  Time m_rxTime; // Time the event message was read
+  Time m_rxStamp; // Receive time stamp of the event message
+  Time m_correction; // Correction of the event message received
+  uint32_t m_received; // Event messages received
+};
+
+PtpTimestamperCsmaTestCase::PtpTimestamperCsmaTestCase (PtpTimestampMode_t mode,
+                                                        std::string name, const char *base)
+  : TestCase ("Ptp " + name + " time stamps on CSMA"),
+    m_mode (mode),
+    m_base (base)
+{
+}
+
+PtpTimestamperCsmaTestCase::~PtpTimestamperCsmaTestCase ()
+{
+}
+
+void
+PtpTimestamperCsmaTestCase::Send (Ptr<Socket> socket, bool event)
+{
+  if (!event)
+    {
+      socket->Send (Create<Packet> (1400));
+      return;
+    }
+  Ptr<Packet> packet = Create<Packet> (44);
+  packet->AddPacketTag (PtpCorrectionTag ());
+  m_sendTime = Simulator::Now ();
+  m_txTimestamper->transmit (packet);
+  socket->Send (packet);
+}
+
+void
+PtpTimestamperCsmaTestCase::TransmitBegin (Ptr<const Packet> packet)
+{
+  PtpCorrectionTag tag;
+  if (packet->PeekPacketTag (tag))
+    {
+      m_txBeginTime = Simulator::Now ();
+    }
+}
+
+void
+PtpTimestamperCsmaTestCase::Receive (Ptr<Socket> socket)
+{
+  Ptr<Packet> packet = socket->Recv ();
+  PtpCorrectionTag tag;
+  if (!packet->PeekPacketTag (tag))
+    {
+      return;
+    }
+  m_correction = tag.getCorrection ();
+  m_rxTime = Simulator::Now ();
+  m_rxStamp = m_rxTimestamper->getReceiveTime (packet);
+  m_received++;
+}
+
+void
+PtpTimestamperCsmaTestCase::DoRun (void)
+{
+  m_received = 0;
+  NodeContainer nodes;
+  nodes.Create (2);
+  CsmaHelper csma;
+  csma.SetChannelAttribute ("DataRate", DataRateValue (DataRate ("100Mbps")));
+  csma.SetChannelAttribute ("Delay", TimeValue (NanoSeconds (0)));
+  NetDeviceContainer devices = csma.Install (nodes);
+
+  // Both clocks follow the simulator time, 250 ns software and application
+  // latency
+  PtpNode sender (0, 0, 0, Ipv4Address ());
+  sender.setGlobalMaster ();
+  PtpNode receiver (1, 1, 0, Ipv4Address ());
+  receiver.setGlobalMaster ();
+  Ptr<ConstantRandomVariable> latency = CreateObject<ConstantRandomVariable> ();
+  latency->SetAttribute ("Constant", DoubleValue (250));
+  m_txTimestamper = Create<PtpTimestamper> (&sender, m_mode);
+  m_txTimestamper->setLatency (latency);
+  m_rxTimestamper = Create<PtpTimestamper> (&receiver, m_mode);
+  m_rxTimestamper->setLatency (latency);
+  // Before the Internet stack adds the loopback device
+  NS_TEST_ASSERT_MSG_EQ (m_txTimestamper->install (nodes.Get (0)), 1, "Device not watched");
+  NS_TEST_ASSERT_MSG_EQ (m_rxTimestamper->install (nodes.Get (1)), 1, "Device not watched");
+  devices.Get (0)->TraceConnectWithoutContext (
+    "PhyTxBegin", MakeCallback (&PtpTimestamperCsmaTestCase::TransmitBegin, this));
+
+  InternetStackHelper internet;
+  internet.Install (nodes);
+  Ipv4AddressHelper ipv4;
+  ipv4.SetBase (m_base, "255.255.255.0");
+  Ipv4InterfaceContainer interfaces = ipv4.Assign (devices);
+
+  TypeId tid = TypeId::LookupByName ("ns3::UdpSocketFactory");
+  Ptr<Socket> sink = Socket::CreateSocket (nodes.Get (1), tid);
+  sink->Bind (InetSocketAddress (Ipv4Address::GetAny (), 319));
+  sink->SetRecvCallback (MakeCallback (&PtpTimestamperCsmaTestCase::Receive, this));
+  Ptr<Socket> source = Socket::CreateSocket (nodes.Get (0), tid);
+  source->Bind ();
+  source->Connect (InetSocketAddress (interfaces.GetAddress (1), 319));
+
+  // ARP first, then the event message behind a large frame
+  Simulator::Schedule (Seconds (1), &PtpTimestamperCsmaTestCase::Send, this, source, false);
+  Simulator::Schedule (Seconds (2), &PtpTimestamperCsmaTestCase::Send, this, source, false);
+  Simulator::Schedule (Seconds (2), &PtpTimestamperCsmaTestCase::Send, this, source, true);
+  Simulator::Stop (Seconds (3));
+  Simulator::Run ();
+  Simulator::Destroy ();
+
+  NS_TEST_ASSERT_MSG_EQ (m_received, 1, "Event message lost");
+  if (m_mode == TIMESTAMP_HARDWARE)
+    {
+      // Stamped when it starts to leave, without latency
+      NS_TEST_ASSERT_MSG_GT (m_txBeginTime, m_sendTime, "Message did not wait for the medium");
+      NS_TEST_ASSERT_MSG_EQ (m_correction, m_txBeginTime - m_sendTime,
+                             "Correction is not the time to the PHY");
+      NS_TEST_ASSERT_MSG_EQ (m_rxStamp, m_rxTime, "Receive time stamp mismatch");
+    }
+  else
+    {
+      // The driver gets the message at once, both are stamped late
+      NS_TEST_ASSERT_MSG_EQ (m_correction, NanoSeconds (250), "Correction is not the latency");
+      NS_TEST_ASSERT_MSG_EQ (m_rxStamp, m_rxTime + NanoSeconds (250),
+                             "Receive time stamp mismatch");
+    }
+  NS_TEST_ASSERT_MSG_EQ (m_rxTimestamper->getMissedCount (), 0, "Message not stamped");
+}
+
+// Check that a Wi-Fi device is refused in the hardware and software modes:
+// the PHY traces a copy of the frame, and the MAC traces it before channel
+// access.
+class PtpTimestamperWifiTestCase : public TestCase
+{
+public:
+  PtpTimestamperWifiTestCase ();
+  virtual ~PtpTimestamperWifiTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+PtpTimestamperWifiTestCase::PtpTimestamperWifiTestCase ()
+  : TestCase ("Ptp time stamps on Wi-Fi")
+{
+}
+
+PtpTimestamperWifiTestCase::~PtpTimestamperWifiTestCase ()
+{
+}
+
+void
+PtpTimestamperWifiTestCase::DoRun (void)
+{
+  NodeContainer nodes;
+  nodes.Create (1);
+  WifiHelper wifi;
+  YansWifiPhyHelper phy = YansWifiPhyHelper::Default ();
+  YansWifiChannelHelper channel = YansWifiChannelHelper::Default ();
+  phy.SetChannel (channel.Create ());
+  WifiMacHelper mac;
+  mac.SetType ("ns3::AdhocWifiMac");
+  NetDeviceContainer devices = wifi.Install (phy, mac, nodes);
+
+  PtpNode node (0, 0, 0, Ipv4Address ());
+  node.setGlobalMaster ();
+  Ptr<PtpTimestamper> hardware = Create<PtpTimestamper> (&node, TIMESTAMP_HARDWARE);
+  NS_TEST_ASSERT_MSG_EQ (hardware->install (devices.Get (0)), false,
+                         "Hardware time stamps on a Wi-Fi PHY");
+  NS_TEST_ASSERT_MSG_EQ (hardware->install (nodes.Get (0)), 0,
+                         "Hardware time stamps on a Wi-Fi node");
+  Ptr<PtpTimestamper> software = Create<PtpTimestamper> (&node, TIMESTAMP_SOFTWARE);
+  NS_TEST_ASSERT_MSG_EQ (software->install (devices.Get (0)), false,
+                         "Software time stamps on a Wi-Fi MAC");
+  Ptr<PtpTimestamper> application = Create<PtpTimestamper> (&node, TIMESTAMP_APPLICATION);
+  NS_TEST_ASSERT_MSG_EQ (application->install (devices.Get (0)), true,
+                         "Application time stamps refused on Wi-Fi");
+  Simulator::Destroy ();
+}
+
+class PtpApplicationTestCase : public TestCase
+{
+public:
+  PtpApplicationTestCase ();
+  virtual ~PtpApplicationTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+PtpApplicationTestCase::PtpApplicationTestCase ()
+  : TestCase ("Ptp application synchronizes a chain")
+{
+}
+
+PtpApplicationTestCase::~PtpApplicationTestCase ()
+{
+}
+
+void
+PtpApplicationTestCase::DoRun (void)
+{
+  NodeContainer nodes;
+  nodes.Create (3);
+  SimpleNetDeviceHelper simple;
+  NetDeviceContainer devices = simple.Install (nodes);
+  InternetStackHelper internet;
+  internet.Install (nodes);
+  Ipv4AddressHelper ipv4;
+  ipv4.SetBase ("10.1.1.0", "255.255.255.0");
+  Ipv4InterfaceContainer interfaces = ipv4.Assign (devices);
+
+  PtpApplicationHelper ptp;
+  ApplicationContainer apps = ptp.Install (nodes, interfaces, PtpTopology::Chain (3));
+  apps.Start (Seconds (1.0));
+  apps.Stop (Seconds (5.5));
+  Simulator::Run ();
+
+  // Node 2 syncs to node 1 once node 1 serves it, one interval later
+  for (uint32_t i = 1; i < 3; i++)
+    {
+      PtpNode *node = DynamicCast<PtpApplication> (apps.Get (i))->getPtpNode ();
+      NS_TEST_ASSERT_MSG_EQ (node->getState (), SYNCED, "Slave not synchronized");
+      NS_TEST_ASSERT_MSG_LT (std::fabs (node->getCurrentOffsetError ()), 1000,
+                             "Slave offset too large");
+      NS_TEST_ASSERT_MSG_EQ (node->getReceivedPacketCounter (DRPLY) > 0, true, "No DRPLY");
+    }
+  Simulator::Destroy ();
+}
+
+class PtpBmcaTestCase : public TestCase
+{
+public:
+  PtpBmcaTestCase ();
+  virtual ~PtpBmcaTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+PtpBmcaTestCase::PtpBmcaTestCase ()
+  : TestCase ("Ptp best master clock algorithm")
+{
+}
+
+PtpBmcaTestCase::~PtpBmcaTestCase ()
+{
+}
+
+void
+PtpBmcaTestCase::DoRun (void)
+{
+  PtpBmca node0 (0);
+  PtpBmca node1 (1);
+  PtpAnnounce_t announce;
+  announce.grandmaster = node0.getDefaultDataset ();
+  announce.stepsRemoved = 0;
+  announce.sequenceId = 7;
+
+  PtpHeader txHeader;
+  txHeader.setMessageType (ANNOUNCE);
+  txHeader.setAnnounce (announce);
+  Ptr<Packet> packet = Create<Packet> ();
+  packet->AddHeader (txHeader);
+  NS_TEST_ASSERT_MSG_EQ (packet->GetSize (), 64, "Unexpected ANNOUNCE size");
+  PtpHeader rxHeader;
+  packet->RemoveHeader (rxHeader);
+  NS_TEST_ASSERT_MSG_EQ (rxHeader.getAnnounce ().grandmaster.identity, 0, "Grandmaster mismatch");
+  NS_TEST_ASSERT_MSG_EQ (rxHeader.getAnnounce ().sequenceId, 7, "Sequence mismatch");
+
+  // A better priority1 beats a lower identity
+  PtpClockDataset_t better = node1.getDefaultDataset ();
+  better.priority1 = 127;
+  NS_TEST_ASSERT_MSG_LT (PtpBmca::compareDatasets (better, node0.getDefaultDataset ()), 0,
+                         "priority1 ignored");
+
+  // Node 1 follows node 0, then elects itself once node 0 goes silent
+  node1.setReceiptTimeout (Seconds (3));
+  node1.start (Seconds (0));
+  NS_TEST_ASSERT_MSG_EQ (node1.decide (Seconds (1)), false, "Listening node decided");
+  node1.addAnnounce (0, rxHeader.getAnnounce (), Seconds (1));
+  NS_TEST_ASSERT_MSG_EQ (node1.decide (Seconds (1)), true, "Better master not followed");
+  NS_TEST_ASSERT_MSG_EQ (node1.getState (), BMCA_SLAVE, "Node 1 not a slave");
+  NS_TEST_ASSERT_MSG_EQ (node1.getParentId (), 0, "Wrong parent");
+  NS_TEST_ASSERT_MSG_EQ (node1.getStepsRemoved (), 1, "Wrong steps removed");
+  NS_TEST_ASSERT_MSG_EQ (node1.decide (Seconds (4)), false, "Announce expired early");
+  NS_TEST_ASSERT_MSG_EQ (node1.decide (Seconds (5)), true, "Announce never expired");
+  NS_TEST_ASSERT_MSG_EQ (node1.getState (), BMCA_GRANDMASTER, "Node 1 not elected");
+  NS_TEST_ASSERT_MSG_EQ (node1.getGrandmasterId (), 1, "Wrong grandmaster");
+}
+
+// Install a PTP network of the given topology on nodes sharing one simple
+// channel, addressed in the /24 network base, and start it at 1 s for the
+// given number of sync intervals.
+static std::vector<PtpNode *>
+InstallPtpNetwork (PTPNetwork &network, const PtpHelper &helper,
+                   const PtpTopology &topology, const char *base, int iterations)
+{
+  NodeContainer nodes;
+  nodes.Create (topology.GetNNodes ());
+  SimpleNetDeviceHelper simple;
+  NetDeviceContainer devices = simple.Install (nodes);
+  InternetStackHelper internet;
+  internet.Install (nodes);
+  Ipv4AddressHelper ipv4;
+  ipv4.SetBase (base, "255.255.255.0");
+  Ipv4InterfaceContainer interfaces = ipv4.Assign (devices);
+
+  network.setOffsetTraceEnabled (false);
+  network.setSimulationIterations (iterations);
+  std::vector<PtpNode *> ptpNodes = helper.Install (network, nodes, interfaces, topology);
+  Simulator::Schedule (Seconds (1), &PTPNetwork::startPTPProtocol, &network);
+  return ptpNodes;
+}
+
+// Check that a one-step master sends no FOLLOW, and that its slaves answer
+// each SYNC with a DREQ and get synchronized.
+class PtpOneStepClockTestCase : public TestCase
+{
+public:
+  PtpOneStepClockTestCase ();
+  virtual ~PtpOneStepClockTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+PtpOneStepClockTestCase::PtpOneStepClockTestCase ()
+  : TestCase ("Ptp one-step clock")
+{
+}
+
+PtpOneStepClockTestCase::~PtpOneStepClockTestCase ()
+{
+}
+
+void
+PtpOneStepClockTestCase::DoRun (void)
+{
+  PTPNetwork network (2, 0, Seconds (1), CreateTempDirFilename (""));
+  network.setOneStepClock (true);
+  PtpHelper helper;
+  std::vector<PtpNode *> nodes = InstallPtpNetwork (network, helper, PtpTopology::Star (3),
+                                                    "10.1.2.0", 5);
+  Simulator::Stop (Seconds (10));
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_GT (nodes[0]->getSentPacketCounter (SYNC), 0, "No SYNC sent");
+  NS_TEST_ASSERT_MSG_EQ (nodes[0]->getSentPacketCounter (FOLLOW), 0,
+                         "FOLLOW sent by a one-step clock");
+  for (uint32_t i = 1; i < nodes.size (); i++)
+    {
+      NS_TEST_ASSERT_MSG_EQ (nodes[i]->getReceivedPacketCounter (FOLLOW), 0, "FOLLOW received");
+      NS_TEST_ASSERT_MSG_GT (nodes[i]->getReceivedPacketCounter (SYNC), 0, "No SYNC received");
+      NS_TEST_ASSERT_MSG_EQ (nodes[i]->getSentPacketCounter (DREQ),
+                             nodes[i]->getReceivedPacketCounter (SYNC),
+                             "DREQ not sent on SYNC");
+      NS_TEST_ASSERT_MSG_EQ (nodes[i]->getState (), SYNCED, "Slave not synchronized");
+      NS_TEST_ASSERT_MSG_LT (std::fabs (nodes[i]->getCurrentOffsetError ()), 1000,
+                             "Slave offset too large");
+    }
+  Simulator::Destroy ();
+}
+
+// Check that boundary clocks on a chain synchronize every slave in each
+// round, that ptp_rounds.csv reports a finite latency for every round, and
+// that ptp_messages.csv reports the share of the channel PTP took.
+class PtpBoundaryClockTestCase : public TestCase
+{
+public:
+  PtpBoundaryClockTestCase ();
+  virtual ~PtpBoundaryClockTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+PtpBoundaryClockTestCase::PtpBoundaryClockTestCase ()
+  : TestCase ("Ptp boundary clocks round latency")
+{
+}
+
+PtpBoundaryClockTestCase::~PtpBoundaryClockTestCase ()
+{
+}
+
+void
+PtpBoundaryClockTestCase::DoRun (void)
+{
+  std::string logdir = CreateTempDirFilename ("");
+  PTPNetwork network (3, 0, Seconds (1), logdir);
+  network.setBoundaryClock (true);
+  network.setChannelDataRate (DataRate ("1Mbps"));
+  PtpHelper helper;
+  InstallPtpNetwork (network, helper, PtpTopology::Chain (4), "10.1.5.0", 5);
+  Simulator::Stop (Seconds (10));
+  Simulator::Run ();
+  network.closeLogs ();
+  Simulator::Destroy ();
+
+  const std::vector<PtpRound_t> &rounds = network.getRounds ();
+  NS_TEST_ASSERT_MSG_EQ (rounds.size (), 5, "Round count mismatch");
+  for (uint32_t i = 0; i < rounds.size (); i++)
+    {
+      NS_TEST_ASSERT_MSG_EQ (rounds[i].synced, 3, "Not every slave synchronized in the round");
+    }
+
+  std::ifstream file ((logdir + "ptp_rounds.csv").c_str ());
+  NS_TEST_ASSERT_MSG_EQ (file.is_open (), true, "ptp_rounds.csv not written");
+  std::string line;
+  std::getline (file, line);
+  uint32_t nRows = 0;
+  while (std::getline (file, line))
+    {
+      std::vector<std::string> fields;
+      std::stringstream row (line);
+      std::string field;
+      while (std::getline (row, field, ','))
+        {
+          fields.push_back (field);
+        }
+      NS_TEST_ASSERT_MSG_EQ (fields.size (), 5, "Malformed round " << line);
+      // -1 if the round did not synchronize every slave
+      int64_t latency = std::strtoll (fields[3].c_str (), NULL, 10);
+      NS_TEST_ASSERT_MSG_GT (latency, 0, "Round " << fields[0] << " latency not finite");
+      NS_TEST_ASSERT_MSG_LT (latency, 1000000000, "Round " << fields[0] << " too long");
+      nRows++;
+    }
+  NS_TEST_ASSERT_MSG_EQ (nRows, 5, "Round rows missing");
+
+  // The last row totals the network, its last column is the channel share
+  std::ifstream messages ((logdir + "ptp_messages.csv").c_str ());
+  NS_TEST_ASSERT_MSG_EQ (messages.is_open (), true, "ptp_messages.csv not written");
+  std::string total;
+  while (std::getline (messages, line))
+    {
+      total = line;
+    }
+  NS_TEST_ASSERT_MSG_EQ (total.compare (0, 4, "all,"), 0, "Network total missing");
+  double utilization = std::strtod (total.substr (total.rfind (',') + 1).c_str (), NULL);
+  NS_TEST_ASSERT_MSG_GT (utilization, 0, "Channel utilization not written");
+  NS_TEST_ASSERT_MSG_LT (utilization, 100, "Channel utilization too large");
+}
+
+// Check that once the grandmaster of a chain fails, the best master clock
+// algorithm elects its neighbor and the remaining slave synchronizes to it.
+class PtpFailoverTestCase : public TestCase
+{
+public:
+  PtpFailoverTestCase ();
+  virtual ~PtpFailoverTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+PtpFailoverTestCase::PtpFailoverTestCase ()
+  : TestCase ("Ptp grandmaster failover")
+{
+}
+
+PtpFailoverTestCase::~PtpFailoverTestCase ()
+{
+}
+
+void
+PtpFailoverTestCase::DoRun (void)
+{
+  PTPNetwork network (2, 0, Seconds (1), CreateTempDirFilename (""));
+  network.setBmcaEnabled (true);
+  PtpHelper helper;
+  InstallPtpNetwork (network, helper, PtpTopology::Chain (3), "10.1.6.0", 25);
+  // Node 0 is elected a few announce intervals after the start
+  Simulator::Schedule (Seconds (11), &PTPNetwork::failGrandmaster, &network);
+  Simulator::Stop (Seconds (30));
+  Simulator::Run ();
+  Simulator::Destroy ();
+
+  const std::vector<PtpFailover_t> &failovers = network.getFailovers ();
+  NS_TEST_ASSERT_MSG_EQ (failovers.size (), 1, "Failure not recorded");
+  const PtpFailover_t &failover = failovers[0];
+  NS_TEST_ASSERT_MSG_EQ (failover.nodeId, 0, "Wrong node failed");
+  NS_TEST_ASSERT_MSG_EQ (failover.grandmaster, true, "Failed node was not the grandmaster");
+  NS_TEST_ASSERT_MSG_EQ (failover.newGrandmaster, 1, "Wrong grandmaster elected");
+  NS_TEST_ASSERT_MSG_GT (failover.electedTime, failover.failTime, "No grandmaster elected");
+  NS_TEST_ASSERT_MSG_EQ (failover.resyncTime.IsStrictlyNegative (), false,
+                         "Slave not synchronized to the new grandmaster");
+  NS_TEST_ASSERT_MSG_LT (failover.resyncTime - failover.failTime, Seconds (10),
+                         "Resynchronization too slow");
+  NS_TEST_ASSERT_MSG_EQ (failover.resynced, failover.slaves, "Slaves not synchronized");
+}
+
+// Check that a sink of PTPNetwork::connectOffsetErrorTrace and of the
+// OffsetError source of PtpApplication fires once per sync of each slave.
+class PtpOffsetErrorTraceTestCase : public TestCase
+{
+public:
+  PtpOffsetErrorTraceTestCase ();
+  virtual ~PtpOffsetErrorTraceTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void OffsetErrorChanged (uint16_t nodeId, double offsetError);
+
+  std::vector<int> m_syncs; // Offset errors received for each node
+};
+
+PtpOffsetErrorTraceTestCase::PtpOffsetErrorTraceTestCase ()
+  : TestCase ("Ptp offset error trace")
+{
+}
+
+PtpOffsetErrorTraceTestCase::~PtpOffsetErrorTraceTestCase ()
+{
+}
+
+void
+PtpOffsetErrorTraceTestCase::OffsetErrorChanged (uint16_t nodeId, double offsetError)
+{
+  if (nodeId >= m_syncs.size ())
+    {
+      m_syncs.resize (nodeId + 1, 0);
+    }
+  m_syncs[nodeId]++;
+}
+
+void
+PtpOffsetErrorTraceTestCase::DoRun (void)
+{
+  PTPNetwork network (2, 0, Seconds (1), CreateTempDirFilename (""));
+  PtpHelper helper;
+  std::vector<PtpNode *> nodes = InstallPtpNetwork (network, helper, PtpTopology::Star (3),
+                                                    "10.1.11.0", 5);
+  network.connectOffsetErrorTrace (MakeCallback (&PtpOffsetErrorTraceTestCase::OffsetErrorChanged,
+                                                 this));
+  Simulator::Stop (Seconds (10));
+  Simulator::Run ();
+
+  m_syncs.resize (nodes.size (), 0);
+  NS_TEST_ASSERT_MSG_EQ (m_syncs[0], 0, "Offset error of the master traced");
+  for (uint32_t i = 1; i < nodes.size (); i++)
+    {
+      NS_TEST_ASSERT_MSG_GT (m_syncs[i], 0, "No offset error traced");
+      NS_TEST_ASSERT_MSG_EQ (m_syncs[i], nodes[i]->getReceivedPacketCounter (DRPLY),
+                             "Offset error not traced once per sync");
+    }
+  Simulator::Destroy ();
+
+  m_syncs.clear ();
+  NodeContainer appNodes;
+  appNodes.Create (3);
+  SimpleNetDeviceHelper simple;
+  NetDeviceContainer devices = simple.Install (appNodes);
+  InternetStackHelper internet;
+  internet.Install (appNodes);
+  Ipv4AddressHelper ipv4;
+  ipv4.SetBase ("10.1.12.0", "255.255.255.0");
+  Ipv4InterfaceContainer interfaces = ipv4.Assign (devices);
+
+  PtpApplicationHelper ptp;
+  ApplicationContainer apps = ptp.Install (appNodes, interfaces, PtpTopology::Chain (3));
+  for (uint32_t i = 0; i < apps.GetN (); i++)
+    {
+      apps.Get (i)->TraceConnectWithoutContext (
+        "OffsetError", MakeCallback (&PtpOffsetErrorTraceTestCase::OffsetErrorChanged, this));
+    }
+  apps.Start (Seconds (1.0));
+  apps.Stop (Seconds (5.5));
+  Simulator::Run ();
+
+  m_syncs.resize (apps.GetN (), 0);
+  NS_TEST_ASSERT_MSG_EQ (m_syncs[0], 0, "Offset error of the grandmaster traced");
+  for (uint32_t i = 1; i < apps.GetN (); i++)
+    {
+      PtpNode *node = DynamicCast<PtpApplication> (apps.Get (i))->getPtpNode ();
+      NS_TEST_ASSERT_MSG_GT (m_syncs[i], 0, "No offset error traced");
+      NS_TEST_ASSERT_MSG_EQ (m_syncs[i], node->getReceivedPacketCounter (DRPLY),
+                             "Offset error not traced once per sync");
+    }
+  Simulator::Destroy ();
+}
+
+// Check that PtpOffsetErrorSampler passes one in every sample period syncs
+// of a node, and the last sample of each node once per batch interval.
+class PtpOffsetErrorSamplerTestCase : public TestCase
+{
+public:
+  PtpOffsetErrorSamplerTestCase ();
+  virtual ~PtpOffsetErrorSamplerTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void OffsetErrorChanged (uint16_t nodeId, double offsetError);
+
+  std::vector<uint16_t> m_nodeIds; // Node IDs passed to the sink
+  std::vector<double> m_offsetErrors; // Offset errors passed to the sink
+  std::vector<Time> m_times; // Simulation times of the sink calls
+};
+
+PtpOffsetErrorSamplerTestCase::PtpOffsetErrorSamplerTestCase ()
+  : TestCase ("Ptp offset error sampler")
+{
+}
+
+PtpOffsetErrorSamplerTestCase::~PtpOffsetErrorSamplerTestCase ()
+{
+}
+
+void
+PtpOffsetErrorSamplerTestCase::OffsetErrorChanged (uint16_t nodeId, double offsetError)
+{
+  m_nodeIds.push_back (nodeId);
+  m_offsetErrors.push_back (offsetError);
+  m_times.push_back (Simulator::Now ());
+}
+
+void
+PtpOffsetErrorSamplerTestCase::DoRun (void)
+{
+  Callback<void, uint16_t, double> sink =
+    MakeCallback (&PtpOffsetErrorSamplerTestCase::OffsetErrorChanged, this);
+
+  // Every sync passes without a sample period or a batch interval
+  PtpOffsetErrorSampler all;
+  all.SetSink (sink);
+  all.GetCallback () (1, 5);
+  all.GetCallback () (2, 6);
+  NS_TEST_ASSERT_MSG_EQ (m_offsetErrors.size (), 2, "Offset errors dropped");
+
+  // Syncs 1, 4 and 7 of node 1 pass, node 2 is sampled on its own
+  m_nodeIds.clear ();
+  m_offsetErrors.clear ();
+  PtpOffsetErrorSampler sampled;
+  sampled.SetSink (sink);
+  sampled.SetSamplePeriod (3);
+  for (uint32_t i = 1; i <= 7; i++)
+    {
+      sampled.OffsetErrorChanged (1, i);
+    }
+  sampled.OffsetErrorChanged (2, 100);
+  NS_TEST_ASSERT_MSG_EQ (m_offsetErrors.size (), 4, "Wrong number of samples");
+  NS_TEST_ASSERT_MSG_EQ (m_offsetErrors[0], 1, "Wrong first sample");
+  NS_TEST_ASSERT_MSG_EQ (m_offsetErrors[1], 4, "Wrong second sample");
+  NS_TEST_ASSERT_MSG_EQ (m_offsetErrors[2], 7, "Wrong third sample");
+  NS_TEST_ASSERT_MSG_EQ (m_nodeIds[3], 2, "Sample of node 2 dropped");
+  NS_TEST_ASSERT_MSG_EQ (m_offsetErrors[3], 100, "Wrong sample of node 2");
+
+  // The last offset error of each node passes one interval after the first
+  m_nodeIds.clear ();
+  m_offsetErrors.clear ();
+  PtpOffsetErrorSampler batched;
+  batched.SetSink (sink);
+  batched.SetBatchInterval (Seconds (1));
+  Simulator::Schedule (MilliSeconds (100), &PtpOffsetErrorSampler::OffsetErrorChanged,
+                       &batched, 1, 10);
+  Simulator::Schedule (MilliSeconds (200), &PtpOffsetErrorSampler::OffsetErrorChanged,
+                       &batched, 1, 20);
+  Simulator::Schedule (MilliSeconds (300), &PtpOffsetErrorSampler::OffsetErrorChanged,
+                       &batched, 2, 30);
+  Simulator::Schedule (MilliSeconds (1500), &PtpOffsetErrorSampler::OffsetErrorChanged,
+                       &batched, 1, 40);
+  Simulator::Run ();
+  Simulator::Destroy ();
+
+  NS_TEST_ASSERT_MSG_EQ (m_offsetErrors.size (), 3, "Wrong number of batched updates");
+  NS_TEST_ASSERT_MSG_EQ (m_nodeIds[0], 1, "Wrong node of the first batch");
+  NS_TEST_ASSERT_MSG_EQ (m_offsetErrors[0], 20, "Not the last offset error of node 1");
+  NS_TEST_ASSERT_MSG_EQ (m_times[0], MilliSeconds (1100), "First batch at the wrong time");
+  NS_TEST_ASSERT_MSG_EQ (m_nodeIds[1], 2, "Wrong node of the first batch");
+  NS_TEST_ASSERT_MSG_EQ (m_offsetErrors[1], 30, "Wrong offset error of node 2");
+  NS_TEST_ASSERT_MSG_EQ (m_times[1], MilliSeconds (1100), "First batch at the wrong time");
+  NS_TEST_ASSERT_MSG_EQ (m_offsetErrors[2], 40, "Wrong offset error of the second batch");
+  NS_TEST_ASSERT_MSG_EQ (m_times[2], MilliSeconds (2500), "Second batch at the wrong time");
+}
+
+#ifdef PTP_INSTRUMENTATION
+static uint64_t g_allocationReads = 0; // Reads of the fake allocation counter
+
+// Fake allocation counter: one more allocation at every read
+static uint64_t
+CountAllocationReads (void)
+{
+  return ++g_allocationReads;
+}
+
+// Check that the probes of PTPNetwork count every call of the message
+// handlers, and read allocations from the counter the program installs.
+class PtpInstrumentationTestCase : public TestCase
+{
+public:
+  PtpInstrumentationTestCase ();
+  virtual ~PtpInstrumentationTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+PtpInstrumentationTestCase::PtpInstrumentationTestCase ()
+  : TestCase ("Ptp instrumentation probes")
+{
+}
+
+PtpInstrumentationTestCase::~PtpInstrumentationTestCase ()
+{
+}
+
+void
+PtpInstrumentationTestCase::DoRun (void)
+{
+  NS_TEST_ASSERT_MSG_EQ (PtpInstrumentation::getAllocationCount (), 0,
+                         "Allocations counted without a counter");
+  PtpInstrumentation::setAllocationCounter (&CountAllocationReads);
+  PTPNetwork network (2, 0, Seconds (1), CreateTempDirFilename (""));
+  PtpHelper helper;
+  std::vector<PtpNode *> nodes = InstallPtpNetwork (network, helper, PtpTopology::Star (3),
+                                                    "10.1.10.0", 3);
+  Simulator::Stop (Seconds (10));
+  Simulator::Run ();
+  Simulator::Destroy ();
+  PtpInstrumentation::setAllocationCounter (NULL);
+
+  uint64_t sent[PTP_NUM_MESSAGE_TYPES] = { 0 };
+  uint64_t received[PTP_NUM_MESSAGE_TYPES] = { 0 };
+  uint64_t packets = 0;
+  for (uint32_t i = 0; i < nodes.size (); i++)
+    {
+      for (int type = 0; type < PTP_NUM_MESSAGE_TYPES; type++)
+        {
+          PtpMessageType_t msgType = (PtpMessageType_t) type;
+          sent[type] += nodes[i]->getSentPacketCounter (msgType);
+          received[type] += nodes[i]->getReceivedPacketCounter (msgType);
+          packets += nodes[i]->getReceivedPacketCounter (msgType) +
+            nodes[i]->getOverheardPacketCounter (msgType);
+        }
+    }
+  const PtpInstrumentation &instrumentation = network.getInstrumentation ();
+  NS_TEST_ASSERT_MSG_GT (packets, 0, "No PTP message received");
+  NS_TEST_ASSERT_MSG_EQ (instrumentation.getCounters (PTP_PROBE_RECEIVE).calls, packets,
+                         "receivePacket calls miscounted");
+  NS_TEST_ASSERT_MSG_EQ (instrumentation.getCounters (PTP_PROBE_RECEIVE_SYNC).calls,
+                         received[SYNC], "SYNC handler calls miscounted");
+  NS_TEST_ASSERT_MSG_EQ (instrumentation.getCounters (PTP_PROBE_RECEIVE_FOLLOW).calls,
+                         received[FOLLOW], "FOLLOW handler calls miscounted");
+  NS_TEST_ASSERT_MSG_EQ (instrumentation.getCounters (PTP_PROBE_RECEIVE_DREQ).calls,
+                         received[DREQ], "DREQ handler calls miscounted");
+  NS_TEST_ASSERT_MSG_EQ (instrumentation.getCounters (PTP_PROBE_RECEIVE_DRPLY).calls,
+                         received[DRPLY], "DRPLY handler calls miscounted");
+  NS_TEST_ASSERT_MSG_EQ (instrumentation.getCounters (PTP_PROBE_SEND_SYNC_FOLLOW).calls,
+                         sent[SYNC], "sendSyncFollowPacket calls miscounted");
+  NS_TEST_ASSERT_MSG_EQ (instrumentation.getCounters (PTP_PROBE_SEND_DREQ).calls,
+                         sent[DREQ], "sendDreqPacket calls miscounted");
+  NS_TEST_ASSERT_MSG_EQ (instrumentation.getCounters (PTP_PROBE_SEND_DRPLY).calls,
+                         sent[DRPLY], "sendDrplyPacket calls miscounted");
+  // sendDreqPacket has no nested probe: two reads, one allocation per call
+  NS_TEST_ASSERT_MSG_EQ (instrumentation.getCounters (PTP_PROBE_SEND_DREQ).allocations,
+                         instrumentation.getCounters (PTP_PROBE_SEND_DREQ).calls,
+                         "Allocations not read from the installed counter");
+}
+#endif /* PTP_INSTRUMENTATION */
+
 // The TestSuite class names the TestSuite, identifies what type of TestSuite,
 // and enables the TestCases to be run.  Typically, only the constructor for
 // this class must be defined
@@ -60,6 +1742,36 @@ PtpTestSuite::PtpTestSuite ()
 {
   // TestDuration for TestCase can be QUICK, EXTENSIVE or TAKES_FOREVER
   AddTestCase (new PtpTestCase1, TestCase::QUICK);
+  AddTestCase (new PtpLazyClockTestCase, TestCase::QUICK);
+  AddTestCase (new PtpHeaderTestCase, TestCase::QUICK);
+  AddTestCase (new PtpTraceWriterTestCase, TestCase::QUICK);
+  AddTestCase (new PtpStatisticsTestCase, TestCase::QUICK);
+  AddTestCase (new PtpTopologyTestCase, TestCase::QUICK);
+  AddTestCase (new PtpGroupSyncTestCase, TestCase::QUICK);
+  AddTestCase (new PtpPiServoTestCase, TestCase::QUICK);
+  AddTestCase (new PtpAdaptiveSyncIntervalTestCase, TestCase::QUICK);
+  AddTestCase (new PtpTransparentClockTestCase, TestCase::QUICK);
+  AddTestCase (new PtpTransparentBridgeTestCase, TestCase::QUICK);
+  AddTestCase (new PtpPeerDelayTestCase, TestCase::QUICK);
+  AddTestCase (new PtpBmcaTestCase, TestCase::QUICK);
+  AddTestCase (new PtpOscillatorTestCase, TestCase::QUICK);
+  AddTestCase (new PtpTimestamperTestCase, TestCase::QUICK);
+  AddTestCase (new PtpTimestamperCsmaTestCase (TIMESTAMP_APPLICATION, "application", "10.1.7.0"),
+               TestCase::QUICK);
+  AddTestCase (new PtpTimestamperCsmaTestCase (TIMESTAMP_SOFTWARE, "software", "10.1.8.0"),
+               TestCase::QUICK);
+  AddTestCase (new PtpTimestamperCsmaTestCase (TIMESTAMP_HARDWARE, "hardware", "10.1.9.0"),
+               TestCase::QUICK);
+  AddTestCase (new PtpTimestamperWifiTestCase, TestCase::QUICK);
+  AddTestCase (new PtpApplicationTestCase, TestCase::QUICK);
+  AddTestCase (new PtpOneStepClockTestCase, TestCase::QUICK);
+  AddTestCase (new PtpBoundaryClockTestCase, TestCase::QUICK);
+  AddTestCase (new PtpFailoverTestCase, TestCase::QUICK);
+  AddTestCase (new PtpOffsetErrorTraceTestCase, TestCase::QUICK);
+  AddTestCase (new PtpOffsetErrorSamplerTestCase, TestCase::QUICK);
+#ifdef PTP_INSTRUMENTATION
+  AddTestCase (new PtpInstrumentationTestCase, TestCase::QUICK);
+#endif
 }
 
 // Do not forget to allocate an instance of this TestSuite